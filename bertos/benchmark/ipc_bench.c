@@ -0,0 +1,487 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Kernel IPC micro-benchmarks.
+ *
+ * All the benchmarks share the same skeleton: a set of worker processes
+ * wait for SIG_USER0, run a batch of operations and the last one to
+ * finish wakes up the main process with SIG_USER1. The main process
+ * times the whole round, optionally taking part to it.
+ */
+
+#include "ipc_bench.h"
+
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
+
+/* The benchmark needs processes and signals */
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+
+#include "cfg/cfg_ipc_bench.h"
+#include "cfg/cfg_sem.h"
+#include <cfg/debug.h>
+#include <cfg/compiler.h>
+
+#include <cpu/irq.h>
+
+#include <drv/timer.h>
+
+#include <kern/proc.h>
+#include <kern/signal.h>
+#include <kern/msg.h>
+#if CONFIG_KERN_SEMAPHORES
+	#include <kern/sem.h>
+#endif
+
+#define BENCH_TASKS    CONFIG_IPC_BENCH_MAX_TASKS
+#define BENCH_SAMPLES  CONFIG_IPC_BENCH_SAMPLES
+#define BENCH_BATCH    CONFIG_IPC_BENCH_BATCH
+#define BENCH_STACK    KERN_MINSTACKSIZE
+
+#define SIG_BENCH_START  SIG_USER0
+#define SIG_BENCH_DONE   SIG_USER1
+#define SIG_BENCH_TOKEN  SIG_USER2
+
+#define HP_PER_TICK  (TIMER_HW_HPTICKS_PER_SEC / TIMER_TICKS_PER_SEC)
+
+typedef void (*bench_body_t)(int id);
+
+typedef struct BenchMsg
+{
+	Msg msg;
+	MsgPort reply;
+} BenchMsg;
+
+static cpu_stack_t bench_stacks[BENCH_TASKS][(BENCH_STACK + sizeof(cpu_stack_t) - 1) / sizeof(cpu_stack_t)];
+static struct Process *bench_procs[BENCH_TASKS];
+static struct Process *bench_main;
+static uint32_t bench_samples[BENCH_SAMPLES];
+
+static bench_body_t bench_body;
+static volatile int bench_stop;
+static volatile int bench_pending;
+static volatile int bench_alive;
+static int bench_workers;
+
+static MsgPort bench_port;
+static BenchMsg bench_msgs[BENCH_TASKS];
+#if CONFIG_KERN_SEMAPHORES
+static Semaphore bench_sem;
+#endif
+static Timer bench_timers[BENCH_TASKS + 1];
+
+/*
+ * Return the current time in hp ticks.
+ *
+ * When the high precision counter restarts at each tick, the tick count
+ * provides the upper part of the time.
+ */
+static uint32_t bench_now(void)
+{
+	ticks_t ticks;
+	hptime_t hp;
+
+	ATOMIC(
+		ticks = timer_clock_unlocked();
+		hp = timer_hw_hpread();
+	);
+
+	if ((uint32_t)TIMER_HW_CNT > HP_PER_TICK)
+		return (uint32_t)hp;
+	return (uint32_t)ticks * HP_PER_TICK + (uint32_t)hp;
+}
+
+/* Convert \a hp ticks spent for \a ops operations in ns per operation */
+static uint32_t bench_ns(uint32_t hp, uint32_t ops)
+{
+	return (uint32_t)((uint64_t)hp * 1000000000UL / TIMER_HW_HPTICKS_PER_SEC / ops);
+}
+
+static void bench_report(const char *name, int tasks)
+{
+	/* Insertion sort: the number of samples is small */
+	for (int i = 1; i < BENCH_SAMPLES; i++)
+	{
+		uint32_t v = bench_samples[i];
+		int j;
+
+		for (j = i; j > 0 && bench_samples[j - 1] > v; j--)
+			bench_samples[j] = bench_samples[j - 1];
+		bench_samples[j] = v;
+	}
+
+	kprintf("BENCH %s tasks=%d samples=%d min_ns=%lu median_ns=%lu p99_ns=%lu\n",
+		name, tasks, BENCH_SAMPLES,
+		(unsigned long)bench_samples[0],
+		(unsigned long)bench_samples[BENCH_SAMPLES / 2],
+		(unsigned long)bench_samples[(BENCH_SAMPLES * 99 - 1) / 100]);
+}
+
+/*
+ * Terminate the calling process. Interrupts stay disabled from the update
+ * of bench_alive until proc_exit() switches to another process, so that
+ * bench_join() can't return, and the stack be reused, while the process
+ * is still running on it.
+ */
+static void bench_exit(void)
+{
+	IRQ_DISABLE;
+	bench_alive--;
+	proc_exit();
+}
+
+static void bench_worker(void)
+{
+	int id = (int)(ssize_t)proc_currentUserData();
+
+	for (;;)
+	{
+		bool last;
+
+		sig_wait(SIG_BENCH_START);
+		if (bench_stop)
+			break;
+
+		bench_body(id);
+
+		ATOMIC(last = (--bench_pending == 0));
+		if (last)
+			sig_send(bench_main, SIG_BENCH_DONE);
+	}
+	bench_exit();
+}
+
+/* Wait for all the workers to exit, so that their stacks can be reused */
+static void bench_join(void)
+{
+	while (bench_alive)
+		proc_yield();
+}
+
+static void bench_kill(void)
+{
+	bench_stop = 1;
+	for (int i = 0; i < bench_workers; i++)
+		sig_send(bench_procs[i], SIG_BENCH_START);
+	bench_join();
+}
+
+static int bench_spawn(bench_body_t body, int workers)
+{
+	bench_body = body;
+	bench_workers = workers;
+	bench_stop = 0;
+	bench_alive = workers;
+	for (int i = 0; i < workers; i++)
+	{
+		bench_procs[i] = proc_new(bench_worker, (iptr_t)(ssize_t)i,
+			sizeof(bench_stacks[i]), bench_stacks[i]);
+		if (!bench_procs[i])
+		{
+			/* Stop the workers already created */
+			ATOMIC(bench_alive -= workers - i);
+			bench_workers = i;
+			bench_kill();
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Time one round of the workers, with the main process running \a main_body */
+static uint32_t bench_round(void (*main_body)(void))
+{
+	uint32_t start;
+
+	/* Forget signals left over by the previous round */
+	sig_check(SIG_BENCH_DONE | SIG_BENCH_TOKEN);
+	bench_pending = bench_workers;
+
+	start = bench_now();
+	for (int i = 0; i < bench_workers; i++)
+		sig_send(bench_procs[i], SIG_BENCH_START);
+	if (main_body)
+		main_body();
+	sig_wait(SIG_BENCH_DONE);
+	return bench_now() - start;
+}
+
+static void bench_measure(const char *name, int tasks, void (*main_body)(void), uint32_t ops)
+{
+	/* Warm up */
+	bench_round(main_body);
+
+	for (int s = 0; s < BENCH_SAMPLES; s++)
+		bench_samples[s] = bench_ns(bench_round(main_body), ops);
+
+	bench_kill();
+	bench_report(name, tasks);
+}
+
+/*
+ * Signal ring: the main process and the workers pass a token around.
+ */
+static void sig_body(int id)
+{
+	struct Process *next = (id + 1 < bench_workers) ? bench_procs[id + 1] : bench_main;
+
+	for (int i = 0; i < BENCH_BATCH; i++)
+	{
+		sig_wait(SIG_BENCH_TOKEN);
+		sig_send(next, SIG_BENCH_TOKEN);
+	}
+}
+
+static void sig_main(void)
+{
+	for (int i = 0; i < BENCH_BATCH; i++)
+	{
+		sig_send(bench_procs[0], SIG_BENCH_TOKEN);
+		sig_wait(SIG_BENCH_TOKEN);
+	}
+}
+
+static int bench_sig(int tasks)
+{
+	if (bench_spawn(sig_body, tasks - 1) < 0)
+		return -1;
+	bench_measure("sig", tasks, sig_main, BENCH_BATCH * tasks);
+	return 0;
+}
+
+#if CONFIG_KERN_SEMAPHORES
+/*
+ * Semaphore contention: the owner yields the CPU while holding the lock.
+ */
+static void sem_body(UNUSED_ARG(int, id))
+{
+	for (int i = 0; i < BENCH_BATCH; i++)
+	{
+		sem_obtain(&bench_sem);
+		proc_yield();
+		sem_release(&bench_sem);
+	}
+}
+
+static int bench_semaphore(int tasks)
+{
+	sem_init(&bench_sem);
+	if (bench_spawn(sem_body, tasks) < 0)
+		return -1;
+	bench_measure("sem", tasks, NULL, BENCH_BATCH * tasks);
+	return 0;
+}
+#endif
+
+/*
+ * Message round trip: the workers send a message to the main process
+ * and wait for the reply.
+ */
+static void msg_body(int id)
+{
+	BenchMsg *m = &bench_msgs[id];
+
+	for (int i = 0; i < BENCH_BATCH; i++)
+	{
+		msg_put(&bench_port, &m->msg);
+		sig_wait(SIG_BENCH_TOKEN);
+		while (!msg_get(&m->reply))
+			sig_wait(SIG_BENCH_TOKEN);
+	}
+}
+
+static void msg_main(void)
+{
+	int count = 0;
+
+	while (count < BENCH_BATCH * bench_workers)
+	{
+		Msg *msg;
+
+		sig_wait(SIG_BENCH_TOKEN);
+		while ((msg = msg_get(&bench_port)))
+		{
+			msg_reply(msg);
+			count++;
+		}
+	}
+}
+
+static int bench_msg(int tasks)
+{
+	msg_initPort(&bench_port, event_createSignal(bench_main, SIG_BENCH_TOKEN));
+	if (bench_spawn(msg_body, tasks - 1) < 0)
+		return -1;
+	for (int i = 0; i < tasks - 1; i++)
+	{
+		msg_initPort(&bench_msgs[i].reply,
+			event_createSignal(bench_procs[i], SIG_BENCH_TOKEN));
+		bench_msgs[i].msg.replyPort = &bench_msgs[i].reply;
+	}
+	bench_measure("msg", tasks, msg_main, BENCH_BATCH * (tasks - 1));
+	return 0;
+}
+
+/*
+ * Synchronous call: same as the message round trip, with msg_call().
+ */
+static void call_body(int id)
+{
+	BenchMsg *m = &bench_msgs[id];
+
+	for (int i = 0; i < BENCH_BATCH; i++)
+		msg_call(&bench_port, &m->msg);
+}
+
+static int bench_call(int tasks)
+{
+	msg_initPort(&bench_port, event_createSignal(bench_main, SIG_BENCH_TOKEN));
+	if (bench_spawn(call_body, tasks - 1) < 0)
+		return -1;
+	bench_measure("call", tasks, msg_main, BENCH_BATCH * (tasks - 1));
+	return 0;
+}
+
+/*
+ * Yield: the workers hand the CPU to each other.
+ */
+static void yield_body(UNUSED_ARG(int, id))
+{
+	for (int i = 0; i < BENCH_BATCH; i++)
+		proc_yield();
+}
+
+static int bench_yield(int tasks)
+{
+	if (bench_spawn(yield_body, tasks) < 0)
+		return -1;
+	bench_measure("yield", tasks, NULL, BENCH_BATCH * tasks);
+	return 0;
+}
+
+/*
+ * Process churn: create tasks that terminate immediately.
+ */
+static void churn_proc(void)
+{
+	bench_exit();
+}
+
+static int bench_proc(int tasks)
+{
+	for (int s = -1; s < BENCH_SAMPLES; s++)
+	{
+		uint32_t start = bench_now();
+
+		bench_alive = tasks;
+		for (int i = 0; i < tasks; i++)
+		{
+			if (!proc_new(churn_proc, NULL, sizeof(bench_stacks[i]), bench_stacks[i]))
+			{
+				ATOMIC(bench_alive -= tasks - i);
+				bench_join();
+				return -1;
+			}
+		}
+		bench_join();
+
+		/* The first round is a warm up */
+		if (s >= 0)
+			bench_samples[s] = bench_ns(bench_now() - start, tasks);
+	}
+	bench_report("proc", tasks);
+	return 0;
+}
+
+/*
+ * Timers: add and abort a timer while \a tasks timers are pending.
+ */
+static void bench_timer(int tasks)
+{
+	Timer *t = &bench_timers[tasks];
+
+	for (int i = 0; i < tasks; i++)
+	{
+		timer_setSoftint(&bench_timers[i], NULL, 0);
+		timer_setDelay(&bench_timers[i], ms_to_ticks(60000) + i);
+		timer_add(&bench_timers[i]);
+	}
+
+	timer_setSoftint(t, NULL, 0);
+	for (int s = -1; s < BENCH_SAMPLES; s++)
+	{
+		uint32_t start = bench_now();
+
+		for (int i = 0; i < BENCH_BATCH; i++)
+		{
+			/* Insert in the middle of the queue */
+			timer_setDelay(t, ms_to_ticks(60000) + tasks / 2);
+			timer_add(t);
+			timer_abort(t);
+		}
+		if (s >= 0)
+			bench_samples[s] = bench_ns(bench_now() - start, BENCH_BATCH);
+	}
+
+	for (int i = 0; i < tasks; i++)
+		timer_abort(&bench_timers[i]);
+	bench_report("timer", tasks);
+}
+
+int ipc_bench(void)
+{
+	int ret = 0;
+
+	bench_main = proc_current();
+
+	for (int tasks = 2; tasks <= BENCH_TASKS; tasks *= 2)
+	{
+		if (bench_sig(tasks) < 0)
+			ret = -1;
+	#if CONFIG_KERN_SEMAPHORES
+		if (bench_semaphore(tasks) < 0)
+			ret = -1;
+	#endif
+		if (bench_msg(tasks) < 0)
+			ret = -1;
+		if (bench_call(tasks) < 0)
+			ret = -1;
+		if (bench_yield(tasks) < 0)
+			ret = -1;
+		if (bench_proc(tasks) < 0)
+			ret = -1;
+		bench_timer(tasks);
+	}
+	return ret;
+}
+
+#endif /* CONFIG_KERN && CONFIG_KERN_SIGNALS */
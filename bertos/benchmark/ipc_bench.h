@@ -0,0 +1,81 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Kernel IPC micro-benchmarks.
+ *
+ * Measures the cost of the kernel primitives with 2, 4, 8... up to
+ * CONFIG_IPC_BENCH_MAX_TASKS tasks:
+ *  - sig: signal ping-pong along a ring of tasks (sig_send()/sig_wait());
+ *  - sem: tasks contending for one semaphore (needs CONFIG_KERN_SEMAPHORES);
+ *  - msg: producers sending messages to one consumer and waiting for
+ *    the reply (msg_put()/msg_get()/msg_reply());
+ *  - call: same as msg, with the synchronous msg_call();
+ *  - yield: tasks yielding the CPU to each other (proc_yield());
+ *  - proc: creation and termination of tasks (proc_new()/proc_exit());
+ *  - timer: timer_add()/timer_abort() with as many pending timers.
+ *
+ * Each measure collects CONFIG_IPC_BENCH_SAMPLES samples, every sample
+ * timing a batch of operations with the high precision timer. Results are
+ * printed through kdebug, one line per measure:
+ *
+ * \code
+ * BENCH sig tasks=8 samples=32 min_ns=812 median_ns=850 p99_ns=1204
+ * \endcode
+ *
+ * Times are per single operation (a signal hop, a semaphore
+ * obtain/release, a message round trip, a yield, a task lifetime,
+ * a timer add/abort pair).
+ *
+ * $WIZ$ module_name = "ipc_bench"
+ * $WIZ$ module_depends = "kernel", "signal", "timer", "msg"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_ipc_bench.h"
+ */
+
+#ifndef BENCHMARK_IPC_BENCH_H
+#define BENCHMARK_IPC_BENCH_H
+
+/**
+ * Run all the benchmarks and print the results.
+ *
+ * \note The kernel and the timer must be already initialized and the
+ *       caller must be the only running process.
+ *
+ * \return 0 on success, -1 if a benchmark could not create its processes;
+ *         the other benchmarks are run anyway.
+ */
+int ipc_bench(void);
+
+int ipc_bench_testRun(void);
+int ipc_bench_testSetup(void);
+int ipc_bench_testTearDown(void);
+
+#endif /* BENCHMARK_IPC_BENCH_H */
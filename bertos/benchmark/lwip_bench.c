@@ -0,0 +1,389 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief lwIP throughput, latency and memory usage benchmark.
+ *
+ * The client side of each benchmark runs in the calling process, the
+ * server side in a process of its own; the server signals the end of
+ * the benchmark with SIG_USER0. Times are taken with hptime_get(), so
+ * they are host times.
+ */
+
+#include "lwip_bench.h"
+
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
+
+/* lwIP needs processes and signals, see arch/sys_arch.c */
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+
+#include "cfg/cfg_lwip_bench.h"
+#include <cfg/debug.h>
+#include <cfg/compiler.h>
+#include <cfg/macros.h>
+
+#include <drv/timer.h>
+
+#include <emul/eth_emul.h>
+
+#include <kern/proc.h>
+#include <kern/signal.h>
+
+#include <os/hptime.h>
+
+#include <string.h> /* memset() */
+
+#include <netif/ethernetif.h>
+
+#include <lwip/api.h>
+#include <lwip/inet.h>
+#include <lwip/ip.h>
+#include <lwip/memp.h>
+#include <lwip/netif.h>
+#include <lwip/pbuf.h>
+#include <lwip/stats.h>
+#include <lwip/sys.h>
+#include <lwip/tcpip.h>
+
+/* Without receive timeouts a lost datagram blocks the UDP benchmark forever */
+#if !LWIP_SO_RCVTIMEO
+	#error "The lwIP benchmark needs LWIP_SO_RCVTIMEO enabled"
+#endif
+
+#define BENCH_TCP_PORT  5001
+#define BENCH_UDP_PORT  5002
+#define BENCH_SAMPLES   CONFIG_LWIP_BENCH_UDP_SAMPLES
+#define BENCH_STACK     (KERN_MINSTACKSIZE * 3)
+
+/* Chunk of the TCP writes, large enough for the UDP datagrams too */
+#define BENCH_DATA_SIZE \
+	(CONFIG_LWIP_BENCH_UDP_SIZE > 1024 ? CONFIG_LWIP_BENCH_UDP_SIZE : 1024)
+
+#define SIG_BENCH_DONE  SIG_USER0
+
+static struct netif bench_netif;
+static struct ip_addr bench_addr;
+
+static struct Process *bench_main;
+static struct netconn *bench_server;
+static cpu_stack_t tcp_stack[(BENCH_STACK + sizeof(cpu_stack_t) - 1) / sizeof(cpu_stack_t)];
+static cpu_stack_t udp_stack[(BENCH_STACK + sizeof(cpu_stack_t) - 1) / sizeof(cpu_stack_t)];
+
+static uint32_t bench_received;
+static uint8_t bench_data[BENCH_DATA_SIZE];
+static uint32_t bench_samples[BENCH_SAMPLES];
+
+static void bench_done(UNUSED_ARG(void *, arg))
+{
+	sig_send(bench_main, SIG_BENCH_DONE);
+}
+
+static uint32_t bench_elapsed(hptime_t start)
+{
+	return (uint32_t)(hptime_get() - start) / HPTIME_TICKS_PER_MICRO;
+}
+
+/* Restart the peak usage of the memory pools from the current usage */
+static void bench_resetStats(void)
+{
+#if LWIP_STATS && MEMP_STATS
+	for (int i = 0; i < MEMP_MAX; i++)
+	{
+		lwip_stats.memp[i].max = lwip_stats.memp[i].used;
+		lwip_stats.memp[i].err = 0;
+	}
+#endif
+#if LWIP_STATS && MEM_STATS
+	lwip_stats.mem.max = lwip_stats.mem.used;
+	lwip_stats.mem.err = 0;
+#endif
+}
+
+static void bench_stats(void)
+{
+#if LWIP_STATS && MEMP_STATS
+	static const char * const pool_names[MEMP_MAX] =
+	{
+		#define LWIP_MEMPOOL(name, num, size, desc) desc,
+		#include <lwip/memp_std.h>
+	};
+
+	for (int i = 0; i < MEMP_MAX; i++)
+		kprintf("BENCH lwip memp %s avail=%d max=%d err=%lu\n", pool_names[i],
+			lwip_stats.memp[i].avail, lwip_stats.memp[i].max,
+			(unsigned long)lwip_stats.memp[i].err);
+#endif
+#if LWIP_STATS && MEM_STATS
+	kprintf("BENCH lwip mem avail=%d max=%d err=%lu\n",
+		lwip_stats.mem.avail, lwip_stats.mem.max,
+		(unsigned long)lwip_stats.mem.err);
+#endif
+}
+
+/*
+ * TCP throughput: the sink reads everything until the connection is closed.
+ */
+static void tcp_sink(void)
+{
+	struct netconn *conn;
+	struct netbuf *buf;
+
+	if ((conn = netconn_accept(bench_server)))
+	{
+		while ((buf = netconn_recv(conn)))
+		{
+			bench_received += netbuf_len(buf);
+			netbuf_delete(buf);
+		}
+		netconn_delete(conn);
+	}
+	sig_send(bench_main, SIG_BENCH_DONE);
+}
+
+static int bench_tcp(void)
+{
+	struct netconn *conn;
+	EthEmulStats st;
+	hptime_t start;
+	uint32_t us;
+	long sent = 0;
+
+	bench_server = netconn_new(NETCONN_TCP);
+	if (!bench_server)
+		return -1;
+	netconn_bind(bench_server, IP_ADDR_ANY, BENCH_TCP_PORT);
+	netconn_listen(bench_server);
+
+	bench_received = 0;
+	proc_new(tcp_sink, NULL, sizeof(tcp_stack), tcp_stack);
+
+	eth_emul_stats(&st, true);
+	start = hptime_get();
+
+	conn = netconn_new(NETCONN_TCP);
+	if (!conn || netconn_connect(conn, &bench_addr, BENCH_TCP_PORT) != ERR_OK)
+	{
+		/* Wake up the sink with no connection, as lwIP does on errors */
+		if (bench_server->acceptmbox != SYS_MBOX_NULL)
+			sys_mbox_post(bench_server->acceptmbox, NULL);
+		sig_wait(SIG_BENCH_DONE);
+
+		if (conn)
+			netconn_delete(conn);
+		netconn_delete(bench_server);
+		return -1;
+	}
+
+	while (sent < CONFIG_LWIP_BENCH_TCP_BYTES)
+	{
+		size_t len = MIN((long)sizeof(bench_data), CONFIG_LWIP_BENCH_TCP_BYTES - sent);
+
+		if (netconn_write(conn, bench_data, len, NETCONN_COPY) != ERR_OK)
+			break;
+		sent += len;
+	}
+	netconn_close(conn);
+	sig_wait(SIG_BENCH_DONE);
+
+	us = MAX(bench_elapsed(start), (uint32_t)1);
+	eth_emul_stats(&st, false);
+	netconn_delete(conn);
+	netconn_delete(bench_server);
+
+	kprintf("BENCH lwip tcp bytes=%lu us=%lu kbyte_s=%lu frames=%lu copies=%lu copy_bytes=%lu mss=%d wnd=%d snd_buf=%d\n",
+		(unsigned long)bench_received, (unsigned long)us,
+		(unsigned long)((uint64_t)bench_received * 1000000 / 1024 / us),
+		(unsigned long)st.tx_frames, (unsigned long)st.copies,
+		(unsigned long)st.copy_bytes, TCP_MSS, TCP_WND, TCP_SND_BUF);
+
+	return (bench_received == CONFIG_LWIP_BENCH_TCP_BYTES) ? 0 : -1;
+}
+
+/*
+ * UDP latency: the echo process sends back every datagram it receives.
+ */
+static void udp_echo(void)
+{
+	struct netbuf *buf;
+
+	/* One more datagram for the warm up */
+	for (int i = 0; i <= BENCH_SAMPLES; i++)
+	{
+		if (!(buf = netconn_recv(bench_server)))
+			break;
+		netconn_sendto(bench_server, buf, netbuf_fromaddr(buf), netbuf_fromport(buf));
+		netbuf_delete(buf);
+	}
+	sig_send(bench_main, SIG_BENCH_DONE);
+}
+
+static int bench_udp(void)
+{
+	struct netconn *conn;
+	struct netbuf tx, *rx;
+	int ret = 0;
+
+	bench_server = netconn_new(NETCONN_UDP);
+	conn = netconn_new(NETCONN_UDP);
+	if (!bench_server || !conn)
+	{
+		if (conn)
+			netconn_delete(conn);
+		if (bench_server)
+			netconn_delete(bench_server);
+		return -1;
+	}
+	/* A lost datagram must not block the benchmark forever */
+	bench_server->recv_timeout = 1000;
+	conn->recv_timeout = 1000;
+	netconn_bind(bench_server, IP_ADDR_ANY, BENCH_UDP_PORT);
+	netconn_connect(conn, &bench_addr, BENCH_UDP_PORT);
+	proc_new(udp_echo, NULL, sizeof(udp_stack), udp_stack);
+
+	/*
+	 * The client stands for the remote host: its datagram is not taken
+	 * from the NETBUF pool, that would be short of the one the reply
+	 * needs when sized for the echo process only.
+	 */
+	memset(&tx, 0, sizeof(tx));
+	netbuf_ref(&tx, bench_data, CONFIG_LWIP_BENCH_UDP_SIZE);
+
+	/* The first round trip is a warm up */
+	for (int s = -1; s < BENCH_SAMPLES; s++)
+	{
+		hptime_t start = hptime_get();
+
+		if (netconn_send(conn, &tx) != ERR_OK || !(rx = netconn_recv(conn)))
+		{
+			ret = -1;
+			break;
+		}
+		netbuf_delete(rx);
+
+		if (s >= 0)
+			bench_samples[s] = bench_elapsed(start);
+	}
+	sig_wait(SIG_BENCH_DONE);
+
+	if (tx.p)
+		pbuf_free(tx.p);
+	netconn_delete(conn);
+	netconn_delete(bench_server);
+	if (ret)
+		return -1;
+
+	/* Insertion sort: the number of samples is small */
+	for (int i = 1; i < BENCH_SAMPLES; i++)
+	{
+		uint32_t v = bench_samples[i];
+		int j;
+
+		for (j = i; j > 0 && bench_samples[j - 1] > v; j--)
+			bench_samples[j] = bench_samples[j - 1];
+		bench_samples[j] = v;
+	}
+
+	kprintf("BENCH lwip udp size=%d samples=%d min_us=%lu median_us=%lu p99_us=%lu\n",
+		CONFIG_LWIP_BENCH_UDP_SIZE, BENCH_SAMPLES,
+		(unsigned long)bench_samples[0],
+		(unsigned long)bench_samples[BENCH_SAMPLES / 2],
+		(unsigned long)bench_samples[(BENCH_SAMPLES * 99 - 1) / 100]);
+	return 0;
+}
+
+int lwip_bench_replay(const char *path)
+{
+	EthEmulStats st;
+	hptime_t start;
+	uint32_t us;
+
+	eth_emul_setLoopback(false);
+	eth_emul_stats(&st, true);
+	bench_resetStats();
+	start = hptime_get();
+
+	if (eth_emul_replay(path) < 0)
+	{
+		eth_emul_setLoopback(true);
+		return -1;
+	}
+	/* Frames are processed by the ethernet thread as soon as it reads them */
+	while (!eth_emul_idle())
+		proc_yield();
+
+	us = MAX(bench_elapsed(start), (uint32_t)1);
+	eth_emul_stats(&st, false);
+	eth_emul_setLoopback(true);
+
+	kprintf("BENCH lwip replay frames=%lu bytes=%lu dropped=%lu us=%lu frames_s=%lu\n",
+		(unsigned long)st.rx_frames, (unsigned long)st.rx_bytes,
+		(unsigned long)st.rx_dropped, (unsigned long)us,
+		(unsigned long)((uint64_t)st.rx_frames * 1000000 / us));
+	bench_stats();
+
+	return st.rx_frames ? 0 : -1;
+}
+
+int lwip_bench(void)
+{
+	for (size_t i = 0; i < sizeof(bench_data); i++)
+		bench_data[i] = i;
+	bench_resetStats();
+
+	if (bench_tcp() < 0 || bench_udp() < 0)
+		return -1;
+	bench_stats();
+	return 0;
+}
+
+int lwip_bench_init(void)
+{
+	struct ip_addr netmask, gw;
+
+	bench_main = proc_current();
+	tcpip_init(bench_done, NULL);
+	sig_wait(SIG_BENCH_DONE);
+
+	bench_addr.addr = htonl(CONFIG_LWIP_BENCH_IPADDR);
+	netmask.addr = htonl(CONFIG_LWIP_BENCH_NETMASK);
+	gw.addr = 0;
+
+	/* ethernetif.c strips the ethernet header: IP packets go to ip_input() */
+	if (!netif_add(&bench_netif, &bench_addr, &netmask, &gw, NULL,
+			ethernetif_init, ip_input))
+		return -1;
+	netif_set_default(&bench_netif);
+	netif_set_up(&bench_netif);
+	return 0;
+}
+
+#endif /* CONFIG_KERN && CONFIG_KERN_SIGNALS */
@@ -0,0 +1,96 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief lwIP throughput, latency and memory usage benchmark.
+ *
+ * Runs the whole lwIP stack on the host, over the emulated ethernet
+ * interface (emul/eth_emul.h) in loopback: every frame goes through
+ * netif/ethernetif.c, ARP and the driver queues, so the measures reflect
+ * the settings of cfg_lwip.h (TCP_WND, TCP_MSS, pool sizes...).
+ *  - tcp: bulk transfer to a sink process listening on the same stack;
+ *  - udp: round trip time of datagrams echoed by another process;
+ *  - replay: rate at which the stack processes the frames of a pcap
+ *    capture, e.g. traffic recorded on the field.
+ *
+ * Results are printed through kdebug, one line per measure, followed by
+ * the peak usage of the lwIP memory pools when LWIP_STATS is enabled:
+ *
+ * \code
+ * BENCH lwip tcp bytes=262144 us=14017 kbyte_s=18263 frames=1030 copies=2314 copy_bytes=635544 mss=536 wnd=2144 snd_buf=1072
+ * BENCH lwip udp size=64 samples=64 min_us=26 median_us=27 p99_us=42
+ * BENCH lwip memp PBUF_POOL avail=16 max=7 err=0
+ * BENCH lwip mem avail=1600 max=1532 err=1
+ * BENCH lwip replay frames=1161 bytes=331594 dropped=0 us=3576 frames_s=324664
+ * \endcode
+ *
+ * \note Two lwIP stacks can't live in the same program, lwIP keeps its
+ *       state in global variables: the endpoints of the connections are
+ *       both on the benchmarked stack, talking through the emulated wire.
+ *
+ * $WIZ$ module_name = "lwip_bench"
+ * $WIZ$ module_depends = "kernel", "signal", "timer", "lwip"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_lwip_bench.h"
+ */
+
+#ifndef BENCHMARK_LWIP_BENCH_H
+#define BENCHMARK_LWIP_BENCH_H
+
+/**
+ * Start lwIP and bring up the emulated interface.
+ *
+ * \note The kernel and the timer must be already initialized.
+ * \return 0 on success, -1 on error.
+ */
+int lwip_bench_init(void);
+
+/**
+ * Run the TCP and UDP benchmarks and print the results.
+ *
+ * \return 0 on success, -1 if a benchmark could not complete.
+ */
+int lwip_bench(void);
+
+/**
+ * Replay the pcap capture \a path to the stack and print the results.
+ *
+ * The loopback is disabled during the replay, so the stack answers
+ * to the replayed traffic but it doesn't receive its own answers.
+ *
+ * \return 0 on success, -1 if the capture can't be replayed.
+ */
+int lwip_bench_replay(const char *path);
+
+int lwip_bench_testRun(void);
+int lwip_bench_testSetup(void);
+int lwip_bench_testTearDown(void);
+
+#endif /* BENCHMARK_LWIP_BENCH_H */
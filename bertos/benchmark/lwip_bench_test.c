@@ -0,0 +1,99 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Run the lwIP benchmark on the host, over the emulated ethernet.
+ *
+ * The traffic of the benchmark is recorded and replayed to the stack.
+ * Set LWIP_BENCH_REPLAY to a pcap capture to replay it too, e.g. one
+ * recorded on the field with tcpdump.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ * $test$: cp bertos/cfg/cfg_lwip.h $cfgdir/
+ * $test$: sed -i "s/#define LWIP_STATS  *0/#define LWIP_STATS 1/" $cfgdir/cfg_lwip.h
+ * $test$: sed -i "s/#define LWIP_SO_RCVTIMEO  *0/#define LWIP_SO_RCVTIMEO 1/" $cfgdir/cfg_lwip.h
+ */
+
+#include "lwip_bench.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <drv/timer.h>
+
+#include <kern/proc.h>
+
+#include <stdio.h> /* snprintf() */
+#include <stdlib.h> /* getenv() */
+
+#include <emul/eth_emul.h>
+
+int lwip_bench_testRun(void)
+{
+	const char *dir = getenv("testdir");
+	const char *replay = getenv("LWIP_BENCH_REPLAY");
+	char path[256];
+
+	snprintf(path, sizeof(path), "%s/lwip_bench.pcap", dir ? dir : "/tmp");
+
+	kputs("Run lwIP benchmark..\n");
+	if (eth_emul_capture(path) < 0 || lwip_bench() < 0)
+		return -1;
+	eth_emul_capture(NULL);
+
+	if (lwip_bench_replay(path) < 0)
+		return -1;
+	if (replay && lwip_bench_replay(replay) < 0)
+		return -1;
+	kputs("> lwIP benchmark..Ok!\n");
+	return 0;
+}
+
+int lwip_bench_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	return lwip_bench_init();
+}
+
+int lwip_bench_testTearDown(void)
+{
+	kputs("TearDown lwIP benchmark.\n");
+	return 0;
+}
+
+TEST_MAIN(lwip_bench);
@@ -63,5 +63,42 @@
  */
 #define CONFIG_BATTFS_SHUFFLE_FREE_PAGES 0
 
+/**
+ * Set to 1 to enable the mount checkpoint.
+ * A snapshot of the page allocation array is kept on a separate
+ * block device, so mount does not need to scan the whole disk.
+ * See battfs_mountCheckpoint().
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_CHECKPOINT 0
+
+/**
+ * Set to 1 to keep an index of the files in RAM.
+ * Opening a file, or checking if it exists, does not read the disk,
+ * at the cost of 6 bytes of RAM per inode.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_INODE_INDEX 0
+
+/**
+ * Set to 1 to enable wear leveling.
+ * The erase count of each page is kept on a separate block device:
+ * free pages are used least worn first and battfs_gcStep() moves
+ * the data never rewritten out of the least worn pages.
+ * See battfs_wearInit().
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_BATTFS_WEAR_LEVELING 0
+
+/**
+ * Erase count difference that makes battfs_gcStep() move a page
+ * holding data to a more worn page.
+ * Lower values level better, at the cost of more page moves.
+ * It is also the number of erases after which the counts are saved.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 1
+ */
+#define CONFIG_BATTFS_WEAR_THRESHOLD 16
+
 
 #endif /* BATTFS */
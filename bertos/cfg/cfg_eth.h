@@ -54,4 +54,25 @@
  */
 #define ETH_LOG_FORMAT     LOG_FMT_TERSE
 
+/**
+ * Zero-copy frame transfers between the driver and lwIP.
+ *
+ * Received frames are handed to the stack in the driver buffers, that go
+ * back to the driver when lwIP frees them, and transmitted frames are
+ * gathered from the pbufs they are made of.
+ * It needs a driver with the zero-copy interface of drv/eth.h (the
+ * emulator has it) and LWIP_SUPPORT_CUSTOM_PBUF.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_ETH_ZEROCOPY       0
+
+/**
+ * Number of frames the emulated interface can queue for reception.
+ *
+ * Used only by the emulator driver, it plays the role of the DMA
+ * receive ring of the real controllers.
+ * $WIZ$ type = "int"; min = 1
+ */
+#define CONFIG_ETH_EMUL_RXFRAMES  32
+
 #endif /* CFG_ETH_H */
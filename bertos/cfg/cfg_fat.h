@@ -107,6 +107,22 @@
 #define CONFIG_FAT_USE_FORWARD 0
 #define	_USE_FORWARD (CONFIG_FAT_USE_FORWARD && CONFIG_FAT_FS_TINY)
 
+/**
+ * Keep a map of the cluster chain of each FatFile, so that seeks and reads
+ * at random offsets find their cluster without following the FAT chain.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_FAT_USE_FASTSEEK 0
+#define _USE_FASTSEEK CONFIG_FAT_USE_FASTSEEK
+
+/**
+ * Size in DWORDs of the cluster chain map of each FatFile.
+ * A map holds (CONFIG_FAT_LINKMAP_SIZE - 2) / 2 contiguous fragments of the
+ * file, the clusters past the last fragment are found on the FAT.
+ * $WIZ$ type = "int"; min = 4
+ */
+#define CONFIG_FAT_LINKMAP_SIZE 32
+
 /**
  * Number of volumes (logical drives) to be used.
  * $WIZ$ type = "int"; min = 1; max = 255
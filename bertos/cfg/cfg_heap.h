@@ -45,6 +45,35 @@
  */
 #define CONFIG_HEAP_MALLOC     1
 
+/**
+ * Keep usage statistics for each heap.
+ *
+ * Track bytes in use, peak usage, free chunks, allocation failures and
+ * a histogram of the requested sizes. See heap_stats().
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_HEAP_STATS      0
+
+/**
+ * Two-level segregated fit allocator.
+ *
+ * Keep free blocks in segregated lists indexed by a two-level bitmap:
+ * allocation and release run in constant time and free blocks are
+ * merged immediately, at the cost of one sizeof(MemChunk) header for
+ * each allocated block.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_HEAP_TLSF       0
+
+/**
+ * Number of first level size classes of the TLSF allocator.
+ *
+ * The largest block is sizeof(MemChunk) << (CONFIG_HEAP_TLSF_FL + 2)
+ * bytes: the default allows heaps up to 2MB with 8 bytes chunks.
+ * $WIZ$ type = "int"; min = 2; max = 28
+ */
+#define CONFIG_HEAP_TLSF_FL    16
+
 #endif /* CFG_HEAP_H */
 
 
@@ -0,0 +1,60 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Configuration file for the kernel IPC benchmark.
+ */
+
+#ifndef CFG_IPC_BENCH_H
+#define CFG_IPC_BENCH_H
+
+/**
+ * Maximum number of tasks used by each benchmark.
+ *
+ * Every measure is repeated with 2, 4, 8... tasks up to this value.
+ * One stack of KERN_MINSTACKSIZE bytes is reserved for each task.
+ * $WIZ$ type = "int"; min = 2
+ */
+#define CONFIG_IPC_BENCH_MAX_TASKS  64
+
+/**
+ * Number of samples collected for each measure.
+ * $WIZ$ type = "int"; min = 1
+ */
+#define CONFIG_IPC_BENCH_SAMPLES    32
+
+/**
+ * Number of operations timed together in each sample, per task.
+ * $WIZ$ type = "int"; min = 1
+ */
+#define CONFIG_IPC_BENCH_BATCH      16
+
+#endif /* CFG_IPC_BENCH_H */
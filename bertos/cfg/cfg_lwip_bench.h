@@ -0,0 +1,72 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Configuration file for the lwIP benchmark.
+ */
+
+#ifndef CFG_LWIP_BENCH_H
+#define CFG_LWIP_BENCH_H
+
+/**
+ * Address of the emulated interface, as a host order 32 bit value.
+ *
+ * Set it to the address of the unit that recorded the traffic to
+ * replay, otherwise the stack discards all the replayed packets.
+ * $WIZ$ type = "hex"
+ */
+#define CONFIG_LWIP_BENCH_IPADDR    0x0A000001
+
+/**
+ * Netmask of the emulated interface, as a host order 32 bit value.
+ * $WIZ$ type = "hex"
+ */
+#define CONFIG_LWIP_BENCH_NETMASK   0xFFFFFF00
+
+/**
+ * Bytes sent through the TCP connection by the throughput benchmark.
+ * $WIZ$ type = "int"; min = 1
+ */
+#define CONFIG_LWIP_BENCH_TCP_BYTES 262144L
+
+/**
+ * Number of UDP round trips timed by the latency benchmark.
+ * $WIZ$ type = "int"; min = 1
+ */
+#define CONFIG_LWIP_BENCH_UDP_SAMPLES 64
+
+/**
+ * Payload of the UDP datagrams used by the latency benchmark.
+ * $WIZ$ type = "int"; min = 1; max = 1472
+ */
+#define CONFIG_LWIP_BENCH_UDP_SIZE  64
+
+#endif /* CFG_LWIP_BENCH_H */
@@ -44,4 +44,14 @@
  */
 #define CONFIG_KERN_MONITOR 0
 
+/**
+ * Per-process CPU time and context switch accounting.
+ *
+ * Measures with the high precision timer the run time of each process,
+ * its voluntary and involuntary context switches and the longest time
+ * it has kept preemption disabled. See monitor_stats().
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_KERN_MONITOR_STATS 0
+
 #endif /*  CFG_MONITOR_H */
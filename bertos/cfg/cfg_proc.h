@@ -74,6 +74,26 @@
  */
 #define CONFIG_KERN_PRI 0
 
+/**
+ * Constant time ready queue for the priority scheduler.
+ *
+ * Keep a FIFO list of ready processes for each priority level plus a bitmap
+ * of non-empty levels, instead of a single sorted list.
+ * Priorities outside the configured levels share the lowest/highest level.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_KERN_PRI_BITMAP 0
+
+/**
+ * Number of priority levels of the ready queue bitmap.
+ * Levels are centered on the default priority 0, eg. 32 levels
+ * map priorities from -16 to 15.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 2
+ * $WIZ$ max = 32
+ */
+#define CONFIG_KERN_PRI_LEVELS 32
+
 /**
  * Dynamic memory allocation for processes.
  * $WIZ$ type = "boolean"
@@ -44,4 +44,15 @@
  */
 #define CONFIG_KERN_SEMAPHORES  0
 
+/**
+ * Priority inheritance for semaphores (needs CONFIG_KERN_PRI).
+ *
+ * The owner of a semaphore runs at the priority of the highest priority
+ * waiter until it releases the semaphore, and waiters are queued by
+ * priority. Enables also the priority ceiling protocol, see
+ * sem_setCeiling().
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_SEM_PRI_INHERIT  0
+
 #endif /*  CFG_SEM_H */
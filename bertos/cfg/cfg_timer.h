@@ -58,10 +58,38 @@
  */
 #define CONFIG_TIMER_EVENTS  1
 
+/**
+ * Keep asynchronous timers in a hierarchical timing wheel.
+ *
+ * Adding and aborting a timer take constant time, instead of a sorted
+ * insertion in the timers queue, at the cost of some RAM for the slots.
+ * Useful with many concurrent timers.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_TIMER_WHEEL  0
+
+/**
+ * Log2 of the number of slots of each level of the timing wheel.
+ * $WIZ$ type = "int"
+ * $WIZ$ min = 2
+ * $WIZ$ max = 8
+ */
+#define CONFIG_TIMER_WHEEL_BITS  6
+
 /**
  * Support hi-res timer_usleep().
  * $WIZ$ type = "boolean"
  */
 #define CONFIG_TIMER_UDELAY  1
 
+/**
+ * Stop the periodic tick while the scheduler is idle.
+ *
+ * The hardware timer is reprogrammed to fire when the first asynchronous
+ * timer expires and the system clock is caught up on wake up.
+ * Needs support from the hardware timer driver.
+ * $WIZ$ type = "boolean"
+ */
+#define CONFIG_TIMER_TICKLESS  0
+
 #endif /* CFG_TIMER_H */
@@ -296,6 +296,7 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+	ser_rxNotify(ser_handles[port]);
 }
 
 INLINE bool lpc2_uartTxReady(int port)
@@ -324,6 +325,7 @@ static void uart_irq_tx(int port)
 		/* THR: put a character to the Transmit Holding Register */
 		*(reg8_t *)(uart_param[port].base + THR) = fifo_pop(txfifo);
 	}
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
@@ -441,6 +443,7 @@ static struct LPC2Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart0_rxbuffer,
 			.txbuffer_size = sizeof(uart0_txbuffer),
 			.rxbuffer_size = sizeof(uart0_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.irq = INT_UART0,
@@ -452,6 +455,7 @@ static struct LPC2Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart1_rxbuffer,
 			.txbuffer_size = sizeof(uart1_txbuffer),
 			.rxbuffer_size = sizeof(uart1_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.irq = INT_UART1,
@@ -463,6 +467,7 @@ static struct LPC2Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart2_rxbuffer,
 			.txbuffer_size = sizeof(uart2_txbuffer),
 			.rxbuffer_size = sizeof(uart2_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.irq = INT_UART2,
@@ -474,6 +479,7 @@ static struct LPC2Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart3_rxbuffer,
 			.txbuffer_size = sizeof(uart3_txbuffer),
 			.rxbuffer_size = sizeof(uart3_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.irq = INT_UART3,
@@ -183,6 +183,7 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+	ser_rxNotify(ser_handles[port]);
 }
 
 static void uart_irq_tx(int port)
@@ -204,6 +205,7 @@ static void uart_irq_tx(int port)
 		}
 		HWREG(base + UART_O_DR) = fifo_pop(txfifo);
 	}
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
@@ -331,6 +333,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart0_rxbuffer,
 			.txbuffer_size = sizeof(uart0_txbuffer),
 			.rxbuffer_size = sizeof(uart0_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = UART0_BASE,
@@ -343,6 +346,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart1_rxbuffer,
 			.txbuffer_size = sizeof(uart1_txbuffer),
 			.rxbuffer_size = sizeof(uart1_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = UART1_BASE,
@@ -355,6 +359,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart2_rxbuffer,
 			.txbuffer_size = sizeof(uart2_txbuffer),
 			.rxbuffer_size = sizeof(uart2_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = UART2_BASE,
@@ -205,6 +205,7 @@ static void uart_irq_rx(int port)
 		else
 			fifo_push(rxfifo, c);
 	}
+	ser_rxNotify(ser_handles[port]);
 }
 
 static void uart_irq_tx(int port)
@@ -225,6 +226,7 @@ static void uart_irq_tx(int port)
 	{
 		base->DR = fifo_pop(txfifo);
 	}
+	ser_txNotify(ser_handles[port]);
 }
 
 static void uart_common_irq_handler(int port)
@@ -352,6 +354,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart1_rxbuffer,
 			.txbuffer_size = sizeof(uart1_txbuffer),
 			.rxbuffer_size = sizeof(uart1_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = USART1_BASE,
@@ -364,6 +367,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart2_rxbuffer,
 			.txbuffer_size = sizeof(uart2_txbuffer),
 			.rxbuffer_size = sizeof(uart2_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = USART2_BASE,
@@ -377,6 +381,7 @@ static struct CM3Serial UARTDesc[SER_CNT] =
 			.rxbuffer = uart3_rxbuffer,
 			.txbuffer_size = sizeof(uart3_txbuffer),
 			.rxbuffer_size = sizeof(uart3_rxbuffer),
+			.notify = true,
 		},
 		.sending = false,
 		.base = USART3_BASE,
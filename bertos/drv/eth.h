@@ -129,6 +129,49 @@ ssize_t eth_getFrame(uint8_t *buf, size_t len);
 ssize_t eth_send(const uint8_t *buf, size_t len);
 ssize_t eth_recv(uint8_t *buf, size_t len);
 
+/**
+ * \name Zero-copy interface
+ *
+ * Available on the drivers supporting CONFIG_ETH_ZEROCOPY.
+ * \{
+ */
+
+/**
+ * Segment of a frame to transmit.
+ */
+typedef struct EthSeg
+{
+	const uint8_t *data;
+	size_t len;
+} EthSeg;
+
+/**
+ * Transmit a frame gathered from \a count segments.
+ *
+ * The controller reads the segments in place: they must not change
+ * until the function returns.
+ * \return the length of the frame, or -1 if it can't be transmitted.
+ */
+ssize_t eth_sendSegs(const EthSeg *segs, size_t count);
+
+/**
+ * Wait for a frame and take its receive buffer, without copying it.
+ *
+ * The buffer is reused by the driver only after it has been given back
+ * with eth_putFrameBuf(); until then, the controller can't use it for
+ * the next frames.
+ * \param len filled with the frame length.
+ * \return the frame buffer, ETH_FRAME_LEN bytes long.
+ */
+uint8_t *eth_getFrameBuf(size_t *len);
+
+/**
+ * Give back to the driver a buffer taken with eth_getFrameBuf().
+ */
+void eth_putFrameBuf(uint8_t *buf);
+
+/** \} */
+
 int eth_init(void);
 
 extern const uint8_t mac_addr[ETH_ADDR_LEN];
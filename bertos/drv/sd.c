@@ -116,6 +116,8 @@ static int16_t sd_waitR1(Sd *sd)
 	return EOF;
 }
 
+#define SD_STOP_TRANSMISSION 0x4C
+
 static int16_t sd_sendCommand(Sd *sd, uint8_t cmd, uint32_t param, uint8_t crc)
 {
 	KFile *fd = sd->ch;
@@ -130,9 +132,33 @@ static int16_t sd_sendCommand(Sd *sd, uint8_t cmd, uint32_t param, uint8_t crc)
 
 	kfile_putc(crc, fd);
 
+	/* The byte following the stop command must be discarded */
+	if (cmd == SD_STOP_TRANSMISSION)
+		kfile_getc(fd);
+
 	return sd_waitR1(sd);
 }
 
+/*
+ * Wait for the card to release the data line after a write or a
+ * stop command, when busy it keeps it low.
+ */
+static bool sd_waitBusy(Sd *sd)
+{
+	ticks_t start = timer_clock();
+	do
+	{
+		if (kfile_getc(sd->ch) == 0xff)
+			return true;
+
+		cpu_relax();
+	}
+	while (timer_clock() - start < SD_BUSY_TIMEOUT);
+
+	LOG_ERR("Timeout waiting busy\n");
+	return false;
+}
+
 static bool sd_getBlock(Sd *sd, void *buf, size_t len)
 {
 	uint8_t token;
@@ -236,6 +262,21 @@ static int16_t sd_getCSD(Sd *sd, CardCSD *csd)
 }
 
 
+/* Whole block transfers use the default block length */
+static bool sd_setDefaultBlockLen(Sd *sd)
+{
+	if (sd->tranfer_len != SD_DEFAULT_BLOCKLEN)
+	{
+		if ((sd->r1 = sd_setBlockLen(sd, SD_DEFAULT_BLOCKLEN)))
+		{
+			LOG_ERR("setBlockLen failed: %04X\n", sd->r1);
+			return false;
+		}
+		sd->tranfer_len = SD_DEFAULT_BLOCKLEN;
+	}
+	return true;
+}
+
 #define SD_READ_SINGLEBLOCK 0x51
 
 static size_t sd_readDirect(struct KBlock *b, block_idx_t idx, void *buf, size_t offset, size_t size)
@@ -286,15 +327,8 @@ static size_t sd_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t
 	ASSERT(size == SD_DEFAULT_BLOCKLEN);
 
 	LOG_INFO("writing block %ld\n", idx);
-	if (sd->tranfer_len != SD_DEFAULT_BLOCKLEN)
-	{
-		if ((sd->r1 = sd_setBlockLen(sd, SD_DEFAULT_BLOCKLEN)))
-		{
-			LOG_ERR("setBlockLen failed: %04X\n", sd->r1);
-			return 0;
-		}
-		sd->tranfer_len = SD_DEFAULT_BLOCKLEN;
-	}
+	if (!sd_setDefaultBlockLen(sd))
+		return 0;
 
 	SD_SELECT(sd);
 
@@ -325,6 +359,112 @@ static size_t sd_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t
 	return SD_DEFAULT_BLOCKLEN;
 }
 
+#define SD_READ_MULTIPLEBLOCK 0x52
+
+static size_t sd_readBlocks(struct KBlock *b, block_idx_t idx, void *buf, size_t count)
+{
+	Sd *sd = SD_CAST(b);
+	uint8_t *data = (uint8_t *)buf;
+	size_t i;
+
+	LOG_INFO("reading %d blocks from block %ld\n", count, idx);
+	if (!sd_setDefaultBlockLen(sd))
+		return 0;
+
+	if (!sd_select(sd, true))
+	{
+		LOG_ERR("%s failed, card busy\n", __func__);
+		return 0;
+	}
+
+	sd->r1 = sd_sendCommand(sd, SD_READ_MULTIPLEBLOCK, idx * SD_DEFAULT_BLOCKLEN, 0);
+
+	if (sd->r1)
+	{
+		LOG_ERR("read multiple block failed: %04X\n", sd->r1);
+		sd_select(sd, false);
+		return 0;
+	}
+
+	/* The card streams the blocks one after another until stopped */
+	for (i = 0; i < count; i++, data += SD_DEFAULT_BLOCKLEN)
+		if (!sd_getBlock(sd, data, SD_DEFAULT_BLOCKLEN))
+		{
+			LOG_ERR("read multiple block failed reading block %ld\n", idx + i);
+			break;
+		}
+
+	int16_t r1 = sd_sendCommand(sd, SD_STOP_TRANSMISSION, 0, 0);
+	if (r1)
+	{
+		LOG_ERR("stop transmission failed: %04X\n", r1);
+		sd->r1 = r1;
+	}
+	sd_waitBusy(sd);
+	sd_select(sd, false);
+
+	return i;
+}
+
+#define SD_WRITE_MULTIPLEBLOCK   0x59
+#define SD_MULTIPLE_STARTTOKEN   0xFC
+#define SD_MULTIPLE_STOPTOKEN    0xFD
+
+static size_t sd_writeBlocks(KBlock *b, block_idx_t idx, const void *buf, size_t count)
+{
+	Sd *sd = SD_CAST(b);
+	KFile *fd = sd->ch;
+	const uint8_t *data = (const uint8_t *)buf;
+	size_t i;
+
+	LOG_INFO("writing %d blocks from block %ld\n", count, idx);
+	if (!sd_setDefaultBlockLen(sd))
+		return 0;
+
+	if (!sd_select(sd, true))
+	{
+		LOG_ERR("%s failed, card busy\n", __func__);
+		return 0;
+	}
+
+	sd->r1 = sd_sendCommand(sd, SD_WRITE_MULTIPLEBLOCK, idx * SD_DEFAULT_BLOCKLEN, 0);
+
+	if (sd->r1)
+	{
+		LOG_ERR("write multiple block failed: %04X\n", sd->r1);
+		sd_select(sd, false);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++, data += SD_DEFAULT_BLOCKLEN)
+	{
+		kfile_putc(SD_MULTIPLE_STARTTOKEN, fd);
+		kfile_write(fd, data, SD_DEFAULT_BLOCKLEN);
+		/* send fake crc */
+		kfile_putc(0, fd);
+		kfile_putc(0, fd);
+
+		uint8_t dataresp = kfile_getc(fd);
+		if ((dataresp & 0x1f) != SD_DATA_ACCEPTED)
+		{
+			LOG_ERR("write block %ld failed: %02X\n", idx + i, dataresp);
+			break;
+		}
+
+		/* The card programs the block before accepting the next one */
+		if (!sd_waitBusy(sd))
+			break;
+	}
+
+	kfile_putc(SD_MULTIPLE_STOPTOKEN, fd);
+	/* One byte gap before the card starts signalling busy */
+	kfile_getc(fd);
+	sd_waitBusy(sd);
+	sd_select(sd, false);
+
+	return i;
+}
+
 void sd_writeTest(Sd *sd)
 {
 	uint8_t buf[SD_DEFAULT_BLOCKLEN];
@@ -388,6 +528,8 @@ static const KBlockVTable sd_unbuffered_vt =
 {
 	.readDirect = sd_readDirect,
 	.writeDirect = sd_writeDirect,
+	.readBlocks = sd_readBlocks,
+	.writeBlocks = sd_writeBlocks,
 
 	.error = sd_error,
 	.clearerr = sd_clearerr,
@@ -397,6 +539,8 @@ static const KBlockVTable sd_buffered_vt =
 {
 	.readDirect = sd_readDirect,
 	.writeDirect = sd_writeDirect,
+	.readBlocks = sd_readBlocks,
+	.writeBlocks = sd_writeBlocks,
 
 	.readBuf = kblock_swReadBuf,
 	.writeBuf = kblock_swWriteBuf,
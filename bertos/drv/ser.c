@@ -39,6 +39,13 @@
  * has proved to be fast enough to handle transfer rates up to
  * 38400bps on a 16MHz 80196.
  *
+ * Data is moved between the caller buffers and the FIFOs in blocks.
+ * With the kernel and signals enabled, and a low level driver that
+ * calls ser_rxNotify() and ser_txNotify() from its interrupt handlers,
+ * readers and writers sleep while the FIFOs are empty or full, instead
+ * of polling them. Only one process at a time may wait on each
+ * direction of a port.
+ *
  * MODULE CONFIGURATION
  *
  *  \li \c CONFIG_SER_HWHANDSHAKE - set to 1 to enable RTS/CTS handshake.
@@ -56,12 +63,15 @@
 
 #include "cfg/cfg_ser.h"
 #include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
 #include <cfg/debug.h>
 
 #include <mware/formatwr.h>
 
 #include <cpu/power.h> /* cpu_relax() */
 
+#include <mware/event.h>
+
 #include <string.h> /* memset() */
 
 /*
@@ -83,49 +93,189 @@
 
 struct Serial *ser_handles[SER_CNT];
 
+/** Wait forever, used when timeouts are disabled */
+#define SER_NOTIMEOUT  ((ticks_t)-1)
+
+#if CONFIG_SER_RXTIMEOUT != -1
+	#define SER_RXTIMEOUT(port)  ((port)->rxtimeout)
+#else
+	#define SER_RXTIMEOUT(port)  SER_NOTIMEOUT
+#endif
+
+#if CONFIG_SER_TXTIMEOUT != -1
+	#define SER_TXTIMEOUT(port)  ((port)->txtimeout)
+#else
+	#define SER_TXTIMEOUT(port)  SER_NOTIMEOUT
+#endif
+
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	#define SER_RXEVENT(port)  (&(port)->rx_event)
+	#define SER_TXEVENT(port)  (&(port)->tx_event)
+#else
+	#define SER_RXEVENT(port)  NULL
+	#define SER_TXEVENT(port)  NULL
+#endif
+
 /**
- * Insert \a c in tx FIFO buffer.
- * \note This function will switch out the calling process
- * if the tx buffer is full. If the buffer is full
- * and \a port->txtimeout is 0 return EOF immediatly.
+ * Wait for the interrupt handler to trigger event \a e.
  *
- * \return EOF on error or timeout, \a c otherwise.
+ * If the low level driver notifies its FIFO activity, the calling
+ * process is put to sleep until the event or the timeout, otherwise
+ * we just relax the cpu and let the caller poll again.
+ *
+ * \param start Time the caller started waiting.
+ * \param timeout Timeout in ticks, or SER_NOTIMEOUT.
+ * \return false if \a timeout ticks have elapsed since \a start,
+ *         true otherwise. The caller must check again its FIFO in
+ *         any case.
  */
-static int ser_putchar(int c, struct Serial *port)
+static bool ser_wait(struct Serial *port, UNUSED_ARG(Event *, e), ticks_t start, ticks_t timeout)
 {
-	if (fifo_isfull_locked(&port->txfifo))
+	ticks_t elapsed = 0;
+
+	if (timeout != SER_NOTIMEOUT)
 	{
-#if CONFIG_SER_TXTIMEOUT != -1
-		/* If timeout == 0 we don't want to wait */
-		if (port->txtimeout == 0)
-			return EOF;
+		elapsed = timer_clock() - start;
+		if (elapsed >= timeout)
+			return false;
+	}
 
-		ticks_t start_time = timer_clock();
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	if (port->hw->notify)
+	{
+		if (timeout == SER_NOTIMEOUT)
+			event_wait(e);
+		else
+			event_waitTimeout(e, timeout - elapsed);
+		return true;
+	}
+#else
+	(void)port;
 #endif
 
-		/* Wait while buffer is full... */
-		do
+	cpu_relax();
+	return true;
+}
+
+/**
+ * Copy up to \a size bytes from \a _buf to the tx FIFO.
+ *
+ * Data is moved in blocks. While the FIFO is full the calling process
+ * sleeps, or polls without the kernel. If the buffer is full and
+ * \a port->txtimeout is 0 return immediatly.
+ *
+ * \return the number of bytes written, less than \a size on timeout.
+ */
+static size_t ser_writeBlock(struct Serial *port, const void *_buf, size_t size)
+{
+	const uint8_t *buf = (const uint8_t *)_buf;
+	ticks_t timeout = SER_TXTIMEOUT(port);
+	ticks_t start = 0;
+	size_t total = 0;
+
+	if (timeout != SER_NOTIMEOUT)
+		start = timer_clock();
+
+	while (total < size)
+	{
+		size_t len = fifo_pushBlock(&port->txfifo, buf + total, size - total);
+
+		if (len)
 		{
-			cpu_relax();
+			total += len;
 
-#if CONFIG_SER_TXTIMEOUT != -1
-			if (timer_clock() - start_time >= port->txtimeout)
-			{
-				ATOMIC(port->status |= SERRF_TXTIMEOUT);
-				return EOF;
-			}
-#endif /* CONFIG_SER_TXTIMEOUT */
+			/* (re)trigger tx interrupt */
+			port->hw->table->txStart(port->hw);
+
+			/* The timeout counts from the last progress */
+			if (timeout != SER_NOTIMEOUT)
+				start = timer_clock();
+			continue;
+		}
+
+		/* If timeout == 0 we don't want to wait */
+		if (timeout == 0)
+			break;
+
+		if (!ser_wait(port, SER_TXEVENT(port), start, timeout))
+		{
+			ATOMIC(port->status |= SERRF_TXTIMEOUT);
+			break;
 		}
-		while (fifo_isfull_locked(&port->txfifo));
 	}
 
-	fifo_push_locked(&port->txfifo, (unsigned char)c);
+	return total;
+}
+
+/**
+ * Copy up to \a size bytes from the rx FIFO to \a _buf.
+ *
+ * Data is moved in blocks. While the FIFO is empty the calling process
+ * sleeps, or polls without the kernel. If the buffer is empty and
+ * \a port->rxtimeout is 0 return immediatly.
+ *
+ * \return the number of bytes read, less than \a size on timeout or
+ *         error.
+ */
+static size_t ser_readBlock(struct Serial *port, void *_buf, size_t size)
+{
+	uint8_t *buf = (uint8_t *)_buf;
+	ticks_t timeout = SER_RXTIMEOUT(port);
+	ticks_t start = 0;
+	size_t total = 0;
+
+	if (timeout != SER_NOTIMEOUT)
+		start = timer_clock();
 
-	/* (re)trigger tx interrupt */
-	port->hw->table->txStart(port->hw);
+	while (total < size)
+	{
+		size_t len;
+
+		if (ser_getstatus(port) & SERRF_RX)
+			break;
+
+		len = fifo_popBlock(&port->rxfifo, buf + total, size - total);
+		if (len)
+		{
+			total += len;
+
+			/* The timeout counts from the last received char */
+			if (timeout != SER_NOTIMEOUT)
+				start = timer_clock();
+			continue;
+		}
+
+		/* If timeout == 0 we don't want to wait for chars */
+		if (timeout == 0)
+			break;
+
+		if (!ser_wait(port, SER_RXEVENT(port), start, timeout))
+		{
+			ATOMIC(port->status |= SERRF_RXTIMEOUT);
+			break;
+		}
+	}
+
+	return total;
+}
+
+/**
+ * Insert \a c in tx FIFO buffer.
+ * \note This function will switch out the calling process
+ * if the tx buffer is full. If the buffer is full
+ * and \a port->txtimeout is 0 return EOF immediatly.
+ *
+ * \return EOF on error or timeout, \a c otherwise.
+ */
+static int ser_putchar(int c, struct Serial *port)
+{
+	uint8_t b = (uint8_t)c;
+
+	if (ser_writeBlock(port, &b, 1) != 1)
+		return EOF;
 
 	/* Avoid returning signed extended char */
-	return (int)((unsigned char)c);
+	return (int)b;
 }
 
 
@@ -139,39 +289,12 @@ static int ser_putchar(int c, struct Serial *port)
  */
 static int ser_getchar(struct Serial *port)
 {
-	if (fifo_isempty_locked(&port->rxfifo))
-	{
-#if CONFIG_SER_RXTIMEOUT != -1
-		/* If timeout == 0 we don't want to wait for chars */
-		if (port->rxtimeout == 0)
-			return EOF;
-
-		ticks_t start_time = timer_clock();
-#endif
-
-		/* Wait while buffer is empty */
-		do
-		{
-			cpu_relax();
-
-#if CONFIG_SER_RXTIMEOUT != -1
-			if (timer_clock() - start_time >= port->rxtimeout)
-			{
-				ATOMIC(port->status |= SERRF_RXTIMEOUT);
-				return EOF;
-			}
-#endif /* CONFIG_SER_RXTIMEOUT */
-		}
-		while (fifo_isempty_locked(&port->rxfifo) && (ser_getstatus(port) & SERRF_RX) == 0);
-	}
+	uint8_t b;
 
-	/*
-	 * Get a byte from the FIFO (avoiding sign-extension),
-	 * re-enable RTS, then return result.
-	 */
-	if (ser_getstatus(port) & SERRF_RX)
+	if (ser_readBlock(port, &b, 1) != 1)
 		return EOF;
-	return (int)(unsigned char)fifo_pop_locked(&port->rxfifo);
+
+	return (int)b;
 }
 
 /**
@@ -196,44 +319,19 @@ int ser_getchar_nowait(struct Serial *fd)
  *
  * \return number of bytes actually read.
  */
-static size_t ser_read(struct KFile *fd, void *_buf, size_t size)
+static size_t ser_read(struct KFile *fd, void *buf, size_t size)
 {
-	Serial *fds = SERIAL_CAST(fd);
-
-	size_t i = 0;
-	char *buf = (char *)_buf;
-	int c;
-
-	while (i < size)
-	{
-		if ((c = ser_getchar(fds)) == EOF)
-			break;
-		buf[i++] = c;
-	}
-
-	return i;
+	return ser_readBlock(SERIAL_CAST(fd), buf, size);
 }
 
 /**
  * \brief Write a buffer to serial.
  *
- * \return 0 if OK, EOF in case of error.
- *
- * \todo Optimize with fifo_pushblock()
+ * \return number of bytes actually written.
  */
-static size_t ser_write(struct KFile *fd, const void *_buf, size_t size)
+static size_t ser_write(struct KFile *fd, const void *buf, size_t size)
 {
-	Serial *fds = SERIAL_CAST(fd);
-	const char *buf = (const char *)_buf;
-	size_t i = 0;
-
-	while (size--)
-	{
-		if (ser_putchar(*buf++, fds) == EOF)
-			break;
-		i++;
-	}
-	return i;
+	return ser_writeBlock(SERIAL_CAST(fd), buf, size);
 }
 
 
@@ -328,8 +426,9 @@ static int ser_flush(struct KFile *fd)
 	 * Wait until the FIFO becomes empty, and then until the byte currently in
 	 * the hardware register gets shifted out.
 	 */
-	while (!fifo_isempty(&fds->txfifo)
-	       || fds->hw->table->txSending(fds->hw))
+	while (!fifo_isempty_locked(&fds->txfifo))
+		ser_wait(fds, SER_TXEVENT(fds), 0, SER_NOTIMEOUT);
+	while (fds->hw->table->txSending(fds->hw))
 		cpu_relax();
 	return 0;
 }
@@ -358,6 +457,10 @@ static struct Serial *ser_open(struct Serial *fd, unsigned int unit)
 	ASSERT(fd->hw->rxbuffer);
 	fifo_init(&fd->txfifo, fd->hw->txbuffer, fd->hw->txbuffer_size);
 	fifo_init(&fd->rxfifo, fd->hw->rxbuffer, fd->hw->rxbuffer_size);
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	event_initGeneric(&fd->rx_event);
+	event_initGeneric(&fd->tx_event);
+#endif
 
 	fd->hw->table->init(fd->hw, fd);
 
@@ -78,7 +78,10 @@
 #endif
 
 #include "cfg/cfg_ser.h"
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
 
+#include <mware/event.h>
 
 
 /**
@@ -169,6 +172,20 @@ typedef struct Serial
 	ticks_t txtimeout;
 #endif
 
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	/**
+	 * \name Events triggered by the interrupt handlers.
+	 *
+	 * Used to sleep while the rx FIFO is empty or the tx FIFO is full,
+	 * see ser_rxNotify() and ser_txNotify().
+	 *
+	 * \{
+	 */
+	Event rx_event;
+	Event tx_event;
+	/* \} */
+#endif
+
 	/** Holds the flags defined above.  Will be 0 when no errors have occurred. */
 	volatile serstatus_t status;
 
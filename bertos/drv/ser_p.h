@@ -41,8 +41,14 @@
 #ifndef DRV_SER_P_H
 #define DRV_SER_P_H
 
+#include "ser.h"
+
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
+
 #include <cfg/compiler.h> /* size_t */
 
+#include <mware/event.h>
 
 
 struct SerialHardware;
@@ -65,10 +71,50 @@ struct SerialHardware
 	unsigned char *rxbuffer;
 	size_t         txbuffer_size;
 	size_t         rxbuffer_size;
+	/**
+	 * True if the driver interrupt handlers call ser_rxNotify() and
+	 * ser_txNotify(): the high level driver will then put the callers
+	 * to sleep instead of polling the FIFOs.
+	 */
+	bool           notify;
 };
 
 struct SerialHardware *ser_hw_getdesc(int unit);
 
+/**
+ * Notify the high level driver that new data, or an error, is
+ * available in the rx FIFO of \a ser.
+ *
+ * To be called by the rx interrupt handler after pushing one or more
+ * characters.
+ */
+INLINE void ser_rxNotify(struct Serial *ser)
+{
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	event_do(&ser->rx_event);
+#else
+	(void)ser;
+#endif
+}
+
+/**
+ * Notify the high level driver that room is available in the tx FIFO
+ * of \a ser.
+ *
+ * To be called by the tx interrupt handler after popping one or more
+ * characters. Writers are woken up only when at least half of the
+ * FIFO is free, to move data in reasonably sized blocks.
+ */
+INLINE void ser_txNotify(struct Serial *ser)
+{
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+	if (fifo_count(&ser->txfifo) <= fifo_len(&ser->txfifo) / 2)
+		event_do(&ser->tx_event);
+#else
+	(void)ser;
+#endif
+}
+
 
 
 #endif /* DRV_SER_P_H */
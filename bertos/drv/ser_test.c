@@ -0,0 +1,171 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Serial driver test, using the emulated port in loopback mode.
+ *
+ * Data larger than the FIFOs is moved through the port while the reader
+ * and the writer sleep waiting for the emulated interrupts, and a low
+ * priority process checks that the waits don't burn the cpu.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: echo  "#undef CONFIG_KERN_PRI" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN_PRI 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ * $test$: cp bertos/cfg/cfg_ser.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_SER_RXTIMEOUT" >> $cfgdir/cfg_ser.h
+ * $test$: echo "#define CONFIG_SER_RXTIMEOUT 1000" >> $cfgdir/cfg_ser.h
+ * $test$: echo  "#undef CONFIG_SER_TXTIMEOUT" >> $cfgdir/cfg_ser.h
+ * $test$: echo "#define CONFIG_SER_TXTIMEOUT 1000" >> $cfgdir/cfg_ser.h
+ */
+
+#include "cfg/cfg_ser.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/proc.h>
+#include <kern/irq.h>
+
+#include <drv/ser.h>
+#include <drv/timer.h>
+
+#include <stdlib.h> /* setenv() */
+#include <string.h> /* memcmp() */
+
+#define TEST_LEN      300
+#define TEST_BAUDRATE 38400
+
+static Serial ser;
+
+static uint8_t tx_buf[TEST_LEN];
+static uint8_t rx_buf[TEST_LEN];
+static volatile size_t rx_len;
+static volatile bool rx_done;
+
+static volatile unsigned long idle_count;
+static volatile bool idle_stop;
+
+PROC_DEFINE_STACK(reader_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(idle_stack, KERN_MINSTACKSIZE * 2);
+
+static void reader(void)
+{
+	rx_len = kfile_read(&ser.fd, rx_buf, sizeof(rx_buf));
+	rx_done = true;
+}
+
+/*
+ * Runs only when every other process is sleeping.
+ */
+static void idle(void)
+{
+	while (!idle_stop)
+	{
+		idle_count++;
+		proc_yield();
+	}
+}
+
+int ser_testRun(void)
+{
+	ticks_t start;
+	unsigned long count;
+
+	for (int i = 0; i < TEST_LEN; i++)
+		tx_buf[i] = i * 7 + 1;
+
+	/* Nothing to read and no wait: return at once */
+	ser_settimeouts(&ser, 0, 1000);
+	ASSERT(kfile_read(&ser.fd, rx_buf, 1) == 0);
+	ASSERT(ser_getstatus(&ser) == 0);
+
+	/* The reader sleeps until the timeout */
+	ser_settimeouts(&ser, 200, 1000);
+	count = idle_count;
+	start = timer_clock();
+	ASSERT(kfile_read(&ser.fd, rx_buf, 1) == 0);
+	ASSERT(timer_clock() - start >= ms_to_ticks(200));
+	ASSERT(ser_getstatus(&ser) & SERRF_RXTIMEOUT);
+	kprintf("idle loops while waiting: %lu\n", idle_count - count);
+	ASSERT(idle_count - count > 100);
+	kfile_clearerr(&ser.fd);
+
+	/*
+	 * Transfer more than the FIFOs can hold: the writer blocks on
+	 * the tx FIFO while the reader waits for the rx one.
+	 */
+	ser_settimeouts(&ser, 1000, 1000);
+	proc_new(reader, NULL, sizeof(reader_stack), reader_stack);
+	count = idle_count;
+	ASSERT(kfile_write(&ser.fd, tx_buf, sizeof(tx_buf)) == sizeof(tx_buf));
+	ASSERT(kfile_flush(&ser.fd) == 0);
+
+	start = timer_clock();
+	while (!rx_done && timer_clock() - start < ms_to_ticks(5000))
+		timer_delay(10);
+
+	ASSERT(rx_done);
+	ASSERT(rx_len == sizeof(tx_buf));
+	ASSERT(memcmp(rx_buf, tx_buf, sizeof(tx_buf)) == 0);
+	ASSERT(ser_getstatus(&ser) == 0);
+	kprintf("idle loops during transfer: %lu\n", idle_count - count);
+	ASSERT(idle_count - count > 0);
+
+	idle_stop = true;
+	return 0;
+}
+
+int ser_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+
+	setenv("BERTOS_SER0", "loopback", 1);
+	ser_init(&ser, SER_UART0);
+	ser_setbaudrate(&ser, TEST_BAUDRATE);
+
+	proc_setPri(proc_new(idle, NULL, sizeof(idle_stack), idle_stack), -1);
+	return 0;
+}
+
+int ser_testTearDown(void)
+{
+	kfile_close(&ser.fd);
+	return 0;
+}
+
+TEST_MAIN(ser);
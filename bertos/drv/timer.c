@@ -47,6 +47,8 @@
 #include <cfg/debug.h>
 #include <cfg/module.h>
 
+#include <kern/trace.h>
+
 #include <cpu/attr.h>
 #include <cpu/types.h>
 #include <cpu/irq.h>
@@ -110,18 +112,71 @@
 volatile ticks_t _clock;
 
 
+#if CONFIG_TIMER_TICKLESS
+
+#ifndef TIMER_HW_TICKLESS_MAX
+	#error CONFIG_TIMER_TICKLESS is not supported by this hardware timer
+#endif
+
+/// True while the periodic tick is stopped.
+static volatile bool tickless_idle;
+
+/// Value of the system clock when the periodic tick was stopped.
+static ticks_t tickless_clock;
+
+/**
+ * Restart the periodic tick and catch up the system clock with the ticks
+ * elapsed while idle (at least \a min_ticks).
+ */
+static void timer_ticklessExit(ticks_t min_ticks)
+{
+	ticks_t elapsed = timer_hw_wakeup();
+
+	tickless_idle = false;
+	_clock = tickless_clock + MAX(elapsed, min_ticks);
+}
+
+#endif /* CONFIG_TIMER_TICKLESS */
+
+
 #if CONFIG_TIMER_EVENTS
 
+#if CONFIG_TIMER_WHEEL
+
+#define WHEEL_BITS    CONFIG_TIMER_WHEEL_BITS
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS  DIV_ROUNDUP(sizeof(ticks_t) * CPU_BITS_PER_CHAR, WHEEL_BITS)
+
+/** Slot of wheel level \a level holding the timers that expire at tick \a t. */
+#define WHEEL_SLOT(t, level) \
+	((unsigned)(((unsigned long)(long)(t) >> ((level) * WHEEL_BITS)) & WHEEL_MASK))
+
+/**
+ * Hierarchical timing wheel of active asynchronous timers.
+ *
+ * Level 0 has one slot for each tick, a slot of level n spans a whole
+ * turn of level n - 1. Timers are moved (cascaded) to the lower level
+ * when the lower level wraps around.
+ */
+REGISTER static List timers_wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/** Next tick to be processed by the timing wheel. */
+static ticks_t wheel_clock;
+
+#else /* !CONFIG_TIMER_WHEEL */
+
 /**
  * List of active asynchronous timers.
  */
 REGISTER static List timers_queue;
 
+#endif /* CONFIG_TIMER_WHEEL */
+
 /**
- * This function really does the job. It adds \a timer to \a queue.
- * \see timer_add for details.
+ * Mark \a timer as active and compute its expiration time.
  */
-INLINE void timer_addToList(Timer *timer, List *queue)
+INLINE void timer_arm(Timer *timer)
 {
 	/* Inserting timers twice causes mayhem. */
 	ASSERT(timer->magic != TIMER_MAGIC_ACTIVE);
@@ -130,6 +185,15 @@ INLINE void timer_addToList(Timer *timer, List *queue)
 
 	/* Calculate expiration time for this timer */
 	timer->tick = _clock + timer->_delay;
+}
+
+/**
+ * This function really does the job. It adds \a timer to \a queue.
+ * \see timer_add for details.
+ */
+INLINE void timer_addToList(Timer *timer, List *queue)
+{
+	timer_arm(timer);
 
 	/*
 	 * Search for the first node whose expiration time is
@@ -153,6 +217,92 @@ INLINE void timer_addToList(Timer *timer, List *queue)
 	INSERT_BEFORE(&timer->link, &node->link);
 }
 
+#if CONFIG_TIMER_WHEEL
+
+/**
+ * Insert an armed timer in the wheel slot of its expiration time.
+ *
+ * The level is chosen so that the timer is cascaded down before
+ * the slot comes around again.
+ */
+INLINE void timer_wheelInsert(Timer *timer)
+{
+	ticks_t expires = timer->tick;
+	ticks_t delta = expires - wheel_clock;
+	unsigned level;
+
+	/* Already expired: run it on the next tick processed. */
+	if (delta < 0)
+	{
+		expires = wheel_clock;
+		delta = 0;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if ((unsigned long)delta < (1UL << ((level + 1) * WHEEL_BITS)))
+			break;
+
+	ADDTAIL(&timers_wheel[level][WHEEL_SLOT(expires, level)], &timer->link);
+}
+
+/**
+ * Move all the timers of a slot to the lower levels.
+ *
+ * \return the index of the cascaded slot.
+ */
+static unsigned timer_wheelCascade(unsigned level)
+{
+	unsigned idx = WHEEL_SLOT(wheel_clock, level);
+	Timer *timer;
+
+	while ((timer = (Timer *)list_remHead(&timers_wheel[level][idx])))
+		timer_wheelInsert(timer);
+
+	return idx;
+}
+
+/**
+ * Process all the ticks elapsed since the last call, expiring the timers
+ * of each level 0 slot.
+ *
+ * Every tick costs constant time, plus a cascade of the upper levels
+ * once every WHEEL_SLOTS ticks.
+ */
+static void timer_wheelPoll(void)
+{
+	Timer *timer;
+	List *slot;
+	unsigned level;
+
+	while (timer_clock_unlocked() - wheel_clock >= 0)
+	{
+		slot = &timers_wheel[0][WHEEL_SLOT(wheel_clock, 0)];
+
+		/* Level 0 wrapped around: cascade the upper levels */
+		if (slot == &timers_wheel[0][0])
+			for (level = 1; level < WHEEL_LEVELS; level++)
+				if (timer_wheelCascade(level))
+					break;
+
+		/*
+		 * Timers re-armed by the expired events must go
+		 * into the next slots.
+		 */
+		wheel_clock++;
+
+		while ((timer = (Timer *)list_remHead(slot)))
+		{
+			DB(timer->magic = TIMER_MAGIC_INACTIVE;)
+			trace_event(TRACE_TIMER, timer, 0);
+
+			/* Execute the associated event */
+			event_do(&timer->expire);
+		}
+	}
+}
+
+#endif /* CONFIG_TIMER_WHEEL */
+
 /**
  * Add the specified timer to the software timer service queue.
  * When the delay indicated by the timer expires, the timer
@@ -162,7 +312,25 @@ INLINE void timer_addToList(Timer *timer, List *queue)
  */
 void timer_add(Timer *timer)
 {
-	ATOMIC(timer_addToList(timer, &timers_queue));
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+#if CONFIG_TIMER_TICKLESS
+	/*
+	 * Timers may be added by an ISR while the tick is stopped: the clock
+	 * must be up to date to compute the expiration time, and the next
+	 * hardware interrupt may be due too late for the new timer.
+	 */
+	if (UNLIKELY(tickless_idle))
+		timer_ticklessExit(0);
+#endif
+#if CONFIG_TIMER_WHEEL
+	timer_arm(timer);
+	timer_wheelInsert(timer);
+#else
+	timer_addToList(timer, &timers_queue);
+#endif
+	IRQ_RESTORE(flags);
 }
 
 /**
@@ -200,6 +368,7 @@ INLINE void timer_poll(List *queue)
 		/* Retreat the expired timer */
 		REMOVE(&timer->link);
 		DB(timer->magic = TIMER_MAGIC_INACTIVE;)
+		trace_event(TRACE_TIMER, timer, 0);
 
 		/* Execute the associated event */
 		event_do(&timer->expire);
@@ -240,6 +409,107 @@ void synctimer_poll(List *queue)
 #endif /* CONFIG_TIMER_EVENTS */
 
 
+#if CONFIG_TIMER_TICKLESS
+
+#if CONFIG_TIMER_EVENTS && CONFIG_TIMER_WHEEL
+/*
+ * Return true if some timer is waiting in the upper levels of the wheel.
+ */
+static bool timer_wheelUpperPending(void)
+{
+	unsigned level, i;
+
+	for (level = 1; level < WHEEL_LEVELS; level++)
+		for (i = 0; i < WHEEL_SLOTS; i++)
+			if (!LIST_EMPTY(&timers_wheel[level][i]))
+				return true;
+	return false;
+}
+
+/*
+ * Return the ticks until the first timer of the wheel expires, or until
+ * the next cascade of the upper levels, whichever comes first.
+ */
+static ticks_t timer_nextDelay(ticks_t max_delay)
+{
+	ticks_t t = wheel_clock;
+	bool upper = timer_wheelUpperPending();
+	unsigned i;
+
+	for (i = 0; i < WHEEL_SLOTS; i++, t++)
+	{
+		if ((upper && !WHEEL_SLOT(t, 0))
+				|| !LIST_EMPTY(&timers_wheel[0][WHEEL_SLOT(t, 0)]))
+			return MIN(t - _clock, max_delay);
+	}
+	return max_delay;
+}
+#elif CONFIG_TIMER_EVENTS
+/*
+ * Return the ticks until the first timer of the queue expires.
+ */
+static ticks_t timer_nextDelay(ticks_t max_delay)
+{
+	if (!LIST_EMPTY(&timers_queue))
+		return MIN(((Timer *)LIST_HEAD(&timers_queue))->tick - _clock, max_delay);
+
+	return max_delay;
+}
+#else
+	#define timer_nextDelay(max_delay)  (max_delay)
+#endif
+
+/**
+ * Stop the periodic tick until the first asynchronous timer expires.
+ *
+ * This is called by the scheduler with interrupts disabled when there is no
+ * process ready to run. While the tick is stopped the system clock is not
+ * updated: it is caught up when the hardware timer fires or when
+ * timer_idleExit() is called.
+ */
+void timer_idleEnter(void)
+{
+	ticks_t delay;
+
+	IRQ_ASSERT_DISABLED();
+	if (tickless_idle)
+		return;
+
+	delay = timer_nextDelay(TIMER_HW_TICKLESS_MAX);
+
+	/* Nothing to save if the next tick is due anyway */
+	if (delay <= 1)
+		return;
+
+	tickless_clock = _clock;
+	tickless_idle = true;
+	timer_hw_sleep(delay);
+}
+
+/**
+ * Restart the periodic tick stopped by timer_idleEnter().
+ *
+ * The system clock is caught up and the expired timers are processed.
+ * This is called by the scheduler with interrupts disabled as soon as a
+ * process becomes ready to run.
+ */
+void timer_idleExit(void)
+{
+	IRQ_ASSERT_DISABLED();
+	if (!tickless_idle)
+		return;
+
+	timer_ticklessExit(0);
+#if CONFIG_TIMER_EVENTS && CONFIG_TIMER_WHEEL
+	timer_wheelPoll();
+#elif CONFIG_TIMER_EVENTS
+	timer_poll(&timers_queue);
+#endif
+}
+
+#endif /* CONFIG_TIMER_TICKLESS */
+
+
 /**
  * Wait for the specified amount of timer ticks.
  *
@@ -358,20 +628,29 @@ DEFINE_TIMER_ISR
 		return;
 
 	TIMER_STROBE_ON;
+	trace_event(TRACE_IRQ_ENTER, NULL, TRACE_IRQ_TIMER);
 
 	/* Update the master ms counter */
-	++_clock;
+#if CONFIG_TIMER_TICKLESS
+	if (UNLIKELY(tickless_idle))
+		timer_ticklessExit(1);
+	else
+#endif
+		++_clock;
 
 	/* Update the current task's quantum (if enabled). */
 	proc_decQuantum();
 
-	#if CONFIG_TIMER_EVENTS
+	#if CONFIG_TIMER_EVENTS && CONFIG_TIMER_WHEEL
+		timer_wheelPoll();
+	#elif CONFIG_TIMER_EVENTS
 		timer_poll(&timers_queue);
 	#endif
 
 	/* Perform hw IRQ handling */
 	timer_hw_irq();
 
+	trace_event(TRACE_IRQ_EXIT, NULL, TRACE_IRQ_TIMER);
 	TIMER_STROBE_OFF;
 }
 
@@ -386,7 +665,12 @@ void timer_init(void)
 		MOD_CHECK(irq);
 	#endif
 
-	#if CONFIG_TIMER_EVENTS
+	#if CONFIG_TIMER_EVENTS && CONFIG_TIMER_WHEEL
+		for (unsigned level = 0; level < WHEEL_LEVELS; level++)
+			for (unsigned i = 0; i < WHEEL_SLOTS; i++)
+				LIST_INIT(&timers_wheel[level][i]);
+		wheel_clock = 0;
+	#elif CONFIG_TIMER_EVENTS
 		LIST_INIT(&timers_queue);
 	#endif
 
@@ -236,6 +236,11 @@ INLINE void timer_delay(mtime_t delay)
 void timer_init(void);
 void timer_cleanup(void);
 
+#if CONFIG_TIMER_TICKLESS
+void timer_idleEnter(void);
+void timer_idleExit(void);
+#endif
+
 int timer_testSetup(void);
 int timer_testRun(void);
 int timer_testTearDown(void);
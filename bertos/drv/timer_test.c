@@ -123,6 +123,67 @@ static void timer_test_async(void)
 	}
 }
 
+/*
+ * Stress test: lots of concurrent timers with scattered delays, a third of
+ * them aborted before expiring.
+ */
+#define STRESS_TIMERS     2000
+#define STRESS_MAX_DELAY  500
+
+static Timer stress_timers[STRESS_TIMERS];
+static volatile int stress_expired;
+static volatile int stress_errors;
+
+static void timer_test_stressHook(iptr_t _timer)
+{
+	Timer *timer = (Timer *)(void *)_timer;
+	size_t i = timer - stress_timers;
+
+	/* Timers must expire exactly on their tick, aborted ones never */
+	if (timer_clock_unlocked() != timer->tick || i % 3 == 0)
+		stress_errors++;
+	stress_expired++;
+}
+
+static int timer_test_stress(void)
+{
+	size_t i;
+	int expected = 0;
+	ticks_t start;
+
+	kprintf("Stress test with %d timers\n", STRESS_TIMERS);
+	stress_expired = 0;
+	stress_errors = 0;
+
+	/* Timers with short delays must not expire before being aborted */
+	IRQ_DISABLE;
+	for (i = 0; i < countof(stress_timers); ++i)
+	{
+		Timer *timer = &stress_timers[i];
+		timer_setDelay(timer, (i * 7919) % STRESS_MAX_DELAY + 1);
+		timer_setSoftint(timer, timer_test_stressHook, (iptr_t)timer);
+		timer_add(timer);
+	}
+
+	for (i = 0; i < countof(stress_timers); ++i)
+	{
+		if (i % 3 == 0)
+			timer_abort(&stress_timers[i]);
+		else
+			expected++;
+	}
+	IRQ_ENABLE;
+
+	start = timer_clock();
+	while (stress_expired < expected
+		&& timer_clock() - start < STRESS_MAX_DELAY * 2)
+		wdt_reset();
+
+	kprintf("expired %d/%d timers, %d errors\n",
+		stress_expired, expected, stress_errors);
+	return (stress_expired == expected && !stress_errors) ? 0 : -1;
+}
+
 static void timer_test_poll(void)
 {
 	int secs = 0;
@@ -194,6 +255,8 @@ int timer_testRun(void)
 	timer_test_async();
 	timer_test_poll();
 	synctimer_test();
+	if (timer_test_stress())
+		return -1;
 	return 0;
 }
 
@@ -39,8 +39,11 @@
 /* Low level disk I/O module skeleton for FatFs     (C)ChaN, 2007        */
 /*-----------------------------------------------------------------------*/
 
+#include "diskio_emul.h"
+
 #include <fs/fatfs/diskio.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 #include <time.h>
 
@@ -48,6 +51,8 @@
 
 static volatile DSTATUS Stat = STA_NOINIT;
 
+static DiskEmulStats stats;
+
 /**
  * This is an example implementation, used to simulate the the calls to normal filesystem calls
  * It only works for drive 0.
@@ -118,6 +123,8 @@ DRESULT disk_read (
 	if (drv || !count) return RES_PARERR;
 	if (Stat & STA_NOINIT) return RES_NOTRDY;
 
+	stats.reads++;
+	stats.read_sectors += count;
 	fseek(fake_disk, sector * SECTOR_SIZE, SEEK_SET);
 	size_t read_items = fread(buff, SECTOR_SIZE, count, fake_disk);
 	if (read_items == count)
@@ -148,6 +155,8 @@ DRESULT disk_write (
 	if (Stat & STA_NOINIT) return RES_NOTRDY;
 	if (Stat & STA_PROTECT) return RES_WRPRT;
 
+	stats.writes++;
+	stats.write_sectors += count;
 	fseek(fake_disk, sector * SECTOR_SIZE, SEEK_SET);
 	size_t write_items = fwrite(buff, SECTOR_SIZE, count, fake_disk);
 	if (write_items == count)
@@ -197,6 +206,13 @@ DRESULT disk_ioctl (
 	return RES_OK;
 }
 
+void disk_emul_stats(DiskEmulStats *st, bool reset)
+{
+	*st = stats;
+	if (reset)
+		memset(&stats, 0, sizeof(stats));
+}
+
 DWORD get_fattime(void)
 {
 	time_t tmp = time(0);
@@ -0,0 +1,62 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Low level disk access for FatFs emulated, transfer counters.
+ *
+ * The emulated disk counts the sectors transferred, so that the tests
+ * can measure the disk accesses made by the FatFs module.
+ */
+
+#ifndef EMUL_DISKIO_EMUL_H
+#define EMUL_DISKIO_EMUL_H
+
+#include <cfg/compiler.h>
+
+#include <cpu/types.h>
+
+/**
+ * Emulated disk counters.
+ */
+typedef struct DiskEmulStats
+{
+	uint32_t reads;         ///< disk_read() calls
+	uint32_t read_sectors;  ///< Sectors read
+	uint32_t writes;        ///< disk_write() calls
+	uint32_t write_sectors; ///< Sectors written
+} DiskEmulStats;
+
+/**
+ * Copy the disk counters in \a stats and clear them if \a reset.
+ */
+void disk_emul_stats(DiskEmulStats *stats, bool reset);
+
+#endif /* EMUL_DISKIO_EMUL_H */
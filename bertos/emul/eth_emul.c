@@ -0,0 +1,477 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Ethernet driver emulator for hosted environments.
+ *
+ * Received frames wait in a ring of CONFIG_ETH_EMUL_RXFRAMES slots, like
+ * the DMA descriptors of a real controller: the reader blocks on an event
+ * until a frame is queued by the loopback or by the replay of a capture.
+ * A slot lent to the stack with eth_getFrameBuf() stops the ring, as a
+ * descriptor still owned by the software: the frames that find it are lost.
+ * Captures use the classic pcap format, so they can be inspected with
+ * tcpdump or wireshark and recorded on the field with the same tools.
+ */
+
+#include "eth_emul.h"
+
+#include "cfg/cfg_eth.h"
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
+
+/* The receiver sleeps on an event: processes and signals are needed */
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+
+#define LOG_LEVEL  ETH_LOG_LEVEL
+#define LOG_FORMAT ETH_LOG_FORMAT
+
+#include <cfg/log.h>
+#include <cfg/debug.h>
+#include <cfg/macros.h>
+
+#include <cpu/byteorder.h>
+
+#include <drv/eth.h>
+#include <drv/timer.h>
+
+#include <kern/proc.h>
+
+#include <mware/event.h>
+
+#include <stddef.h> /* offsetof() */
+#include <stdio.h> /* fopen(), fread(), fwrite() */
+#include <stdlib.h> /* getenv() */
+#include <string.h> /* memcpy() */
+
+#define PCAP_MAGIC          0xa1b2c3d4UL
+#define PCAP_MAGIC_NSEC     0xa1b23c4dUL
+#define PCAP_MAGIC_SWAP     0xd4c3b2a1UL
+#define PCAP_MAGIC_NSEC_SWAP 0x4d3cb2a1UL
+#define PCAP_LINK_ETHERNET  1
+
+/* pcap file header */
+typedef struct PcapHeader
+{
+	uint32_t magic;
+	uint16_t version_major;
+	uint16_t version_minor;
+	int32_t  thiszone;
+	uint32_t sigfigs;
+	uint32_t snaplen;
+	uint32_t network;
+} PcapHeader;
+
+/* pcap header of each recorded frame */
+typedef struct PcapRecord
+{
+	uint32_t ts_sec;
+	uint32_t ts_usec;
+	uint32_t incl_len;
+	uint32_t orig_len;
+} PcapRecord;
+
+/* States of the receive slots */
+#define SLOT_FREE   0  ///< Ready to receive a frame
+#define SLOT_READY  1  ///< Holds a frame not yet read
+#define SLOT_LENT   2  ///< Holds a frame lent with eth_getFrameBuf()
+
+typedef struct EthFrame
+{
+	size_t len;
+	int state;
+	uint8_t data[ETH_FRAME_LEN];
+} EthFrame;
+
+/* Locally administered address, it can't clash with a real interface */
+const uint8_t mac_addr[] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x01 };
+
+static EthFrame rx_ring[CONFIG_ETH_EMUL_RXFRAMES];
+static size_t rx_head;     ///< Next frame to read
+static size_t rx_tail;     ///< Next slot to fill
+static size_t rx_offset;   ///< Bytes of the next frame already read
+static Event rx_event;
+
+static uint8_t tx_buf[ETH_FRAME_LEN];
+static size_t tx_len;
+
+static uint8_t replay_buf[ETH_FRAME_LEN];
+static FILE *replay_fp;
+static bool replay_swap;
+
+static FILE *capture_fp;
+static bool loopback = true;
+static EthEmulStats stats;
+
+static void capture_frame(const uint8_t *buf, size_t len)
+{
+	PcapRecord rec;
+	utime_t us;
+
+	if (!capture_fp)
+		return;
+
+	us = ticks_to_us(timer_clock());
+	rec.ts_sec = us / 1000000;
+	rec.ts_usec = us % 1000000;
+	rec.incl_len = rec.orig_len = len;
+
+	if (fwrite(&rec, sizeof(rec), 1, capture_fp) != 1
+		|| fwrite(buf, 1, len, capture_fp) != len)
+	{
+		LOG_ERR("capture write error, capture stopped\n");
+		fclose(capture_fp);
+		capture_fp = NULL;
+	}
+}
+
+/*
+ * Queue a frame for reception.
+ *
+ * As on a real controller, a frame that finds the ring full is lost.
+ */
+static void rx_enqueue(const uint8_t *buf, size_t len)
+{
+	EthFrame *frame;
+
+	proc_forbid();
+	frame = &rx_ring[rx_tail];
+	if (frame->state != SLOT_FREE)
+	{
+		stats.rx_dropped++;
+		proc_permit();
+		return;
+	}
+	memcpy(frame->data, buf, len);
+	frame->len = len;
+	frame->state = SLOT_READY;
+	rx_tail = (rx_tail + 1) % countof(rx_ring);
+
+	stats.rx_frames++;
+	stats.rx_bytes += len;
+	proc_permit();
+
+	event_do(&rx_event);
+}
+
+/*
+ * Move the next frame of the capture being replayed to the receive ring.
+ *
+ * \return false when there is nothing more to replay.
+ */
+static bool replay_next(void)
+{
+	PcapRecord rec;
+
+	if (!replay_fp)
+		return false;
+
+	while (fread(&rec, sizeof(rec), 1, replay_fp) == 1)
+	{
+		if (replay_swap)
+			rec.incl_len = SWAB32(rec.incl_len);
+
+		/* Jumbo frames, or frames recorded with the FCS, don't fit */
+		if (rec.incl_len < ETH_HEAD_LEN || rec.incl_len > sizeof(replay_buf))
+		{
+			stats.rx_dropped++;
+			if (fseek(replay_fp, rec.incl_len, SEEK_CUR))
+				break;
+			continue;
+		}
+		if (fread(replay_buf, 1, rec.incl_len, replay_fp) != rec.incl_len)
+			break;
+
+		capture_frame(replay_buf, rec.incl_len);
+		rx_enqueue(replay_buf, rec.incl_len);
+		return true;
+	}
+
+	LOG_INFO("replay done\n");
+	fclose(replay_fp);
+	replay_fp = NULL;
+	return false;
+}
+
+void eth_emul_setLoopback(bool enable)
+{
+	loopback = enable;
+}
+
+int eth_emul_capture(const char *path)
+{
+	PcapHeader hdr;
+
+	if (capture_fp)
+	{
+		fclose(capture_fp);
+		capture_fp = NULL;
+	}
+	if (!path)
+		return 0;
+
+	if (!(capture_fp = fopen(path, "wb")))
+	{
+		LOG_ERR("unable to create capture %s\n", path);
+		return -1;
+	}
+
+	hdr.magic = PCAP_MAGIC;
+	hdr.version_major = 2;
+	hdr.version_minor = 4;
+	hdr.thiszone = 0;
+	hdr.sigfigs = 0;
+	hdr.snaplen = ETH_FRAME_LEN;
+	hdr.network = PCAP_LINK_ETHERNET;
+	if (fwrite(&hdr, sizeof(hdr), 1, capture_fp) != 1)
+	{
+		fclose(capture_fp);
+		capture_fp = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+int eth_emul_replay(const char *path)
+{
+	PcapHeader hdr;
+	FILE *fp;
+
+	if (!(fp = fopen(path, "rb")))
+	{
+		LOG_ERR("unable to open capture %s\n", path);
+		return -1;
+	}
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		goto error;
+
+	/* Captures are recorded in the byte order of the host that made them */
+	if (hdr.magic == PCAP_MAGIC || hdr.magic == PCAP_MAGIC_NSEC)
+		replay_swap = false;
+	else if (hdr.magic == PCAP_MAGIC_SWAP || hdr.magic == PCAP_MAGIC_NSEC_SWAP)
+		replay_swap = true;
+	else
+		goto error;
+
+	if ((replay_swap ? SWAB32(hdr.network) : hdr.network) != PCAP_LINK_ETHERNET)
+		goto error;
+
+	if (replay_fp)
+		fclose(replay_fp);
+	replay_fp = fp;
+
+	/* Wake up the reader, it will fetch the frames */
+	event_do(&rx_event);
+	return 0;
+
+error:
+	LOG_ERR("%s is not an ethernet pcap capture\n", path);
+	fclose(fp);
+	return -1;
+}
+
+INLINE bool rx_ready(void)
+{
+	return rx_ring[rx_head].state == SLOT_READY;
+}
+
+bool eth_emul_idle(void)
+{
+	return !replay_fp && !rx_ready();
+}
+
+void eth_emul_stats(EthEmulStats *st, bool reset)
+{
+	proc_forbid();
+	*st = stats;
+	if (reset)
+	{
+		memset(&stats, 0, sizeof(stats));
+		/* Not a counter, but the current state */
+		stats.rx_lent = st->rx_lent;
+	}
+	proc_permit();
+}
+
+ssize_t eth_putFrame(const uint8_t *buf, size_t len)
+{
+	size_t wr_len;
+
+	if (UNLIKELY(!len))
+		return -1;
+
+	wr_len = MIN(len, sizeof(tx_buf) - tx_len);
+	memcpy(tx_buf + tx_len, buf, wr_len);
+	tx_len += wr_len;
+	stats.copies++;
+	stats.copy_bytes += wr_len;
+
+	return wr_len;
+}
+
+void eth_sendFrame(void)
+{
+	stats.tx_frames++;
+	stats.tx_bytes += tx_len;
+
+	capture_frame(tx_buf, tx_len);
+	if (loopback)
+		rx_enqueue(tx_buf, tx_len);
+	tx_len = 0;
+}
+
+ssize_t eth_send(const uint8_t *buf, size_t len)
+{
+	if (UNLIKELY(!len))
+		return -1;
+
+	len = eth_putFrame(buf, len);
+	eth_sendFrame();
+
+	return len;
+}
+
+ssize_t eth_sendSegs(const EthSeg *segs, size_t count)
+{
+	size_t len = 0;
+
+	/* Here the controller gathers the segments with its DMA */
+	for (size_t i = 0; i < count; i++)
+	{
+		if (len + segs[i].len > sizeof(tx_buf))
+			return -1;
+		memcpy(tx_buf + len, segs[i].data, segs[i].len);
+		len += segs[i].len;
+		stats.copies++;
+	}
+	stats.copy_bytes += len;
+	tx_len = len;
+	eth_sendFrame();
+
+	return len;
+}
+
+size_t eth_getFrameLen(void)
+{
+	/* Replayed frames are fetched only when there is nothing to read */
+	while (!rx_ready())
+	{
+		if (!replay_next())
+			event_wait(&rx_event);
+	}
+	return rx_ring[rx_head].len;
+}
+
+ssize_t eth_getFrame(uint8_t *buf, size_t len)
+{
+	EthFrame *frame;
+	size_t rd_len;
+
+	if (UNLIKELY(!len))
+		return -1;
+	if (UNLIKELY(!rx_ready()))
+		return 0;
+
+	/* Frames can be read in more chunks, one for each pbuf */
+	frame = &rx_ring[rx_head];
+	rd_len = MIN(len, frame->len - rx_offset);
+	memcpy(buf, frame->data + rx_offset, rd_len);
+	rx_offset += rd_len;
+	stats.copies++;
+	stats.copy_bytes += rd_len;
+
+	if (rx_offset >= frame->len)
+	{
+		rx_offset = 0;
+		proc_forbid();
+		frame->state = SLOT_FREE;
+		rx_head = (rx_head + 1) % countof(rx_ring);
+		proc_permit();
+	}
+	return rd_len;
+}
+
+uint8_t *eth_getFrameBuf(size_t *len)
+{
+	EthFrame *frame;
+
+	*len = eth_getFrameLen();
+	ASSERT(!rx_offset);
+
+	proc_forbid();
+	frame = &rx_ring[rx_head];
+	frame->state = SLOT_LENT;
+	rx_head = (rx_head + 1) % countof(rx_ring);
+	stats.rx_lent++;
+	proc_permit();
+
+	return frame->data;
+}
+
+void eth_putFrameBuf(uint8_t *buf)
+{
+	EthFrame *frame = (EthFrame *)(buf - offsetof(EthFrame, data));
+
+	ASSERT(frame >= rx_ring && frame < rx_ring + countof(rx_ring));
+	ASSERT(frame->state == SLOT_LENT);
+
+	proc_forbid();
+	frame->state = SLOT_FREE;
+	stats.rx_lent--;
+	proc_permit();
+}
+
+ssize_t eth_recv(uint8_t *buf, size_t len)
+{
+	if (UNLIKELY(!len))
+		return -1;
+	len = MIN(len, eth_getFrameLen());
+	return len ? eth_getFrame(buf, len) : 0;
+}
+
+int eth_init(void)
+{
+	const char *path;
+
+	event_initGeneric(&rx_event);
+	for (size_t i = 0; i < countof(rx_ring); i++)
+		rx_ring[i].state = SLOT_FREE;
+	rx_head = rx_tail = rx_offset = 0;
+	tx_len = 0;
+
+	if ((path = getenv("BERTOS_ETH_CAPTURE")))
+		eth_emul_capture(path);
+	if ((path = getenv("BERTOS_ETH_REPLAY")))
+		eth_emul_replay(path);
+
+	return 0;
+}
+
+#endif /* CONFIG_KERN && CONFIG_KERN_SIGNALS */
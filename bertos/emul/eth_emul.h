@@ -0,0 +1,112 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Ethernet driver emulator for hosted environments.
+ *
+ * Implements the drv/eth.h interface without any network: the emulated
+ * wire can loop the transmitted frames back to the receiver, replay the
+ * frames recorded in a pcap file and record the traffic to a pcap file.
+ * It allows to run the lwIP stack (see netif/ethernetif.h) on the host.
+ *
+ * The driver counts the copies of frame data made by the CPU between the
+ * stack and the driver buffers. The gathering of eth_sendSegs(), that a
+ * controller would do with its DMA, is counted too since here the CPU
+ * does it.
+ *
+ * The environment variables BERTOS_ETH_REPLAY and BERTOS_ETH_CAPTURE,
+ * when set, name the pcap files to replay and to record from eth_init().
+ */
+
+#ifndef EMUL_ETH_EMUL_H
+#define EMUL_ETH_EMUL_H
+
+#include <cfg/compiler.h>
+
+#include <cpu/types.h>
+
+/**
+ * Emulated interface counters.
+ */
+typedef struct EthEmulStats
+{
+	uint32_t tx_frames;   ///< Frames transmitted
+	uint32_t tx_bytes;    ///< Bytes transmitted
+	uint32_t rx_frames;   ///< Frames received, looped back or replayed
+	uint32_t rx_bytes;    ///< Bytes received
+	uint32_t rx_dropped;  ///< Frames lost, the receive queue was full or they were too long
+	uint32_t rx_lent;     ///< Receive buffers currently lent with eth_getFrameBuf()
+	uint32_t copies;      ///< Copies made by the CPU with eth_putFrame(), eth_sendSegs() and eth_getFrame()
+	uint32_t copy_bytes;  ///< Bytes moved by those copies
+} EthEmulStats;
+
+/**
+ * Enable or disable the loopback of transmitted frames.
+ *
+ * When enabled (the default) every frame transmitted is also received,
+ * so the stack can talk to its own address through the whole ethernet
+ * path, ARP included.
+ */
+void eth_emul_setLoopback(bool enable);
+
+/**
+ * Record all the traffic of the interface in the pcap file \a path.
+ *
+ * A previous capture is closed. Pass NULL to stop recording.
+ * \return 0 on success, -1 if the file can't be created.
+ */
+int eth_emul_capture(const char *path);
+
+/**
+ * Receive all the frames recorded in the pcap file \a path.
+ *
+ * Frames are read from the file as soon as there is room in the
+ * receive queue, so they are fed to the stack at the highest rate
+ * it can process them.
+ * \return 0 on success, -1 if the file can't be opened or it is not
+ *         an ethernet capture.
+ */
+int eth_emul_replay(const char *path);
+
+/**
+ * \return true if there is no replay in progress and all the received
+ *         frames have been read by the stack.
+ */
+bool eth_emul_idle(void);
+
+/**
+ * Copy the interface counters in \a stats and clear them if \a reset.
+ *
+ * rx_lent is the current state of the receive ring, it is never cleared.
+ */
+void eth_emul_stats(EthEmulStats *stats, bool reset);
+
+#endif /* EMUL_ETH_EMUL_H */
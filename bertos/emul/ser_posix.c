@@ -32,6 +32,17 @@
  *
  * \brief Serial port emulator for hosted environments.
  *
+ * Each unit is backed by a host serial device: /dev/ttyS0, /dev/ttyS1...
+ * unless the environment variable BERTOS_SER0, BERTOS_SER1... names a
+ * different one.
+ * The UART interrupts are emulated by a timer polling the device once
+ * per tick and moving at most as many characters as the line would
+ * carry at the current baudrate.
+ *
+ * If the device is "loopback", or it can't be opened, the unit works in
+ * loopback mode: every character transmitted is received back on the
+ * same port, as with a loopback plug.
+ *
  * \author Bernie Innocenti <bernie@codewiz.org>
  */
 
@@ -43,13 +54,18 @@
 #include <drv/ser.h>
 #include <drv/ser_p.h>
 
+#include <drv/timer.h>
+
 #include <struct/fifobuf.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 
 #include <fcntl.h> /* open() */
-#include <unistd.h> /* read(), write() */
+#include <unistd.h> /* read(), write(), pipe() */
+#include <stdio.h> /* snprintf() */
+#include <stdlib.h> /* getenv() */
+#include <string.h> /* strcmp() */
 
 
 /* From the high-level serial driver */
@@ -69,38 +85,116 @@ struct EmulSerial
 {
 	struct SerialHardware hw;
 	struct Serial *ser;
-	int fd;
+	int fd;           ///< Transmit side of the device
+	int rx_fd;        ///< Receive side, different from fd in loopback mode
+	unsigned long rate;
+	Timer timer;      ///< Emulated rx/tx interrupts
 };
 
 
+static struct EmulSerial UARTDescs[SER_CNT];
+
+/*
+ * Emulated UART interrupt: transmit and receive the characters
+ * the line would carry in one tick.
+ */
+static void uart_poll(iptr_t arg)
+{
+	struct EmulSerial *hw = (struct EmulSerial *)arg;
+	struct Serial *ser = hw->ser;
+	/* 10 bits per char, including start and stop bits */
+	unsigned long budget = MAX(hw->rate / 10 / TIMER_TICKS_PER_SEC, 1UL);
+	unsigned long n = 0;
+
+	/* Send the data in place, at most two spans */
+	for (int i = 0; i < 2 && n < budget; i++)
+	{
+		size_t len;
+		const unsigned char *data = fifo_peekRead(&ser->txfifo, &len);
+		ssize_t done;
+
+		len = MIN(len, budget - n);
+		if (!len || (done = write(hw->fd, data, len)) <= 0)
+			break;
+		fifo_commitRead(&ser->txfifo, done);
+		n += done;
+	}
+	if (n)
+		ser_txNotify(ser);
+
+	/* Characters left in the device when the fifo is full act as flow control */
+	n = 0;
+	for (int i = 0; i < 2 && n < budget; i++)
+	{
+		size_t len;
+		unsigned char *data = fifo_peekWrite(&ser->rxfifo, &len);
+		ssize_t done;
+
+		len = MIN(len, budget - n);
+		if (!len || (done = read(hw->rx_fd, data, len)) <= 0)
+			break;
+		fifo_commitWrite(&ser->rxfifo, done);
+		n += done;
+	}
+	if (n)
+		ser_rxNotify(ser);
+
+	timer_add(&hw->timer);
+}
+
 /*
  * Callbacks
  */
 static void uart_init(struct SerialHardware *_hw, struct Serial *ser)
 {
 	struct EmulSerial *hw = (struct EmulSerial *)_hw;
+	int unit = hw - UARTDescs;
+	const char *dev;
+	char name[16];
+	int pipefd[2];
 
 	hw->ser = ser;
-	hw->fd = open("/dev/ttyS0", O_RDWR);
+	snprintf(name, sizeof(name), "BERTOS_SER%d", unit);
+	if (!(dev = getenv(name)))
+	{
+		snprintf(name, sizeof(name), "/dev/ttyS%d", unit);
+		dev = name;
+	}
+
+	hw->fd = hw->rx_fd = -1;
+	if (strcmp(dev, "loopback"))
+		hw->fd = hw->rx_fd = open(dev, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if (hw->fd < 0)
+	{
+		TRACEMSG("unit %d in loopback mode", unit);
+		if (pipe(pipefd) == 0)
+		{
+			hw->rx_fd = pipefd[0];
+			hw->fd = pipefd[1];
+			fcntl(hw->rx_fd, F_SETFL, O_NONBLOCK);
+			fcntl(hw->fd, F_SETFL, O_NONBLOCK);
+		}
+	}
+
+	timer_setSoftint(&hw->timer, uart_poll, (iptr_t)hw);
+	timer_setDelay(&hw->timer, 1);
+	timer_add(&hw->timer);
 }
 
-static void uart_cleanup(UNUSED_ARG(struct SerialHardware *, _hw))
+static void uart_cleanup(struct SerialHardware *_hw)
 {
 	struct EmulSerial *hw = (struct EmulSerial *)_hw;
 
+	timer_abort(&hw->timer);
+	if (hw->rx_fd != hw->fd)
+		close(hw->rx_fd);
 	close(hw->fd);
-	hw->fd = -1;
+	hw->fd = hw->rx_fd = -1;
 }
 
-static void uart_txStart(struct SerialHardware * _hw)
+static void uart_txStart(UNUSED_ARG(struct SerialHardware *, _hw))
 {
-	struct EmulSerial *hw = (struct EmulSerial *)_hw;
-
-	while(!fifo_isempty(&hw->ser->txfifo))
-	{
-		char c = fifo_pop(&hw->ser->txfifo);
-		write(hw->fd, &c, 1);
-	}
+	/* Characters are sent by uart_poll() at line speed */
 }
 
 static bool uart_txSending(UNUSED_ARG(struct SerialHardware *, _hw))
@@ -109,11 +203,12 @@ static bool uart_txSending(UNUSED_ARG(struct SerialHardware *, _hw))
 }
 
 
-static void uart_setBaudrate(UNUSED_ARG(struct SerialHardware *, _hw), unsigned long rate)
+static void uart_setBaudrate(struct SerialHardware *_hw, unsigned long rate)
 {
-	TRACEMSG("rate=%lu", rate);
-	// TODO
+	struct EmulSerial *hw = (struct EmulSerial *)_hw;
 
+	TRACEMSG("rate=%lu", rate);
+	hw->rate = rate;
 }
 
 static void uart_setParity(UNUSED_ARG(struct SerialHardware *, _hw), int parity)
@@ -154,9 +249,11 @@ static struct EmulSerial UARTDescs[SER_CNT] =
 			C99INIT(rxbuffer, uart0_rxbuffer),
 			C99INIT(txbuffer_size, sizeof(uart0_txbuffer)),
 			C99INIT(rxbuffer_size, sizeof(uart0_rxbuffer)),
+			C99INIT(notify, true),
 		},
 		C99INIT(ser, NULL),
 		C99INIT(fd, -1),
+		C99INIT(rx_fd, -1),
 	},
 	{
 		C99INIT(hw, /**/) {
@@ -165,9 +262,11 @@ static struct EmulSerial UARTDescs[SER_CNT] =
 			C99INIT(rxbuffer, uart1_rxbuffer),
 			C99INIT(txbuffer_size, sizeof(uart1_txbuffer)),
 			C99INIT(rxbuffer_size, sizeof(uart1_rxbuffer)),
+			C99INIT(notify, true),
 		},
 		C99INIT(ser, NULL),
 		C99INIT(fd, -1),
+		C99INIT(rx_fd, -1),
 	},
 };
 
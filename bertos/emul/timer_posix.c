@@ -73,6 +73,56 @@ static void timer_hw_init(void)
 	setitimer(ITIMER_REAL, &itv, NULL);
 }
 
+#if CONFIG_TIMER_TICKLESS
+
+/// Period of the system tick [us].
+#define TIMER_HW_TICK_US  (1000000 / TIMER_TICKS_PER_SEC)
+
+/// When the periodic tick was stopped.
+static hptime_t tickless_start;
+
+/**
+ * Stop the periodic tick and fire the next interrupt \a ticks ticks from now.
+ *
+ * The tick becomes periodic again after that interrupt.
+ */
+static void timer_hw_sleep(ticks_t ticks)
+{
+	struct itimerval itv =
+	{
+		{ 0, TIMER_HW_TICK_US },                    /* it_interval */
+		{ ticks / TIMER_TICKS_PER_SEC,
+		  (ticks % TIMER_TICKS_PER_SEC) * TIMER_HW_TICK_US } /* it_value */
+	};
+
+	tickless_start = hptime_get();
+	setitimer(ITIMER_REAL, &itv, NULL);
+}
+
+/**
+ * Restart the periodic tick.
+ *
+ * The next interrupt is aligned to the tick boundary, so that the fraction
+ * of tick elapsed while sleeping is not lost.
+ *
+ * \return The number of whole ticks elapsed since timer_hw_sleep().
+ */
+static ticks_t timer_hw_wakeup(void)
+{
+	hptime_t elapsed_us = (hptime_get() - tickless_start)
+		* 1000000 / HPTIME_TICKS_PER_SECOND;
+	struct itimerval itv =
+	{
+		{ 0, TIMER_HW_TICK_US },                                     /* it_interval */
+		{ 0, TIMER_HW_TICK_US - (long)(elapsed_us % TIMER_HW_TICK_US) } /* it_value */
+	};
+
+	setitimer(ITIMER_REAL, &itv, NULL);
+	return (ticks_t)(elapsed_us / TIMER_HW_TICK_US);
+}
+
+#endif /* CONFIG_TIMER_TICKLESS */
+
 static void timer_hw_cleanup(void)
 {
 	static const struct itimerval itv =
@@ -84,9 +134,4 @@ static void timer_hw_cleanup(void)
 	signal(SIGALRM, SIG_DFL);
 }
 
-INLINE hptime_t timer_hw_hpread(void)
-{
-	return hptime_get();
-}
-
 #define timer_hw_triggered() (true)
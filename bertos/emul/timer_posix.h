@@ -52,7 +52,16 @@
 /// Frequency of the hardware high-precision timer.
 #define TIMER_HW_HPTICKS_PER_SEC  HPTIME_TICKS_PER_SECOND
 
+/// Read the high-precision timer.
+INLINE hptime_t timer_hw_hpread(void)
+{
+	return hptime_get();
+}
+
 /// Not needed.
 #define timer_hw_irq() do {} while (0)
 
+/// Longest tickless sleep supported by timer_hw_sleep() [ticks].
+#define TIMER_HW_TICKLESS_MAX  (TIMER_TICKS_PER_SEC * 60L)
+
 #endif /* DRV_TIMER_POSIX_H */
@@ -43,6 +43,7 @@
 #include <cfg/macros.h> /* MIN, MAX */
 #include <cfg/test.h>
 #include <cpu/byteorder.h> /* cpu_to_xx */
+#include <algo/crc.h>
 
 #define LOG_LEVEL       BATTFS_LOG_LEVEL
 #define LOG_FORMAT      BATTFS_LOG_FORMAT
@@ -153,6 +154,35 @@ static bool readHdr(struct BattFsSuper *disk, pgcnt_t page, struct BattFsPageHea
 	return true;
 }
 
+#if CONFIG_BATTFS_INODE_INDEX
+
+/**
+ * Keep the index fill up to date with header \a hdr, if it belongs
+ * to the last page of its file.
+ */
+INLINE void indexSetFill(struct BattFsSuper *disk, struct BattFsPageHeader *hdr)
+{
+	if (hdr->pgoff + 1 == disk->file_pages[hdr->inode])
+		disk->file_fill[hdr->inode] = hdr->fill;
+}
+
+/**
+ * Add a page at the end of file \a inode in the index.
+ */
+static void indexAddPage(struct BattFsSuper *disk, inode_t inode)
+{
+	disk->file_pages[inode]++;
+	for (unsigned i = inode + 1; i < BATTFS_MAX_FILES; i++)
+		disk->file_start[i]++;
+}
+
+#else /* !CONFIG_BATTFS_INODE_INDEX */
+
+#define indexSetFill(disk, hdr)  do { } while (0)
+#define indexAddPage(disk, inode)  do { } while (0)
+
+#endif /* CONFIG_BATTFS_INODE_INDEX */
+
 static bool writeHdr(struct BattFsSuper *disk, pgcnt_t page, struct BattFsPageHeader *hdr)
 {
 	uint8_t buf[BATTFS_HEADER_LEN];
@@ -173,6 +203,23 @@ static bool writeHdr(struct BattFsSuper *disk, pgcnt_t page, struct BattFsPageHe
 		LOG_ERR("writing to buffer\n");
 		return false;
 	}
+	indexSetFill(disk, hdr);
+	return true;
+}
+
+/**
+ * Write the header of the page being written, if some of its
+ * updates have been delayed.
+ * \return true if ok, false on errors.
+ */
+static bool commitHdr(struct BattFsSuper *disk)
+{
+	if (disk->wr_pending)
+	{
+		if (!writeHdr(disk, disk->wr_page, &disk->wr_hdr))
+			return false;
+		disk->wr_pending = false;
+	}
 	return true;
 }
 
@@ -356,15 +403,39 @@ static bool fillPageArray(struct BattFsSuper *disk, pgoff_t *filelen_table)
 }
 
 
+#if CONFIG_BATTFS_INODE_INDEX
 /**
- * Initialize and mount disk described by
- * \a disk.
- * \return false on errors, true otherwise.
+ * Build the inode index from the file lengths in \a filelen_table.
+ * \return true if ok, false on disk read errors.
  */
-bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
+static bool buildIndex(struct BattFsSuper *disk, pgoff_t *filelen_table)
 {
-	pgoff_t filelen_table[BATTFS_MAX_FILES];
+	BattFsPageHeader hdr;
+	pgcnt_t start = 0;
+
+	for (unsigned i = 0; i < BATTFS_MAX_FILES; i++)
+	{
+		disk->file_start[i] = start;
+		disk->file_pages[i] = filelen_table[i];
+		disk->file_fill[i] = 0;
+		start += filelen_table[i];
+
+		if (filelen_table[i])
+		{
+			if (!readHdr(disk, disk->page_array[start - 1], &hdr))
+				return false;
+			disk->file_fill[i] = hdr.fill;
+		}
+	}
+	return true;
+}
+#endif
 
+/*
+ * Initialize the fields of \a disk common to all the mount methods.
+ */
+static void initSuper(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
+{
 	ASSERT(dev);
 	ASSERT(kblock_partialWrite(dev));
 	disk->dev = dev;
@@ -378,11 +449,29 @@ bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_ar
 	disk->page_array = page_array;
 	ASSERT(array_size >= disk->dev->blk_cnt * sizeof(pgcnt_t));
 
-	memset(filelen_table, 0, BATTFS_MAX_FILES * sizeof(pgoff_t));
-
 	disk->free_bytes = 0;
 	disk->disk_size = (disk_size_t)disk->data_size * disk->dev->blk_cnt;
 
+	disk->wr_page = PAGE_UNSET_SENTINEL;
+	disk->wr_pending = false;
+
+	#if CONFIG_BATTFS_WEAR_LEVELING
+		disk->wear = NULL;
+	#endif
+
+	/* Init list for opened files. */
+	LIST_INIT(&disk->file_opened_list);
+}
+
+/*
+ * Build the page allocation array scanning the whole disk.
+ */
+static bool scanDisk(struct BattFsSuper *disk)
+{
+	pgoff_t filelen_table[BATTFS_MAX_FILES];
+
+	memset(filelen_table, 0, BATTFS_MAX_FILES * sizeof(pgoff_t));
+
 	/* Count pages per file */
 	if (!countDiskFilePages(disk, filelen_table))
 	{
@@ -402,22 +491,647 @@ bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_ar
 		LOG_ERR("filling page array\n");
 		return false;
 	}
+	#if CONFIG_BATTFS_INODE_INDEX
+		if (!buildIndex(disk, filelen_table))
+		{
+			LOG_ERR("building inode index\n");
+			return false;
+		}
+	#endif
 	#if LOG_LEVEL >= LOG_LVL_INFO
 		dumpPageArray(disk);
 	#endif
 	#if CONFIG_BATTFS_SHUFFLE_FREE_PAGES
 		SHUFFLE(&disk->page_array[disk->free_page_start], disk->dev->blk_cnt - disk->free_page_start);
 
-		LOG_INFO("Page array after shuffle:\n");
-		#if LOG_LEVEL >= LOG_LVL_INFO
-			dumpPageArray(disk);
-		#endif
+		LOG_INFO("Page array after shuffle:\n");
+		#if LOG_LEVEL >= LOG_LVL_INFO
+			dumpPageArray(disk);
+		#endif
+	#endif
+	return true;
+}
+
+/**
+ * Initialize and mount disk described by
+ * \a disk.
+ * \return false on errors, true otherwise.
+ */
+bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_array, size_t array_size)
+{
+	initSuper(disk, dev, page_array, array_size);
+	#if CONFIG_BATTFS_CHECKPOINT
+		disk->ckp = NULL;
+	#endif
+	return scanDisk(disk);
+}
+
+#if CONFIG_BATTFS_CHECKPOINT || CONFIG_BATTFS_WEAR_LEVELING
+
+/* Helpers for the auxiliary devices, checkpoint and erase counts */
+
+INLINE uint32_t get_le32(const uint8_t *buf)
+{
+	return (uint32_t)buf[3] << 24 | (uint32_t)buf[2] << 16 | (uint32_t)buf[1] << 8 | buf[0];
+}
+
+INLINE void put_le32(uint8_t *buf, uint32_t val)
+{
+	buf[0] = val;
+	buf[1] = val >> 8;
+	buf[2] = val >> 16;
+	buf[3] = val >> 24;
+}
+
+/*
+ * Read or write \a len bytes at \a addr of device \a b, starting from block \a base.
+ */
+static bool auxTransfer(KBlock *b, block_idx_t base, disk_size_t addr, void *_buf, size_t len, bool write)
+{
+	uint8_t *buf = (uint8_t *)_buf;
+
+	while (len)
+	{
+		block_idx_t idx = base + addr / b->blk_size;
+		size_t offset = addr % b->blk_size;
+		size_t size = MIN(len, b->blk_size - offset);
+
+		if ((write ? kblock_write(b, idx, buf, offset, size) : kblock_read(b, idx, buf, offset, size)) != size)
+		{
+			LOG_ERR("%s error, block %ld\n", write ? "write" : "read", (long)idx);
+			return false;
+		}
+		addr += size;
+		buf += size;
+		len -= size;
+	}
+	return true;
+}
+
+#endif
+
+#if CONFIG_BATTFS_CHECKPOINT
+
+/*
+ * Checkpoint slot layout, little endian:
+ * magic (4), generation (4), page count (2), free_page_start (2),
+ * free_bytes (4), index entries (2), crc (2), state (1), followed by
+ * the page allocation array, 2 bytes per page, and by the inode index,
+ * if enabled: page count and last page fill of each file, 2 bytes each.
+ * The crc covers everything but itself and the state, which is changed
+ * in place clearing bits, as flash memories allow.
+ */
+#define CKP_MAGIC     0x4B434642UL /* "BFCK" */
+#define CKP_INDEX_POS 16
+#define CKP_CRC_POS   18
+#define CKP_STATE_POS 20
+#define CKP_HDR_LEN   21
+
+#if CONFIG_BATTFS_INODE_INDEX
+	#define CKP_INDEX_FILES BATTFS_MAX_FILES
+#else
+	#define CKP_INDEX_FILES 0
+#endif
+
+#define CKP_CLEAN 0xFF ///< The disk is exactly as described.
+#define CKP_DIRTY 0x0F ///< Pages free in the checkpoint may have been written.
+#define CKP_STALE 0x00 ///< Too many pages written, the checkpoint is useless.
+
+/* Page array entries converted at a time */
+#define CKP_CHUNK 16
+
+/* Checkpoint device blocks used by each slot */
+static block_idx_t ckpSlotBlocks(struct BattFsSuper *disk)
+{
+	return DIV_ROUNDUP(CKP_HDR_LEN + (disk_size_t)disk->dev->blk_cnt * 2 + CKP_INDEX_FILES * 4,
+		disk->ckp->blk_size);
+}
+
+/*
+ * Read or write \a len bytes at \a addr inside checkpoint \a slot.
+ */
+static bool ckpTransfer(struct BattFsSuper *disk, uint8_t slot, disk_size_t addr, void *buf, size_t len, bool write)
+{
+	return auxTransfer(disk->ckp, slot * ckpSlotBlocks(disk), addr, buf, len, write);
+}
+
+static bool ckpSetState(struct BattFsSuper *disk, uint8_t slot, uint8_t state)
+{
+	if (!ckpTransfer(disk, slot, CKP_STATE_POS, &state, 1, true)
+		|| kblock_flush(disk->ckp) != 0)
+		return false;
+	if (slot == disk->ckp_slot)
+		disk->ckp_state = state;
+	return true;
+}
+
+/*
+ * Called before a free page is used.
+ * The first page taken after a checkpoint makes it dirty: on mount the
+ * pages free in the checkpoint will be read again. Since pages are taken
+ * from the start of the free list and released at its end, these are
+ * all the pages that can change until the free list of the checkpoint
+ * has been used up; from then on the checkpoint is stale.
+ */
+static bool ckpAllocate(struct BattFsSuper *disk)
+{
+	if (!disk->ckp || disk->ckp_state == CKP_STALE)
+		return true;
+
+	if (disk->ckp_state == CKP_CLEAN && !ckpSetState(disk, disk->ckp_slot, CKP_DIRTY))
+		return false;
+
+	if (disk->ckp_allocs++ == disk->ckp_free)
+		return ckpSetState(disk, disk->ckp_slot, CKP_STALE);
+	return true;
+}
+
+/*
+ * Called before a page in use is written in place, as on unbuffered
+ * devices: the replay reads only the pages free in the checkpoint, so
+ * the new header would be lost and the checkpoint is stale.
+ */
+static bool ckpRewrite(struct BattFsSuper *disk)
+{
+	if (!disk->ckp || disk->ckp_state == CKP_STALE)
+		return true;
+
+	return ckpSetState(disk, disk->ckp_slot, CKP_STALE);
+}
+
+bool battfs_checkpoint(struct BattFsSuper *disk)
+{
+	uint8_t hdr[CKP_HDR_LEN];
+	uint8_t buf[CKP_CHUNK * 2];
+	uint8_t slot = disk->ckp_slot ^ 1;
+	uint16_t crc = 0;
+
+	if (!commitHdr(disk))
+		return false;
+
+	if (!disk->ckp || disk->ckp_state == CKP_CLEAN)
+		return true;
+
+	/* The disk must be as described before the checkpoint is written */
+	if (kblock_flush(disk->dev) != 0)
+		return false;
+
+	put_le32(&hdr[0], CKP_MAGIC);
+	put_le32(&hdr[4], disk->ckp_gen + 1);
+	hdr[8] = disk->dev->blk_cnt;
+	hdr[9] = disk->dev->blk_cnt >> 8;
+	hdr[10] = disk->free_page_start;
+	hdr[11] = disk->free_page_start >> 8;
+	put_le32(&hdr[12], disk->free_bytes);
+	hdr[CKP_INDEX_POS] = CKP_INDEX_FILES & 0xFF;
+	hdr[CKP_INDEX_POS + 1] = CKP_INDEX_FILES >> 8;
+	crc = crc16(crc, hdr, CKP_CRC_POS);
+
+	for (pgcnt_t i = 0; i < disk->dev->blk_cnt; i += CKP_CHUNK)
+	{
+		pgcnt_t n = MIN((pgcnt_t)CKP_CHUNK, (pgcnt_t)(disk->dev->blk_cnt - i));
+
+		for (pgcnt_t j = 0; j < n; j++)
+		{
+			buf[j * 2] = disk->page_array[i + j];
+			buf[j * 2 + 1] = disk->page_array[i + j] >> 8;
+		}
+		crc = crc16(crc, buf, n * 2);
+		if (!ckpTransfer(disk, slot, CKP_HDR_LEN + (disk_size_t)i * 2, buf, n * 2, true))
+			return false;
+	}
+
+	#if CONFIG_BATTFS_INODE_INDEX
+		/* The file starts follow from the number of pages */
+		disk_size_t addr = CKP_HDR_LEN + (disk_size_t)disk->dev->blk_cnt * 2;
+		for (unsigned i = 0; i < BATTFS_MAX_FILES; i += CKP_CHUNK / 2)
+		{
+			for (unsigned j = 0; j < CKP_CHUNK / 2; j++)
+			{
+				buf[j * 4] = disk->file_pages[i + j];
+				buf[j * 4 + 1] = disk->file_pages[i + j] >> 8;
+				buf[j * 4 + 2] = disk->file_fill[i + j];
+				buf[j * 4 + 3] = disk->file_fill[i + j] >> 8;
+			}
+			crc = crc16(crc, buf, sizeof(buf));
+			if (!ckpTransfer(disk, slot, addr, buf, sizeof(buf), true))
+				return false;
+			addr += sizeof(buf);
+		}
+	#endif
+
+	hdr[CKP_CRC_POS] = crc;
+	hdr[CKP_CRC_POS + 1] = crc >> 8;
+	hdr[CKP_STATE_POS] = CKP_CLEAN;
+	if (!ckpTransfer(disk, slot, 0, hdr, CKP_HDR_LEN, true)
+		|| kblock_flush(disk->ckp) != 0)
+		return false;
+
+	/* The new checkpoint is in place, the previous one must not be used anymore */
+	if (disk->ckp_gen && !ckpSetState(disk, disk->ckp_slot, CKP_STALE))
+		return false;
+
+	LOG_INFO("checkpoint %ld written in slot %d\n", (long)disk->ckp_gen + 1, slot);
+	disk->ckp_gen++;
+	disk->ckp_slot = slot;
+	disk->ckp_state = CKP_CLEAN;
+	disk->ckp_free = disk->dev->blk_cnt - disk->free_page_start;
+	disk->ckp_allocs = 0;
+	/* The next write to the last page must make the checkpoint stale again */
+	disk->wr_page = PAGE_UNSET_SENTINEL;
+	return true;
+}
+
+/*
+ * Load the page allocation array from checkpoint \a slot.
+ * \return true if the checkpoint is valid.
+ */
+static bool ckpLoad(struct BattFsSuper *disk, uint8_t slot, uint8_t *hdr)
+{
+	uint8_t buf[CKP_CHUNK * 2];
+	uint16_t crc = crc16(0, hdr, CKP_CRC_POS);
+
+	for (pgcnt_t i = 0; i < disk->dev->blk_cnt; i += CKP_CHUNK)
+	{
+		pgcnt_t n = MIN((pgcnt_t)CKP_CHUNK, (pgcnt_t)(disk->dev->blk_cnt - i));
+
+		if (!ckpTransfer(disk, slot, CKP_HDR_LEN + (disk_size_t)i * 2, buf, n * 2, false))
+			return false;
+		crc = crc16(crc, buf, n * 2);
+		for (pgcnt_t j = 0; j < n; j++)
+			disk->page_array[i + j] = buf[j * 2 + 1] << 8 | buf[j * 2];
+	}
+
+	#if CONFIG_BATTFS_INODE_INDEX
+		disk_size_t addr = CKP_HDR_LEN + (disk_size_t)disk->dev->blk_cnt * 2;
+		pgcnt_t start = 0;
+		for (unsigned i = 0; i < BATTFS_MAX_FILES; i += CKP_CHUNK / 2)
+		{
+			if (!ckpTransfer(disk, slot, addr, buf, sizeof(buf), false))
+				return false;
+			crc = crc16(crc, buf, sizeof(buf));
+			addr += sizeof(buf);
+			for (unsigned j = 0; j < CKP_CHUNK / 2; j++)
+			{
+				disk->file_start[i + j] = start;
+				disk->file_pages[i + j] = buf[j * 4 + 1] << 8 | buf[j * 4];
+				disk->file_fill[i + j] = buf[j * 4 + 3] << 8 | buf[j * 4 + 2];
+				start += disk->file_pages[i + j];
+			}
+		}
+	#endif
+
+	if (crc != (uint16_t)(hdr[CKP_CRC_POS + 1] << 8 | hdr[CKP_CRC_POS]))
+	{
+		LOG_WARN("checkpoint in slot %d corrupted\n", slot);
+		return false;
+	}
+
+	disk->free_page_start = hdr[11] << 8 | hdr[10];
+	disk->free_bytes = get_le32(&hdr[12]);
+	return disk->free_page_start <= disk->dev->blk_cnt && disk->free_bytes <= disk->disk_size;
+}
+
+static bool findFile(BattFsSuper *disk, inode_t inode, pgcnt_t *last);
+
+/*
+ * Merge in the page allocation array the pages written after a dirty
+ * checkpoint, like fillPageArray() does.
+ * They can only be among the free ones, and they have been taken
+ * in order, so each page of a file follows the previous one.
+ * \return false on disk read errors or if the pages are not as expected.
+ */
+static bool ckpReplay(struct BattFsSuper *disk)
+{
+	BattFsPageHeader hdr, prv;
+	pgcnt_t pos;
+
+	for (pgcnt_t i = disk->free_page_start; i < disk->dev->blk_cnt; i++)
+	{
+		pgcnt_t page = disk->page_array[i];
+
+		if (!readHdr(disk, page, &hdr))
+			return false;
+		if (hdr.fcs != computeFcs(&hdr))
+			continue;
+
+		bool found = findFile(disk, hdr.inode, &pos);
+		pos += hdr.pgoff;
+		if (!found && hdr.pgoff)
+			return false;
+
+		if (found && pos < disk->free_page_start)
+		{
+			if (!readHdr(disk, disk->page_array[pos], &prv))
+				return false;
+			if (prv.inode == hdr.inode)
+			{
+				if (prv.pgoff != hdr.pgoff)
+					return false;
+				/* Same page, the newest one wins */
+				if (hdr.seq > prv.seq)
+				{
+					disk->page_array[i] = disk->page_array[pos];
+					disk->page_array[pos] = page;
+					disk->free_bytes += prv.fill;
+					disk->free_bytes -= hdr.fill;
+					indexSetFill(disk, &hdr);
+				}
+				continue;
+			}
+		}
+
+		/* A new page at the end of the file */
+		if (hdr.pgoff)
+		{
+			if (!readHdr(disk, disk->page_array[pos - 1], &prv))
+				return false;
+			if (prv.inode != hdr.inode || prv.pgoff != hdr.pgoff - 1)
+				return false;
+		}
+		LOG_INFO("replay page %d, inode %d, pgoff %d\n", page, hdr.inode, hdr.pgoff);
+		memmove(&disk->page_array[pos + 1], &disk->page_array[pos], (i - pos) * sizeof(pgcnt_t));
+		disk->page_array[pos] = page;
+		disk->free_page_start++;
+		disk->free_bytes -= hdr.fill;
+		indexAddPage(disk, hdr.inode);
+		indexSetFill(disk, &hdr);
+	}
+	return true;
+}
+
+bool battfs_mountCheckpoint(struct BattFsSuper *disk, struct KBlock *dev, struct KBlock *ckp,
+	pgcnt_t *page_array, size_t array_size)
+{
+	uint8_t hdr[2][CKP_HDR_LEN];
+	bool valid[2];
+
+	initSuper(disk, dev, page_array, array_size);
+	ASSERT(ckp);
+	ASSERT(kblock_partialWrite(ckp));
+	disk->ckp = ckp;
+	ASSERT(ckp->blk_cnt >= 2 * ckpSlotBlocks(disk));
+
+	/* Nothing valid found: the first checkpoint goes to slot 0 */
+	disk->ckp_gen = 0;
+	disk->ckp_slot = 1;
+	disk->ckp_state = CKP_STALE;
+
+	for (uint8_t slot = 0; slot < 2; slot++)
+		valid[slot] = ckpTransfer(disk, slot, 0, hdr[slot], CKP_HDR_LEN, false)
+			&& get_le32(&hdr[slot][0]) == CKP_MAGIC
+			&& (pgcnt_t)(hdr[slot][9] << 8 | hdr[slot][8]) == dev->blk_cnt
+			&& (hdr[slot][CKP_INDEX_POS + 1] << 8 | hdr[slot][CKP_INDEX_POS]) == CKP_INDEX_FILES;
+
+	/* Try the newest checkpoint first */
+	uint8_t first = (valid[1] && (!valid[0] || get_le32(&hdr[1][4]) > get_le32(&hdr[0][4]))) ? 1 : 0;
+
+	for (uint8_t n = 0; n < 2; n++)
+	{
+		uint8_t slot = first ^ n;
+
+		if (!valid[slot] || !ckpLoad(disk, slot, hdr[slot]))
+			continue;
+
+		disk->ckp_gen = get_le32(&hdr[slot][4]);
+		disk->ckp_slot = slot;
+		disk->ckp_state = hdr[slot][CKP_STATE_POS];
+		LOG_INFO("checkpoint %ld in slot %d, state %02x\n", (long)disk->ckp_gen, slot, disk->ckp_state);
+
+		if (disk->ckp_state == CKP_CLEAN)
+		{
+			disk->ckp_free = dev->blk_cnt - disk->free_page_start;
+			disk->ckp_allocs = 0;
+			return true;
+		}
+		if (disk->ckp_state == CKP_DIRTY)
+		{
+			if (!ckpReplay(disk))
+			{
+				LOG_WARN("checkpoint replay failed\n");
+				break;
+			}
+			/* Pages freed by the replay are not in the old free list */
+			return battfs_checkpoint(disk);
+		}
+		break;
+	}
+
+	LOG_INFO("no usable checkpoint, scanning the disk\n");
+	disk->free_bytes = 0;
+	disk->ckp_state = CKP_STALE;
+	return scanDisk(disk);
+}
+
+#else /* !CONFIG_BATTFS_CHECKPOINT */
+
+#define ckpAllocate(disk)  (true)
+#define ckpRewrite(disk)  (true)
+#define battfs_checkpoint(disk)  (true)
+
+#endif /* CONFIG_BATTFS_CHECKPOINT */
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+
+/*
+ * Erase count slot layout, little endian:
+ * magic (4), generation (4), page count (2), crc (2), followed by
+ * the erase count of each page, 4 bytes each. The crc covers the counts.
+ */
+#define WEAR_MAGIC   0x4C574642UL /* "BFWL" */
+#define WEAR_CRC_POS 10
+#define WEAR_HDR_LEN 12
+
+/* Erase counts converted at a time */
+#define WEAR_CHUNK 16
+
+/* Free pages searched for the least worn one when a page is needed */
+#define WEAR_LOOKAHEAD 8
+
+/* Pages sorted and pages checked by each battfs_gcStep() */
+#define GC_STEP_PAGES 16
+
+/* Erase count device blocks used by each slot */
+static block_idx_t wearSlotBlocks(struct BattFsSuper *disk)
+{
+	return DIV_ROUNDUP(WEAR_HDR_LEN + (disk_size_t)disk->dev->blk_cnt * 4, disk->wear->blk_size);
+}
+
+static bool wearTransfer(struct BattFsSuper *disk, uint8_t slot, disk_size_t addr, void *buf, size_t len, bool write)
+{
+	return auxTransfer(disk->wear, slot * wearSlotBlocks(disk), addr, buf, len, write);
+}
+
+/*
+ * Load the erase counts from \a slot, their generation is put in \a gen.
+ * \return true if they are valid.
+ */
+static bool wearLoad(struct BattFsSuper *disk, uint8_t slot, uint32_t *gen)
+{
+	uint8_t hdr[WEAR_HDR_LEN];
+	uint8_t buf[WEAR_CHUNK * 4];
+	uint16_t crc = 0;
+
+	if (!wearTransfer(disk, slot, 0, hdr, WEAR_HDR_LEN, false)
+		|| get_le32(&hdr[0]) != WEAR_MAGIC
+		|| (pgcnt_t)(hdr[9] << 8 | hdr[8]) != disk->dev->blk_cnt)
+		return false;
+
+	for (pgcnt_t i = 0; i < disk->dev->blk_cnt; i += WEAR_CHUNK)
+	{
+		pgcnt_t n = MIN((pgcnt_t)WEAR_CHUNK, (pgcnt_t)(disk->dev->blk_cnt - i));
+
+		if (!wearTransfer(disk, slot, WEAR_HDR_LEN + (disk_size_t)i * 4, buf, n * 4, false))
+			return false;
+		crc = crc16(crc, buf, n * 4);
+		for (pgcnt_t j = 0; j < n; j++)
+			disk->erase_cnt[i + j] = get_le32(&buf[j * 4]);
+	}
+	*gen = get_le32(&hdr[4]);
+	return crc == (uint16_t)(hdr[WEAR_CRC_POS + 1] << 8 | hdr[WEAR_CRC_POS]);
+}
+
+/*
+ * Save the erase counts in the slot not holding the last ones.
+ * The header is written last, so the previous counts are still
+ * there if the save is interrupted.
+ */
+static bool wearSave(struct BattFsSuper *disk)
+{
+	uint8_t hdr[WEAR_HDR_LEN];
+	uint8_t buf[WEAR_CHUNK * 4];
+	uint8_t slot = disk->wear_slot ^ 1;
+	uint16_t crc = 0;
+
+	for (pgcnt_t i = 0; i < disk->dev->blk_cnt; i += WEAR_CHUNK)
+	{
+		pgcnt_t n = MIN((pgcnt_t)WEAR_CHUNK, (pgcnt_t)(disk->dev->blk_cnt - i));
+
+		for (pgcnt_t j = 0; j < n; j++)
+			put_le32(&buf[j * 4], disk->erase_cnt[i + j]);
+		crc = crc16(crc, buf, n * 4);
+		if (!wearTransfer(disk, slot, WEAR_HDR_LEN + (disk_size_t)i * 4, buf, n * 4, true))
+			return false;
+	}
+
+	put_le32(&hdr[0], WEAR_MAGIC);
+	put_le32(&hdr[4], disk->wear_gen + 1);
+	hdr[8] = disk->dev->blk_cnt;
+	hdr[9] = disk->dev->blk_cnt >> 8;
+	hdr[WEAR_CRC_POS] = crc;
+	hdr[WEAR_CRC_POS + 1] = crc >> 8;
+	if (!wearTransfer(disk, slot, 0, hdr, WEAR_HDR_LEN, true)
+		|| kblock_flush(disk->wear) != 0)
+		return false;
+
+	LOG_INFO("erase counts %ld saved in slot %d\n", (long)disk->wear_gen + 1, slot);
+	disk->wear_gen++;
+	disk->wear_slot = slot;
+	disk->wear_unsaved = 0;
+	return true;
+}
+
+bool battfs_wearInit(struct BattFsSuper *disk, struct KBlock *wear, erase_cnt_t *erase_cnt, size_t size)
+{
+	uint32_t gen[2];
+	bool valid[2];
+
+	ASSERT(wear);
+	ASSERT(erase_cnt);
+	ASSERT(size >= disk->dev->blk_cnt * sizeof(erase_cnt_t));
+
+	disk->wear = wear;
+	disk->erase_cnt = erase_cnt;
+	ASSERT(wearSlotBlocks(disk) * 2 <= wear->blk_cnt);
+
+	disk->wear_unsaved = 0;
+	disk->gc_free = 0;
+	disk->gc_used = 0;
+	disk->gc_cold = PAGE_UNSET_SENTINEL;
+
+	valid[0] = wearLoad(disk, 0, &gen[0]);
+	valid[1] = wearLoad(disk, 1, &gen[1]);
+
+	if (valid[1] && (!valid[0] || gen[1] > gen[0]))
+	{
+		disk->wear_slot = 1;
+		disk->wear_gen = gen[1];
+		return true;
+	}
+	if (valid[0])
+	{
+		disk->wear_slot = 0;
+		disk->wear_gen = gen[0];
+		/* Slot 1 has been loaded after it */
+		return wearLoad(disk, 0, &gen[0]);
+	}
+
+	LOG_INFO("no erase counts, starting from 0\n");
+	memset(erase_cnt, 0, disk->dev->blk_cnt * sizeof(erase_cnt_t));
+	disk->wear_slot = 1;
+	disk->wear_gen = 0;
+	return true;
+}
+
+/*
+ * Number of pages at the start of the free list that can be used
+ * in any order.
+ */
+static pgcnt_t wearWindow(struct BattFsSuper *disk)
+{
+	pgcnt_t free = disk->dev->blk_cnt - disk->free_page_start;
+
+	#if CONFIG_BATTFS_CHECKPOINT
+		/*
+		 * The pages free in the checkpoint must be used before
+		 * the ones freed after it, see ckpAllocate().
+		 */
+		if (disk->ckp && disk->ckp_state != CKP_STALE)
+			free = MIN(free, (pgcnt_t)(disk->ckp_free - disk->ckp_allocs));
 	#endif
-	/* Init list for opened files. */
-	LIST_INIT(&disk->file_opened_list);
-	return true;
+	return free;
+}
+
+/*
+ * Move the free page at position \a pos of the free list to its start,
+ * where it is taken by the caller, and count its erase.
+ */
+static void wearTake(struct BattFsSuper *disk, pgcnt_t pos)
+{
+	pgcnt_t *free_list = &disk->page_array[disk->free_page_start];
+
+	if (pos)
+		SWAP(free_list[0], free_list[pos]);
+	disk->erase_cnt[free_list[0]]++;
+	disk->wear_unsaved++;
+}
+
+/*
+ * Called before the first free page is used: take the least worn
+ * of the first ones instead.
+ * battfs_gcStep() keeps the free list sorted, so the search is short.
+ */
+static void wearAllocate(struct BattFsSuper *disk)
+{
+	pgcnt_t *free_list = &disk->page_array[disk->free_page_start];
+	pgcnt_t window = MIN(wearWindow(disk), (pgcnt_t)WEAR_LOOKAHEAD);
+	pgcnt_t best = 0;
+
+	if (!disk->wear)
+		return;
+
+	for (pgcnt_t i = 1; i < window; i++)
+		if (disk->erase_cnt[free_list[i]] < disk->erase_cnt[free_list[best]])
+			best = i;
+	wearTake(disk, best);
 }
 
+#else /* !CONFIG_BATTFS_WEAR_LEVELING */
+
+#define wearAllocate(disk)  do { } while (0)
+
+#endif /* CONFIG_BATTFS_WEAR_LEVELING */
+
 /**
  * Check the filesystem.
  * \return true if ok, false on errors.
@@ -429,6 +1143,8 @@ bool battfs_fsck(struct BattFsSuper *disk)
 	FSCHECK(disk->free_page_start <= disk->dev->blk_cnt);
 	FSCHECK(disk->data_size < disk->dev->blk_size);
 	FSCHECK(disk->free_bytes <= disk->disk_size);
+	/* The delayed header updates are already accounted in free_bytes */
+	FSCHECK(commitHdr(disk));
 
 	disk_size_t free_bytes = 0;
 	BattFsPageHeader hdr, prev_hdr;
@@ -473,6 +1189,24 @@ bool battfs_fsck(struct BattFsSuper *disk)
 	FSCHECK(page_used == disk->free_page_start);
 	FSCHECK(free_bytes == disk->free_bytes);
 
+	#if CONFIG_BATTFS_INODE_INDEX
+		pgcnt_t file_start = 0;
+		for (unsigned i = 0; i < BATTFS_MAX_FILES; i++)
+		{
+			FSCHECK(disk->file_start[i] == file_start);
+			if (disk->file_pages[i])
+			{
+				FSCHECK(readHdr(disk, disk->page_array[file_start], &hdr));
+				FSCHECK(hdr.inode == i && hdr.pgoff == 0);
+				file_start += disk->file_pages[i];
+				FSCHECK(readHdr(disk, disk->page_array[file_start - 1], &hdr));
+				FSCHECK(hdr.inode == i && hdr.pgoff + 1 == disk->file_pages[i]);
+				FSCHECK(hdr.fill == disk->file_fill[i]);
+			}
+		}
+		FSCHECK(file_start == disk->free_page_start);
+	#endif
+
 	return true;
 }
 
@@ -484,7 +1218,7 @@ static int battfs_flush(struct KFile *fd)
 {
 	BattFs *fdb = BATTFS_CAST(fd);
 
-	if (kblock_flush(fdb->disk->dev) == 0)
+	if (commitHdr(fdb->disk) && kblock_flush(fdb->disk->dev) == 0 && battfs_checkpoint(fdb->disk))
 		return 0;
 	else
 	{
@@ -520,6 +1254,10 @@ static pgcnt_t allocateNewPage(struct BattFsSuper *disk, pgcnt_t new_pos, inode_
 		return NO_SPACE;
 	}
 
+	if (!ckpAllocate(disk))
+		return NO_SPACE;
+	wearAllocate(disk);
+
 	LOG_INFO("Getting new page %d, pos %d\n", disk->page_array[disk->free_page_start], new_pos);
 	pgcnt_t new_page = disk->page_array[disk->free_page_start++];
 	memmove(&disk->page_array[new_pos + 1], &disk->page_array[new_pos], (disk->free_page_start - new_pos - 1) * sizeof(pgcnt_t));
@@ -537,17 +1275,15 @@ static pgcnt_t allocateNewPage(struct BattFsSuper *disk, pgcnt_t new_pos, inode_
 	}
 
 	disk->page_array[new_pos] = new_page;
+	indexAddPage(disk, inode);
 	return new_page;
 }
 
-static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_pos)
+/*
+ * Take the first free page and put page \a old_pos at the end of the free list.
+ */
+static pgcnt_t replacePage(struct BattFsSuper *disk, pgcnt_t old_pos)
 {
-	if (SPACE_OVER(disk))
-	{
-		LOG_ERR("No disk space available!\n");
-		return NO_SPACE;
-	}
-
 	/* Get a free page */
 	pgcnt_t new_page = disk->page_array[disk->free_page_start];
 	movePages(disk, disk->free_page_start + 1, -1);
@@ -558,207 +1294,324 @@ static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_pos)
 	return new_page;
 }
 
-/**
- * Write to file \a fd \a size bytes from \a buf.
- * \return The number of bytes written.
+static pgcnt_t renewPage(struct BattFsSuper *disk, pgcnt_t old_pos)
+{
+	if (SPACE_OVER(disk))
+	{
+		LOG_ERR("No disk space available!\n");
+		return NO_SPACE;
+	}
+
+	if (!ckpAllocate(disk))
+		return NO_SPACE;
+	wearAllocate(disk);
+
+	return replacePage(disk, old_pos);
+}
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+
+/*
+ * Move the data of page array position \a pos to the last free page
+ * that can be used, if it is worn enough.
+ * The free list is sorted by battfs_gcStep(), so it is one of the most worn.
  */
-static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
+static bool gcMove(struct BattFsSuper *disk, pgcnt_t pos, pgcnt_t window)
 {
-	BattFs *fdb = BATTFS_CAST(fd);
-	BattFsSuper *disk = fdb->disk;
-	const uint8_t *buf = (const uint8_t *)_buf;
+	BattFsPageHeader hdr;
+	pgcnt_t old_page = disk->page_array[pos];
+	pgcnt_t new_page = disk->page_array[disk->free_page_start + window - 1];
 
-	size_t total_write = 0;
-	pgoff_t pg_offset;
-	pgaddr_t addr_offset;
-	pgaddr_t wr_len;
-	BattFsPageHeader curr_hdr;
-	pgcnt_t new_page;
+	if (disk->erase_cnt[new_page] <= disk->erase_cnt[old_page] + CONFIG_BATTFS_WEAR_THRESHOLD)
+		return true;
 
-	if (fd->seek_pos < 0)
+	LOG_INFO("moving page %d to page %d\n", old_page, new_page);
+	/* The page may be the one being written */
+	if (!commitHdr(disk) || !readHdr(disk, old_page, &hdr) || !ckpAllocate(disk))
+		return false;
+	wearTake(disk, window - 1);
+	replacePage(disk, old_page);
+
+	hdr.seq++;
+	if (kblock_copy(disk->dev, old_page, new_page) != 0
+		|| !writeHdr(disk, new_page, &hdr))
+		return false;
+	disk->page_array[pos] = new_page;
+	return true;
+}
+
+bool battfs_gcStep(struct BattFsSuper *disk)
+{
+	pgcnt_t *free_list = &disk->page_array[disk->free_page_start];
+	pgcnt_t window = wearWindow(disk);
+
+	if (!disk->wear)
+		return true;
+
+	/* Bubble the least worn free pages towards the start of the free list */
+	for (int i = 0; i < GC_STEP_PAGES && window > 1; i++)
 	{
-		fdb->errors |= BATTFS_NEGATIVE_SEEK_ERR;
-		return total_write;
+		if (disk->gc_free == 0 || disk->gc_free >= window)
+			disk->gc_free = window - 1;
+		if (disk->erase_cnt[free_list[disk->gc_free]] < disk->erase_cnt[free_list[disk->gc_free - 1]])
+			SWAP(free_list[disk->gc_free], free_list[disk->gc_free - 1]);
+		disk->gc_free--;
+	}
+
+	/* Look for the least worn page holding data */
+	for (int i = 0; i < GC_STEP_PAGES && disk->gc_used < disk->free_page_start; i++, disk->gc_used++)
+	{
+		if (disk->gc_cold == PAGE_UNSET_SENTINEL
+			|| disk->erase_cnt[disk->page_array[disk->gc_used]] < disk->erase_cnt[disk->page_array[disk->gc_cold]])
+			disk->gc_cold = disk->gc_used;
+	}
+
+	if (disk->gc_used >= disk->free_page_start)
+	{
+		/* The page array may have changed since: any page holding data will do */
+		if (disk->gc_cold < disk->free_page_start && window
+			&& !gcMove(disk, disk->gc_cold, window))
+			return false;
+		disk->gc_used = 0;
+		disk->gc_cold = PAGE_UNSET_SENTINEL;
 	}
 
-	if (fd->seek_pos > fd->size)
+	if (disk->wear_unsaved >= CONFIG_BATTFS_WEAR_THRESHOLD)
+		return wearSave(disk);
+	return true;
+}
+
+#endif /* CONFIG_BATTFS_WEAR_LEVELING */
+
+/* Zeros written in the holes left seeking past the end of a file. */
+static const uint8_t zero_fill[32];
+
+/**
+ * Take \a page in the device cache without reading it from the disk,
+ * because all its content is going to be replaced.
+ * The cached page is flushed and the cache is just relabeled, so the
+ * caller must overwrite the header of \a page before the cache is
+ * flushed again.
+ * \return true if ok, false on errors.
+ */
+static bool claimPage(struct BattFsSuper *disk, pgcnt_t page)
+{
+	if (!kblock_buffered(disk->dev))
+		return true;
+
+	if (kblock_flush(disk->dev) != 0)
+		return false;
+	return kblock_copy(disk->dev, kblock_cachedBlock(disk->dev), page) == 0;
+}
+
+/**
+ * Write \a len bytes from \a buf at \a addr in page \a pgoff of file \a fdb.
+ * If \a buf is NULL the bytes are filled with 0s.
+ *
+ * The page being written is kept in disk->wr_page: as long as the
+ * file keeps writing it (and it is still dirty in the device cache)
+ * the data are only combined in the cache and the header is updated
+ * once, when the page is full, when another page is written or when
+ * the file is flushed. Moving to another page renews it, as usual,
+ * but its old content is not read if it is entirely overwritten.
+ *
+ * \return true if ok, false on errors.
+ */
+static bool writePage(BattFs *fdb, pgoff_t pgoff, pgaddr_t addr, const uint8_t *buf, pgaddr_t len)
+{
+	BattFsSuper *disk = fdb->disk;
+	BattFsPageHeader *hdr = &disk->wr_hdr;
+	pgcnt_t page = disk->wr_page;
+	bool new_hdr = true;
+
+	if (pgoff > fdb->max_off)
 	{
-		if (!readHdr(disk, fdb->start[fdb->max_off], &curr_hdr))
+		/* Write outside EOF */
+		ASSERT(pgoff == fdb->max_off + 1);
+		LOG_INFO("New page needed, pg_offset %d, pos %d\n", pgoff, (int)((fdb->start - disk->page_array) + pgoff));
+
+		if (!commitHdr(disk))
 		{
-			fdb->errors |= BATTFS_DISK_READ_ERR;
-			return total_write;
+			fdb->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
 		}
+		/* wr_hdr is reused for the new page */
+		disk->wr_page = PAGE_UNSET_SENTINEL;
 
-		/*
-		 * Renew page only if is not in cache.
-		 * This avoids rewriting the same page continuously
-		 * if the user code keeps writing in the same portion
-		 * of the file.
-		 */
-		if (kblock_buffered(disk->dev)
-			&& ((fdb->start[fdb->max_off] != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
+		page = allocateNewPage(disk, (fdb->start - disk->page_array) + pgoff, fdb->inode);
+		if (page == NO_SPACE)
 		{
-			new_page = renewPage(disk, fdb->start[fdb->max_off]);
-			if (new_page == NO_SPACE)
-			{
-				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
-				return total_write;
-			}
-
-			kblock_copy(disk->dev, fdb->start[fdb->max_off], new_page);
-			fdb->start[fdb->max_off] = new_page;
+			fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
+			return false;
 		}
-		else
-			new_page = fdb->start[fdb->max_off];
+		fdb->max_off = pgoff;
 
-		/* Fill unused space of first page with 0s */
-		uint8_t dummy = 0;
-		// TODO: write in blocks to speed up things
-		pgaddr_t zero_bytes = MIN(fd->seek_pos - fd->size, (kfile_off_t)(disk->data_size - curr_hdr.fill));
-		while (zero_bytes--)
+		if (!claimPage(disk, page))
 		{
-			if (kblock_write(disk->dev, new_page, &dummy, curr_hdr.fill, 1) != 1)
-			{
-				fdb->errors |= BATTFS_DISK_WRITE_ERR;
-				return total_write;
-			}
-			curr_hdr.fill++;
-			fd->size++;
-			disk->free_bytes--;
+			fdb->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
 		}
-		curr_hdr.seq++;
-		if (!writeHdr(disk, new_page, &curr_hdr))
+
+		hdr->inode = fdb->inode;
+		hdr->pgoff = pgoff;
+		hdr->fill = 0;
+		hdr->seq = 0;
+	}
+	else if (fdb->start[pgoff] != disk->wr_page
+		|| (kblock_buffered(disk->dev)
+		&& (disk->wr_page != kblock_cachedBlock(disk->dev) || !kblock_cacheDirty(disk->dev))))
+	{
+		if (!commitHdr(disk))
 		{
 			fdb->errors |= BATTFS_DISK_WRITE_ERR;
-			return total_write;
+			return false;
 		}
+		/* wr_hdr is reused for the new page */
+		disk->wr_page = PAGE_UNSET_SENTINEL;
 
-		/* Allocate the missing pages first. */
-		pgoff_t missing_pages = fd->seek_pos / disk->data_size - fdb->max_off;
-
-		LOG_INFO("missing pages: %d\n", missing_pages);
-
-		while (missing_pages--)
+		page = fdb->start[pgoff];
+		if (!readHdr(disk, page, hdr))
 		{
-			zero_bytes = MIN((kfile_off_t)disk->data_size, fd->seek_pos - fd->size);
+			fdb->errors |= BATTFS_DISK_READ_ERR;
+			return false;
+		}
 
-			new_page = allocateNewPage(disk, (fdb->start - disk->page_array) + fdb->max_off + 1, fdb->inode);
+		/* Renew page only if is not in cache. */
+		if (kblock_buffered(disk->dev)
+			&& (page != kblock_cachedBlock(disk->dev) || !kblock_cacheDirty(disk->dev)))
+		{
+			pgcnt_t new_page = renewPage(disk, page);
 			if (new_page == NO_SPACE)
 			{
 				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
-				return total_write;
+				return false;
 			}
 
-
-			// TODO: write in blocks to speed up things
-			/* Fill page buffer with 0 to avoid filling unused pages with garbage */
-			for (pgaddr_t off = 0; off < disk->data_size; off++)
-			{
-				if (kblock_write(disk->dev, new_page, &dummy, off, 1) != 1)
-				{
-					fdb->errors |= BATTFS_DISK_WRITE_ERR;
-					return total_write;
-				}
-			}
-			curr_hdr.inode = fdb->inode;
-			curr_hdr.pgoff = ++fdb->max_off;
-			curr_hdr.fill = zero_bytes;
-			curr_hdr.seq = 0;
-
-			if (!writeHdr(disk, new_page, &curr_hdr))
+			LOG_INFO("Re-writing page %d to %d\n", page, new_page);
+			/* Copy the old page only if some of its data survive */
+			if ((addr == 0 && len >= hdr->fill) ?
+				!claimPage(disk, new_page) :
+				kblock_copy(disk->dev, page, new_page) != 0)
 			{
 				fdb->errors |= BATTFS_DISK_WRITE_ERR;
-				return total_write;
+				return false;
 			}
-
-			/* Update size and free space left */
-			fd->size += zero_bytes;
-			disk->free_bytes -= zero_bytes;
+			fdb->start[pgoff] = page = new_page;
+		}
+		else if (!ckpRewrite(disk))
+		{
+			fdb->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
 		}
+		hdr->seq++;
 	}
-
-	while (size)
+	else
 	{
-		pg_offset = fd->seek_pos / disk->data_size;
-		addr_offset = fd->seek_pos % disk->data_size;
-		wr_len = MIN(size, (size_t)(disk->data_size - addr_offset));
+		LOG_INFO("Using cached block %d\n", page);
+		new_hdr = false;
+	}
 
-		/* Handle write outside EOF */
-		if (pg_offset > fdb->max_off)
+	if (new_hdr)
+	{
+		/*
+		 * A new sequence number, or the header of a claimed page,
+		 * must reach the disk together with the data.
+		 */
+		if (!writeHdr(disk, page, hdr))
 		{
-			LOG_INFO("New page needed, pg_offset %d, pos %d\n", pg_offset, (int)((fdb->start - disk->page_array) + pg_offset));
-
-			new_page = allocateNewPage(disk, (fdb->start - disk->page_array) + pg_offset, fdb->inode);
-			if (new_page == NO_SPACE)
-			{
-				fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
-				return total_write;
-			}
+			fdb->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
+		}
+		disk->wr_page = page;
+	}
 
-			curr_hdr.inode = fdb->inode;
-			curr_hdr.pgoff = pg_offset;
-			curr_hdr.fill = 0;
-			curr_hdr.seq = 0;
-			fdb->max_off = pg_offset;
+	if (buf)
+	{
+		if (kblock_write(disk->dev, page, buf, addr, len) != len)
+		{
+			fdb->errors |= BATTFS_DISK_WRITE_ERR;
+			return false;
 		}
-		else
+	}
+	else
+	{
+		for (pgaddr_t off = 0, n; off < len; off += n)
 		{
-			if (!readHdr(disk, fdb->start[pg_offset], &curr_hdr))
+			n = MIN((pgaddr_t)(len - off), (pgaddr_t)sizeof(zero_fill));
+			if (kblock_write(disk->dev, page, zero_fill, addr + off, n) != n)
 			{
-				fdb->errors |= BATTFS_DISK_READ_ERR;
-				return total_write;
+				fdb->errors |= BATTFS_DISK_WRITE_ERR;
+				return false;
 			}
+		}
+	}
 
-			/* Renew page only if is not in cache. */
-			if (kblock_buffered(disk->dev)
-				&& ((fdb->start[fdb->max_off] != kblock_cachedBlock(disk->dev)) || !kblock_cacheDirty(disk->dev)))
-			{
-				new_page = renewPage(disk, fdb->start[pg_offset]);
-				if (new_page == NO_SPACE)
-				{
-					fdb->errors |= BATTFS_DISK_SPACEOVER_ERR;
-					return total_write;
-				}
-
-				LOG_INFO("Re-writing page %d to %d\n", fdb->start[pg_offset], new_page);
-				if (kblock_copy(disk->dev, fdb->start[pg_offset], new_page) != 0)
-				{
-					fdb->errors |= BATTFS_DISK_WRITE_ERR;
-					return total_write;
-				}
-				fdb->start[pg_offset] = new_page;
-			}
-			else
-			{
-				LOG_INFO("Using cached block %d\n", fdb->start[pg_offset]);
-				new_page = fdb->start[pg_offset];
-			}
+	if (addr + len > hdr->fill)
+	{
+		fill_t fill_delta = addr + len - hdr->fill;
+		disk->free_bytes -= fill_delta;
+		fdb->fd.size += fill_delta;
+		hdr->fill += fill_delta;
+		disk->wr_pending = true;
 
-			curr_hdr.seq++;
-		}
-		//LOG_INFO("writing to buffer for page %d, offset %d, size %d\n", disk->curr_page, addr_offset, wr_len);
-		if (kblock_write(disk->dev, new_page, buf, addr_offset, wr_len) != wr_len)
+		/* Appends will not touch a full page anymore */
+		if (hdr->fill == disk->data_size && !commitHdr(disk))
 		{
 			fdb->errors |= BATTFS_DISK_WRITE_ERR;
-			return total_write;
+			return false;
 		}
+	}
+	return true;
+}
+
+/**
+ * Write to file \a fd \a size bytes from \a buf.
+ * \return The number of bytes written.
+ */
+static size_t battfs_write(struct KFile *fd, const void *_buf, size_t size)
+{
+	BattFs *fdb = BATTFS_CAST(fd);
+	BattFsSuper *disk = fdb->disk;
+	const uint8_t *buf = (const uint8_t *)_buf;
+
+	size_t total_write = 0;
+	pgoff_t pg_offset;
+	pgaddr_t addr_offset;
+	pgaddr_t wr_len;
+
+	if (fd->seek_pos < 0)
+	{
+		fdb->errors |= BATTFS_NEGATIVE_SEEK_ERR;
+		return total_write;
+	}
+
+	/* Fill the space between EOF and the seek position with 0s */
+	while (fd->size < fd->seek_pos)
+	{
+		pg_offset = fd->size / disk->data_size;
+		addr_offset = fd->size % disk->data_size;
+		wr_len = MIN(fd->seek_pos - fd->size, (kfile_off_t)(disk->data_size - addr_offset));
+
+		if (!writePage(fdb, pg_offset, addr_offset, NULL, wr_len))
+			return total_write;
+	}
+
+	while (size)
+	{
+		pg_offset = fd->seek_pos / disk->data_size;
+		addr_offset = fd->seek_pos % disk->data_size;
+		wr_len = MIN(size, (size_t)(disk->data_size - addr_offset));
+
+		//LOG_INFO("writing to buffer for page %d, offset %d, size %d\n", fdb->start[pg_offset], addr_offset, wr_len);
+		if (!writePage(fdb, pg_offset, addr_offset, buf, wr_len))
+			return total_write;
 
 		size -= wr_len;
 		fd->seek_pos += wr_len;
 		total_write += wr_len;
 		buf += wr_len;
-		fill_t fill_delta = MAX((int32_t)(addr_offset + wr_len) - curr_hdr.fill, (int32_t)0);
-		disk->free_bytes -= fill_delta;
-		fd->size += fill_delta;
-		curr_hdr.fill += fill_delta;
-
-		if (!writeHdr(disk, new_page, &curr_hdr))
-		{
-			fdb->errors |= BATTFS_DISK_WRITE_ERR;
-			return total_write;
-		}
 
-		//LOG_INFO("free_bytes %d, seek_pos %d, size %d, curr_hdr.fill %d\n", disk->free_bytes, fd->seek_pos, fd->size, curr_hdr.fill);
+		//LOG_INFO("free_bytes %d, seek_pos %d, size %d, fill %d\n", disk->free_bytes, fd->seek_pos, fd->size, disk->wr_hdr.fill);
 	}
 	return total_write;
 }
@@ -826,6 +1679,10 @@ static size_t battfs_read(struct KFile *fd, void *_buf, size_t size)
  */
 static bool findFile(BattFsSuper *disk, inode_t inode, pgcnt_t *last)
 {
+#if CONFIG_BATTFS_INODE_INDEX
+	*last = disk->file_start[inode];
+	return disk->file_pages[inode] != 0;
+#else
 	BattFsPageHeader hdr;
 	pgcnt_t first = 0, page;
 	*last = disk->free_page_start;
@@ -852,6 +1709,7 @@ static bool findFile(BattFsSuper *disk, inode_t inode, pgcnt_t *last)
 	}
 	LOG_INFO("Not found: last %d\n", *last);
 	return false;
+#endif
 }
 
 /**
@@ -863,27 +1721,33 @@ bool battfs_fileExists(BattFsSuper *disk, inode_t inode)
 	return findFile(disk, inode, &dummy);
 }
 
+#if !CONFIG_BATTFS_INODE_INDEX
 /**
  * Count size of file \a inode on \a disk, starting at pointer \a start
- * in disk->page_array. Size is written in \a size.
- * \return true if all s ok, false on disk read errors.
+ * in disk->page_array. The offset of its last page is written in \a max_off.
+ * \return the file size, EOF on disk read errors.
  */
-static file_size_t countFileSize(BattFsSuper *disk, pgcnt_t *start, inode_t inode)
+static file_size_t countFileSize(BattFsSuper *disk, pgcnt_t *start, inode_t inode, pgcnt_t *max_off)
 {
 	file_size_t size = 0;
 	BattFsPageHeader hdr;
 
+	*max_off = 0;
 	while (start < &disk->page_array[disk->free_page_start])
 	{
 		if (!readHdr(disk, *start++, &hdr))
 			return EOF;
 		if (hdr.fcs == computeFcs(&hdr) && hdr.inode == inode)
+		{
 			size += hdr.fill;
+			*max_off = hdr.pgoff;
+		}
 		else
 			break;
 	}
 	return size;
 }
+#endif
 
 static int battfs_error(struct KFile *fd)
 {
@@ -909,6 +1773,13 @@ bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mo
 
 	memset(fd, 0, sizeof(*fd));
 
+	/* File sizes are read from the headers */
+	if (!commitHdr(disk))
+	{
+		fd->errors |= BATTFS_DISK_WRITE_ERR;
+		return false;
+	}
+
 	/* Search file start point in disk page array */
 	pgcnt_t start_pos;
 	if (!findFile(disk, inode, &start_pos))
@@ -920,34 +1791,42 @@ bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mo
 			return false;
 		}
 		/* Create the file */
-		BattFsPageHeader hdr;
+		BattFsPageHeader *hdr = &disk->wr_hdr;
+		pgcnt_t page = allocateNewPage(disk, start_pos, inode);
 
-		if (allocateNewPage(disk, start_pos, inode) == NO_SPACE)
+		if (page == NO_SPACE)
 		{
 			fd->errors |= BATTFS_DISK_SPACEOVER_ERR;
 			return false;
 		}
 
-		hdr.inode = inode;
-		hdr.pgoff = 0;
-		hdr.fill = 0;
-		hdr.seq = 0;
-		if (!writeHdr(disk, disk->page_array[start_pos], &hdr))
+		hdr->inode = inode;
+		hdr->pgoff = 0;
+		hdr->fill = 0;
+		hdr->seq = 0;
+		disk->wr_page = PAGE_UNSET_SENTINEL;
+		if (!claimPage(disk, page) || !writeHdr(disk, page, hdr))
 		{
 			fd->errors |= BATTFS_DISK_WRITE_ERR;
 			return false;
 		}
+		disk->wr_page = page;
 	}
 	fd->start = &disk->page_array[start_pos];
 	LOG_INFO("Start pos %d\n", start_pos);
 
 	/* Fill file size */
-	if ((fd->fd.size = countFileSize(disk, fd->start, inode)) == EOF)
-	{
-		fd->errors |= BATTFS_DISK_READ_ERR;
-		return false;
-	}
-	fd->max_off = fd->fd.size / disk->data_size;
+	#if CONFIG_BATTFS_INODE_INDEX
+		/* All the pages but the last one are full */
+		fd->fd.size = (file_size_t)(disk->file_pages[inode] - 1) * disk->data_size + disk->file_fill[inode];
+		fd->max_off = disk->file_pages[inode] - 1;
+	#else
+		if ((fd->fd.size = countFileSize(disk, fd->start, inode, &fd->max_off)) == EOF)
+		{
+			fd->errors |= BATTFS_DISK_READ_ERR;
+			return false;
+		}
+	#endif
 
 	/* Reset seek position */
 	fd->fd.seek_pos = 0;
@@ -998,6 +1877,24 @@ bool battfs_umount(struct BattFsSuper *disk)
 	}
 
 	/* Close disk */
+	#if CONFIG_BATTFS_CHECKPOINT
+		if (disk->ckp)
+		{
+			if (!battfs_checkpoint(disk))
+				res = EOF;
+			if (kblock_close(disk->ckp) != 0)
+				res = EOF;
+		}
+	#endif
+	#if CONFIG_BATTFS_WEAR_LEVELING
+		if (disk->wear)
+		{
+			if (disk->wear_unsaved && !wearSave(disk))
+				res = EOF;
+			if (kblock_close(disk->wear) != 0)
+				res = EOF;
+		}
+	#endif
 	return (kblock_flush(disk->dev) == 0) && (kblock_close(disk->dev) == 0) && (res == 0);
 }
 
@@ -36,14 +36,31 @@
  * \brief BattFS: a filesystem for embedded platforms (interface).
  * TODO: Add detailed filesystem description.
  *
+ * Mounting requires to scan the headers of all the disk pages.
+ * With CONFIG_BATTFS_CHECKPOINT a snapshot of the page allocation array
+ * can be kept on a separate block device, see battfs_mountCheckpoint():
+ * the snapshot is written on file flush and on umount, and the next mount
+ * loads it and reads only the pages that could have been written after it.
+ *
+ * With CONFIG_BATTFS_INODE_INDEX the position, the length and the fill of
+ * the last page of every file are kept in RAM, so files can be found and
+ * opened without reading the disk.
+ *
+ * With CONFIG_BATTFS_WEAR_LEVELING the erase count of every page is kept
+ * on a separate block device, see battfs_wearInit(): writes take the least
+ * worn free pages and battfs_gcStep(), run in the background, moves the
+ * data never rewritten out of the least worn pages.
+ *
  * $WIZ$ module_name = "battfs"
- * $WIZ$ module_depends = "rotating_hash", "kfile"
+ * $WIZ$ module_depends = "rotating_hash", "crc16", "kfile"
  * $WIZ$ module_configuration = "bertos/cfg/cfg_battfs.h"
  */
 
 #ifndef FS_BATTFS_H
 #define FS_BATTFS_H
 
+#include "cfg/cfg_battfs.h"
+
 #include <cfg/compiler.h> // uintXX_t; STATIC_ASSERT
 #include <cpu/types.h> // CPU_BITS_PER_CHAR
 #include <algo/rotating_hash.h>
@@ -112,6 +129,7 @@ typedef struct BattFsPageHeader
 #define PAGE_UNSET_SENTINEL ((pgcnt_t)((1L << (CPU_BITS_PER_CHAR * sizeof(pgcnt_t))) - 1))
 
 typedef uint32_t disk_size_t; ///< Type for disk sizes.
+typedef uint32_t erase_cnt_t; ///< Type for page erase counts.
 
 /**
  * Context used to describe a disk.
@@ -142,6 +160,47 @@ typedef struct BattFsSuper
 	disk_size_t free_bytes;  ///< Free space on the disk.
 
 	List file_opened_list;       ///< List used to keep trace of open files.
+
+	/**
+	 * Write combining.
+	 * Header of the page being written: the fill updates are kept here
+	 * and written in the page only when it is full, when another page
+	 * is written or when the file is flushed.
+	 */
+	pgcnt_t wr_page;
+	BattFsPageHeader wr_hdr;  ///< Header of wr_page.
+	bool wr_pending;          ///< True if wr_hdr is newer than the header in wr_page.
+
+#if CONFIG_BATTFS_INODE_INDEX
+	/**
+	 * Inode index.
+	 * Position in page_array of the first page of each file, or where it
+	 * would be created if it does not exist.
+	 */
+	pgcnt_t file_start[BATTFS_MAX_FILES];
+	pgcnt_t file_pages[BATTFS_MAX_FILES]; ///< Number of pages of each file, 0 if it does not exist.
+	fill_t file_fill[BATTFS_MAX_FILES];   ///< Filled bytes in the last page of each file.
+#endif
+
+#if CONFIG_BATTFS_CHECKPOINT
+	KBlock *ckp;          ///< Checkpoint device, NULL if not used.
+	uint32_t ckp_gen;     ///< Generation of the last checkpoint written.
+	uint8_t ckp_slot;     ///< Checkpoint device slot holding it.
+	uint8_t ckp_state;    ///< Its state, clean, dirty or stale.
+	pgcnt_t ckp_free;     ///< Free pages when it was written.
+	pgcnt_t ckp_allocs;   ///< Pages allocated since then.
+#endif
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+	KBlock *wear;            ///< Erase count device, NULL if not used.
+	erase_cnt_t *erase_cnt;  ///< Erase count of each page.
+	uint32_t wear_gen;       ///< Generation of the last erase counts saved.
+	uint8_t wear_slot;       ///< Erase count device slot holding them.
+	pgcnt_t wear_unsaved;    ///< Pages allocated since then.
+	pgcnt_t gc_free;         ///< Free list position sorted by the next battfs_gcStep().
+	pgcnt_t gc_used;         ///< Page array position checked by the next battfs_gcStep().
+	pgcnt_t gc_cold;         ///< Least worn page holding data found, PAGE_UNSET_SENTINEL if none.
+#endif
 	/* TODO add other fields. */
 } BattFsSuper;
 
@@ -209,6 +268,65 @@ bool battfs_mount(struct BattFsSuper *disk, struct KBlock *dev, pgcnt_t *page_ar
 bool battfs_fsck(struct BattFsSuper *disk);
 bool battfs_umount(struct BattFsSuper *disk);
 
+#if CONFIG_BATTFS_CHECKPOINT
+/**
+ * Mount \a dev using the checkpoint kept on \a ckp.
+ *
+ * The checkpoint device holds two slots, each one large enough for the
+ * page allocation array of \a dev, so the previous checkpoint is still
+ * there if a new one is interrupted.
+ * If the newest checkpoint describes the disk, nothing else is read;
+ * if the disk was modified after it, only the pages that were free are
+ * read again and merged. When the checkpoint is missing, corrupted or
+ * too old the whole disk is scanned like battfs_mount().
+ *
+ * \return false on errors, true otherwise.
+ */
+bool battfs_mountCheckpoint(struct BattFsSuper *disk, struct KBlock *dev, struct KBlock *ckp,
+	pgcnt_t *page_array, size_t array_size);
+
+/**
+ * Write a checkpoint of \a disk, if it has been modified since the last one.
+ * This is done automatically on file flush and on umount.
+ * \return true if ok, false on errors.
+ */
+bool battfs_checkpoint(struct BattFsSuper *disk);
+#endif
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+/**
+ * Enable wear leveling on the mounted \a disk.
+ *
+ * The erase count of each page is kept in \a erase_cnt, which must have
+ * room for a count per page, and saved on \a wear in two alternate
+ * slots, each one large enough for all the counts. Counts are loaded
+ * from the newest valid slot, or start from 0 if there is none.
+ * They are saved by battfs_gcStep() every CONFIG_BATTFS_WEAR_THRESHOLD
+ * erases and on umount, so a power loss can only forget a few erases.
+ *
+ * \return false on errors, true otherwise.
+ */
+bool battfs_wearInit(struct BattFsSuper *disk, struct KBlock *wear, erase_cnt_t *erase_cnt, size_t size);
+
+/**
+ * Do a bounded amount of wear leveling work on \a disk.
+ *
+ * Each call sorts a few free pages, so that writes take the least worn
+ * ones without searching for them, and checks a few pages holding data:
+ * once all of them have been checked, the least worn one is moved to a
+ * worn free page if their erase counts differ by more than
+ * CONFIG_BATTFS_WEAR_THRESHOLD. This way data that are never rewritten
+ * do not keep the least worn pages out of use.
+ *
+ * It is meant to be called periodically by a low priority process.
+ * BattFS is not reentrant: the calls must be serialized with the other
+ * calls on \a disk, for example with a semaphore.
+ *
+ * \return false on errors, true otherwise.
+ */
+bool battfs_gcStep(struct BattFsSuper *disk);
+#endif
+
 bool battfs_fileExists(BattFsSuper *disk, inode_t inode);
 bool battfs_fileopen(BattFsSuper *disk, BattFs *fd, inode_t inode, filemode_t mode);
 
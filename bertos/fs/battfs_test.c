@@ -32,14 +32,25 @@
  * \brief BattFS Test.
  *
  * \author Francesco Sacchi <batt@develer.com>
+ *
+ * $test$: cp bertos/cfg/cfg_battfs.h $cfgdir/
+ * $test$: echo "#undef CONFIG_BATTFS_CHECKPOINT" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_CHECKPOINT 1" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#undef CONFIG_BATTFS_INODE_INDEX" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_INODE_INDEX 1" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#undef CONFIG_BATTFS_WEAR_LEVELING" >> $cfgdir/cfg_battfs.h
+ * $test$: echo "#define CONFIG_BATTFS_WEAR_LEVELING 1" >> $cfgdir/cfg_battfs.h
  */
 
 #include <fs/battfs.h>
 #include <io/kblock_posix.h>
+#include <io/kblock_ram.h>
 
 #include <cfg/debug.h>
 #include <cfg/test.h>
 
+#include <os/hptime.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -1071,6 +1082,748 @@ static void openAllFiles(BattFsSuper *disk)
 }
 
 
+#if CONFIG_BATTFS_CHECKPOINT
+
+const char ckp_filename[]="battfs_ckp.bin";
+
+#define CKP_BLOCKS 32
+#define CKP_HDR_LEN 21
+#if CONFIG_BATTFS_INODE_INDEX
+	#define CKP_INDEX_LEN (BATTFS_MAX_FILES * 4)
+#else
+	#define CKP_INDEX_LEN 0
+#endif
+#define CKP_FILES 6
+#define CKP_FILE_MAX 2048
+
+static uint8_t ckp_buffer[PAGE_SIZE];
+static pgcnt_t ckp_ref[PAGE_COUNT];
+static uint8_t content[CKP_FILES][CKP_FILE_MAX];
+static size_t content_size[CKP_FILES];
+
+/* Open the disk and the checkpoint images, erasing them if \a erase */
+static void ckpOpen(KBlockPosix *f, KBlockPosix *c, bool erase)
+{
+	FILE *fp = fopen(test_filename, erase ? "w+" : "r+");
+	FILE *fc = fopen(ckp_filename, erase ? "w+" : "r+");
+
+	ASSERT(fp && fc);
+	if (erase)
+	{
+		for (int i = 0; i < FILE_SIZE; i++)
+			fputc(0xff, fp);
+		for (int i = 0; i < CKP_BLOCKS * PAGE_SIZE; i++)
+			fputc(0xff, fc);
+		memset(content_size, 0, sizeof(content_size));
+	}
+	kblockposix_init(f, fp, HW_PAGEBUF, page_buffer, PAGE_SIZE, PAGE_COUNT);
+	kblockposix_init(c, fc, false, ckp_buffer, PAGE_SIZE, CKP_BLOCKS);
+}
+
+/* Simulate a power loss: the disk is left as it is */
+static void ckpCrash(KBlockPosix *f, KBlockPosix *c)
+{
+	ASSERT(kblock_flush(&f->b) == 0);
+	fclose(f->fp);
+	fclose(c->fp);
+}
+
+/* Write \a size bytes at \a pos in file \a inode, keeping a copy of the content */
+static void ckpWrite(BattFsSuper *disk, inode_t inode, size_t pos, size_t size, bool close)
+{
+	BattFs fd;
+	uint8_t buf[CKP_FILE_MAX];
+
+	ASSERT(pos + size <= CKP_FILE_MAX);
+	for (size_t i = 0; i < size; i++)
+		buf[i] = content[inode][pos + i] = i * 3 + inode + pos;
+	content_size[inode] = MAX(content_size[inode], pos + size);
+
+	ASSERT(battfs_fileopen(disk, &fd, inode, BATTFS_CREATE));
+	ASSERT(kfile_seek(&fd.fd, pos, KSM_SEEK_SET) == (kfile_off_t)pos);
+	ASSERT(kfile_write(&fd.fd, buf, size) == size);
+	if (close)
+		ASSERT(kfile_close(&fd.fd) == 0);
+	else
+		REMOVE(&fd.link);
+}
+
+static void ckpCheckFiles(BattFsSuper *disk)
+{
+	BattFs fd;
+	uint8_t buf[CKP_FILE_MAX];
+
+	for (inode_t i = 0; i < CKP_FILES; i++)
+	{
+		if (!content_size[i])
+		{
+			ASSERT(!battfs_fileExists(disk, i));
+			continue;
+		}
+		ASSERT(battfs_fileopen(disk, &fd, i, 0));
+		ASSERT(fd.fd.size == (kfile_off_t)content_size[i]);
+		ASSERT(kfile_read(&fd.fd, buf, content_size[i]) == content_size[i]);
+		ASSERT(memcmp(buf, content[i], content_size[i]) == 0);
+		ASSERT(kfile_close(&fd.fd) == 0);
+	}
+}
+
+/* Mount the disk with a full scan and save the page array in ckp_ref */
+static void ckpReference(pgcnt_t *free_start, disk_size_t *free_bytes)
+{
+	BattFsSuper disk;
+	KBlockPosix f;
+	FILE *fp = fopen(test_filename, "r+");
+
+	kblockposix_init(&f, fp, HW_PAGEBUF, page_buffer, PAGE_SIZE, PAGE_COUNT);
+	ASSERT(battfs_mount(&disk, &f.b, page_array, sizeof(page_array)));
+	ASSERT(battfs_fsck(&disk));
+	memcpy(ckp_ref, page_array, sizeof(ckp_ref));
+	*free_start = disk.free_page_start;
+	*free_bytes = disk.free_bytes;
+	ASSERT(battfs_umount(&disk));
+}
+
+static int pgcmp(const void *a, const void *b)
+{
+	return *(const pgcnt_t *)a - *(const pgcnt_t *)b;
+}
+
+/* Check that \a disk has the same files and free pages of the reference */
+static void ckpCompare(BattFsSuper *disk, pgcnt_t free_start, disk_size_t free_bytes)
+{
+	pgcnt_t free_pages[PAGE_COUNT];
+
+	ASSERT(battfs_fsck(disk));
+	ASSERT(disk->free_page_start == free_start);
+	ASSERT(disk->free_bytes == free_bytes);
+	ASSERT(memcmp(disk->page_array, ckp_ref, free_start * sizeof(pgcnt_t)) == 0);
+
+	/* The order of free pages may differ */
+	memcpy(free_pages, &disk->page_array[free_start], (PAGE_COUNT - free_start) * sizeof(pgcnt_t));
+	qsort(free_pages, PAGE_COUNT - free_start, sizeof(pgcnt_t), pgcmp);
+	qsort(&ckp_ref[free_start], PAGE_COUNT - free_start, sizeof(pgcnt_t), pgcmp);
+	ASSERT(memcmp(free_pages, &ckp_ref[free_start], (PAGE_COUNT - free_start) * sizeof(pgcnt_t)) == 0);
+}
+
+static void checkpointClean(BattFsSuper *disk)
+{
+	KBlockPosix f, c;
+	pgcnt_t saved[PAGE_COUNT];
+	pgcnt_t free_start;
+	disk_size_t free_bytes;
+
+	TRACEMSG("23: checkpoint after a clean umount\n");
+
+	ckpOpen(&f, &c, true);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ckpWrite(disk, 0, 0, 300, true);
+	ckpWrite(disk, 1, 0, 1000, true);
+	ckpWrite(disk, 3, 0, 50, true);
+	ckpWrite(disk, 1, 200, 100, true);
+	ckpWrite(disk, 4, 0, 2000, true);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_umount(disk));
+	memcpy(saved, page_array, sizeof(saved));
+	free_start = disk->free_page_start;
+	free_bytes = disk->free_bytes;
+
+	/* Nothing is scanned: even the order of free pages is the same */
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ASSERT(memcmp(page_array, saved, sizeof(saved)) == 0);
+	ASSERT(disk->free_page_start == free_start);
+	ASSERT(disk->free_bytes == free_bytes);
+	ASSERT(battfs_fsck(disk));
+	ckpCheckFiles(disk);
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("23: passed\n");
+}
+
+static void checkpointReplay(BattFsSuper *disk)
+{
+	KBlockPosix f, c;
+	pgcnt_t saved[PAGE_COUNT];
+	pgcnt_t free_start;
+	disk_size_t free_bytes;
+
+	TRACEMSG("24: checkpoint replay after a power loss\n");
+
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ckpWrite(disk, 1, 500, 700, false);
+	ckpWrite(disk, 5, 0, 400, false);
+	ckpWrite(disk, 0, 300, 100, false);
+	ckpWrite(disk, 2, 0, 10, false);
+	/* The last append of a file not flushed is lost, overwrite instead */
+	ckpWrite(disk, 1, 600, 100, false);
+	ckpCrash(&f, &c);
+
+	ckpReference(&free_start, &free_bytes);
+
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ckpCompare(disk, free_start, free_bytes);
+	ckpCheckFiles(disk);
+	memcpy(saved, page_array, sizeof(saved));
+	ASSERT(battfs_umount(disk));
+
+	/* A new checkpoint has been written after the replay */
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ASSERT(memcmp(page_array, saved, sizeof(saved)) == 0);
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("24: passed\n");
+}
+
+static void checkpointStale(BattFsSuper *disk)
+{
+	KBlockPosix f, c;
+	pgcnt_t free_start;
+	disk_size_t free_bytes;
+
+	TRACEMSG("25: stale checkpoint\n");
+
+	/* Leave only a few free pages */
+	ckpOpen(&f, &c, true);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	for (inode_t i = 0; i < CKP_FILES; i++)
+		ckpWrite(disk, i, 0, CKP_FILE_MAX, true);
+	BattFs fd;
+	ASSERT(battfs_fileopen(disk, &fd, CKP_FILES, BATTFS_CREATE));
+	while (PAGE_COUNT - disk->free_page_start > 8)
+		ASSERT(kfile_write(&fd.fd, content[0], DATA_SIZE) == DATA_SIZE);
+	ASSERT(kfile_close(&fd.fd) == 0);
+
+	/* Rewrite more pages than the free ones */
+	for (int i = 0; i < 20; i++)
+		ckpWrite(disk, i % CKP_FILES, (i * DATA_SIZE) % CKP_FILE_MAX, 4, false);
+	ckpCrash(&f, &c);
+
+	ckpReference(&free_start, &free_bytes);
+
+	/* The whole disk is scanned, as battfs_mount() does */
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ASSERT(memcmp(page_array, ckp_ref, sizeof(ckp_ref)) == 0);
+	ASSERT(disk->free_page_start == free_start);
+	ASSERT(disk->free_bytes == free_bytes);
+	ckpCheckFiles(disk);
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("25: passed\n");
+}
+
+static void checkpointCorrupt(BattFsSuper *disk)
+{
+	KBlockPosix f, c;
+	pgcnt_t free_start;
+	disk_size_t free_bytes;
+	uint8_t slot = disk->ckp_slot;
+
+	TRACEMSG("26: corrupted checkpoint\n");
+
+	/* Damage the page array in the last checkpoint */
+	FILE *fc = fopen(ckp_filename, "r+");
+	long pos = slot * DIV_ROUNDUP(CKP_HDR_LEN + PAGE_COUNT * 2 + CKP_INDEX_LEN, PAGE_SIZE) * PAGE_SIZE
+		+ CKP_HDR_LEN + 10;
+	fseek(fc, pos, SEEK_SET);
+	int val = fgetc(fc);
+	fseek(fc, pos, SEEK_SET);
+	fputc(val ^ 0x40, fc);
+	fclose(fc);
+
+	ckpReference(&free_start, &free_bytes);
+
+	ckpOpen(&f, &c, false);
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ASSERT(memcmp(page_array, ckp_ref, sizeof(ckp_ref)) == 0);
+	ASSERT(disk->free_page_start == free_start);
+	ASSERT(disk->free_bytes == free_bytes);
+	ckpCheckFiles(disk);
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("26: passed\n");
+}
+
+static uint8_t ckp_ram_disk[FILE_SIZE];
+static uint8_t ckp_ram_ckp[CKP_BLOCKS * PAGE_SIZE];
+
+/* Mount the unbuffered RAM disk with the checkpoint, or with a full scan */
+static void ckpRamMount(BattFsSuper *disk, KBlockRam *ram, KBlockRam *ckp, bool scan)
+{
+	kblockram_init(ram, ckp_ram_disk, sizeof(ckp_ram_disk), PAGE_SIZE, false, false);
+	kblockram_init(ckp, ckp_ram_ckp, sizeof(ckp_ram_ckp), PAGE_SIZE, false, false);
+	if (scan)
+		ASSERT(battfs_mount(disk, &ram->b, page_array, sizeof(page_array)));
+	else
+		ASSERT(battfs_mountCheckpoint(disk, &ram->b, &ckp->b, page_array, sizeof(page_array)));
+}
+
+static void checkpointUnbuffered(BattFsSuper *disk)
+{
+	KBlockRam ram, ckp;
+	pgcnt_t free_start;
+	disk_size_t free_bytes;
+
+	TRACEMSG("27: checkpoint on an unbuffered device\n");
+
+	/* Pages in use are written in place */
+	memset(ckp_ram_disk, 0xff, sizeof(ckp_ram_disk));
+	memset(ckp_ram_ckp, 0xff, sizeof(ckp_ram_ckp));
+	memset(content_size, 0, sizeof(content_size));
+	ckpRamMount(disk, &ram, &ckp, false);
+	ckpWrite(disk, 1, 0, DATA_SIZE + 10, true);
+	ckpWrite(disk, 0, 0, 20, true);
+	ckpWrite(disk, 0, 20, 30, true);
+	ckpWrite(disk, 1, 5, 10, true);
+	ASSERT(battfs_umount(disk));
+
+	ckpRamMount(disk, &ram, &ckp, true);
+	memcpy(ckp_ref, page_array, sizeof(ckp_ref));
+	free_start = disk->free_page_start;
+	free_bytes = disk->free_bytes;
+	ASSERT(battfs_umount(disk));
+
+	ckpRamMount(disk, &ram, &ckp, false);
+	ckpCompare(disk, free_start, free_bytes);
+	ckpCheckFiles(disk);
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("27: passed\n");
+}
+
+static void checkpointBench(BattFsSuper *disk)
+{
+	KBlockPosix f, c;
+	hptime_t start, scan, ckp;
+
+	ckpOpen(&f, &c, false);
+	start = hptime_get();
+	ASSERT(battfs_mount(disk, &f.b, page_array, sizeof(page_array)));
+	scan = hptime_get() - start;
+	ASSERT(battfs_umount(disk));
+	fclose(c.fp);
+
+	ckpOpen(&f, &c, false);
+	start = hptime_get();
+	ASSERT(battfs_mountCheckpoint(disk, &f.b, &c.b, page_array, sizeof(page_array)));
+	ckp = hptime_get() - start;
+	ASSERT(battfs_umount(disk));
+
+	kprintf("BENCH battfs_mount pages=%d us_scan=%lu us_checkpoint=%lu\n",
+		PAGE_COUNT, (unsigned long)scan, (unsigned long)ckp);
+}
+
+#endif /* CONFIG_BATTFS_CHECKPOINT */
+
+/*
+ * RAM disk with a software page buffer, counting the accesses
+ * to the memory.
+ */
+typedef struct CountDisk
+{
+	KBlock b;
+	uint8_t mem[FILE_SIZE];
+	unsigned reads;   ///< Reads from the memory
+	unsigned writes;  ///< Writes to the memory
+} CountDisk;
+
+static size_t countdisk_readDirect(KBlock *b, block_idx_t idx, void *buf, size_t offset, size_t size)
+{
+	CountDisk *d = containerof(b, CountDisk, b);
+	d->reads++;
+	memcpy(buf, d->mem + idx * PAGE_SIZE + offset, size);
+	return size;
+}
+
+static size_t countdisk_writeDirect(KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size)
+{
+	CountDisk *d = containerof(b, CountDisk, b);
+	d->writes++;
+	memcpy(d->mem + idx * PAGE_SIZE + offset, buf, size);
+	return size;
+}
+
+static int countdisk_dummy(UNUSED_ARG(KBlock *, b))
+{
+	return 0;
+}
+
+static void countdisk_clearerr(UNUSED_ARG(KBlock *, b))
+{
+}
+
+static const KBlockVTable countdisk_vt =
+{
+	.readDirect = countdisk_readDirect,
+	.writeDirect = countdisk_writeDirect,
+
+	.readBuf = kblock_swReadBuf,
+	.writeBuf = kblock_swWriteBuf,
+	.load = kblock_swLoad,
+	.store = kblock_swStore,
+
+	.error = countdisk_dummy,
+	.clearerr = countdisk_clearerr,
+	.close = countdisk_dummy,
+};
+
+static CountDisk count_disk;
+
+/*
+ * Init the counting disk, erasing it if \a erase.
+ * Without \a buffered each access goes straight to the memory.
+ */
+static KBlock *countDiskInit(bool erase, bool buffered)
+{
+	CountDisk *d = &count_disk;
+
+	if (erase)
+		memset(d->mem, 0xff, sizeof(d->mem));
+	memset(&d->b, 0, sizeof(d->b));
+	d->b.blk_size = PAGE_SIZE;
+	d->b.blk_cnt = PAGE_COUNT;
+	d->b.priv.flags = KB_PARTIAL_WRITE;
+	d->b.priv.vt = &countdisk_vt;
+	if (buffered)
+	{
+		d->b.priv.buf = page_buffer;
+		d->b.priv.flags |= KB_BUFFERED;
+		kblock_swLoad(&d->b, 0);
+	}
+	d->reads = d->writes = 0;
+	return &d->b;
+}
+
+#if CONFIG_BATTFS_INODE_INDEX
+static void indexOpen(BattFsSuper *disk)
+{
+	BattFs fd[N_FILES];
+	uint8_t buf[DATA_SIZE * 3];
+
+	TRACEMSG("28: open files using the inode index\n");
+
+	memset(buf, 0x5a, sizeof(buf));
+	ASSERT(battfs_mount(disk, countDiskInit(true, true), page_array, sizeof(page_array)));
+	for (inode_t i = 0; i < N_FILES; i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd[i], i * 2, BATTFS_CREATE));
+		ASSERT(kfile_write(&fd[i].fd, buf, i * 37) == (size_t)i * 37);
+		ASSERT(kfile_close(&fd[i].fd) == 0);
+	}
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_umount(disk));
+
+	/* The index is built on mount */
+	ASSERT(battfs_mount(disk, countDiskInit(false, true), page_array, sizeof(page_array)));
+	ASSERT(battfs_fsck(disk));
+
+	/* No disk reads to find and open the files */
+	count_disk.reads = 0;
+	for (unsigned i = 0; i < N_FILES * 2; i++)
+		ASSERT(battfs_fileExists(disk, i) == !(i % 2));
+	for (inode_t i = 0; i < N_FILES; i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd[i], i * 2, 0));
+		ASSERT(fd[i].fd.size == i * 37);
+	}
+	ASSERT(count_disk.reads == 0);
+
+	/* Creating a file moves the following ones */
+	BattFs new_fd;
+	ASSERT(battfs_fileopen(disk, &new_fd, 3, BATTFS_CREATE));
+	ASSERT(kfile_write(&new_fd.fd, buf, sizeof(buf)) == sizeof(buf));
+	ASSERT(battfs_fsck(disk));
+	for (inode_t i = 0; i < N_FILES; i++)
+		ASSERT(kfile_close(&fd[i].fd) == 0);
+	ASSERT(kfile_close(&new_fd.fd) == 0);
+	ASSERT(battfs_fsck(disk));
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("28: passed\n");
+}
+#endif
+
+#define REC_SIZE 10
+#define REC_COUNT (20 * DATA_SIZE / REC_SIZE)
+
+static void appendCombine(BattFsSuper *disk)
+{
+	BattFs fd;
+	uint8_t rec[REC_SIZE];
+	const unsigned pages = DIV_ROUNDUP(REC_COUNT * REC_SIZE, DATA_SIZE);
+	unsigned writes[2];
+	hptime_t start, elapsed[2];
+
+	TRACEMSG("29: append small records\n");
+
+	for (int buffered = 0; buffered < 2; buffered++)
+	{
+		ASSERT(battfs_mount(disk, countDiskInit(true, buffered), page_array, sizeof(page_array)));
+		ASSERT(battfs_fileopen(disk, &fd, 0, BATTFS_CREATE));
+
+		count_disk.writes = count_disk.reads = 0;
+		start = hptime_get();
+		for (unsigned i = 0; i < REC_COUNT; i++)
+		{
+			memset(rec, i, sizeof(rec));
+			ASSERT(kfile_write(&fd.fd, rec, sizeof(rec)) == sizeof(rec));
+		}
+		ASSERT(kfile_close(&fd.fd) == 0);
+		elapsed[buffered] = hptime_get() - start;
+		writes[buffered] = count_disk.writes;
+
+		if (buffered)
+		{
+			/* Every page is written once, and never read */
+			ASSERT(count_disk.writes == pages);
+			ASSERT(count_disk.reads == 0);
+		}
+		else
+		{
+			/* One write per record, the headers only once per page */
+			ASSERT(count_disk.writes <= REC_COUNT + 3 * pages);
+		}
+
+		ASSERT(battfs_fsck(disk));
+		ASSERT(battfs_fileopen(disk, &fd, 0, 0));
+		ASSERT(fd.fd.size == REC_COUNT * REC_SIZE);
+		for (unsigned i = 0; i < REC_COUNT; i++)
+		{
+			ASSERT(kfile_read(&fd.fd, rec, sizeof(rec)) == sizeof(rec));
+			for (unsigned j = 0; j < sizeof(rec); j++)
+				ASSERT(rec[j] == (uint8_t)i);
+		}
+		ASSERT(kfile_close(&fd.fd) == 0);
+		ASSERT(battfs_umount(disk));
+	}
+
+	kprintf("BENCH battfs_append records=%d writes=%u us=%lu unbuffered_writes=%u unbuffered_us=%lu\n",
+		REC_COUNT, writes[1], (unsigned long)elapsed[1], writes[0], (unsigned long)elapsed[0]);
+
+	TRACEMSG("29: passed\n");
+}
+
+static void zeroFill(BattFsSuper *disk)
+{
+	BattFs fd;
+	uint8_t buf[DATA_SIZE];
+	const kfile_off_t hole = DATA_SIZE * 10 + 7;
+	const unsigned pages = hole / DATA_SIZE + 1;
+
+	TRACEMSG("30: fill with zeros writing past EOF\n");
+
+	for (int buffered = 0; buffered < 2; buffered++)
+	{
+		ASSERT(battfs_mount(disk, countDiskInit(true, buffered), page_array, sizeof(page_array)));
+		ASSERT(battfs_fileopen(disk, &fd, 0, BATTFS_CREATE));
+		ASSERT(kfile_write(&fd.fd, "aaaaa", 5) == 5);
+
+		count_disk.writes = count_disk.reads = 0;
+		ASSERT(kfile_seek(&fd.fd, hole, KSM_SEEK_SET) == hole);
+		ASSERT(kfile_write(&fd.fd, "b", 1) == 1);
+		ASSERT(kfile_close(&fd.fd) == 0);
+
+		if (buffered)
+		{
+			ASSERT(count_disk.writes == pages);
+			ASSERT(count_disk.reads == 0);
+		}
+		else
+		{
+			/* A few writes per page, not one per byte */
+			ASSERT(count_disk.writes <= pages * 8);
+		}
+
+		ASSERT(battfs_fsck(disk));
+		ASSERT(battfs_fileopen(disk, &fd, 0, 0));
+		ASSERT(fd.fd.size == hole + 1);
+		ASSERT(kfile_read(&fd.fd, buf, 5) == 5);
+		ASSERT(memcmp(buf, "aaaaa", 5) == 0);
+		for (kfile_off_t pos = 5; pos < hole; pos += DATA_SIZE)
+		{
+			size_t len = MIN(hole - pos, (kfile_off_t)DATA_SIZE);
+			ASSERT(kfile_read(&fd.fd, buf, len) == len);
+			for (size_t i = 0; i < len; i++)
+				ASSERT(buf[i] == 0);
+		}
+		ASSERT(kfile_read(&fd.fd, buf, 1) == 1);
+		ASSERT(buf[0] == 'b');
+		ASSERT(kfile_close(&fd.fd) == 0);
+		ASSERT(battfs_umount(disk));
+	}
+
+	TRACEMSG("30: passed\n");
+}
+
+#if CONFIG_BATTFS_WEAR_LEVELING
+
+#define WEAR_BLOCKS 32
+#define COLD_FILES 4
+#define COLD_PAGES 40
+#define HOT_FILE COLD_FILES
+#define HOT_WRITES 20000
+
+static uint8_t wear_disk[(PAGE_COUNT + 1) * PAGE_SIZE];
+static uint8_t wear_dev[WEAR_BLOCKS * PAGE_SIZE];
+static erase_cnt_t erase_cnt[PAGE_COUNT];
+#if CONFIG_BATTFS_CHECKPOINT
+	static uint8_t wear_ckp[CKP_BLOCKS * PAGE_SIZE];
+	static KBlockRam wear_ckp_ram;
+#endif
+
+/* Mount the RAM disk, using the checkpoint if available */
+static void wearMount(BattFsSuper *disk, KBlockRam *ram, KBlockRam *cnt)
+{
+	kblockram_init(ram, wear_disk, sizeof(wear_disk), PAGE_SIZE, true, false);
+	kblockram_init(cnt, wear_dev, sizeof(wear_dev), PAGE_SIZE, false, false);
+	#if CONFIG_BATTFS_CHECKPOINT
+		kblockram_init(&wear_ckp_ram, wear_ckp, sizeof(wear_ckp), PAGE_SIZE, false, false);
+		ASSERT(battfs_mountCheckpoint(disk, &ram->b, &wear_ckp_ram.b, page_array, sizeof(page_array)));
+	#else
+		ASSERT(battfs_mount(disk, &ram->b, page_array, sizeof(page_array)));
+	#endif
+	ASSERT(battfs_wearInit(disk, &cnt->b, erase_cnt, sizeof(erase_cnt)));
+}
+
+static void wearCheckCold(BattFsSuper *disk)
+{
+	BattFs fd;
+	uint8_t buf[DATA_SIZE];
+
+	for (inode_t i = 0; i < COLD_FILES; i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd, i, 0));
+		ASSERT(fd.fd.size == COLD_PAGES * DATA_SIZE);
+		for (int pg = 0; pg < COLD_PAGES; pg++)
+		{
+			ASSERT(kfile_read(&fd.fd, buf, DATA_SIZE) == DATA_SIZE);
+			for (int j = 0; j < DATA_SIZE; j++)
+				ASSERT(buf[j] == (uint8_t)(i + pg + j));
+		}
+		ASSERT(kfile_close(&fd.fd) == 0);
+	}
+}
+
+/*
+ * Fill most of the disk with files never rewritten and keep rewriting
+ * a small one, calling battfs_gcStep() after each write if \a gc.
+ * The range of the erase counts is returned in \a min and \a max.
+ */
+static void wearRun(BattFsSuper *disk, KBlockRam *ram, KBlockRam *cnt, bool gc, erase_cnt_t *min, erase_cnt_t *max)
+{
+	BattFs fd;
+	uint8_t buf[DATA_SIZE];
+
+	memset(wear_disk, 0xff, sizeof(wear_disk));
+	memset(wear_dev, 0xff, sizeof(wear_dev));
+	#if CONFIG_BATTFS_CHECKPOINT
+		memset(wear_ckp, 0xff, sizeof(wear_ckp));
+	#endif
+	wearMount(disk, ram, cnt);
+
+	for (inode_t i = 0; i < COLD_FILES; i++)
+	{
+		ASSERT(battfs_fileopen(disk, &fd, i, BATTFS_CREATE));
+		for (int pg = 0; pg < COLD_PAGES; pg++)
+		{
+			for (int j = 0; j < DATA_SIZE; j++)
+				buf[j] = i + pg + j;
+			ASSERT(kfile_write(&fd.fd, buf, DATA_SIZE) == DATA_SIZE);
+		}
+		ASSERT(kfile_close(&fd.fd) == 0);
+	}
+
+	ASSERT(battfs_fileopen(disk, &fd, HOT_FILE, BATTFS_CREATE));
+	for (unsigned n = 0; n < HOT_WRITES; n++)
+	{
+		memset(buf, n, sizeof(buf));
+		ASSERT(kfile_seek(&fd.fd, (n % 2) * DATA_SIZE, KSM_SEEK_SET) == (kfile_off_t)(n % 2) * DATA_SIZE);
+		ASSERT(kfile_write(&fd.fd, buf, DATA_SIZE) == DATA_SIZE);
+		ASSERT(kfile_flush(&fd.fd) == 0);
+		if (gc)
+			ASSERT(battfs_gcStep(disk));
+	}
+	ASSERT(kfile_close(&fd.fd) == 0);
+	ASSERT(battfs_fsck(disk));
+	wearCheckCold(disk);
+
+	*min = *max = erase_cnt[0];
+	for (pgcnt_t i = 1; i < PAGE_COUNT; i++)
+	{
+		*min = MIN(*min, erase_cnt[i]);
+		*max = MAX(*max, erase_cnt[i]);
+	}
+}
+
+static void wearLeveling(BattFsSuper *disk)
+{
+	KBlockRam ram, cnt;
+	erase_cnt_t min, max, gc_min, gc_max;
+	static erase_cnt_t saved[PAGE_COUNT];
+
+	TRACEMSG("31: wear leveling\n");
+
+	/* Without the gc the pages of the cold files are never used again */
+	wearRun(disk, &ram, &cnt, false, &min, &max);
+	ASSERT(min == 1);
+	ASSERT(max > HOT_WRITES / (PAGE_COUNT - COLD_FILES * COLD_PAGES));
+	ASSERT(battfs_umount(disk));
+
+	wearRun(disk, &ram, &cnt, true, &gc_min, &gc_max);
+	ASSERT(gc_max - gc_min <= 4 * CONFIG_BATTFS_WEAR_THRESHOLD);
+	ASSERT(gc_max < max / 2);
+	memcpy(saved, erase_cnt, sizeof(saved));
+	ASSERT(battfs_umount(disk));
+
+	kprintf("BENCH battfs_wear writes=%d pages=%d min=%lu max=%lu gc_min=%lu gc_max=%lu\n",
+		HOT_WRITES, PAGE_COUNT, (unsigned long)min, (unsigned long)max,
+		(unsigned long)gc_min, (unsigned long)gc_max);
+
+	/* Erase counts are saved on umount */
+	memset(erase_cnt, 0, sizeof(erase_cnt));
+	wearMount(disk, &ram, &cnt);
+	ASSERT(memcmp(erase_cnt, saved, sizeof(saved)) == 0);
+	ASSERT(battfs_fsck(disk));
+	wearCheckCold(disk);
+
+	#if CONFIG_BATTFS_CHECKPOINT
+	{
+		/* The gc moves pages too, the checkpoint must be replayed correctly after a power loss */
+		pgcnt_t free_start;
+		disk_size_t free_bytes;
+		BattFs fd;
+		uint8_t buf[DATA_SIZE];
+
+		ASSERT(battfs_fileopen(disk, &fd, HOT_FILE, 0));
+		for (unsigned n = 0; n < 500; n++)
+		{
+			memset(buf, n, sizeof(buf));
+			ASSERT(kfile_seek(&fd.fd, (n % 2) * DATA_SIZE, KSM_SEEK_SET) == (kfile_off_t)(n % 2) * DATA_SIZE);
+			ASSERT(kfile_write(&fd.fd, buf, DATA_SIZE) == DATA_SIZE);
+			ASSERT(battfs_gcStep(disk));
+		}
+		ASSERT(kblock_flush(&ram.b) == 0);
+
+		ASSERT(battfs_mount(disk, &ram.b, page_array, sizeof(page_array)));
+		memcpy(ckp_ref, page_array, sizeof(ckp_ref));
+		free_start = disk->free_page_start;
+		free_bytes = disk->free_bytes;
+
+		wearMount(disk, &ram, &cnt);
+		ckpCompare(disk, free_start, free_bytes);
+		wearCheckCold(disk);
+	}
+	#endif
+	ASSERT(battfs_umount(disk));
+
+	TRACEMSG("31: passed\n");
+}
+#endif /* CONFIG_BATTFS_WEAR_LEVELING */
+
 int battfs_testRun(void)
 {
 	BattFsSuper disk;
@@ -1095,6 +1848,22 @@ int battfs_testRun(void)
 	endOfSpace(&disk);
 	multipleFilesRW(&disk);
 	openAllFiles(&disk);
+	#if CONFIG_BATTFS_CHECKPOINT
+		checkpointClean(&disk);
+		checkpointReplay(&disk);
+		checkpointStale(&disk);
+		checkpointCorrupt(&disk);
+		checkpointUnbuffered(&disk);
+		checkpointBench(&disk);
+	#endif
+	#if CONFIG_BATTFS_INODE_INDEX
+		indexOpen(&disk);
+	#endif
+	appendCombine(&disk);
+	zeroFill(&disk);
+	#if CONFIG_BATTFS_WEAR_LEVELING
+		wearLeveling(&disk);
+	#endif
 
 	kprintf("All tests passed!\n");
 
@@ -1108,6 +1877,9 @@ int battfs_testSetup(void)
 
 int battfs_testTearDown(void)
 {
+	#if CONFIG_BATTFS_CHECKPOINT
+		remove(ckp_filename);
+	#endif
 	return 0;
 }
 
@@ -39,6 +39,9 @@
 
 #include "fat.h"
 
+/* Fast append needs f_prealloc() and f_truncate() */
+#define FAT_APPEND  (!CONFIG_FAT_FS_READONLY && CONFIG_FAT_FS_MINIMIZE == 0)
+
 static size_t fatfile_read(struct KFile *_fd, void *buf, size_t size)
 {
 	FatFile *fd = FATFILE_CAST(_fd);
@@ -47,10 +50,33 @@ static size_t fatfile_read(struct KFile *_fd, void *buf, size_t size)
 	return count;
 }
 
+#if FAT_APPEND
+/*
+ * Preallocate the clusters for the writes up to \a end, plus a chunk.
+ * When there is no contiguous space left the fast append is turned off;
+ * disk errors abort the file and they are reported by the next f_write().
+ */
+static void fatfile_prealloc(FatFile *fd, DWORD end)
+{
+	DWORD alloc_end = end + fd->append_chunk;
+
+	if (alloc_end < end)
+		alloc_end = (DWORD)-1;
+	if (f_prealloc(&fd->fat_file, alloc_end) == FR_OK)
+		fd->alloc_end = alloc_end;
+	else
+		fd->append_chunk = 0;
+}
+#endif
+
 static size_t fatfile_write(struct KFile *_fd, const void *buf, size_t size)
 {
 	FatFile *fd = FATFILE_CAST(_fd);
 	UINT count;
+#if FAT_APPEND
+	if (fd->append_chunk && fd->fat_file.fptr + size > fd->alloc_end)
+		fatfile_prealloc(fd, fd->fat_file.fptr + size);
+#endif
 	fd->error_code = f_write(&fd->fat_file, buf, size, &count);
 	return count;
 }
@@ -58,7 +84,19 @@ static size_t fatfile_write(struct KFile *_fd, const void *buf, size_t size)
 static int fatfile_close(struct KFile *_fd)
 {
 	FatFile *fd = FATFILE_CAST(_fd);
+	FRESULT err = FR_OK;
+#if FAT_APPEND
+	if (fd->alloc_end > fd->fat_file.fsize)
+	{
+		/* Release the clusters preallocated past the end of file */
+		err = f_lseek(&fd->fat_file, fd->fat_file.fsize);
+		if (err == FR_OK)
+			err = f_truncate(&fd->fat_file);
+	}
+#endif
 	fd->error_code = f_close(&fd->fat_file);
+	if (fd->error_code == FR_OK)
+		fd->error_code = err;
 	if (fd->error_code)
 		return EOF;
 	else
@@ -97,6 +135,16 @@ static kfile_off_t fatfile_seek(struct KFile *_fd, kfile_off_t offset, KSeekMode
 		}
 		break;
 	}
+#if CONFIG_FAT_USE_FASTSEEK
+	if (!fd->fat_file.cltbl)
+	{
+		/* Map the cluster chain on the first seek */
+		fd->linkmap[0] = CONFIG_FAT_LINKMAP_SIZE;
+		fd->error_code = f_linkmap(&fd->fat_file, fd->linkmap);
+		if (fd->error_code)
+			return EOF;
+	}
+#endif
 	fd->error_code = f_lseek(&fd->fat_file, lseek_offset);
 	if ((fd->error_code) || (fd->fat_file.fptr != lseek_offset))
 		return EOF;
@@ -138,6 +186,18 @@ FRESULT fatfile_open(FatFile *file, const char *file_path, BYTE mode)
 	file->fd.flush = fatfile_flush;
 	file->fd.error = fatfile_error;
 	file->fd.clearerr = fatfile_clearerr;
+#if FAT_APPEND
+	file->append_chunk = 0;
+	file->alloc_end = 0;
+#endif
 	return f_open(&file->fat_file, file_path, mode);
 }
 
+#if FAT_APPEND
+void fatfile_setAppend(FatFile *file, DWORD chunk)
+{
+	file->append_chunk = chunk;
+	file->alloc_end = 0;
+}
+#endif
+
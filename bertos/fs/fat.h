@@ -35,6 +35,11 @@
  * This driver needs some low level hardware access functions. An example implementation
  * is provided in sd.h.
  *
+ * With CONFIG_FAT_USE_FASTSEEK each FatFile builds a map of its cluster chain
+ * on the first seek and keeps it up to date as the file grows: seeks and
+ * reads at random offsets then find their cluster in the map, without
+ * following the FAT chain from the start of the file.
+ *
  *
  * \author Luca Ottaviano <lottaviano@develer.com>
  *
@@ -55,6 +60,13 @@ typedef struct FatFile
 	KFile fd;
 	FIL fat_file;
 	FRESULT error_code;       ///< error code for calls like kfile_read
+#if CONFIG_FAT_USE_FASTSEEK
+	DWORD linkmap[CONFIG_FAT_LINKMAP_SIZE]; ///< Cluster chain map, see f_linkmap()
+#endif
+#if !CONFIG_FAT_FS_READONLY && CONFIG_FAT_FS_MINIMIZE == 0
+	DWORD append_chunk;       ///< Bytes preallocated at once in fast append mode, 0 if disabled
+	DWORD alloc_end;          ///< File offset up to which clusters have been preallocated
+#endif
 } FatFile;
 
 #define KFT_FATFILE MAKE_ID('F', 'A', 'T', 'F')
@@ -80,5 +92,25 @@ INLINE FatFile * FATFILE_CAST(KFile *fd)
  */
 FRESULT fatfile_open(FatFile *file, const char *file_path, BYTE mode);
 
+#if !CONFIG_FAT_FS_READONLY && CONFIG_FAT_FS_MINIMIZE == 0
+/**
+ * Set the fast append mode of \a file, opened for writing.
+ *
+ * When a write goes past the clusters allocated to the file, \a chunk
+ * more bytes are allocated at once as a run of contiguous clusters, right
+ * after the last cluster of the file if they are free. The file does not
+ * search a free cluster on the FAT every time it grows and, being
+ * contiguous, it takes a single fragment in the cluster chain map.
+ * The clusters left past the end of the file are released by kfile_close().
+ *
+ * If the disk has no contiguous run of free clusters large enough, the
+ * mode is turned off and the file grows one cluster at a time.
+ *
+ * \param file A pointer to an open FatFile.
+ * \param chunk Bytes to preallocate at once, 0 to disable the fast append.
+ */
+void fatfile_setAppend(FatFile *file, DWORD chunk);
+#endif
+
 #endif /* FS_FAT_H */
 
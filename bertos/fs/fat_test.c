@@ -37,6 +37,10 @@
  * $test$: cp bertos/cfg/cfg_fat.h $cfgdir/
  * $test$: echo  "#undef CONFIG_FAT_USE_MKFS" >> $cfgdir/cfg_fat.h
  * $test$: echo "#define CONFIG_FAT_USE_MKFS 1" >> $cfgdir/cfg_fat.h
+ * $test$: echo  "#undef CONFIG_FAT_USE_FASTSEEK" >> $cfgdir/cfg_fat.h
+ * $test$: echo "#define CONFIG_FAT_USE_FASTSEEK 1" >> $cfgdir/cfg_fat.h
+ * $test$: echo  "#undef CONFIG_FAT_LINKMAP_SIZE" >> $cfgdir/cfg_fat.h
+ * $test$: echo "#define CONFIG_FAT_LINKMAP_SIZE 80" >> $cfgdir/cfg_fat.h
  *
  */
 
@@ -45,7 +49,10 @@
 #include "fatfs/ff.h"
 #include "fatfs/diskio.h"
 
+#include <emul/diskio_emul.h>
+
 #include <cfg/test.h>
+#include <cfg/debug.h>
 
 /* avoid compiler warnings... */
 int fatfile_testSetup(void);
@@ -54,6 +61,213 @@ int fatfile_testRun(void);
 
 static FATFS file_system;
 
+/* The cluster size made by f_mkfs() in fatfile_testSetup() */
+#define CLUSTER_SIZE  512
+/* Fragments of the file written by fatfile_fastSeek() */
+#define SEEK_FRAGS    32
+#define SEEK_FRAG_LEN (64 * CLUSTER_SIZE)
+#define SEEK_SIZE     ((DWORD)SEEK_FRAGS * SEEK_FRAG_LEN)
+#define SEEK_READS    200
+
+static uint32_t rand_state = 1;
+
+static uint32_t nextRand(void)
+{
+	rand_state = rand_state * 1103515245UL + 12345;
+	return rand_state >> 8;
+}
+
+/* The file content is the sequence of its 32 bit word offsets */
+static void fillWords(uint32_t *buf, DWORD off, size_t len)
+{
+	for (size_t i = 0; i < len / sizeof(uint32_t); i++)
+		buf[i] = off + i * sizeof(uint32_t);
+}
+
+static DWORD freeClusters(void)
+{
+	DWORD nclst;
+	FATFS *fs;
+
+	ASSERT(f_getfree("", &nclst, &fs) == FR_OK);
+	return nclst;
+}
+
+/* Count the contiguous fragments of the cluster chain of \a path */
+static unsigned countFragments(const char *path)
+{
+	FIL fil;
+	DWORD tbl[512];
+	unsigned frags = 0;
+
+	ASSERT(f_open(&fil, path, FA_READ) == FR_OK);
+	tbl[0] = countof(tbl);
+	ASSERT(f_linkmap(&fil, tbl) == FR_OK);
+	for (DWORD *p = tbl + 1; *p; p += 2)
+		frags++;
+	ASSERT(f_close(&fil) == FR_OK);
+	return frags;
+}
+
+/* Read \a n words at random offsets of \a file and check them */
+static uint32_t randomReads(FatFile *file, DWORD size, int n, bool kfile)
+{
+	DiskEmulStats st;
+
+	disk_emul_stats(&st, true);
+	for (int i = 0; i < n; i++)
+	{
+		DWORD off = (nextRand() % size) & ~(sizeof(uint32_t) - 1);
+		uint32_t val;
+
+		if (kfile)
+		{
+			ASSERT(kfile_seek(&file->fd, off, KSM_SEEK_SET) == (kfile_off_t)off);
+			ASSERT(kfile_read(&file->fd, &val, sizeof(val)) == sizeof(val));
+		}
+		else
+		{
+			UINT count;
+			ASSERT(f_lseek(&file->fat_file, off) == FR_OK);
+			ASSERT(f_read(&file->fat_file, &val, sizeof(val), &count) == FR_OK);
+			ASSERT(count == sizeof(val));
+		}
+		if (val != off)
+		{
+			kprintf("Read %08lx at offset %08lx\n", (unsigned long)val, (unsigned long)off);
+			ASSERT(0);
+		}
+	}
+	disk_emul_stats(&st, true);
+	return st.read_sectors;
+}
+
+/*
+ * Write a file in fragments, interleaved with another one, then read it at
+ * random offsets following the FAT chain and with the cluster map.
+ */
+static int fatfile_fastSeek(void)
+{
+	static uint32_t buf[SEEK_FRAG_LEN / sizeof(uint32_t)];
+	FatFile file, other;
+	DWORD free_start = freeClusters();
+	DiskEmulStats st;
+
+	ASSERT(fatfile_open(&file, "seek.log", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	ASSERT(fatfile_open(&other, "other.log", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	for (DWORD off = 0; off < SEEK_SIZE; off += SEEK_FRAG_LEN)
+	{
+		fillWords(buf, off, sizeof(buf));
+		ASSERT(kfile_write(&file.fd, buf, sizeof(buf)) == sizeof(buf));
+		ASSERT(kfile_write(&other.fd, buf, CLUSTER_SIZE) == CLUSTER_SIZE);
+	}
+	ASSERT(kfile_close(&other.fd) == 0);
+	ASSERT(kfile_close(&file.fd) == 0);
+	ASSERT(countFragments("seek.log") == SEEK_FRAGS);
+
+	/* Random reads following the FAT chain */
+	ASSERT(fatfile_open(&file, "seek.log", FA_READ) == FR_OK);
+	uint32_t chain = randomReads(&file, SEEK_SIZE, SEEK_READS, false);
+
+	/* The first kfile_seek() maps the chain, then the FAT is not read */
+	disk_emul_stats(&st, true);
+	ASSERT(kfile_seek(&file.fd, 0, KSM_SEEK_SET) == 0);
+	disk_emul_stats(&st, true);
+	uint32_t map = randomReads(&file, SEEK_SIZE, SEEK_READS, true);
+	kprintf("BENCH fat_seek: %d random reads, %lu sectors read following the chain, "
+		"%lu with the map (%lu to build it)\n", SEEK_READS, (unsigned long)chain,
+		(unsigned long)map, (unsigned long)st.read_sectors);
+	ASSERT(map <= SEEK_READS);
+	ASSERT(map < chain);
+	ASSERT(kfile_close(&file.fd) == 0);
+
+	/* Grow the file through the map, the new clusters are mapped too */
+	ASSERT(fatfile_open(&file, "seek.log", FA_READ | FA_WRITE) == FR_OK);
+	ASSERT(kfile_seek(&file.fd, 0, KSM_SEEK_END) == (kfile_off_t)SEEK_SIZE);
+	fillWords(buf, SEEK_SIZE, sizeof(buf));
+	ASSERT(kfile_write(&file.fd, buf, sizeof(buf)) == sizeof(buf));
+	map = randomReads(&file, SEEK_SIZE + sizeof(buf), SEEK_READS, true);
+	ASSERT(map <= SEEK_READS);
+
+	/* Truncate to half, the map drops the released clusters */
+	ASSERT(kfile_seek(&file.fd, SEEK_SIZE / 2 + 100, KSM_SEEK_SET) == SEEK_SIZE / 2 + 100);
+	ASSERT(f_truncate(&file.fat_file) == FR_OK);
+	ASSERT(file.fat_file.fsize == SEEK_SIZE / 2 + 100);
+	map = randomReads(&file, SEEK_SIZE / 2, SEEK_READS, true);
+	ASSERT(map <= SEEK_READS);
+	ASSERT(kfile_seek(&file.fd, SEEK_SIZE / 2, KSM_SEEK_SET) == SEEK_SIZE / 2);
+	fillWords(buf, SEEK_SIZE / 2, sizeof(buf));
+	ASSERT(kfile_write(&file.fd, buf, sizeof(buf)) == sizeof(buf));
+	map = randomReads(&file, SEEK_SIZE / 2 + sizeof(buf), SEEK_READS, true);
+	ASSERT(map <= SEEK_READS);
+	ASSERT(kfile_close(&file.fd) == 0);
+
+	ASSERT(fatfile_open(&file, "seek.log", FA_READ) == FR_OK);
+	randomReads(&file, SEEK_SIZE / 2 + sizeof(buf), SEEK_READS, false);
+	ASSERT(kfile_close(&file.fd) == 0);
+
+	ASSERT(f_unlink("seek.log") == FR_OK);
+	ASSERT(f_unlink("other.log") == FR_OK);
+	ASSERT(freeClusters() == free_start);
+	return 0;
+}
+
+#define APPEND_RECORD 100
+#define APPEND_COUNT  2000
+#define APPEND_CHUNK  (16 * 1024UL)
+
+/*
+ * Append records to a file interleaved with another growing file,
+ * with and without the fast append mode.
+ */
+static unsigned appendRun(DWORD chunk)
+{
+	uint32_t rec[APPEND_RECORD / sizeof(uint32_t)];
+	FatFile file, other;
+	DWORD free_start = freeClusters();
+
+	ASSERT(fatfile_open(&file, "append.log", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	ASSERT(fatfile_open(&other, "other.log", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK);
+	fatfile_setAppend(&file, chunk);
+	for (int i = 0; i < APPEND_COUNT; i++)
+	{
+		fillWords(rec, i * sizeof(rec), sizeof(rec));
+		ASSERT(kfile_write(&file.fd, rec, sizeof(rec)) == sizeof(rec));
+		if (i % 4 == 0)
+			ASSERT(kfile_write(&other.fd, rec, sizeof(rec)) == sizeof(rec));
+	}
+	ASSERT(kfile_close(&other.fd) == 0);
+	ASSERT(kfile_close(&file.fd) == 0);
+
+	unsigned frags = countFragments("append.log");
+	ASSERT(fatfile_open(&file, "append.log", FA_READ) == FR_OK);
+	ASSERT(file.fat_file.fsize == APPEND_COUNT * sizeof(rec));
+	randomReads(&file, APPEND_COUNT * sizeof(rec), SEEK_READS, true);
+	ASSERT(kfile_close(&file.fd) == 0);
+
+	/* No preallocated cluster is left behind */
+	DWORD used = (APPEND_COUNT * sizeof(rec) + CLUSTER_SIZE - 1) / CLUSTER_SIZE
+		+ ((APPEND_COUNT + 3) / 4 * sizeof(rec) + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+	ASSERT(freeClusters() == free_start - used);
+
+	ASSERT(f_unlink("append.log") == FR_OK);
+	ASSERT(f_unlink("other.log") == FR_OK);
+	ASSERT(freeClusters() == free_start);
+	return frags;
+}
+
+static int fatfile_fastAppend(void)
+{
+	unsigned plain = appendRun(0);
+	unsigned fast = appendRun(APPEND_CHUNK);
+
+	kprintf("BENCH fat_append: %lu bytes in %u fragments, %u with fast append\n",
+		(unsigned long)APPEND_COUNT * APPEND_RECORD, plain, fast);
+	ASSERT(fast <= (APPEND_COUNT * APPEND_RECORD) / APPEND_CHUNK + 1);
+	ASSERT(fast < plain);
+	return 0;
+}
+
 int fatfile_testSetup(void)
 {
 	FRESULT err;
@@ -120,7 +334,12 @@ int fatfile_testRun(void)
 	fatfile_open(&file_handler, "foo.txt", FA_READ | FA_WRITE);
 	ASSERT((size_t)kfile_seek(&file_handler.fd, sizeof(int), KSM_SEEK_END) == sizeof(int) * (SIZE + 1));
 	ASSERT(kfile_seek(&file_handler.fd, -SIZE, KSM_SEEK_SET) == 0);
+	ASSERT(kfile_close(&file_handler.fd) == 0);
 
+	if (fatfile_fastSeek() != 0)
+		return -1;
+	if (fatfile_fastAppend() != 0)
+		return -1;
 	return 0;
 }
 
@@ -67,13 +67,8 @@ DRESULT disk_read (
 	KBlock *dev = devs[drv];
 	ASSERT(dev);
 
-
-	while (count--)
-	{
-		if (kblock_read(dev, sector++, buff, 0, dev->blk_size) != dev->blk_size)
-			return RES_ERROR;
-		buff += dev->blk_size;
-	}
+	if (kblock_readBlocks(dev, sector, buff, count) != count)
+		return RES_ERROR;
 	return RES_OK;
 }
 
@@ -93,12 +88,8 @@ DRESULT disk_write (
 	KBlock *dev = devs[drv];
 	ASSERT(dev);
 
-	while (count--)
-	{
-		if (kblock_write(dev, sector++, buff, 0, dev->blk_size) != dev->blk_size)
-			return RES_ERROR;
-		buff += dev->blk_size;
-	}
+	if (kblock_writeBlocks(dev, sector, buff, count) != count)
+		return RES_ERROR;
 	return RES_OK;
 }
 #endif /* _READONLY */
@@ -502,6 +502,104 @@ DWORD clust2sect (	/* !=0: sector number, 0: failed - invalid cluster# */
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Cluster link map of a file                                            */
+/*-----------------------------------------------------------------------*/
+/* The map is a table of DWORDs: tbl[0] is the size of the table, then
+/  come pairs of {number of clusters, first cluster#}, one for each
+/  contiguous fragment of the cluster chain from the top of the file,
+/  terminated by a zero. When the table is full, the last clusters of
+/  the chain are not in the map and they are followed on the FAT. */
+
+#if _USE_FASTSEEK
+static
+DWORD clmt_clust (	/* 0: not in the map, >=2: cluster# */
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs		/* File offset to look up */
+)
+{
+	DWORD cl, ncl, *tbl;
+
+
+	tbl = fp->cltbl;
+	if (!tbl) return 0;
+	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster index from the top of the file */
+	for (tbl++; (ncl = *tbl++) != 0; tbl++) {
+		if (cl < ncl) return *tbl + cl;		/* The cluster is in this fragment */
+		cl -= ncl;
+	}
+
+	return 0;
+}
+
+
+#if !_FS_READONLY
+static
+void clmt_add (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs,		/* File offset of the first cluster added to the chain */
+	DWORD clst,		/* First cluster# */
+	DWORD n			/* Number of contiguous clusters */
+)
+{
+	DWORD cl, *tbl;
+	UINT i;
+
+
+	tbl = fp->cltbl;
+	if (!tbl) return;
+	cl = ofs / SS(fp->fs) / fp->fs->csize;
+	for (i = 1; tbl[i]; i += 2) {
+		if (cl < tbl[i]) return;			/* Already in the map */
+		cl -= tbl[i];
+	}
+	if (cl) return;							/* Not following the last mapped cluster */
+	if (i > 1 && tbl[i - 1] + tbl[i - 2] == clst) {
+		tbl[i - 2] += n;					/* Stretch the last fragment */
+	} else if (i + 2 < tbl[0]) {
+		tbl[i] = n; tbl[i + 1] = clst;		/* Append a new fragment */
+		tbl[i + 2] = 0;
+	}
+}
+
+
+#if _FS_MINIMIZE == 0
+static
+void clmt_trim (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD ofs		/* New end of the cluster chain */
+)
+{
+	DWORD cl, *tbl;
+	UINT i;
+
+
+	tbl = fp->cltbl;
+	if (!tbl) return;
+	cl = ofs ? (ofs - 1) / SS(fp->fs) / fp->fs->csize + 1 : 0;	/* Clusters left in the chain */
+	for (i = 1; tbl[i]; i += 2) {
+		if (cl <= tbl[i]) {
+			if (cl) {
+				tbl[i] = cl; i += 2;
+			}
+			tbl[i] = 0;
+			break;
+		}
+		cl -= tbl[i];
+	}
+}
+#endif
+#endif /* !_FS_READONLY */
+
+#else
+#define	clmt_clust(fp, ofs)			0
+#define	clmt_add(fp, ofs, clst, n)	do {} while (0)
+#define	clmt_trim(fp, ofs)			do {} while (0)
+#endif /* _USE_FASTSEEK */
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Seek directory index                                                  */
 /*-----------------------------------------------------------------------*/
@@ -1627,6 +1725,9 @@ FRESULT f_open (
 	fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 	fp->fptr = 0; fp->csect = 255;		/* File pointer */
 	fp->dsect = 0;
+#if _USE_FASTSEEK
+	fp->cltbl = NULL;					/* No link map */
+#endif
 	fp->fs = dj.fs; fp->id = dj.fs->id;	/* Owner file system object of the file */
 
 	LEAVE_FF(dj.fs, FR_OK);
@@ -1667,8 +1768,10 @@ FRESULT f_read (
 		rbuff += rcnt, fp->fptr += rcnt, *br += rcnt, btr -= rcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
-				clst = (fp->fptr == 0) ?			/* On the top of the file? */
-					fp->org_clust : get_cluster(fp->fs, fp->curr_clust);
+				clst = clmt_clust(fp, fp->fptr);	/* Look up the link map first */
+				if (clst == 0)
+					clst = (fp->fptr == 0) ?		/* On the top of the file? */
+						fp->org_clust : get_cluster(fp->fs, fp->curr_clust);
 				if (clst <= 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 				fp->curr_clust = clst;				/* Update current cluster */
@@ -1753,12 +1856,17 @@ FRESULT f_write (
 		wbuff += wcnt, fp->fptr += wcnt, *bw += wcnt, btw -= wcnt) {
 		if ((fp->fptr % SS(fp->fs)) == 0) {			/* On the sector boundary? */
 			if (fp->csect >= fp->fs->csize) {		/* On the cluster boundary? */
-				if (fp->fptr == 0) {				/* On the top of the file? */
-					clst = fp->org_clust;			/* Follow from the origin */
-					if (clst == 0)					/* When there is no cluster chain, */
-						fp->org_clust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
-				} else {							/* Middle or end of the file */
-					clst = create_chain(fp->fs, fp->curr_clust);			/* Follow or streach cluster chain */
+				clst = clmt_clust(fp, fp->fptr);	/* Look up the link map first */
+				if (clst == 0) {
+					if (fp->fptr == 0) {			/* On the top of the file? */
+						clst = fp->org_clust;		/* Follow from the origin */
+						if (clst == 0)				/* When there is no cluster chain, */
+							fp->org_clust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+					} else {						/* Middle or end of the file */
+						clst = create_chain(fp->fs, fp->curr_clust);			/* Follow or streach cluster chain */
+					}
+					if (clst >= 2 && clst != 0xFFFFFFFF)
+						clmt_add(fp, fp->fptr, clst, 1);	/* Keep the link map up to date */
 				}
 				if (clst == 0) break;				/* Could not allocate a new cluster (disk full) */
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
@@ -1910,6 +2018,59 @@ FRESULT f_close (
 
 
 
+#if _USE_FASTSEEK
+/*-----------------------------------------------------------------------*/
+/* Set up the Cluster Link Map                                           */
+/*-----------------------------------------------------------------------*/
+/* Fill tbl with the map of the cluster chain of the file and attach it to
+/  the file object: from then on the file finds its clusters in the map
+/  instead of following the FAT. tbl[0] must hold the size of the table in
+/  DWORDs (at least 4), the map is kept up to date as the file grows or it
+/  is truncated. A null tbl detaches the map. */
+
+FRESULT f_linkmap (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD *tbl		/* Pointer to the map table (NULL: no map) */
+)
+{
+	FRESULT res;
+	DWORD cl, pcl, scl, ncl;
+	UINT i;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+
+	fp->cltbl = NULL;
+	if (tbl) {
+		if (tbl[0] < 4) LEAVE_FF(fp->fs, FR_INVALID_OBJECT);
+		i = 1;
+		cl = fp->org_clust;
+		while (cl && cl < fp->fs->max_clust) {
+			if (i + 2 >= tbl[0]) break;		/* The table is full */
+			scl = cl; ncl = 0;
+			do {							/* Count the contiguous clusters of a fragment */
+				pcl = cl; ncl++;
+				cl = get_cluster(fp->fs, cl);
+				if (cl == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
+				if (cl <= 1) ABORT(fp->fs, FR_INT_ERR);
+			} while (cl == pcl + 1);
+			tbl[i++] = ncl;
+			tbl[i++] = scl;
+		}
+		tbl[i] = 0;
+		fp->cltbl = tbl;
+	}
+
+	LEAVE_FF(fp->fs, FR_OK);
+}
+#endif /* _USE_FASTSEEK */
+
+
+
+
 #if _FS_MINIMIZE <= 2
 /*-----------------------------------------------------------------------*/
 /* Seek File R/W Pointer                                                 */
@@ -1939,7 +2100,12 @@ FRESULT f_lseek (
 	nsect = 0;
 	if (ofs > 0) {
 		bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
-		if (ifptr > 0 &&
+		clst = clmt_clust(fp, ofs - 1);			/* Look up the link map first */
+		if (clst) {									/* When the cluster is in the map, */
+			fp->fptr = (ofs - 1) & ~(bcs - 1);		/* go straight to it */
+			ofs -= fp->fptr;
+			fp->curr_clust = clst;
+		} else if (ifptr > 0 &&
 			(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
 			fp->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
 			ofs -= fp->fptr;
@@ -1952,6 +2118,7 @@ FRESULT f_lseek (
 				if (clst == 1) ABORT(fp->fs, FR_INT_ERR);
 				if (clst == 0xFFFFFFFF) ABORT(fp->fs, FR_DISK_ERR);
 				fp->org_clust = clst;
+				if (clst) clmt_add(fp, 0, clst, 1);
 			}
 #endif
 			fp->curr_clust = clst;
@@ -1972,6 +2139,10 @@ FRESULT f_lseek (
 				fp->curr_clust = clst;
 				fp->fptr += bcs;
 				ofs -= bcs;
+#if !_FS_READONLY
+				if (fp->flag & FA_WRITE)
+					clmt_add(fp, fp->fptr, clst, 1);
+#endif
 			}
 			fp->fptr += ofs;
 			fp->csect = (BYTE)(ofs / SS(fp->fs));	/* Sector offset in the cluster */
@@ -2148,20 +2319,25 @@ FRESULT f_truncate (
 	if (fp->fsize > fp->fptr) {
 		fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 		fp->flag |= FA__WRITTEN;
-		if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
+	}
+	/* Remove the clusters past the R/W point, preallocated ones included */
+	if (fp->fptr == 0) {		/* When set file size to zero, remove entire cluster chain */
+		if (fp->org_clust) {
 			res = remove_chain(fp->fs, fp->org_clust);
 			fp->org_clust = 0;
-		} else {				/* When truncate a part of the file, remove remaining clusters */
-			ncl = get_cluster(fp->fs, fp->curr_clust);
-			res = FR_OK;
-			if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
-			if (ncl == 1) res = FR_INT_ERR;
-			if (res == FR_OK && ncl < fp->fs->max_clust) {
-				res = put_cluster(fp->fs, fp->curr_clust, 0x0FFFFFFF);
-				if (res == FR_OK) res = remove_chain(fp->fs, ncl);
-			}
+			fp->flag |= FA__WRITTEN;
+		}
+	} else {					/* When truncate a part of the file, remove remaining clusters */
+		ncl = get_cluster(fp->fs, fp->curr_clust);
+		if (ncl == 0xFFFFFFFF) res = FR_DISK_ERR;
+		if (ncl == 1) res = FR_INT_ERR;
+		if (res == FR_OK && ncl < fp->fs->max_clust) {
+			res = put_cluster(fp->fs, fp->curr_clust, 0x0FFFFFFF);
+			if (res == FR_OK) res = remove_chain(fp->fs, ncl);
+			fp->flag |= FA__WRITTEN;
 		}
 	}
+	clmt_trim(fp, fp->fptr);
 	if (res != FR_OK) fp->flag |= FA__ERROR;
 
 	LEAVE_FF(fp->fs, res);
@@ -2170,6 +2346,97 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Preallocate Contiguous Clusters                                       */
+/*-----------------------------------------------------------------------*/
+/* Stretch the cluster chain of the file with a single run of contiguous
+/  clusters, so that it can hold fsz bytes. The file size does not change:
+/  f_write() and f_lseek() use the preallocated clusters as the file grows
+/  and f_truncate() releases the ones left past the end of the file. */
+
+FRESULT f_prealloc (
+	FIL *fp,		/* Pointer to the file object */
+	DWORD fsz		/* Number of bytes the cluster chain must hold */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD bcs, clst, last, have, need, ncl, scl, run, left;
+
+
+	res = validate(fp->fs, fp->id);		/* Check validity of the object */
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	if (fp->flag & FA__ERROR)			/* Check abort flag */
+		LEAVE_FF(fp->fs, FR_INT_ERR);
+	if (!(fp->flag & FA_WRITE))			/* Check access mode */
+		LEAVE_FF(fp->fs, FR_DENIED);
+
+	fs = fp->fs;
+	bcs = (DWORD)fs->csize * SS(fs);	/* Cluster size (byte) */
+	need = fsz ? (fsz - 1) / bcs + 1 : 0;
+
+	/* Find the last cluster of the chain, starting from the current one */
+	last = 0; have = 0;
+	if (fp->fptr > 0) {
+		clst = fp->curr_clust;
+		have = (fp->fptr - 1) / bcs + 1;
+	} else {
+		clst = fp->org_clust;
+		if (clst) have = 1;
+	}
+	while (clst) {
+		last = clst;
+		if (have >= need) LEAVE_FF(fs, FR_OK);	/* Already allocated */
+		clst = get_cluster(fs, last);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (clst <= 1) ABORT(fs, FR_INT_ERR);
+		if (clst >= fs->max_clust) break;		/* End of the chain */
+		have++;
+	}
+	if (have >= need) LEAVE_FF(fs, FR_OK);
+	need -= have;
+
+	/* Search a run of free clusters, right after the chain if possible */
+	scl = last ? last + 1 : fs->last_clust + 1;
+	if (scl < 2 || scl >= fs->max_clust) scl = 2;
+	ncl = scl; run = 0;
+	for (left = fs->max_clust - 2 + need; ; ncl++) {
+		if (ncl >= fs->max_clust) {		/* Wrap around, the run can't go on */
+			ncl = 2; run = 0;
+		}
+		clst = get_cluster(fs, ncl);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (clst == 1) ABORT(fs, FR_INT_ERR);
+		if (clst != 0) run = 0;
+		else if (++run == need) break;
+		if (--left == 0) LEAVE_FF(fs, FR_DENIED);	/* No contiguous space */
+	}
+	scl = ncl - need + 1;
+
+	/* Make the chain of the run, then link it to the file */
+	for (ncl = scl; ncl < scl + need - 1; ncl++) {
+		res = put_cluster(fs, ncl, ncl + 1);
+		if (res != FR_OK) ABORT(fs, res);
+	}
+	res = put_cluster(fs, ncl, 0x0FFFFFFF);
+	if (res == FR_OK && last) res = put_cluster(fs, last, scl);
+	if (res != FR_OK) ABORT(fs, res);
+	if (!last) fp->org_clust = scl;
+	clmt_add(fp, have * bcs, scl, need);
+
+	fs->last_clust = ncl;				/* Update FSINFO */
+	if (fs->free_clust != 0xFFFFFFFF) {
+		fs->free_clust -= need;
+		fs->fsi_flag = 1;
+	}
+	fp->flag |= FA__WRITTEN;
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Get Number of Free Clusters                                           */
 /*-----------------------------------------------------------------------*/
@@ -82,6 +82,14 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
+#ifndef _USE_FASTSEEK
+#define	_USE_FASTSEEK	0
+#endif
+/* To enable the cluster link map of the file objects (f_linkmap function),
+/  set _USE_FASTSEEK to 1. A file with a link map finds the cluster of any
+/  offset without reading the FAT. */
+
+
 #ifndef _DRIVES
 #define _DRIVES		1
 #endif
@@ -246,6 +254,9 @@ typedef struct _FIL {
 	DWORD	dir_sect;	/* Sector containing the directory entry */
 	BYTE*	dir_ptr;	/* Ponter to the directory entry in the window */
 #endif
+#if _USE_FASTSEEK
+	DWORD*	cltbl;		/* Pointer to the cluster link map table (NULL: no map) */
+#endif
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];/* File R/W buffer */
 #endif
@@ -403,6 +414,8 @@ FRESULT f_readdir (DIR*, FILINFO*);					/* Read a directory item */
 FRESULT f_stat (const char*, FILINFO*);				/* Get file status */
 FRESULT f_getfree (const char*, DWORD*, FATFS**);	/* Get number of free clusters on the drive */
 FRESULT f_truncate (FIL*);							/* Truncate file */
+FRESULT f_prealloc (FIL*, DWORD);					/* Allocate contiguous clusters to a file */
+FRESULT f_linkmap (FIL*, DWORD*);					/* Set up the cluster link map of a file */
 FRESULT f_sync (FIL*);								/* Flush cached data of a writing file */
 FRESULT f_unlink (const char*);						/* Delete an existing file or directory */
 FRESULT	f_mkdir (const char*);						/* Create a new directory */
@@ -118,10 +118,7 @@ int kblock_flush(struct KBlock *b)
 {
 	ASSERT(b);
 
-	if (!kblock_buffered(b))
-		return 0;
-
-	if (kblock_cacheDirty(b))
+	if (kblock_buffered(b) && kblock_cacheDirty(b))
 	{
 		LOG_INFO("flushing block %ld\n", b->priv.curr_blk);
 		if (kblock_store(b, b->priv.curr_blk) == 0)
@@ -129,6 +126,9 @@ int kblock_flush(struct KBlock *b)
 		else
 			return EOF;
 	}
+
+	if (b->priv.vt->flush)
+		return b->priv.vt->flush(b);
 	return 0;
 }
 
@@ -193,6 +193,71 @@ size_t kblock_write(struct KBlock *b, block_idx_t idx, const void *buf, size_t o
 	}
 }
 
+/* Return true if the cached block of \a b falls in the range [idx, idx + count) */
+INLINE bool kblock_cachedInRange(struct KBlock *b, block_idx_t idx, size_t count)
+{
+	return kblock_buffered(b) && b->priv.curr_blk >= idx && b->priv.curr_blk - idx < count;
+}
+
+size_t kblock_readBlocks(struct KBlock *b, block_idx_t idx, void *buf, size_t count)
+{
+	size_t i;
+
+	ASSERT(b);
+	ASSERT(buf);
+	ASSERT(idx + count <= b->blk_cnt);
+	LOG_INFO("blk_idx %ld, count %u\n", idx, count);
+
+	if (b->priv.vt->readBlocks)
+	{
+		/* The device must see the changes made in the buffer */
+		if (kblock_cachedInRange(b, idx, count) && kblock_flush(b) != 0)
+			return 0;
+		return b->priv.vt->readBlocks(b, b->priv.blk_start + idx, buf, count);
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (kblock_read(b, idx + i, buf, 0, b->blk_size) != b->blk_size)
+			break;
+		buf = (uint8_t *)buf + b->blk_size;
+	}
+	return i;
+}
+
+size_t kblock_writeBlocks(struct KBlock *b, block_idx_t idx, const void *buf, size_t count)
+{
+	size_t i;
+
+	ASSERT(b);
+	ASSERT(buf);
+	ASSERT(idx + count <= b->blk_cnt);
+	LOG_INFO("blk_idx %ld, count %u\n", idx, count);
+
+	if (b->priv.vt->writeBlocks)
+	{
+		size_t done = b->priv.vt->writeBlocks(b, b->priv.blk_start + idx, buf, count);
+
+		/* The data written replaces the cached block, dirty or not */
+		if (kblock_cachedInRange(b, idx, done))
+		{
+			size_t pos = (b->priv.curr_blk - idx) * b->blk_size;
+
+			kblock_writeBuf(b, (const uint8_t *)buf + pos, 0, b->blk_size);
+			kblock_setDirty(b, false);
+		}
+		return done;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (kblock_write(b, idx + i, buf, 0, b->blk_size) != b->blk_size)
+			break;
+		buf = (const uint8_t *)buf + b->blk_size;
+	}
+	return i;
+}
+
 int kblock_copy(struct KBlock *b, block_idx_t src, block_idx_t dest)
 {
 	ASSERT(b);
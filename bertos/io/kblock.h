@@ -101,11 +101,14 @@ struct KBlock;
  */
 typedef size_t (* kblock_read_direct_t)  (struct KBlock *b, block_idx_t index, void *buf, size_t offset, size_t size);
 typedef size_t (* kblock_write_direct_t) (struct KBlock *b, block_idx_t index, const void *buf, size_t offset, size_t size);
+typedef size_t (* kblock_read_blocks_t)  (struct KBlock *b, block_idx_t index, void *buf, size_t count);
+typedef size_t (* kblock_write_blocks_t) (struct KBlock *b, block_idx_t index, const void *buf, size_t count);
 
 typedef size_t (* kblock_read_t)        (struct KBlock *b, void *buf, size_t offset, size_t size);
 typedef size_t (* kblock_write_t)       (struct KBlock *b, const void *buf, size_t offset, size_t size);
 typedef int    (* kblock_load_t)        (struct KBlock *b, block_idx_t index);
 typedef int    (* kblock_store_t)       (struct KBlock *b, block_idx_t index);
+typedef int    (* kblock_flush_t)       (struct KBlock *b);
 
 typedef int    (* kblock_error_t)       (struct KBlock *b);
 typedef void   (* kblock_clearerr_t)    (struct KBlock *b);
@@ -119,11 +122,14 @@ typedef struct KBlockVTable
 {
 	kblock_read_direct_t readDirect;
 	kblock_write_direct_t writeDirect;
+	kblock_read_blocks_t readBlocks;   // Optional, \sa kblock_readBlocks()
+	kblock_write_blocks_t writeBlocks; // Optional, \sa kblock_writeBlocks()
 
 	kblock_read_t  readBuf;
 	kblock_write_t writeBuf;
 	kblock_load_t  load;
 	kblock_store_t store;
+	kblock_flush_t flush;     // Optional, \sa kblock_flush()
 
 	kblock_error_t    error;    // \sa kblock_error()
 	kblock_clearerr_t clearerr; // \sa kblock_clearerr()
@@ -247,6 +253,8 @@ INLINE void kblock_clearerr(struct KBlock *b)
  *
  * This function will write any pending modifications to the device.
  * If the device does not have a cache, this function will do nothing.
+ * Devices with their own caching, like \ref kblock_cache, are flushed
+ * through the flush method of their interface.
  *
  * \return 0 if all is OK, EOF on errors.
  * \sa kblock_read(), kblock_write(), kblock_buffered().
@@ -372,6 +380,36 @@ size_t kblock_read(struct KBlock *b, block_idx_t idx, void *buf, size_t offset,
  */
 size_t kblock_write(struct KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size);
 
+/**
+ * Read \a count whole blocks, starting from block \a idx.
+ *
+ * Devices that can transfer contiguous blocks with a single operation,
+ * like SD cards with their multiple block commands, do it in one go;
+ * the others read one block at a time.
+ *
+ * \param b KBlock device.
+ * \param idx the first block to read.
+ * \param buf a buffer of \a count * blk_size bytes.
+ * \param count the number of blocks to read.
+ *
+ * \return the number of blocks read.
+ *
+ * \sa kblock_writeBlocks().
+ */
+size_t kblock_readBlocks(struct KBlock *b, block_idx_t idx, void *buf, size_t count);
+
+/**
+ * Write \a count whole blocks, starting from block \a idx.
+ *
+ * The same as kblock_readBlocks(), but for writing.
+ * On buffered devices the cached block, if written, is kept coherent.
+ *
+ * \return the number of blocks written.
+ *
+ * \sa kblock_readBlocks().
+ */
+size_t kblock_writeBlocks(struct KBlock *b, block_idx_t idx, const void *buf, size_t count);
+
 /**
  * Copy one block to another.
  *
@@ -0,0 +1,248 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief KBlock cache: N-way write-back block cache for any KBlock.
+ *
+ * $WIZ$ module_name = "kblock_cache"
+ * $WIZ$ module_depends = "kblock"
+ */
+
+#include "kblock_cache.h"
+
+#define LOG_LEVEL   LOG_LVL_ERR
+#define LOG_FORMAT  LOG_FMT_VERBOSE
+
+#include <cfg/log.h>
+
+#include <string.h>
+
+/* Flags of the cache lines */
+#define KBC_VALID  BV(0)  ///< The line holds a block
+#define KBC_DIRTY  BV(1)  ///< The block has been modified
+#define KBC_REF    BV(2)  ///< The block has been used since the last CLOCK sweep
+
+INLINE uint8_t *kblockcache_lineData(KBlockCache *c, size_t line)
+{
+	return c->data + line * c->b.blk_size;
+}
+
+/* Write back the line \a line if it's dirty */
+static int kblockcache_clean(KBlockCache *c, size_t line)
+{
+	KBlockCacheLine *l = &c->lines[line];
+
+	if (!(l->flags & KBC_DIRTY))
+		return 0;
+
+	LOG_INFO("writing back block %ld\n", (long)l->idx);
+	if (kblock_write(c->dev, l->idx, kblockcache_lineData(c, line), 0, c->b.blk_size) != c->b.blk_size)
+		return EOF;
+
+	l->flags &= ~KBC_DIRTY;
+	c->stats.writebacks++;
+	return 0;
+}
+
+/* Choose a line to reuse with the CLOCK algorithm */
+static size_t kblockcache_victim(KBlockCache *c)
+{
+	for (;;)
+	{
+		size_t line = c->hand;
+		KBlockCacheLine *l = &c->lines[line];
+
+		c->hand = (c->hand + 1) % c->count;
+		if (!(l->flags & KBC_VALID))
+			return line;
+		if (!(l->flags & KBC_REF))
+			return line;
+		/* Give it a second chance */
+		l->flags &= ~KBC_REF;
+	}
+}
+
+/*
+ * Return the line holding block \a idx, loading it from the device if
+ * \a load is true, or -1 on errors.
+ */
+static int kblockcache_get(KBlockCache *c, block_idx_t idx, bool load)
+{
+	KBlockCacheLine *l;
+	size_t line;
+
+	/* Most accesses hit the same block of the previous one */
+	l = &c->lines[c->last];
+	if ((l->flags & KBC_VALID) && l->idx == idx)
+	{
+		l->flags |= KBC_REF;
+		c->stats.hits++;
+		return c->last;
+	}
+
+	for (line = 0; line < c->count; line++)
+	{
+		l = &c->lines[line];
+		if ((l->flags & KBC_VALID) && l->idx == idx)
+		{
+			l->flags |= KBC_REF;
+			c->last = line;
+			c->stats.hits++;
+			return line;
+		}
+	}
+
+	c->stats.misses++;
+	line = kblockcache_victim(c);
+	if (kblockcache_clean(c, line) != 0)
+		return -1;
+
+	l = &c->lines[line];
+	l->flags = 0;
+	if (load)
+	{
+		LOG_INFO("loading block %ld\n", (long)idx);
+		if (kblock_read(c->dev, idx, kblockcache_lineData(c, line), 0, c->b.blk_size) != c->b.blk_size)
+			return -1;
+		c->stats.loads++;
+	}
+	l->idx = idx;
+	l->flags = KBC_VALID | KBC_REF;
+	c->last = line;
+	return line;
+}
+
+static size_t kblockcache_readDirect(struct KBlock *b, block_idx_t idx, void *buf, size_t offset, size_t size)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+	int line = kblockcache_get(c, idx, true);
+
+	if (line < 0)
+		return 0;
+
+	memcpy(buf, kblockcache_lineData(c, line) + offset, size);
+	return size;
+}
+
+static size_t kblockcache_writeDirect(struct KBlock *b, block_idx_t idx, const void *buf, size_t offset, size_t size)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+	/* A whole block overwrite doesn't need the old data */
+	int line = kblockcache_get(c, idx, offset != 0 || size != b->blk_size);
+
+	if (line < 0)
+		return 0;
+
+	memcpy(kblockcache_lineData(c, line) + offset, buf, size);
+	c->lines[line].flags |= KBC_DIRTY;
+	return size;
+}
+
+static int kblockcache_flush(struct KBlock *b)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+
+	/* Write back in block order, to help the device */
+	for (;;)
+	{
+		size_t line, next = c->count;
+
+		for (line = 0; line < c->count; line++)
+			if ((c->lines[line].flags & KBC_DIRTY)
+				&& (next == c->count || c->lines[line].idx < c->lines[next].idx))
+				next = line;
+
+		if (next == c->count)
+			break;
+		if (kblockcache_clean(c, next) != 0)
+			return EOF;
+	}
+	return kblock_flush(c->dev);
+}
+
+static int kblockcache_error(struct KBlock *b)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+	return kblock_error(c->dev);
+}
+
+static void kblockcache_clearerr(struct KBlock *b)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+	kblock_clearerr(c->dev);
+}
+
+static int kblockcache_close(struct KBlock *b)
+{
+	KBlockCache *c = KBLOCKCACHE_CAST(b);
+	return kblock_close(c->dev);
+}
+
+static const KBlockVTable kblockcache_vt =
+{
+	.readDirect = kblockcache_readDirect,
+	.writeDirect = kblockcache_writeDirect,
+	.flush = kblockcache_flush,
+
+	.error = kblockcache_error,
+	.clearerr = kblockcache_clearerr,
+	.close = kblockcache_close,
+};
+
+void kblockcache_init(KBlockCache *c, KBlock *dev, KBlockCacheLine *lines, void *buf, size_t count)
+{
+	ASSERT(dev);
+	ASSERT(lines);
+	ASSERT(buf);
+	ASSERT(count);
+
+	memset(c, 0, sizeof(*c));
+	memset(lines, 0, count * sizeof(*lines));
+
+	DB(c->b.priv.type = KBT_KBLOCKCACHE);
+	c->b.blk_size = dev->blk_size;
+	c->b.blk_cnt = dev->blk_cnt;
+	/* Partial writes are merged in the cache */
+	c->b.priv.flags |= KB_PARTIAL_WRITE;
+	c->b.priv.vt = &kblockcache_vt;
+
+	c->dev = dev;
+	c->lines = lines;
+	c->data = (uint8_t *)buf;
+	c->count = count;
+}
+
+void kblockcache_stats(KBlockCache *c, KBlockCacheStats *stats, bool reset)
+{
+	*stats = c->stats;
+	if (reset)
+		memset(&c->stats, 0, sizeof(c->stats));
+}
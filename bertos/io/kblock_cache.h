@@ -0,0 +1,128 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief KBlock cache: N-way write-back block cache for any KBlock.
+ *
+ * The cache is a KBlock itself, that decorates another KBlock device
+ * keeping in RAM the last blocks used, instead of the single block
+ * buffer of the buffered KBlocks.
+ * Accesses to cached blocks never reach the device; modified blocks are
+ * written back when they are evicted or when the cache is flushed with
+ * kblock_flush().
+ * Victims are chosen with the CLOCK algorithm, an approximation of LRU
+ * that only needs a reference bit per block.
+ *
+ * The decorated device is better opened unbuffered: the cache reads and
+ * writes whole blocks and a device buffer would only add a copy.
+ *
+ * \code
+ * static KBlockPosix disk;
+ * static KBlockCache cache;
+ * static KBlockCacheLine lines[8];
+ * static uint8_t cache_buf[8 * 512];
+ *
+ * kblockposix_init(&disk, fp, false, NULL, 512, 1024);
+ * kblockcache_init(&cache, &disk.b, lines, cache_buf, countof(lines));
+ * // use cache.b instead of disk.b
+ * \endcode
+ *
+ * $WIZ$ module_name = "kblock_cache"
+ * $WIZ$ module_depends = "kblock"
+ */
+
+#ifndef IO_KBLOCK_CACHE_H
+#define IO_KBLOCK_CACHE_H
+
+#include "kblock.h"
+
+/**
+ * Cache counters.
+ */
+typedef struct KBlockCacheStats
+{
+	uint32_t hits;        ///< Accesses to cached blocks
+	uint32_t misses;      ///< Accesses that needed a free cache line
+	uint32_t loads;       ///< Blocks read from the device
+	uint32_t writebacks;  ///< Dirty blocks written to the device
+} KBlockCacheStats;
+
+/**
+ * State of a cached block.
+ */
+typedef struct KBlockCacheLine
+{
+	block_idx_t idx;      ///< Block held by the line
+	uint8_t flags;        ///< KBC_* flags
+} KBlockCacheLine;
+
+typedef struct KBlockCache
+{
+	KBlock b;
+	KBlock *dev;              ///< Decorated device
+	KBlockCacheLine *lines;   ///< State of the cache lines
+	uint8_t *data;            ///< Data of the cache lines, blk_size bytes each
+	size_t count;             ///< Number of cache lines
+	size_t hand;              ///< CLOCK hand, next eviction candidate
+	size_t last;              ///< Line of the last access
+	KBlockCacheStats stats;
+} KBlockCache;
+
+#define KBT_KBLOCKCACHE MAKE_ID('K', 'B', 'C', 'H')
+
+
+INLINE KBlockCache *KBLOCKCACHE_CAST(KBlock *b)
+{
+	ASSERT(b->priv.type == KBT_KBLOCKCACHE);
+	return (KBlockCache *)b;
+}
+
+/**
+ * Initialize the cache \a c for the device \a dev.
+ *
+ * \param c Cache to initialize.
+ * \param dev Device to cache, already initialized.
+ * \param lines Array of \a count cache line states.
+ * \param buf Buffer for the cached blocks, \a count * dev->blk_size bytes.
+ * \param count Number of blocks to cache.
+ */
+void kblockcache_init(KBlockCache *c, KBlock *dev, KBlockCacheLine *lines, void *buf, size_t count);
+
+/**
+ * Copy the counters of \a c in \a stats and clear them if \a reset.
+ */
+void kblockcache_stats(KBlockCache *c, KBlockCacheStats *stats, bool reset);
+
+int kblock_cache_testRun(void);
+int kblock_cache_testSetup(void);
+int kblock_cache_testTearDown(void);
+
+#endif /* IO_KBLOCK_CACHE_H */
@@ -0,0 +1,265 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Test and benchmark for the KBlock cache.
+ *
+ * The benchmark replays on a kblock_posix image an access pattern
+ * that alternates metadata and data blocks, like a filesystem does,
+ * with and without the cache, and prints the results:
+ *
+ * \code
+ * BENCH kblock_cache lines=8 accesses=12288 hits=10477 misses=1811 loads=1811 writebacks=1811 us_raw=35352 us_cached=8603
+ * \endcode
+ */
+
+#include "kblock_cache.h"
+#include "kblock_ram.h"
+#include "kblock_posix.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <os/hptime.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_SIZE   64
+#define BLOCK_COUNT  32
+#define CACHE_LINES  4
+#define TEST_OPS     4096
+
+#define BENCH_FILE    "kblock_cache.bin"
+#define BENCH_BLOCKS  256
+#define BENCH_LINES   8
+#define BENCH_OPS     8192
+
+static uint8_t ram_buf[BLOCK_SIZE * BLOCK_COUNT];
+static uint8_t shadow[BLOCK_SIZE * BLOCK_COUNT];
+static KBlockCacheLine lines[BENCH_LINES];
+static uint8_t cache_buf[BLOCK_SIZE * BENCH_LINES];
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* Random reads and writes, checked against a shadow copy of the device */
+static int test_random(void)
+{
+	KBlockRam ram;
+	KBlockCache cache;
+	KBlockCacheStats st;
+	uint8_t buf[BLOCK_SIZE];
+
+	kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, false, false);
+	kblockcache_init(&cache, &ram.b, lines, cache_buf, CACHE_LINES);
+	memset(ram_buf, 0, sizeof(ram_buf));
+	memset(shadow, 0, sizeof(shadow));
+
+	for (int i = 0; i < TEST_OPS; i++)
+	{
+		block_idx_t idx = rnd() % BLOCK_COUNT;
+		size_t offset = rnd() % BLOCK_SIZE;
+		size_t size = rnd() % (BLOCK_SIZE - offset) + 1;
+		uint8_t *ref = shadow + idx * BLOCK_SIZE + offset;
+
+		if (rnd() % 8 == 0)
+		{
+			/* Whole block write */
+			offset = 0;
+			size = BLOCK_SIZE;
+			ref = shadow + idx * BLOCK_SIZE;
+		}
+
+		if (rnd() % 2)
+		{
+			for (size_t j = 0; j < size; j++)
+				buf[j] = rnd();
+			memcpy(ref, buf, size);
+			if (kblock_write(&cache.b, idx, buf, offset, size) != size)
+				return -1;
+		}
+		else
+		{
+			if (kblock_read(&cache.b, idx, buf, offset, size) != size)
+				return -1;
+			if (memcmp(buf, ref, size))
+				return -1;
+		}
+	}
+
+	kblockcache_stats(&cache, &st, false);
+	kprintf("hits %ld, misses %ld, loads %ld, writebacks %ld\n",
+		(long)st.hits, (long)st.misses, (long)st.loads, (long)st.writebacks);
+	if (st.hits + st.misses != TEST_OPS)
+		return -1;
+
+	if (kblock_flush(&cache.b) != 0)
+		return -1;
+	if (memcmp(ram_buf, shadow, sizeof(shadow)))
+		return -1;
+	return 0;
+}
+
+/* Modified blocks reach the device only when evicted or flushed */
+static int test_writeBack(void)
+{
+	KBlockRam ram;
+	KBlockCache cache;
+	KBlockCacheStats st;
+	uint8_t buf[BLOCK_SIZE];
+
+	kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, false, false);
+	kblockcache_init(&cache, &ram.b, lines, cache_buf, CACHE_LINES);
+	memset(ram_buf, 0, sizeof(ram_buf));
+
+	memset(buf, 0xaa, sizeof(buf));
+	for (block_idx_t i = 0; i < CACHE_LINES; i++)
+		kblock_write(&cache.b, i, buf, 0, BLOCK_SIZE);
+	if (ram_buf[0] != 0)
+		return -1;
+
+	/* Block 0 is the CLOCK victim */
+	kblock_read(&cache.b, CACHE_LINES, buf, 0, 1);
+	if (ram_buf[0] != 0xaa || ram_buf[BLOCK_SIZE] != 0)
+		return -1;
+
+	kblock_flush(&cache.b);
+	if (ram_buf[(CACHE_LINES - 1) * BLOCK_SIZE] != 0xaa)
+		return -1;
+
+	kblockcache_stats(&cache, &st, true);
+	/* Whole block writes don't load the blocks */
+	if (st.loads != 1 || st.writebacks != CACHE_LINES)
+		return -1;
+	kblockcache_stats(&cache, &st, false);
+	if (st.hits || st.misses)
+		return -1;
+	return 0;
+}
+
+/*
+ * Filesystem-like workload: read-modify-write of a metadata block out
+ * of four, then a data block, mostly sequential.
+ */
+static hptime_t bench_run(KBlock *b)
+{
+	uint8_t buf[16];
+	block_idx_t data = 4;
+	hptime_t start = hptime_get();
+
+	for (int i = 0; i < BENCH_OPS / 2; i++)
+	{
+		block_idx_t meta = rnd() % 4;
+
+		kblock_read(b, meta, buf, 0, sizeof(buf));
+		buf[0]++;
+		kblock_write(b, meta, buf, 0, sizeof(buf));
+
+		if (rnd() % 8 == 0)
+			data = 4 + rnd() % (BENCH_BLOCKS - 4);
+		else if (i % 4 == 0)
+			data = 4 + (data - 3) % (BENCH_BLOCKS - 4);
+		kblock_write(b, data, buf, (i % 4) * sizeof(buf), sizeof(buf));
+	}
+	kblock_flush(b);
+	return hptime_get() - start;
+}
+
+static int bench_posix(void)
+{
+	static uint8_t big_buf[BLOCK_SIZE * BENCH_LINES];
+	KBlockPosix f;
+	KBlockCache cache;
+	KBlockCacheStats st;
+	hptime_t raw, cached;
+	FILE *fp = fopen(BENCH_FILE, "w+");
+
+	if (!fp)
+		return -1;
+	for (int i = 0; i < BENCH_BLOCKS * BLOCK_SIZE; i++)
+		fputc(0xff, fp);
+
+	kblockposix_init(&f, fp, false, NULL, BLOCK_SIZE, BENCH_BLOCKS);
+	seed = 1;
+	raw = bench_run(&f.b);
+
+	kblockcache_init(&cache, &f.b, lines, big_buf, BENCH_LINES);
+	seed = 1;
+	cached = bench_run(&cache.b);
+	kblockcache_stats(&cache, &st, false);
+
+	kprintf("BENCH kblock_cache lines=%d accesses=%d hits=%lu misses=%lu loads=%lu writebacks=%lu us_raw=%lu us_cached=%lu\n",
+		BENCH_LINES, BENCH_OPS / 2 * 3,
+		(unsigned long)st.hits, (unsigned long)st.misses,
+		(unsigned long)st.loads, (unsigned long)st.writebacks,
+		(unsigned long)raw, (unsigned long)cached);
+
+	return kblock_close(&cache.b);
+}
+
+int kblock_cache_testRun(void)
+{
+	if (test_random() != 0)
+	{
+		kputs("KBlock cache random access test..FAIL!\n");
+		return -1;
+	}
+	if (test_writeBack() != 0)
+	{
+		kputs("KBlock cache write-back test..FAIL!\n");
+		return -1;
+	}
+	if (bench_posix() != 0)
+	{
+		kputs("KBlock cache benchmark..FAIL!\n");
+		return -1;
+	}
+	kputs("KBlock cache test..ok!\n");
+	return 0;
+}
+
+int kblock_cache_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int kblock_cache_testTearDown(void)
+{
+	return remove(BENCH_FILE);
+}
+
+TEST_MAIN(kblock_cache);
@@ -0,0 +1,250 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Test for the KBlock multiple block operations.
+ *
+ * Checks kblock_readBlocks() and kblock_writeBlocks() on every kind of
+ * RAM and posix device, and the coherency with the block buffer.
+ * The benchmark reads a kblock_posix image one block at a time and
+ * with multiple block reads, and prints the results:
+ *
+ * \code
+ * BENCH kblock blocks=1024 us_single=319 us_multi=3
+ * \endcode
+ */
+
+#include "kblock.h"
+#include "kblock_ram.h"
+#include "kblock_posix.h"
+#include "kfile_block.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <os/hptime.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_SIZE   64
+#define BLOCK_COUNT  16
+
+#define TEST_FILE     "kblock_test.bin"
+#define BENCH_BLOCKS  1024
+
+int kblock_testSetup(void);
+int kblock_testRun(void);
+int kblock_testTearDown(void);
+
+static uint8_t ram_buf[BLOCK_SIZE * (BLOCK_COUNT + 1)];
+static uint8_t page_buf[BLOCK_SIZE];
+static uint8_t data[BLOCK_SIZE * BLOCK_COUNT];
+static uint8_t check[BLOCK_SIZE * BLOCK_COUNT];
+
+static void fill(uint8_t *buf, size_t size, uint8_t seed)
+{
+	for (size_t i = 0; i < size; i++)
+		buf[i] = (uint8_t)(i * 7 + seed);
+}
+
+/* Run the multiple block operations on a device of BLOCK_COUNT blocks */
+static int test_blocks(KBlock *b)
+{
+	uint8_t blk[BLOCK_SIZE];
+
+	ASSERT(b->blk_cnt == BLOCK_COUNT);
+
+	fill(data, sizeof(data), 1);
+	if (kblock_writeBlocks(b, 0, data, BLOCK_COUNT) != BLOCK_COUNT)
+		return -1;
+	memset(check, 0, sizeof(check));
+	if (kblock_readBlocks(b, 0, check, BLOCK_COUNT) != BLOCK_COUNT
+		|| memcmp(data, check, sizeof(data)) != 0)
+		return -1;
+
+	/* A pending partial write must be seen by a multiple block read */
+	memset(blk, 0xaa, sizeof(blk));
+	if (kblock_write(b, 5, blk, 3, 10) != 10)
+		return -1;
+	memset(data + 5 * BLOCK_SIZE + 3, 0xaa, 10);
+	if (kblock_readBlocks(b, 4, check, 3) != 3
+		|| memcmp(data + 4 * BLOCK_SIZE, check, 3 * BLOCK_SIZE) != 0)
+		return -1;
+
+	/* A multiple block write must replace the buffered block */
+	if (kblock_read(b, 6, blk, 0, BLOCK_SIZE) != BLOCK_SIZE)
+		return -1;
+	if (kblock_write(b, 6, blk, 0, 1) != 1)
+		return -1;
+	fill(data + 6 * BLOCK_SIZE, 2 * BLOCK_SIZE, 9);
+	if (kblock_writeBlocks(b, 6, data + 6 * BLOCK_SIZE, 2) != 2)
+		return -1;
+	if (kblock_read(b, 6, blk, 0, BLOCK_SIZE) != BLOCK_SIZE
+		|| memcmp(data + 6 * BLOCK_SIZE, blk, BLOCK_SIZE) != 0)
+		return -1;
+	if (kblock_flush(b) != 0)
+		return -1;
+	if (kblock_readBlocks(b, 0, check, BLOCK_COUNT) != BLOCK_COUNT
+		|| memcmp(data, check, sizeof(data)) != 0)
+		return -1;
+
+	return 0;
+}
+
+/* Whole blocks read and written through a KFileBlock */
+static int test_kfile(KBlock *b)
+{
+	KFileBlock f;
+	size_t len = BLOCK_SIZE * 5 + BLOCK_SIZE / 2;
+
+	kfileblock_init(&f, b);
+	fill(data, sizeof(data), 3);
+	if (kfile_write(&f.fd, data, sizeof(data)) != sizeof(data))
+		return -1;
+
+	memset(check, 0, sizeof(check));
+	kfile_seek(&f.fd, BLOCK_SIZE / 2, KSM_SEEK_SET);
+	if (kfile_read(&f.fd, check, len) != len
+		|| memcmp(data + BLOCK_SIZE / 2, check, len) != 0)
+		return -1;
+
+	/* Reads stop at the end of the device */
+	kfile_seek(&f.fd, 0, KSM_SEEK_SET);
+	if (kfile_read(&f.fd, check, sizeof(check) + 1) != sizeof(check)
+		|| memcmp(data, check, sizeof(data)) != 0)
+		return -1;
+
+	return kfile_flush(&f.fd);
+}
+
+static int test_ram(void)
+{
+	KBlockRam ram;
+
+	kblockram_init(&ram, ram_buf, sizeof(ram_buf) - BLOCK_SIZE, BLOCK_SIZE, false, false);
+	if (test_blocks(&ram.b) != 0 || test_kfile(&ram.b) != 0)
+		return -1;
+	kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, true, false);
+	if (test_blocks(&ram.b) != 0 || test_kfile(&ram.b) != 0)
+		return -1;
+	kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, true, true);
+	if (test_blocks(&ram.b) != 0 || test_kfile(&ram.b) != 0)
+		return -1;
+	return 0;
+}
+
+static int test_posix(void)
+{
+	KBlockPosix f;
+	FILE *fp = fopen(TEST_FILE, "w+");
+
+	if (!fp)
+		return -1;
+	for (int i = 0; i < BLOCK_COUNT * BLOCK_SIZE; i++)
+		fputc(0, fp);
+
+	kblockposix_init(&f, fp, false, NULL, BLOCK_SIZE, BLOCK_COUNT);
+	if (test_blocks(&f.b) != 0 || test_kfile(&f.b) != 0)
+		return -1;
+	kblockposix_init(&f, fp, false, page_buf, BLOCK_SIZE, BLOCK_COUNT);
+	if (test_blocks(&f.b) != 0 || test_kfile(&f.b) != 0)
+		return -1;
+	kblockposix_init(&f, fp, true, page_buf, BLOCK_SIZE, BLOCK_COUNT);
+	if (test_blocks(&f.b) != 0 || test_kfile(&f.b) != 0)
+		return -1;
+
+	return kblock_close(&f.b);
+}
+
+static int bench_posix(void)
+{
+	static uint8_t big_buf[BLOCK_SIZE * BENCH_BLOCKS];
+	KBlockPosix f;
+	hptime_t start, single, multi;
+	FILE *fp = fopen(TEST_FILE, "w+");
+
+	if (!fp)
+		return -1;
+	fill(big_buf, sizeof(big_buf), 5);
+	fwrite(big_buf, 1, sizeof(big_buf), fp);
+	kblockposix_init(&f, fp, false, NULL, BLOCK_SIZE, BENCH_BLOCKS);
+
+	start = hptime_get();
+	for (block_idx_t i = 0; i < BENCH_BLOCKS; i++)
+		if (kblock_read(&f.b, i, big_buf + i * BLOCK_SIZE, 0, BLOCK_SIZE) != BLOCK_SIZE)
+			return -1;
+	single = hptime_get() - start;
+
+	start = hptime_get();
+	if (kblock_readBlocks(&f.b, 0, big_buf, BENCH_BLOCKS) != BENCH_BLOCKS)
+		return -1;
+	multi = hptime_get() - start;
+
+	kprintf("BENCH kblock blocks=%d us_single=%lu us_multi=%lu\n",
+		BENCH_BLOCKS, (unsigned long)single, (unsigned long)multi);
+
+	return kblock_close(&f.b);
+}
+
+int kblock_testRun(void)
+{
+	if (test_ram() != 0)
+	{
+		kputs("KBlock RAM multiple block test..FAIL!\n");
+		return -1;
+	}
+	if (test_posix() != 0)
+	{
+		kputs("KBlock posix multiple block test..FAIL!\n");
+		return -1;
+	}
+	if (bench_posix() != 0)
+	{
+		kputs("KBlock benchmark..FAIL!\n");
+		return -1;
+	}
+	kputs("KBlock test..ok!\n");
+	return 0;
+}
+
+int kblock_testSetup(void)
+{
+	kdbg_init();
+	return 0;
+}
+
+int kblock_testTearDown(void)
+{
+	return remove(TEST_FILE);
+}
+
+TEST_MAIN(kblock);
@@ -65,8 +65,19 @@ INLINE KFileBlock * KFILEBLOCK_CAST(KFile *fd)
 		if (id >= fb->blk->blk_cnt) \
 			break; \
 		size_t offset = (fd)->seek_pos % fb->blk->blk_size; \
-		size_t count = MIN(size, (size_t)(fb->blk->blk_size - offset)); \
-		size_t ret_len = kblock_##dir(fb->blk, id, buf, offset, count); \
+		size_t count, ret_len; \
+		if (offset == 0 && size >= fb->blk->blk_size) \
+		{ \
+			/* Transfer all the whole blocks with a single operation */ \
+			size_t blocks = MIN(size / fb->blk->blk_size, (size_t)(fb->blk->blk_cnt - id)); \
+			count = blocks * fb->blk->blk_size; \
+			ret_len = kblock_##dir##Blocks(fb->blk, id, buf, blocks) * fb->blk->blk_size; \
+		} \
+		else \
+		{ \
+			count = MIN(size, (size_t)(fb->blk->blk_size - offset)); \
+			ret_len = kblock_##dir(fb->blk, id, buf, offset, count); \
+		} \
 		size -= ret_len; \
 		(fd)->seek_pos += ret_len; \
 		buf = buf + ret_len; \
@@ -77,22 +88,185 @@ INLINE KFileBlock * KFILEBLOCK_CAST(KFile *fd)
 	len; \
 })
 
+/* Write to the device the data collected in the stream buffer */
+static int kfileblock_streamFlush(KFileBlock *fb)
+{
+	size_t blocks = fb->stream_fill / fb->blk->blk_size;
+	size_t tail = fb->stream_fill % fb->blk->blk_size;
+	int ret = 0;
+
+	if (!fb->stream_dirty)
+	{
+		fb->stream_fill = 0;
+		return 0;
+	}
+
+	if (blocks && kblock_writeBlocks(fb->blk, fb->stream_start, fb->stream, blocks) != blocks)
+		ret = EOF;
+	else if (tail && kblock_write(fb->blk, fb->stream_start + blocks,
+			fb->stream + blocks * fb->blk->blk_size, 0, tail) != tail)
+		ret = EOF;
+
+	fb->stream_fill = 0;
+	fb->stream_dirty = false;
+	return ret;
+}
+
+static size_t kfileblock_streamRead(KFileBlock *fb, uint8_t *buf, size_t size)
+{
+	KBlock *b = fb->blk;
+	size_t len = 0;
+	bool sequential = (fb->fd.seek_pos == fb->next_pos);
+
+	if (fb->stream_dirty && kfileblock_streamFlush(fb) != 0)
+		return 0;
+
+	while (size)
+	{
+		block_idx_t id = fb->fd.seek_pos / b->blk_size;
+		if (id >= b->blk_cnt)
+			break;
+		size_t offset = fb->fd.seek_pos % b->blk_size;
+		size_t count, ret_len;
+
+		if (id >= fb->stream_start && (id - fb->stream_start) * b->blk_size < fb->stream_fill)
+		{
+			/* Read ahead */
+			size_t pos = (id - fb->stream_start) * b->blk_size + offset;
+			count = ret_len = MIN(size, fb->stream_fill - pos);
+			memcpy(buf, fb->stream + pos, count);
+		}
+		else if (offset == 0 && size >= b->blk_size)
+		{
+			/* Whole blocks go straight to the caller */
+			size_t blocks = MIN(size / b->blk_size, (size_t)(b->blk_cnt - id));
+			count = blocks * b->blk_size;
+			ret_len = kblock_readBlocks(b, id, buf, blocks) * b->blk_size;
+		}
+		else if (sequential)
+		{
+			/* Fill the buffer from the current block */
+			size_t blocks = MIN(fb->stream_blks, (size_t)(b->blk_cnt - id));
+			fb->stream_start = id;
+			fb->stream_fill = kblock_readBlocks(b, id, fb->stream, blocks) * b->blk_size;
+			if (!fb->stream_fill)
+				break;
+			continue;
+		}
+		else
+		{
+			count = MIN(size, (size_t)(b->blk_size - offset));
+			ret_len = kblock_read(b, id, buf, offset, count);
+		}
+
+		size -= ret_len;
+		fb->fd.seek_pos += ret_len;
+		buf += ret_len;
+		len += ret_len;
+		if (ret_len != count)
+			break;
+		/* From now on the access is sequential */
+		sequential = true;
+	}
+
+	fb->next_pos = fb->fd.seek_pos;
+	return len;
+}
+
+static size_t kfileblock_streamWrite(KFileBlock *fb, const uint8_t *buf, size_t size)
+{
+	KBlock *b = fb->blk;
+	size_t len = 0;
+
+	/* Data read ahead is stale now */
+	if (!fb->stream_dirty)
+		fb->stream_fill = 0;
+
+	while (size)
+	{
+		block_idx_t id = fb->fd.seek_pos / b->blk_size;
+		if (id >= b->blk_cnt)
+			break;
+		size_t offset = fb->fd.seek_pos % b->blk_size;
+		size_t count, ret_len;
+
+		/*
+		 * Write the buffer when the access is not sequential anymore
+		 * or when whole blocks can go straight to the device.
+		 */
+		if (fb->stream_dirty
+			&& ((kfile_off_t)(fb->stream_start * b->blk_size + fb->stream_fill) != fb->fd.seek_pos
+				|| (offset == 0 && size >= b->blk_size))
+			&& kfileblock_streamFlush(fb) != 0)
+			break;
+
+		if (fb->stream_dirty || (offset == 0 && size < b->blk_size))
+		{
+			/* Collect the data in the buffer */
+			if (!fb->stream_dirty)
+			{
+				fb->stream_start = id;
+				fb->stream_dirty = true;
+			}
+			size_t room = MIN(fb->stream_blks, (size_t)(b->blk_cnt - fb->stream_start)) * b->blk_size
+				- fb->stream_fill;
+			count = ret_len = MIN(size, room);
+			memcpy(fb->stream + fb->stream_fill, buf, count);
+			fb->stream_fill += count;
+			if (count == room && kfileblock_streamFlush(fb) != 0)
+				ret_len = 0;
+		}
+		else if (offset == 0)
+		{
+			/* Whole blocks go straight to the device */
+			size_t blocks = MIN(size / b->blk_size, (size_t)(b->blk_cnt - id));
+			count = blocks * b->blk_size;
+			ret_len = kblock_writeBlocks(b, id, buf, blocks) * b->blk_size;
+		}
+		else
+		{
+			/* Complete the current block, then the writes are aligned */
+			count = MIN(size, (size_t)(b->blk_size - offset));
+			ret_len = kblock_write(b, id, buf, offset, count);
+		}
+
+		size -= ret_len;
+		fb->fd.seek_pos += ret_len;
+		buf += ret_len;
+		len += ret_len;
+		if (ret_len != count)
+			break;
+	}
+
+	return len;
+}
+
 static size_t kfileblock_read(struct KFile *fd, void *_buf, size_t size)
 {
 	uint8_t *buf = (uint8_t *)_buf;
+	KFileBlock *fb = KFILEBLOCK_CAST(fd);
+
+	if (fb->stream)
+		return kfileblock_streamRead(fb, buf, size);
 	return KFILEBLOCK(read, fd, buf, size);
 }
 
 static size_t kfileblock_write(struct KFile *fd, const void *_buf, size_t size)
 {
 	const uint8_t *buf = (const uint8_t *)_buf;
+	KFileBlock *fb = KFILEBLOCK_CAST(fd);
+
+	if (fb->stream)
+		return kfileblock_streamWrite(fb, buf, size);
 	return KFILEBLOCK(write, fd, buf, size);
 }
 
 static int kfileblock_flush(struct KFile *fd)
 {
 	KFileBlock *fb = KFILEBLOCK_CAST(fd);
-	return kblock_flush(fb->blk);
+	int ret = kfileblock_streamFlush(fb);
+
+	return kblock_flush(fb->blk) | ret;
 }
 
 static int kfileblock_error(struct KFile *fd)
@@ -110,7 +284,23 @@ static void kfileblock_clearerr(struct KFile *fd)
 static int kfileblock_close(struct KFile *fd)
 {
 	KFileBlock *fb = KFILEBLOCK_CAST(fd);
-	return kblock_close(fb->blk);
+	int ret = kfileblock_streamFlush(fb);
+
+	return kblock_close(fb->blk) | ret;
+}
+
+int kfileblock_setStream(KFileBlock *fb, void *buf, size_t size)
+{
+	int ret;
+
+	ASSERT(fb);
+	ASSERT(!buf || size >= fb->blk->blk_size);
+
+	ret = kfileblock_streamFlush(fb);
+	fb->stream = (uint8_t *)buf;
+	fb->stream_blks = buf ? size / fb->blk->blk_size : 0;
+	fb->next_pos = fb->fd.seek_pos;
+	return ret;
 }
 
 void kfileblock_init(KFileBlock *fb, KBlock *blk)
@@ -60,6 +60,16 @@
  * kfile_read(&kfb.fd, buf, 20);
  * \endcode
  *
+ * Sequential access can be sped up with a stream buffer of some blocks,
+ * see kfileblock_setStream(): reads that follow each other prefetch the
+ * next blocks with a single multiple block read, and sequential writes
+ * are collected and written as whole blocks. Aligned transfers of whole
+ * blocks bypass the buffer and go straight to the device.
+ * \code
+ * static uint8_t stream_buf[4 * 512];
+ * kfileblock_setStream(&kfb, stream_buf, sizeof(stream_buf));
+ * \endcode
+ *
  * \author Francesco Sacchi <batt@develer.com>
  * \author Daniele Basile <asterix@develer.com>
  *
@@ -81,6 +91,14 @@ typedef struct KFileBlock
 {
 	KFile fd;    ///< KFile context
 	KBlock *blk; ///< KBlock device
+
+	/* Stream buffer, see kfileblock_setStream() */
+	uint8_t *stream;           ///< Stream buffer, NULL if disabled
+	size_t stream_blks;        ///< Size of the stream buffer, in blocks
+	block_idx_t stream_start;  ///< First block in the buffer
+	size_t stream_fill;        ///< Bytes read ahead or waiting to be written
+	bool stream_dirty;         ///< True if the buffer holds data to be written
+	kfile_off_t next_pos;      ///< Position following the last read
 } KFileBlock;
 
 /**
@@ -95,6 +113,25 @@ typedef struct KFileBlock
  */
 void kfileblock_init(KFileBlock *fb, KBlock *blk);
 
+/**
+ * Set the stream buffer of a KFileBlock.
+ *
+ * When a read continues the previous one, the blocks from the current
+ * one are read ahead into \a buf with a single kblock_readBlocks().
+ * Sequential writes are collected in \a buf and written to the device
+ * with kblock_writeBlocks() when it is full, when the access is no more
+ * sequential or on kfile_flush().
+ *
+ * \param fb KFileBlock context.
+ * \param buf stream buffer, NULL to disable streaming.
+ * \param size size of \a buf, it must hold at least one block; only
+ *             whole blocks are used.
+ *
+ * \return 0 if OK, EOF if the data of the previous buffer could not be
+ *         written.
+ */
+int kfileblock_setStream(KFileBlock *fb, void *buf, size_t size);
+
 /** \} */ //defgroup kfile_block
 
 #endif /* IO_KFILE_KBLOCK_H */
@@ -0,0 +1,248 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Test for the KFileBlock stream buffer.
+ *
+ * Random reads, writes and seeks through a KFileBlock are checked
+ * against a shadow copy of the device, with every kind of RAM device
+ * and stream buffer size. The benchmark reads and writes a kblock_posix
+ * image sequentially in small chunks, with and without a stream buffer,
+ * and prints the results:
+ *
+ * \code
+ * BENCH kfile_block blocks=256 chunk=16 us_read=343 us_read_stream=45 us_write=3074 us_write_stream=72
+ * \endcode
+ */
+
+#include "kfile_block.h"
+#include "kblock_ram.h"
+#include "kblock_posix.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <os/hptime.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK_SIZE   64
+#define BLOCK_COUNT  32
+#define STREAM_BLKS  4
+#define TEST_OPS     4096
+
+#define BENCH_FILE    "kfile_block.bin"
+#define BENCH_BLOCKS  256
+#define BENCH_CHUNK   16
+
+int kfile_block_testSetup(void);
+int kfile_block_testRun(void);
+int kfile_block_testTearDown(void);
+
+static uint8_t ram_buf[BLOCK_SIZE * (BLOCK_COUNT + 1)];
+static uint8_t shadow[BLOCK_SIZE * BLOCK_COUNT];
+static uint8_t stream_buf[BLOCK_SIZE * STREAM_BLKS];
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245UL + 12345;
+	return (seed >> 16) & 0x7fff;
+}
+
+/* Random accesses, mostly sequential, checked against the shadow copy */
+static int test_random(KBlock *b, size_t stream_size)
+{
+	KFileBlock f;
+	uint8_t buf[BLOCK_SIZE * 3];
+	kfile_off_t pos = 0;
+
+	kfileblock_init(&f, b);
+	if (kfile_write(&f.fd, shadow, sizeof(shadow)) != sizeof(shadow))
+		return -1;
+	kfile_seek(&f.fd, 0, KSM_SEEK_SET);
+	kfileblock_setStream(&f, stream_buf, stream_size);
+
+	for (int i = 0; i < TEST_OPS; i++)
+	{
+		size_t size = rnd() % sizeof(buf) + 1;
+
+		if (rnd() % 8 == 0)
+		{
+			pos = rnd() % sizeof(shadow);
+			kfile_seek(&f.fd, pos, KSM_SEEK_SET);
+		}
+		size = MIN(size, sizeof(shadow) - pos);
+
+		if (rnd() % 2)
+		{
+			if (kfile_read(&f.fd, buf, size) != size
+				|| memcmp(buf, shadow + pos, size) != 0)
+			{
+				kprintf("read error at %ld, size %d\n", (long)pos, (int)size);
+				return -1;
+			}
+		}
+		else
+		{
+			for (size_t j = 0; j < size; j++)
+				buf[j] = rnd();
+			if (kfile_write(&f.fd, buf, size) != size)
+				return -1;
+			memcpy(shadow + pos, buf, size);
+		}
+
+		pos += size;
+		if (pos == sizeof(shadow))
+		{
+			pos = 0;
+			kfile_seek(&f.fd, 0, KSM_SEEK_SET);
+		}
+	}
+
+	/* Everything must be on the device after a flush */
+	if (kfile_flush(&f.fd) != 0)
+		return -1;
+	kfileblock_setStream(&f, NULL, 0);
+	for (block_idx_t i = 0; i < BLOCK_COUNT; i++)
+		if (kblock_read(b, i, buf, 0, BLOCK_SIZE) != BLOCK_SIZE
+			|| memcmp(buf, shadow + i * BLOCK_SIZE, BLOCK_SIZE) != 0)
+		{
+			kprintf("block %ld differs\n", (long)i);
+			return -1;
+		}
+
+	return 0;
+}
+
+static int test_ram(void)
+{
+	KBlockRam ram;
+
+	for (size_t blks = 1; blks <= STREAM_BLKS; blks += STREAM_BLKS - 1)
+	{
+		kblockram_init(&ram, ram_buf, sizeof(ram_buf) - BLOCK_SIZE, BLOCK_SIZE, false, false);
+		if (test_random(&ram.b, blks * BLOCK_SIZE) != 0)
+			return -1;
+		kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, true, false);
+		if (test_random(&ram.b, blks * BLOCK_SIZE) != 0)
+			return -1;
+		kblockram_init(&ram, ram_buf, sizeof(ram_buf), BLOCK_SIZE, true, true);
+		if (test_random(&ram.b, blks * BLOCK_SIZE) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+static hptime_t bench_read(KFileBlock *f)
+{
+	uint8_t buf[BENCH_CHUNK];
+	hptime_t start = hptime_get();
+
+	kfile_seek(&f->fd, 0, KSM_SEEK_SET);
+	while (kfile_read(&f->fd, buf, sizeof(buf)) == sizeof(buf))
+		;
+	return hptime_get() - start;
+}
+
+static hptime_t bench_write(KFileBlock *f)
+{
+	uint8_t buf[BENCH_CHUNK];
+	hptime_t start = hptime_get();
+
+	memset(buf, 0x55, sizeof(buf));
+	kfile_seek(&f->fd, 0, KSM_SEEK_SET);
+	while (kfile_write(&f->fd, buf, sizeof(buf)) == sizeof(buf))
+		;
+	kfile_flush(&f->fd);
+	return hptime_get() - start;
+}
+
+static int bench_posix(void)
+{
+	static uint8_t big_buf[BLOCK_SIZE * 16];
+	KBlockPosix b;
+	KFileBlock f;
+	hptime_t rd, rd_stream, wr, wr_stream;
+	FILE *fp = fopen(BENCH_FILE, "w+");
+
+	if (!fp)
+		return -1;
+	for (int i = 0; i < BENCH_BLOCKS * BLOCK_SIZE; i++)
+		fputc(0xff, fp);
+
+	kblockposix_init(&b, fp, false, NULL, BLOCK_SIZE, BENCH_BLOCKS);
+	kfileblock_init(&f, &b.b);
+	rd = bench_read(&f);
+	wr = bench_write(&f);
+
+	kfileblock_setStream(&f, big_buf, sizeof(big_buf));
+	rd_stream = bench_read(&f);
+	wr_stream = bench_write(&f);
+
+	kprintf("BENCH kfile_block blocks=%d chunk=%d us_read=%lu us_read_stream=%lu us_write=%lu us_write_stream=%lu\n",
+		BENCH_BLOCKS, BENCH_CHUNK, (unsigned long)rd, (unsigned long)rd_stream,
+		(unsigned long)wr, (unsigned long)wr_stream);
+
+	return kfile_close(&f.fd);
+}
+
+int kfile_block_testRun(void)
+{
+	if (test_ram() != 0)
+	{
+		kputs("KFileBlock stream test..FAIL!\n");
+		return -1;
+	}
+	if (bench_posix() != 0)
+	{
+		kputs("KFileBlock benchmark..FAIL!\n");
+		return -1;
+	}
+	kputs("KFileBlock test..ok!\n");
+	return 0;
+}
+
+int kfile_block_testSetup(void)
+{
+	kdbg_init();
+	for (size_t i = 0; i < sizeof(shadow); i++)
+		shadow[i] = rnd();
+	return 0;
+}
+
+int kfile_block_testTearDown(void)
+{
+	return remove(BENCH_FILE);
+}
+
+TEST_MAIN(kfile_block);
@@ -0,0 +1,178 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Counting semaphore test.
+ *
+ * CSEM_PROCS processes compete for CSEM_RESOURCES resources protected by
+ * a counting semaphore. The test checks that the resources are never
+ * overbooked and that they are actually used concurrently.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_sem.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SEMAPHORES" >> $cfgdir/cfg_sem.h
+ * $test$: echo "#define CONFIG_KERN_SEMAPHORES 1" >> $cfgdir/cfg_sem.h
+ */
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/sem.h>
+#include <kern/proc.h>
+
+#include <drv/timer.h>
+
+#define CSEM_PROCS       6
+#define CSEM_RESOURCES   3
+#define CSEM_LOOPS      10
+#define CSEM_DELAY       5
+#define TEST_TIME_OUT_MS 6000
+#define CSEM_TIMEOUT_MS   50
+
+static CountSem csem;
+static CountSem done;
+static volatile int in_use, max_in_use, errors;
+
+static void csem_proc(void)
+{
+	for (int i = 0; i < CSEM_LOOPS; i++)
+	{
+		csem_obtain(&csem);
+		if (++in_use > CSEM_RESOURCES)
+			errors++;
+		if (in_use > max_in_use)
+			max_in_use = in_use;
+		timer_delay(CSEM_DELAY);
+		in_use--;
+		csem_release(&csem);
+	}
+	csem_release(&done);
+}
+
+/* Give back a resource while the main process waits with a timeout */
+static void csem_releaser(void)
+{
+	timer_delay(CSEM_TIMEOUT_MS / 2);
+	csem_release(&csem);
+}
+
+PROC_DEFINE_STACK(csem_stack0, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(csem_stack1, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(csem_stack2, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(csem_stack3, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(csem_stack4, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(csem_stack5, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(releaser_stack, KERN_MINSTACKSIZE * 2);
+
+static cpu_stack_t *csem_stacks[CSEM_PROCS] =
+{
+	csem_stack0, csem_stack1, csem_stack2,
+	csem_stack3, csem_stack4, csem_stack5,
+};
+
+int csem_testRun(void)
+{
+	ticks_t start_time = timer_clock();
+	int finished = 0;
+
+	kputs("Run counting semaphore test..\n");
+
+	/* No resources at all: attempt must fail */
+	ASSERT(!csem_attempt(&done));
+
+	for (int i = 0; i < CSEM_PROCS; i++)
+		proc_new(csem_proc, NULL, sizeof(csem_stack0), csem_stacks[i]);
+
+	while (finished < CSEM_PROCS)
+	{
+		if (timer_clock() - start_time > ms_to_ticks(TEST_TIME_OUT_MS))
+		{
+			kputs("> Counting semaphore test timed out\n");
+			return -1;
+		}
+		if (csem_attempt(&done))
+			finished++;
+		else
+			timer_delay(CSEM_DELAY);
+	}
+
+	kprintf("> max resources in use %d/%d, errors %d\n",
+		max_in_use, CSEM_RESOURCES, errors);
+	if (errors || max_in_use != CSEM_RESOURCES || in_use)
+		return -1;
+
+	/* All the resources must be available again */
+	for (int i = 0; i < CSEM_RESOURCES; i++)
+		if (!csem_attempt(&csem))
+			return -1;
+	if (csem_attempt(&csem))
+		return -1;
+
+	/* Nobody releases the semaphore: the wait must expire */
+	start_time = timer_clock();
+	if (csem_obtainTimeout(&csem, ms_to_ticks(CSEM_TIMEOUT_MS)))
+		return -1;
+	if (timer_clock() - start_time < ms_to_ticks(CSEM_TIMEOUT_MS)
+			|| !LIST_EMPTY(&csem.wait_queue))
+		return -1;
+
+	/* Released before the timeout */
+	proc_new(csem_releaser, NULL, sizeof(releaser_stack), releaser_stack);
+	start_time = timer_clock();
+	if (!csem_obtainTimeout(&csem, ms_to_ticks(CSEM_TIMEOUT_MS * 4)))
+		return -1;
+	kprintf("> obtained after %ld ms\n",
+		(long)ticks_to_ms(timer_clock() - start_time));
+	if (timer_clock() - start_time >= ms_to_ticks(CSEM_TIMEOUT_MS * 4))
+		return -1;
+
+	kputs("> Counting semaphore test..Ok!\n");
+	return 0;
+}
+
+int csem_testSetup(void)
+{
+	kdbg_init();
+	csem_init(&csem, CSEM_RESOURCES);
+	csem_init(&done, 0);
+	timer_init();
+	proc_init();
+	return 0;
+}
+
+int csem_testTearDown(void)
+{
+	kputs("TearDown counting semaphore test.\n");
+	return 0;
+}
+
+TEST_MAIN(csem);
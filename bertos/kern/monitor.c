@@ -51,19 +51,202 @@
 #include <kern/proc.h>
 
 #include <cpu/frame.h> /* CPU_STACK_GROWS_UPWARD */
+#include <cpu/irq.h>
+
+#include <string.h> /* memset() */
 
 /* Access to this list must be protected against the scheduler */
 static List MonitorProcs;
 
+#if CONFIG_KERN_MONITOR_STATS
+
+#define HP_PER_TICK  (TIMER_HW_HPTICKS_PER_SEC / TIMER_TICKS_PER_SEC)
+
+/*
+ * When the high precision counter does not exceed a tick period it
+ * restarts at each tick and must be combined with the tick count,
+ * otherwise it is free running and can be used alone.
+ */
+#define HP_FREE_RUNNING  ((uint32_t)TIMER_HW_CNT > HP_PER_TICK)
+
+/* Largest interval we can account at once without overflows */
+#define HP_MAX_DELTA  ((uint32_t)(0xFFFFFFFFUL - TIMER_HW_HPTICKS_PER_SEC))
+
+/** A point in time, as read from the system timer. */
+typedef struct MonitorStamp
+{
+	ticks_t ticks;
+	hptime_t hp;
+} MonitorStamp;
+
+/* Time of the last context switch */
+static MonitorStamp switch_stamp;
+/* Time of the outermost proc_forbid() */
+static MonitorStamp forbid_stamp;
+
+static uint32_t idle_sec, idle_hp;
+
+/*
+ * Return the hp ticks elapsed since \a stamp and update it to now.
+ *
+ * \note Must be called with interrupts disabled.
+ */
+static uint32_t monitor_elapsed(MonitorStamp *stamp)
+{
+	ticks_t ticks = timer_clock_unlocked();
+	hptime_t hp = timer_hw_hpread();
+	uint32_t delta;
+
+	if (HP_FREE_RUNNING)
+	{
+		if (hp < stamp->hp)
+			delta = 0;
+		else if ((hp - stamp->hp) > (hptime_t)HP_MAX_DELTA)
+			delta = HP_MAX_DELTA;
+		else
+			delta = (uint32_t)(hp - stamp->hp);
+	}
+	else
+	{
+		ticks_t d_ticks = ticks - stamp->ticks;
+
+		if ((uint32_t)d_ticks >= HP_MAX_DELTA / HP_PER_TICK)
+			delta = HP_MAX_DELTA;
+		else
+		{
+			int32_t d = (int32_t)((uint32_t)d_ticks * HP_PER_TICK)
+				+ (int32_t)hp - (int32_t)stamp->hp;
+			/* The counter may wrap before the tick is accounted */
+			delta = d < 0 ? 0 : (uint32_t)d;
+		}
+	}
+
+	stamp->ticks = ticks;
+	stamp->hp = hp;
+	return delta;
+}
+
+/* Add \a delta hp ticks to the time \a sec, \a hp */
+static void monitor_accumulate(uint32_t *sec, uint32_t *hp, uint32_t delta)
+{
+	*hp += delta;
+	*sec += *hp / TIMER_HW_HPTICKS_PER_SEC;
+	*hp %= TIMER_HW_HPTICKS_PER_SEC;
+}
+
+/* Convert \a sec, \a hp to milliseconds */
+static uint32_t monitor_ms(uint32_t sec, uint32_t hp)
+{
+	return sec * 1000 + (uint32_t)((uint64_t)hp * 1000 / TIMER_HW_HPTICKS_PER_SEC);
+}
+
+void monitor_switch(Process *prev, bool preempted)
+{
+	uint32_t delta;
+
+	IRQ_ASSERT_DISABLED();
+
+	delta = monitor_elapsed(&switch_stamp);
+	if (!prev)
+	{
+		monitor_accumulate(&idle_sec, &idle_hp, delta);
+		return;
+	}
+
+	monitor_accumulate(&prev->monitor.run_sec, &prev->monitor.run_hp, delta);
+	if (preempted)
+		prev->monitor.preemptions++;
+	else
+		prev->monitor.switches++;
+}
+
+void monitor_forbidEnter(void)
+{
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+	forbid_stamp.ticks = timer_clock_unlocked();
+	forbid_stamp.hp = timer_hw_hpread();
+	IRQ_RESTORE(flags);
+}
+
+void monitor_forbidExit(void)
+{
+	cpu_flags_t flags;
+	uint32_t delta;
+
+	IRQ_SAVE_DISABLE(flags);
+	delta = monitor_elapsed(&forbid_stamp);
+	/* current_process is NULL while a process is exiting */
+	if (current_process && delta > current_process->monitor.max_forbid)
+		current_process->monitor.max_forbid = delta;
+	IRQ_RESTORE(flags);
+}
+
+void monitor_stats(struct Process *proc, ProcStats *stats)
+{
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+	/* Include the time of the current time slice */
+	if (proc == current_process)
+		monitor_accumulate(&proc->monitor.run_sec, &proc->monitor.run_hp,
+			monitor_elapsed(&switch_stamp));
+
+	stats->run_ms = monitor_ms(proc->monitor.run_sec, proc->monitor.run_hp);
+	stats->switches = proc->monitor.switches;
+	stats->preemptions = proc->monitor.preemptions;
+	stats->max_forbid_us = (uint32_t)((uint64_t)proc->monitor.max_forbid
+		* 1000000UL / TIMER_HW_HPTICKS_PER_SEC);
+	IRQ_RESTORE(flags);
+}
+
+uint32_t monitor_idleTime(void)
+{
+	uint32_t ms;
+
+	ATOMIC(ms = monitor_ms(idle_sec, idle_hp));
+	return ms;
+}
+
+static void monitor_clearStats(Process *proc)
+{
+	proc->monitor.run_sec = proc->monitor.run_hp = 0;
+	proc->monitor.switches = proc->monitor.preemptions = 0;
+	proc->monitor.max_forbid = 0;
+}
+
+void monitor_resetStats(void)
+{
+	Node *node;
+
+	proc_forbid();
+	FOREACH_NODE(node, &MonitorProcs)
+		monitor_clearStats(containerof(node, Process, monitor.link));
+	ATOMIC(
+		idle_sec = idle_hp = 0;
+		monitor_elapsed(&switch_stamp);
+	);
+	proc_permit();
+}
+
+#endif /* CONFIG_KERN_MONITOR_STATS */
+
 void monitor_init(void)
 {
 	LIST_INIT(&MonitorProcs);
+#if CONFIG_KERN_MONITOR_STATS
+	ATOMIC(monitor_elapsed(&switch_stamp));
+#endif
 }
 
 
 void monitor_add(Process *proc, const char *name)
 {
 	proc->monitor.name = name;
+#if CONFIG_KERN_MONITOR_STATS
+	monitor_clearStats(proc);
+#endif
 
 	PROC_ATOMIC(ADDTAIL(&MonitorProcs, &proc->monitor.link));
 }
@@ -130,6 +313,44 @@ void monitor_report(void)
 		kprintf("%-9p%-9p%-9zu%-9zu%s\n",
 			p, p->stack_base, p->stack_size, free, p->monitor.name);
 	}
+
+#if CONFIG_KERN_MONITOR_STATS
+	{
+		uint32_t total = monitor_idleTime();
+		ProcStats stats;
+
+		FOREACH_NODE(node, &MonitorProcs)
+		{
+			monitor_stats(containerof(node, Process, monitor.link), &stats);
+			total += stats.run_ms;
+		}
+
+		kputchar('\n');
+		kprintf("%-9s%-9s%-9s%-9s%-9s%s\n", "Run[ms]", "CPU%", "Switch",
+			"Preempt", "Forbid", "Name");
+		for (i = 0; i < 56; i++)
+			kputchar('-');
+		kputchar('\n');
+
+		FOREACH_NODE(node, &MonitorProcs)
+		{
+			Process *p = containerof(node, Process, monitor.link);
+
+			monitor_stats(p, &stats);
+			kprintf("%-9lu%-9lu%-9lu%-9lu%-9lu%s\n",
+				(unsigned long)stats.run_ms,
+				total ? (unsigned long)((uint64_t)stats.run_ms * 100 / total) : 0UL,
+				(unsigned long)stats.switches,
+				(unsigned long)stats.preemptions,
+				(unsigned long)stats.max_forbid_us,
+				p->monitor.name);
+		}
+		kprintf("%-9lu%-9lu%-9s%-9s%-9s%s\n",
+			(unsigned long)monitor_idleTime(),
+			total ? (unsigned long)((uint64_t)monitor_idleTime() * 100 / total) : 0UL,
+			"-", "-", "-", "<idle>");
+	}
+#endif
 	proc_permit();
 }
 
@@ -71,7 +71,51 @@ void monitor_start(size_t stacksize, cpu_stack_t *stack);
 size_t monitor_checkStack(cpu_stack_t *stack_base, size_t stack_size);
 
 
-/** Print a report of the stack status through kdebug */
+/**
+ * Print a report of the stack status through kdebug.
+ *
+ * With CONFIG_KERN_MONITOR_STATS the run time, the CPU share and the
+ * context switches of each process are reported too.
+ */
 void monitor_report(void);
 
+#if CONFIG_KERN_MONITOR_STATS
+
+struct Process;
+
+/** Execution statistics of a process, see monitor_stats(). */
+typedef struct ProcStats
+{
+	uint32_t run_ms;         ///< Time spent running on the CPU [ms]
+	uint32_t switches;       ///< Voluntary context switches (block or yield)
+	uint32_t preemptions;    ///< Involuntary context switches
+	uint32_t max_forbid_us;  ///< Longest time with preemption disabled [us]
+} ProcStats;
+
+/**
+ * Read the execution statistics of process \a proc.
+ *
+ * \note The preemption disabled time is measured only when the kernel
+ *       is built with CONFIG_KERN_PREEMPT.
+ */
+void monitor_stats(struct Process *proc, ProcStats *stats);
+
+/** Return the time spent in the idle loop [ms] */
+uint32_t monitor_idleTime(void);
+
+/** Clear the statistics of all the processes and of the idle loop. */
+void monitor_resetStats(void);
+
+/** Start timing a proc_forbid() section, called by proc_forbid(). */
+void monitor_forbidEnter(void);
+
+/** End a proc_forbid() section, called by proc_permit(). */
+void monitor_forbidExit(void);
+
+int monitor_testRun(void);
+int monitor_testSetup(void);
+int monitor_testTearDown(void);
+
+#endif /* CONFIG_KERN_MONITOR_STATS */
+
 #endif /* KERN_MONITOR_H */
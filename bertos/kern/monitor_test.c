@@ -0,0 +1,172 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Process statistics test.
+ *
+ * A busy process and a sleeping process run side by side: the busy one
+ * must be charged with most of the CPU time, the sleeper with most of the
+ * context switches and the time spent waiting must go to the idle loop.
+ * A process spinning until it exits must be charged with its last time
+ * slice too.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ * $test$: cp bertos/cfg/cfg_monitor.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_MONITOR" >> $cfgdir/cfg_monitor.h
+ * $test$: echo "#define CONFIG_KERN_MONITOR 1" >> $cfgdir/cfg_monitor.h
+ * $test$: echo  "#undef CONFIG_KERN_MONITOR_STATS" >> $cfgdir/cfg_monitor.h
+ * $test$: echo "#define CONFIG_KERN_MONITOR_STATS 1" >> $cfgdir/cfg_monitor.h
+ */
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/proc.h>
+#include <kern/monitor.h>
+
+#include <drv/timer.h>
+
+#define MON_LOOPS       20
+#define MON_BUSY_US   2000
+#define MON_SLEEP_MS     5
+#define MON_EXIT_US   10000
+#define TEST_TIME_OUT_MS 5000
+
+static volatile int busy_done, sleep_done, exit_done;
+
+static void busy_proc(void)
+{
+	for (int i = 0; i < MON_LOOPS; i++)
+	{
+		timer_udelay(MON_BUSY_US);
+		timer_delay(1);
+	}
+	busy_done = 1;
+}
+
+static void sleep_proc(void)
+{
+	for (int i = 0; i < MON_LOOPS * 2; i++)
+		timer_delay(MON_SLEEP_MS);
+	sleep_done = 1;
+}
+
+static void exit_proc(void)
+{
+	/* Spin without sleeping, up to the exit */
+	timer_busyWait(us_to_hptime(MON_EXIT_US));
+	exit_done = 1;
+}
+
+PROC_DEFINE_STACK(busy_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(sleep_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(exit_stack, KERN_MINSTACKSIZE * 2);
+
+int monitor_testRun(void)
+{
+	ticks_t start_time = timer_clock();
+	struct Process *busy, *sleeper, *exiting;
+	ProcStats bs, ss, ms, es;
+
+	kputs("Run process statistics test..\n");
+
+	monitor_resetStats();
+	busy = proc_new(busy_proc, NULL, sizeof(busy_stack), busy_stack);
+	sleeper = proc_new(sleep_proc, NULL, sizeof(sleep_stack), sleep_stack);
+	exiting = proc_new(exit_proc, NULL, sizeof(exit_stack), exit_stack);
+
+	/* Keep preemption disabled for a while */
+	proc_forbid();
+	timer_udelay(MON_BUSY_US);
+	proc_permit();
+
+	while (!busy_done || !sleep_done || !exit_done)
+	{
+		if (timer_clock() - start_time > ms_to_ticks(TEST_TIME_OUT_MS))
+		{
+			kputs("> Process statistics test timed out\n");
+			return -1;
+		}
+		timer_delay(MON_SLEEP_MS * 4);
+	}
+
+	/* Both processes are zombies now, their statistics are still valid */
+	monitor_stats(busy, &bs);
+	monitor_stats(sleeper, &ss);
+	monitor_stats(exiting, &es);
+	monitor_stats(proc_current(), &ms);
+	monitor_report();
+
+	kprintf("> busy %lu ms %lu sw, sleeper %lu ms %lu sw, exiting %lu ms, idle %lu ms\n",
+		(unsigned long)bs.run_ms, (unsigned long)bs.switches,
+		(unsigned long)ss.run_ms, (unsigned long)ss.switches,
+		(unsigned long)es.run_ms, (unsigned long)monitor_idleTime());
+
+	/* The busy process spins for MON_LOOPS * MON_BUSY_US */
+	if (bs.run_ms < MON_LOOPS * MON_BUSY_US / 1000 * 3 / 4)
+		return -1;
+	if (bs.run_ms <= ss.run_ms)
+		return -1;
+	if (bs.switches < MON_LOOPS || ss.switches < MON_LOOPS * 2)
+		return -1;
+	if (monitor_idleTime() == 0)
+		return -1;
+	/* Its last slice, up to the exit, is not idle time */
+	if (es.run_ms < MON_EXIT_US / 1000 * 3 / 4)
+		return -1;
+#if CONFIG_KERN_PREEMPT
+	if (ms.max_forbid_us < MON_BUSY_US * 3 / 4)
+		return -1;
+#endif
+
+	kputs("> Process statistics test..Ok!\n");
+	return 0;
+}
+
+int monitor_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	return 0;
+}
+
+int monitor_testTearDown(void)
+{
+	kputs("TearDown process statistics test.\n");
+	return 0;
+}
+
+TEST_MAIN(monitor);
@@ -0,0 +1,98 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2026 agent <agent@local>
+ * -->
+ *
+ * \brief Message pools and synchronous calls (implementation).
+ *
+ * \author agent <agent@local>
+ */
+
+#include "msg.h"
+
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_signal.h"
+
+#include <cfg/debug.h>
+
+#include <cpu/types.h>
+
+void msg_initPool(MsgPort *port, void *msgs, size_t msg_size, size_t count)
+{
+	uint8_t *p = (uint8_t *)msgs;
+
+	ASSERT(msg_size >= sizeof(Msg));
+
+	msg_lockPort(port);
+	while (count--)
+	{
+		ADDTAIL(&port->pool, &((Msg *)p)->link);
+		p += msg_size;
+	}
+	msg_unlockPort(port);
+}
+
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+
+void msg_call(MsgPort *port, Msg *msg)
+{
+	MsgPort reply_port;
+	Event *e = &port->event;
+	Signal *reply_sig = &reply_port.event.Ev.Sig.sig;
+	Msg *reply;
+
+	msg_initPort(&reply_port, event_createGeneric());
+	msg->replyPort = &reply_port;
+
+	trace_event(TRACE_MSG_PUT, msg, 0);
+
+	msg_lockPort(port);
+	ADDTAIL(&port->queue, &msg->link);
+	msg_unlockPort(port);
+
+	/* Receivers waiting on a signal get the CPU straight away */
+	if (e->action == event_hook_signal)
+		sig_sendWaitSignal(&e->Ev.Sig.sig_proc->sig, e->Ev.Sig.sig_proc,
+			e->Ev.Sig.sig_bit, reply_sig, EVENT_GENERIC_SIGNAL);
+	else if (e->action == event_hook_generic_signal)
+		sig_sendWaitSignal(&e->Ev.Sig.sig, e->Ev.Sig.sig_proc,
+			e->Ev.Sig.sig_bit, reply_sig, EVENT_GENERIC_SIGNAL);
+	else
+	{
+		event_do(e);
+		event_wait(&reply_port.event);
+	}
+
+	/* Nobody else knows the reply port */
+	reply = msg_get(&reply_port);
+	ASSERT(reply == msg);
+	(void)reply;
+}
+
+#endif /* CONFIG_KERN && CONFIG_KERN_SIGNALS */
@@ -85,6 +85,16 @@
  * a convenient way to provide some kind of result and simplify
  * the resource allocation scheme at the same time.
  *
+ * A port can also own a fixed pool of messages, set up with
+ * msg_initPool(): senders take a message with msg_alloc(), and
+ * the receiver gives it back with msg_free() when it's done,
+ * without any reply.
+ *
+ * For the common request/response case, msg_call() sends a message and
+ * sleeps until it is replied, like a function call executed by the
+ * receiver.  When the receiver is waiting on the port signal, the CPU
+ * is handed off to it directly (see sig_sendWaitSignal()).
+ *
  * When using signals to receive messages in a process, you
  * call sig_wait() in an event-loop to wake up when messages
  * are delivered to any of your ports.  When your process
@@ -191,11 +201,13 @@
 #include <mware/event.h>
 #include <struct/list.h>
 #include <kern/proc.h>
+#include <kern/trace.h>
 
 typedef struct MsgPort
 {
 	List  queue;   /**< Messages queued at this port. */
 	Event event;   /**< Event to trigger when a message arrives. */
+	List  pool;    /**< Free messages, see msg_initPool(). */
 } MsgPort;
 
 
@@ -242,12 +254,53 @@ INLINE void msg_unlockPort(UNUSED_ARG(MsgPort *, port))
 INLINE void msg_initPort(MsgPort *port, Event event)
 {
 	LIST_INIT(&port->queue);
+	LIST_INIT(&port->pool);
 	port->event = event;
 }
 
+/**
+ * Add \a count messages of \a msg_size bytes, stored in the array \a msgs,
+ * to the pool of \a port.
+ *
+ * Each message must begin with a Msg structure.
+ * \code
+ *	static TestMsg test_msgs[8];
+ *
+ *	msg_initPort(&test_port, event_createSignal(proc_current(), SIG_EXAMPLE));
+ *	msg_initPool(&test_port, test_msgs, sizeof(test_msgs[0]), countof(test_msgs));
+ * \endcode
+ */
+void msg_initPool(MsgPort *port, void *msgs, size_t msg_size, size_t count);
+
+/**
+ * Take a message from the pool of \a port.
+ *
+ * \return Pointer to the message or NULL if the pool is empty.
+ */
+INLINE Msg *msg_alloc(MsgPort *port)
+{
+	Msg *msg;
+
+	msg_lockPort(port);
+	msg = (Msg *)list_remHead(&port->pool);
+	msg_unlockPort(port);
+
+	return msg;
+}
+
+/** Give back \a msg to the pool of \a port. */
+INLINE void msg_free(MsgPort *port, Msg *msg)
+{
+	msg_lockPort(port);
+	ADDHEAD(&port->pool, &msg->link);
+	msg_unlockPort(port);
+}
+
 /** Queue \a msg into \a port, triggering the associated event */
 INLINE void msg_put(MsgPort *port, Msg *msg)
 {
+	trace_event(TRACE_MSG_PUT, msg, 0);
+
 	msg_lockPort(port);
 	ADDTAIL(&port->queue, &msg->link);
 	msg_unlockPort(port);
@@ -268,6 +321,8 @@ INLINE Msg *msg_get(MsgPort *port)
 	msg = (Msg *)list_remHead(&port->queue);
 	msg_unlockPort(port);
 
+	trace_event(TRACE_MSG_GET, msg, 0);
+
 	return msg;
 }
 
@@ -291,6 +346,14 @@ INLINE void msg_reply(Msg *msg)
 	msg_put(msg->replyPort, msg);
 }
 
+/**
+ * Send \a msg to \a port and sleep until the receiver replies it.
+ *
+ * The reply port of the message is set by this function.
+ * \note This function can't be called from IRQ context.
+ */
+void msg_call(MsgPort *port, Msg *msg);
+
 /** \} */ //defgroup kern_msg
 
 int msg_testRun(void);
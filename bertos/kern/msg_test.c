@@ -179,6 +179,79 @@ static void fill_msg(TestMsg *msg, int val, int delay, int res)
 	msg->result = res;
 }
 
+/*
+ * Server for the synchronous calls: doubles the value of the messages
+ * taken from the pool of call_port.
+ */
+#define CALL_MSGS 4
+
+static MsgPort call_port;
+static TestMsg call_msgs[CALL_MSGS];
+PROC_DEFINE_STACK(call_stack, KERN_MINSTACKSIZE * 2);
+
+static NORETURN void call_server(void)
+{
+	Msg *msg;
+
+	for (;;)
+	{
+		sig_wait(SIG_USER0);
+		while ((msg = msg_get(&call_port)))
+		{
+			TestMsg *m = containerof(msg, TestMsg, msg);
+
+			m->result = m->val * 2;
+			msg_reply(msg);
+		}
+	}
+}
+
+static int msg_testCall(void)
+{
+	struct Process *server = proc_new(call_server, NULL, sizeof(call_stack), call_stack);
+	TestMsg *m[CALL_MSGS];
+
+	kprintf("Run msg_call test..\n");
+	msg_initPort(&call_port, event_createSignal(server, SIG_USER0));
+	msg_initPool(&call_port, call_msgs, sizeof(call_msgs[0]), countof(call_msgs));
+
+	/* Drain the pool */
+	for (int i = 0; i < CALL_MSGS; i++)
+	{
+		Msg *msg = msg_alloc(&call_port);
+
+		if (!msg)
+			goto error;
+		m[i] = containerof(msg, TestMsg, msg);
+	}
+	if (msg_alloc(&call_port))
+		goto error;
+
+	for (int i = 0; i < 100; i++)
+	{
+		TestMsg *cur = m[i % CALL_MSGS];
+
+		cur->val = i;
+		cur->result = 0;
+		msg_call(&call_port, &cur->msg);
+		if (cur->result != i * 2)
+			goto error;
+	}
+
+	for (int i = 0; i < CALL_MSGS; i++)
+		msg_free(&call_port, &m[i]->msg);
+	for (int i = 0; i < CALL_MSGS; i++)
+		if (!msg_alloc(&call_port))
+			goto error;
+
+	kprintf("msg_call test..ok!\n");
+	return 0;
+
+error:
+	kprintf("msg_call test..fail!\n");
+	return -1;
+}
+
 /**
  * Run signal test
  */
@@ -258,7 +331,7 @@ int msg_testRun(void)
 	if(count == MAX_GLOBAL_COUNT)
 	{
 		kprintf("Message test finished..ok!\n");
-		return 0;
+		return msg_testCall();
 	}
 	
 error:
@@ -89,6 +89,7 @@
 #include "proc.h"
 
 #include "cfg/cfg_proc.h"
+#include "cfg/cfg_timer.h"
 #define LOG_LEVEL KERN_LOG_LEVEL
 #define LOG_FORMAT KERN_LOG_FORMAT
 #include <cfg/log.h>
@@ -103,10 +104,16 @@
 #include <cpu/attr.h>
 #include <cpu/frame.h>
 
+#include <kern/trace.h>
+
 #if CONFIG_KERN_HEAP
 	#include <struct/heap.h>
 #endif
 
+#if CONFIG_TIMER_TICKLESS
+	#include <drv/timer.h> // timer_idleEnter()
+#endif
+
 #include <string.h>           /* memset() */
 
 #define PROC_SIZE_WORDS (ROUND_UP2(sizeof(Process), sizeof(cpu_stack_t)) / sizeof(cpu_stack_t))
@@ -117,7 +124,12 @@
  *
  * \note Access to the list must occur while interrupts are disabled.
  */
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+REGISTER List proc_ready_list[CONFIG_KERN_PRI_LEVELS];
+REGISTER uint32_t proc_ready_mask;
+#else
 REGISTER List proc_ready_list;
+#endif
 
 /*
  * Holds a pointer to the TCB of the currently running process.
@@ -169,6 +181,7 @@ static void proc_context_switch(Process *next, Process *prev)
 
 	if (UNLIKELY(next == prev))
 		return;
+	trace_event(TRACE_SWITCH, prev, 0);
 	/*
 	 * If there is no old process, we save the old stack pointer into a
 	 * dummy variable that we ignore.  In fact, this happens only when the
@@ -194,13 +207,27 @@ static void proc_initStruct(Process *proc)
 #if CONFIG_KERN_PRI
 	proc->link.pri = 0;
 #endif
+
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+	proc->ready_level = -1;
+#endif
+
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+	proc->wait_sem = NULL;
+#endif
 }
 
 MOD_DEFINE(proc);
 
 void proc_init(void)
 {
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+	for (int i = 0; i < CONFIG_KERN_PRI_LEVELS; i++)
+		LIST_INIT(&proc_ready_list[i]);
+	proc_ready_mask = 0;
+#else
 	LIST_INIT(&proc_ready_list);
+#endif
 
 #if CONFIG_KERN_HEAP
 	LIST_INIT(&zombie_list);
@@ -379,6 +406,8 @@ struct Process *proc_new_with_name(UNUSED_ARG(const char *, name), void (*entry)
 	monitor_add(proc, name);
 #endif
 
+	trace_event(TRACE_PROC_NEW, proc, 0);
+
 	/* Add to ready list */
 	ATOMIC(SCHED_ENQUEUE(proc));
 
@@ -478,6 +507,7 @@ void proc_entry(void)
 void proc_exit(void)
 {
 	LOG_INFO("%p:%s", current_process, proc_currentName());
+	trace_event(TRACE_PROC_EXIT, current_process, 0);
 
 #if CONFIG_KERN_MONITOR
 	monitor_remove(current_process);
@@ -491,6 +521,8 @@ void proc_exit(void)
 	 */
 	proc_addZombie(current_process);
 #endif
+	/* The last time slice belongs to the exiting process, not to idle */
+	ATOMIC(MONITOR_SWITCH(current_process, false));
 	current_process = NULL;
 	proc_permit();
 
@@ -502,16 +534,26 @@ void proc_exit(void)
 
 /**
  * Call the scheduler and eventually replace the current running process.
+ *
+ * When \a preempted the switch from the current process is accounted
+ * here, as an involuntary one, unless the scheduler picks it again.
  */
-static void proc_schedule(void)
+static void proc_schedule(bool preempted)
 {
 	Process *old_process = current_process;
+	bool idle;
 
+	(void)preempted;
 	IRQ_ASSERT_DISABLED();
 
+	idle = SCHED_EMPTY();
+#if CONFIG_KERN_TRACE
+	if (idle)
+		trace_event(TRACE_IDLE, old_process, 0);
+#endif
+
 	/* Poll on the ready queue for the first ready process */
-	LIST_ASSERT_VALID(&proc_ready_list);
-	while (!(current_process = (struct Process *)list_remHead(&proc_ready_list)))
+	while (!(current_process = sched_dequeue()))
 	{
 		/*
 		 * Make sure we physically reenable interrupts here, no matter what
@@ -527,12 +569,26 @@ static void proc_schedule(void)
 		 * \todo If there was a way to write sig_wait() so that it does not
 		 * disable interrupts while waiting, there would not be any
 		 * reason to do this.
+		 *
+		 * With CONFIG_TIMER_TICKLESS the periodic tick is also stopped
+		 * until the next timer expires or a process becomes ready.
 		 */
+#if CONFIG_TIMER_TICKLESS
+		timer_idleEnter();
+#endif
 		IRQ_ENABLE;
 		CPU_IDLE;
 		MEMORY_BARRIER;
 		IRQ_DISABLE;
+#if CONFIG_TIMER_TICKLESS
+		if (!SCHED_EMPTY())
+			timer_idleExit();
+#endif
 	}
+	if (idle)
+		MONITOR_SWITCH(NULL, false);
+	else if (preempted && current_process != old_process)
+		MONITOR_SWITCH(old_process, true);
 	if (CONTEXT_SWITCH_FROM_ISR())
 		proc_context_switch(current_process, old_process);
 	/* This RET resumes the execution on the new process */
@@ -559,7 +615,7 @@ bool proc_needPreempt(void)
 		return false;
 	if (!proc_preemptAllowed())
 		return false;
-	if (LIST_EMPTY(&proc_ready_list))
+	if (SCHED_EMPTY())
 		return false;
 	return preempt_quantum() ? prio_next() > prio_curr() :
 			prio_next() >= prio_curr();
@@ -578,15 +634,17 @@ void proc_preempt(void)
 	/* We are inside a IRQ context, so ATOMIC is not needed here */
 	SCHED_ENQUEUE(current_process);
 	preempt_reset_quantum();
-	proc_schedule();
+	proc_schedule(true);
 }
 #endif /* CONFIG_KERN_PREEMPT */
 
 /* Immediately switch to a particular process */
-static void proc_switchTo(Process *proc)
+static void proc_switchTo(Process *proc, bool preempted)
 {
 	Process *old_process = current_process;
 
+	(void)preempted;
+	MONITOR_SWITCH(old_process, preempted);
 	SCHED_ENQUEUE(current_process);
 	preempt_reset_quantum();
 	current_process = proc;
@@ -606,7 +664,8 @@ void proc_switch(void)
 	ASSERT(proc_preemptAllowed());
 	ATOMIC(
 		preempt_reset_quantum();
-		proc_schedule();
+		MONITOR_SWITCH(current_process, false);
+		proc_schedule(false);
 	);
 }
 
@@ -620,11 +679,30 @@ void proc_wakeup(Process *proc)
 	IRQ_ASSERT_DISABLED();
 
 	if (prio_proc(proc) >= prio_curr())
-		proc_switchTo(proc);
+		proc_switchTo(proc, true);
 	else
 		SCHED_ENQUEUE_HEAD(proc);
 }
 
+/**
+ * Dispatch \a proc to the CPU without passing through the ready list.
+ *
+ * \note Assume the current process has been already added to a wait queue
+ *       and \a proc has been awoken, but it is not in the ready list.
+ */
+void proc_handoff(Process *proc)
+{
+	Process *old_process = current_process;
+
+	ASSERT(proc_preemptAllowed());
+	IRQ_ASSERT_DISABLED();
+
+	MONITOR_SWITCH(old_process, false);
+	preempt_reset_quantum();
+	current_process = proc;
+	proc_context_switch(current_process, old_process);
+}
+
 /**
  * Voluntarily release the CPU.
  */
@@ -642,8 +720,8 @@ void proc_yield(void)
 	IRQ_ASSERT_ENABLED();
 
 	IRQ_DISABLE;
-	proc = (struct Process *)list_remHead(&proc_ready_list);
+	proc = sched_dequeue();
 	if (proc)
-		proc_switchTo(proc);
+		proc_switchTo(proc, false);
 	IRQ_ENABLE;
 }
@@ -95,7 +95,11 @@
 #include "cfg/cfg_proc.h"
 #include "cfg/cfg_signal.h"
 #include "cfg/cfg_monitor.h"
+#include "cfg/cfg_sem.h"
 
+#if CONFIG_KERN_MONITOR
+	#include <kern/monitor.h> // monitor_forbidEnter(), monitor_forbidExit()
+#endif
 #include <struct/list.h> // Node, PriNode
 
 #include <cfg/compiler.h>
@@ -117,6 +121,12 @@ typedef struct Process
 	PriNode      link;        /**< Link Process into scheduler lists */
 #else
 	Node         link;        /**< Link Process into scheduler lists */
+#endif
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+	int          ready_level; /**< Ready queue level, -1 if not ready */
+#endif
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+	struct Semaphore *wait_sem; /**< Semaphore the process is waiting for */
 #endif
 	cpu_stack_t  *stack;       /**< Per-process SP */
 	iptr_t       user_data;   /**< Custom data passed to the process */
@@ -142,6 +152,13 @@ typedef struct Process
 	{
 		Node        link;
 		const char *name;
+	#if CONFIG_KERN_MONITOR_STATS
+		uint32_t    run_sec;      /**< Run time, whole seconds */
+		uint32_t    run_hp;       /**< Run time, hp ticks below one second */
+		uint32_t    switches;     /**< Voluntary context switches */
+		uint32_t    preemptions;  /**< Involuntary context switches */
+		uint32_t    max_forbid;   /**< Longest proc_forbid() section [hp ticks] */
+	#endif
 	} monitor;
 #endif
 
@@ -248,6 +265,9 @@ INLINE struct Process *proc_current(void)
 
 #if CONFIG_KERN_PREEMPT
 
+	/* Preemption nesting counter, private to the kernel */
+	extern cpu_atomic_t preempt_count;
+
 	/**
 	 * Disable preemptive task switching.
 	 *
@@ -267,7 +287,6 @@ INLINE struct Process *proc_current(void)
 	 */
 	INLINE void proc_forbid(void)
 	{
-		extern cpu_atomic_t preempt_count;
 		/*
 		 * We don't need to protect the counter against other processes.
 		 * The reason why is a bit subtle.
@@ -291,7 +310,12 @@ INLINE struct Process *proc_current(void)
 		 * "preempt_forbid_cnt != 0" means that no task switching is
 		 * possible.
 		 */
+	#if CONFIG_KERN_MONITOR && CONFIG_KERN_MONITOR_STATS
+		if (preempt_count++ == 0)
+			monitor_forbidEnter();
+	#else
 		++preempt_count;
+	#endif
 
 		/*
 		 * Make sure preempt_count is flushed to memory so the preemption
@@ -307,8 +331,6 @@ INLINE struct Process *proc_current(void)
 	 */
 	INLINE void proc_permit(void)
 	{
-		extern cpu_atomic_t preempt_count;
-
 		/*
 		 * This is to ensure any global state changed by the process gets
 		 * flushed to memory before task switching is re-enabled.
@@ -316,7 +338,12 @@ INLINE struct Process *proc_current(void)
 		MEMORY_BARRIER;
 		/* No need to protect against interrupts here. */
 		ASSERT(preempt_count > 0);
+	#if CONFIG_KERN_MONITOR && CONFIG_KERN_MONITOR_STATS
+		if (--preempt_count == 0)
+			monitor_forbidExit();
+	#else
 		--preempt_count;
+	#endif
 		/*
 		 * This ensures preempt_count is flushed to memory immediately so the
 		 * preemption interrupt sees the correct value.
@@ -331,7 +358,6 @@ INLINE struct Process *proc_current(void)
 	 */
 	INLINE bool proc_preemptAllowed(void)
 	{
-		extern cpu_atomic_t preempt_count;
 		return (preempt_count == 0);
 	}
 #else /* CONFIG_KERN_PREEMPT */
@@ -43,7 +43,9 @@
 #include "cfg/cfg_monitor.h"
 
 #include <cfg/compiler.h>
+#include <cfg/macros.h>       // BV32()
 
+#include <cpu/attr.h>         // CPU_BITS_PER_CHAR
 #include <cpu/types.h>        /* for cpu_stack_t */
 #include <cpu/irq.h>          // IRQ_ASSERT_DISABLED()
 
@@ -70,6 +72,112 @@ EXTERN_C void asm_switch_context(cpu_stack_t **new_sp, cpu_stack_t **save_sp);
 /** Track running processes. */
 extern REGISTER Process	*current_process;
 
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+
+/**
+ * Track ready processes, one FIFO list for each priority level.
+ *
+ * Access to these lists must be performed with interrupts disabled
+ */
+extern REGISTER List     proc_ready_list[CONFIG_KERN_PRI_LEVELS];
+
+/**
+ * Bitmap of ready levels: bit n is set when proc_ready_list[n] is not empty.
+ */
+extern REGISTER uint32_t proc_ready_mask;
+
+STATIC_ASSERT(CONFIG_KERN_PRI_LEVELS >= 2 && CONFIG_KERN_PRI_LEVELS <= 32);
+
+/** Lowest priority that gets its own ready list. */
+#define PRI_LEVEL_MIN  (-(CONFIG_KERN_PRI_LEVELS / 2))
+/** Highest priority that gets its own ready list. */
+#define PRI_LEVEL_MAX  (PRI_LEVEL_MIN + CONFIG_KERN_PRI_LEVELS - 1)
+
+/**
+ * Map a process priority to a ready list index.
+ *
+ * Priorities out of range are clamped to the lowest/highest level.
+ */
+INLINE int sched_level(int pri)
+{
+	if (pri < PRI_LEVEL_MIN)
+		pri = PRI_LEVEL_MIN;
+	else if (pri > PRI_LEVEL_MAX)
+		pri = PRI_LEVEL_MAX;
+	return pri - PRI_LEVEL_MIN;
+}
+
+/**
+ * Return the index of the highest non-empty ready list.
+ *
+ * \note The ready queue must not be empty.
+ */
+INLINE int sched_topLevel(void)
+{
+	ASSERT(proc_ready_mask);
+#if GNUC_PREREQ(3,4)
+	return (int)(sizeof(unsigned long) * CPU_BITS_PER_CHAR) - 1
+		- __builtin_clzl(proc_ready_mask);
+#else
+	uint32_t mask = proc_ready_mask;
+	int level = 0;
+
+	if (mask & 0xFFFF0000UL) { mask >>= 16; level += 16; }
+	if (mask & 0xFF00) { mask >>= 8; level += 8; }
+	if (mask & 0xF0) { mask >>= 4; level += 4; }
+	if (mask & 0xC) { mask >>= 2; level += 2; }
+	if (mask & 0x2) { level += 1; }
+	return level;
+#endif
+}
+
+	#define SCHED_EMPTY()	(proc_ready_mask == 0)
+
+	#define prio_next()	(SCHED_EMPTY() ? INT_MIN : \
+					((PriNode *)LIST_HEAD(&proc_ready_list[sched_topLevel()]))->pri)
+	#define prio_proc(proc)	(proc->link.pri)
+	#define prio_curr()	prio_proc(current_process)
+
+	#define SCHED_ENQUEUE_INTERNAL(proc) do { \
+			int __lvl = sched_level((proc)->link.pri); \
+			LIST_ASSERT_VALID(&proc_ready_list[__lvl]); \
+			ADDTAIL(&proc_ready_list[__lvl], &(proc)->link.link); \
+			proc_ready_mask |= BV32(__lvl); \
+			(proc)->ready_level = __lvl; \
+		} while (0)
+	#define SCHED_ENQUEUE_HEAD_INTERNAL(proc) do { \
+			int __lvl = sched_level((proc)->link.pri); \
+			LIST_ASSERT_VALID(&proc_ready_list[__lvl]); \
+			ADDHEAD(&proc_ready_list[__lvl], &(proc)->link.link); \
+			proc_ready_mask |= BV32(__lvl); \
+			(proc)->ready_level = __lvl; \
+		} while (0)
+
+/**
+ * Unlink the first process of the highest priority ready list.
+ *
+ * \return The process to run, or NULL if no process is ready.
+ */
+INLINE struct Process *sched_dequeue(void)
+{
+	struct Process *proc;
+	int level;
+
+	IRQ_ASSERT_DISABLED();
+	if (SCHED_EMPTY())
+		return NULL;
+
+	level = sched_topLevel();
+	LIST_ASSERT_VALID(&proc_ready_list[level]);
+	proc = (struct Process *)list_remHead(&proc_ready_list[level]);
+	if (LIST_EMPTY(&proc_ready_list[level]))
+		proc_ready_mask &= ~BV32(level);
+	proc->ready_level = -1;
+	return proc;
+}
+
+#else /* !(CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP) */
+
 /**
  * Track ready processes.
  *
@@ -77,25 +185,51 @@ extern REGISTER Process	*current_process;
  */
 extern REGISTER List     proc_ready_list;
 
+	#define SCHED_EMPTY()	LIST_EMPTY(&proc_ready_list)
+
 #if CONFIG_KERN_PRI
 	#define prio_next()	(LIST_EMPTY(&proc_ready_list) ? INT_MIN : \
 					((PriNode *)LIST_HEAD(&proc_ready_list))->pri)
 	#define prio_proc(proc)	(proc->link.pri)
 	#define prio_curr()	prio_proc(current_process)
 
-	#define SCHED_ENQUEUE_INTERNAL(proc) \
-			LIST_ENQUEUE(&proc_ready_list, &(proc)->link)
-	#define SCHED_ENQUEUE_HEAD_INTERNAL(proc) \
-			LIST_ENQUEUE_HEAD(&proc_ready_list, &(proc)->link)
+	#define SCHED_ENQUEUE_INTERNAL(proc) do { \
+			LIST_ASSERT_VALID(&proc_ready_list); \
+			LIST_ENQUEUE(&proc_ready_list, &(proc)->link); \
+		} while (0)
+	#define SCHED_ENQUEUE_HEAD_INTERNAL(proc) do { \
+			LIST_ASSERT_VALID(&proc_ready_list); \
+			LIST_ENQUEUE_HEAD(&proc_ready_list, &(proc)->link); \
+		} while (0)
 #else
 	#define prio_next()	0
 	#define prio_proc(proc)	0
 	#define prio_curr()	0
 
-	#define SCHED_ENQUEUE_INTERNAL(proc) ADDTAIL(&proc_ready_list, &(proc)->link)
-	#define SCHED_ENQUEUE_HEAD_INTERNAL(proc) ADDHEAD(&proc_ready_list, &(proc)->link)
+	#define SCHED_ENQUEUE_INTERNAL(proc) do { \
+			LIST_ASSERT_VALID(&proc_ready_list); \
+			ADDTAIL(&proc_ready_list, &(proc)->link); \
+		} while (0)
+	#define SCHED_ENQUEUE_HEAD_INTERNAL(proc) do { \
+			LIST_ASSERT_VALID(&proc_ready_list); \
+			ADDHEAD(&proc_ready_list, &(proc)->link); \
+		} while (0)
 #endif
 
+/**
+ * Unlink the first process of the ready list.
+ *
+ * \return The process to run, or NULL if no process is ready.
+ */
+INLINE struct Process *sched_dequeue(void)
+{
+	IRQ_ASSERT_DISABLED();
+	LIST_ASSERT_VALID(&proc_ready_list);
+	return (struct Process *)list_remHead(&proc_ready_list);
+}
+
+#endif /* CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP */
+
 /**
  * Enqueue a process in the ready list.
  *
@@ -107,18 +241,38 @@ extern REGISTER List     proc_ready_list;
  */
 #define SCHED_ENQUEUE(proc)  do { \
 		IRQ_ASSERT_DISABLED(); \
-		LIST_ASSERT_VALID(&proc_ready_list); \
 		SCHED_ENQUEUE_INTERNAL(proc); \
 	} while (0)
 
 #define SCHED_ENQUEUE_HEAD(proc)  do { \
 		IRQ_ASSERT_DISABLED(); \
-		LIST_ASSERT_VALID(&proc_ready_list); \
 		SCHED_ENQUEUE_HEAD_INTERNAL(proc); \
 	} while (0)
 
 
-#if CONFIG_KERN_PRI
+#if CONFIG_KERN_PRI && CONFIG_KERN_PRI_BITMAP
+/**
+ * Changes the priority of an already enqueued process.
+ *
+ * The process keeps track of the ready list it belongs to, so it can be
+ * moved to the list of its new priority in constant time.
+ *
+ * No action is performed for processes that aren't in the ready list, eg. in semaphore queues.
+ */
+INLINE void sched_reenqueue(struct Process *proc)
+{
+	int level = proc->ready_level;
+
+	IRQ_ASSERT_DISABLED();
+	if (level < 0 || level == sched_level(proc->link.pri))
+		return;
+
+	REMOVE(&proc->link.link);
+	if (LIST_EMPTY(&proc_ready_list[level]))
+		proc_ready_mask &= ~BV32(level);
+	SCHED_ENQUEUE_INTERNAL(proc);
+}
+#elif CONFIG_KERN_PRI
 /**
  * Changes the priority of an already enqueued process.
  *
@@ -127,7 +281,8 @@ extern REGISTER List     proc_ready_list;
  *
  * No action is performed for processes that aren't in the ready list, eg. in semaphore queues.
  *
- * \note Performance could be improved with a different implementation of priority list.
+ * \note Performance could be improved with a different implementation of
+ * priority list, see CONFIG_KERN_PRI_BITMAP.
  */
 INLINE void sched_reenqueue(struct Process *proc)
 {
@@ -163,6 +318,9 @@ void proc_switch(void);
 /* Immediately schedule a particular process bypassing the scheduler. */
 void proc_wakeup(Process *proc);
 
+/* Switch to a ready process *without* adding the current one to the ready list. */
+void proc_handoff(Process *proc);
+
 /* Initialize a scheduler class. */
 void proc_schedInit(void);
 
@@ -178,8 +336,23 @@ void proc_schedInit(void);
 
 	/** Rename a process */
 	void monitor_rename(Process *proc, const char *name);
+
+	#if CONFIG_KERN_MONITOR_STATS
+		/**
+		 * Charge the CPU time elapsed since the last context switch to
+		 * \a prev and count its switch as voluntary or \a preempted.
+		 * A NULL \a prev charges the time to the idle loop.
+		 */
+		void monitor_switch(Process *prev, bool preempted);
+
+		#define MONITOR_SWITCH(prev, preempted) monitor_switch(prev, preempted)
+	#endif
 #endif /* CONFIG_KERN_MONITOR */
 
+#if !CONFIG_KERN_MONITOR || !CONFIG_KERN_MONITOR_STATS
+	#define MONITOR_SWITCH(prev, preempted) do { } while (0)
+#endif
+
 /*
  * Quantum related macros are used in the
  * timer module and must be empty when
@@ -74,6 +74,11 @@
 #include <drv/timer.h>
 #include <cfg/test.h>
 #include <cfg/cfg_proc.h>
+#include <cfg/cfg_timer.h>
+
+#if CONFIG_TIMER_TICKLESS
+	#include <os/hptime.h>
+#endif
 
 enum
 {
@@ -366,6 +371,44 @@ out:
 }
 #endif /* CONFIG_KERN_SIGNALS & CONFIG_KERN_PRI */
 
+#if CONFIG_TIMER_TICKLESS
+/*
+ * While the main process sleeps no other process is ready to run, so the
+ * periodic tick is stopped: check that the system clock is kept in sync
+ * with the host clock.
+ */
+static int tickless_test(void)
+{
+	static const mtime_t delays[] = { 10, 50, 200, 1000 };
+	size_t i;
+
+	kputs("Run Tickless test..\n");
+	for (i = 0; i < countof(delays); i++)
+	{
+		hptime_t start_hp = hptime_get();
+		ticks_t start = timer_clock();
+		ticks_t ticks, host_ticks;
+
+		timer_delay(delays[i]);
+		ticks = timer_clock() - start;
+		host_ticks = (ticks_t)((hptime_get() - start_hp)
+			* TIMER_TICKS_PER_SEC / HPTIME_TICKS_PER_SECOND);
+
+		kprintf("> delay %ld ms: %ld ticks, host %ld ticks\n",
+			(long)delays[i], (long)ticks, (long)host_ticks);
+		if (ticks < ms_to_ticks(delays[i])
+			|| ticks > ms_to_ticks(delays[i]) + 2
+			|| ABS(ticks - host_ticks) > 2)
+		{
+			kputs("Tickless test failed.\n");
+			return -1;
+		}
+	}
+	kputs("Tickless test successfull.\n");
+	return 0;
+}
+#endif /* CONFIG_TIMER_TICKLESS */
+
 /**
  * Process scheduling test
  */
@@ -379,6 +422,10 @@ int proc_testRun(void)
 #if CONFIG_KERN_SIGNALS & CONFIG_KERN_PRI
 	prio_worker_test();
 #endif /* CONFIG_KERN_SIGNALS & CONFIG_KERN_PRI */
+#if CONFIG_TIMER_TICKLESS
+	if (tickless_test())
+		return -1;
+#endif /* CONFIG_TIMER_TICKLESS */
 	return 0;
 }
 
@@ -0,0 +1,185 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Reader/writer lock test.
+ *
+ * RW_READERS readers and RW_WRITERS writers share a table protected by
+ * a reader/writer lock. Writers update the whole table while holding
+ * the lock, so readers must always see consistent contents. The test
+ * also checks that readers actually share the lock.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_sem.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SEMAPHORES" >> $cfgdir/cfg_sem.h
+ * $test$: echo "#define CONFIG_KERN_SEMAPHORES 1" >> $cfgdir/cfg_sem.h
+ */
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/sem.h>
+#include <kern/proc.h>
+
+#include <drv/timer.h>
+
+#define RW_READERS       4
+#define RW_WRITERS       2
+#define RW_LOOPS        10
+#define RW_DELAY         5
+#define RW_TABLE_SIZE    8
+#define TEST_TIME_OUT_MS 6000
+
+static RWLock lock;
+static CountSem done;
+static volatile int table[RW_TABLE_SIZE];
+static volatile int readers_in, max_readers_in, writers_in, errors;
+
+static void rw_reader(void)
+{
+	for (int i = 0; i < RW_LOOPS; i++)
+	{
+		rwlock_readObtain(&lock);
+		if (writers_in)
+			errors++;
+		if (++readers_in > max_readers_in)
+			max_readers_in = readers_in;
+
+		/* Let the other processes run while we are reading */
+		timer_delay(RW_DELAY);
+		for (int j = 1; j < RW_TABLE_SIZE; j++)
+			if (table[j] != table[0])
+				errors++;
+
+		readers_in--;
+		rwlock_readRelease(&lock);
+		timer_delay(RW_DELAY);
+	}
+	csem_release(&done);
+}
+
+static void rw_writer(void)
+{
+	for (int i = 0; i < RW_LOOPS; i++)
+	{
+		rwlock_writeObtain(&lock);
+		if (readers_in || writers_in++)
+			errors++;
+
+		/* Leave the table inconsistent while sleeping */
+		for (int j = 0; j < RW_TABLE_SIZE; j++)
+		{
+			table[j]++;
+			if (j == RW_TABLE_SIZE / 2)
+				timer_delay(RW_DELAY);
+		}
+
+		writers_in--;
+		rwlock_writeRelease(&lock);
+		timer_delay(RW_DELAY * 2);
+	}
+	csem_release(&done);
+}
+
+PROC_DEFINE_STACK(rw_stack0, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(rw_stack1, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(rw_stack2, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(rw_stack3, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(rw_stack4, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(rw_stack5, KERN_MINSTACKSIZE * 2);
+
+static cpu_stack_t *rw_stacks[RW_READERS + RW_WRITERS] =
+{
+	rw_stack0, rw_stack1, rw_stack2,
+	rw_stack3, rw_stack4, rw_stack5,
+};
+
+int rwlock_testRun(void)
+{
+	ticks_t start_time = timer_clock();
+	int finished = 0;
+
+	kputs("Run reader/writer lock test..\n");
+
+	/* Shared and exclusive access must exclude each other */
+	if (!rwlock_readAttempt(&lock) || !rwlock_readAttempt(&lock)
+			|| rwlock_writeAttempt(&lock))
+		return -1;
+	rwlock_readRelease(&lock);
+	rwlock_readRelease(&lock);
+	if (!rwlock_writeAttempt(&lock) || rwlock_readAttempt(&lock))
+		return -1;
+	rwlock_writeRelease(&lock);
+
+	for (int i = 0; i < RW_READERS + RW_WRITERS; i++)
+		proc_new(i < RW_READERS ? rw_reader : rw_writer, NULL,
+			sizeof(rw_stack0), rw_stacks[i]);
+
+	while (finished < RW_READERS + RW_WRITERS)
+	{
+		if (timer_clock() - start_time > ms_to_ticks(TEST_TIME_OUT_MS))
+		{
+			kputs("> Reader/writer lock test timed out\n");
+			return -1;
+		}
+		if (csem_attempt(&done))
+			finished++;
+		else
+			timer_delay(RW_DELAY);
+	}
+
+	kprintf("> max concurrent readers %d/%d, table %d, errors %d\n",
+		max_readers_in, RW_READERS, table[0], errors);
+	if (errors || max_readers_in < 2 || table[0] != RW_WRITERS * RW_LOOPS)
+		return -1;
+
+	kputs("> Reader/writer lock test..Ok!\n");
+	return 0;
+}
+
+int rwlock_testSetup(void)
+{
+	kdbg_init();
+	rwlock_init(&lock);
+	csem_init(&done, 0);
+	timer_init();
+	proc_init();
+	return 0;
+}
+
+int rwlock_testTearDown(void)
+{
+	kputs("TearDown reader/writer lock test.\n");
+	return 0;
+}
+
+TEST_MAIN(rwlock);
@@ -43,6 +43,9 @@
 #include <kern/proc.h>
 #include <kern/proc_p.h>
 #include <kern/signal.h>
+#include <kern/trace.h>
+
+#include <limits.h> // INT_MIN
 
 INLINE void sem_verify(struct Semaphore *s)
 {
@@ -61,8 +64,90 @@ void sem_init(struct Semaphore *s)
 	LIST_INIT(&s->wait_queue);
 	s->owner = NULL;
 	s->nest_count = 0;
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+	s->owner_pri = 0;
+	s->ceiling = INT_MIN;
+#endif
+}
+
+/*
+ * Add the current process to a wait queue.
+ */
+INLINE void sem_enqueue(List *queue)
+{
+#if CONFIG_KERN_PRI
+	/* Enqueue calling process by priority */
+	LIST_ENQUEUE(queue, &current_process->link);
+#else
+	/* Append calling process to the wait queue */
+	ADDTAIL(queue, (Node *)current_process);
+#endif
+}
+
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+
+/*
+ * Record the priority of the new owner of a semaphore and raise it to the
+ * priority ceiling, if any.
+ */
+INLINE void sem_setOwner(struct Semaphore *s, Process *proc)
+{
+	s->owner = proc;
+	s->owner_pri = prio_proc(proc);
+	if (s->ceiling > s->owner_pri)
+		proc_setPri(proc, s->ceiling);
+}
+
+/*
+ * Boost the owner of \a s to priority \a pri.
+ *
+ * If the owner is in turn waiting for another semaphore, the boost
+ * propagates along the chain of owners.
+ */
+static void sem_inherit(struct Semaphore *s, int pri)
+{
+	Process *owner;
+
+	while (s && (owner = s->owner) && prio_proc(owner) < pri)
+	{
+		proc_setPri(owner, pri);
+
+		/* Keep the wait queue of the owner sorted by priority */
+		s = owner->wait_sem;
+		if (s)
+		{
+			REMOVE(&owner->link.link);
+			LIST_ENQUEUE(&s->wait_queue, &owner->link);
+		}
+	}
+}
+
+/*
+ * Restore the priority the current process had before locking \a s.
+ *
+ * \note Priorities are restored correctly only if semaphores are
+ *       released in the reverse order they have been obtained.
+ *
+ * \return true if the priority of the current process has been lowered.
+ */
+INLINE bool sem_disinherit(struct Semaphore *s)
+{
+	if (prio_curr() == s->owner_pri)
+		return false;
+
+	proc_setPri(current_process, s->owner_pri);
+	return true;
+}
+
+#else /* !(CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT) */
+
+INLINE void sem_setOwner(struct Semaphore *s, Process *proc)
+{
+	s->owner = proc;
 }
 
+#endif /* CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT */
+
 
 /**
  * \brief Attempt to lock a semaphore without waiting.
@@ -81,14 +166,21 @@ bool sem_attempt(struct Semaphore *s)
 
 	proc_forbid();
 	sem_verify(s);
-	if ((!s->owner) || (s->owner == current_process))
+	if (!s->owner)
+	{
+		sem_setOwner(s, current_process);
+		s->nest_count++;
+		result = true;
+	}
+	else if (s->owner == current_process)
 	{
-		s->owner = current_process;
 		s->nest_count++;
 		result = true;
 	}
 	proc_permit();
 
+	if (result)
+		trace_event(TRACE_SEM_OBTAIN, s, 0);
 	return result;
 }
 
@@ -118,8 +210,12 @@ void sem_obtain(struct Semaphore *s)
 	/* Is the semaphore already locked by another process? */
 	if (UNLIKELY(s->owner && (s->owner != current_process)))
 	{
-		/* Append calling process to the wait queue */
-		ADDTAIL(&s->wait_queue, (Node *)current_process);
+		sem_enqueue(&s->wait_queue);
+
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+		current_process->wait_sem = s;
+		sem_inherit(s, prio_curr());
+#endif
 
 		/*
 		 * We will wake up only when the current owner calls
@@ -128,15 +224,18 @@ void sem_obtain(struct Semaphore *s)
 		 */
 		proc_permit();
 		proc_switch();
+		trace_event(TRACE_SEM_OBTAIN, s, 1);
 	}
 	else
 	{
 		ASSERT(LIST_EMPTY(&s->wait_queue));
 
 		/* The semaphore was free: lock it */
-		s->owner = current_process;
+		if (!s->owner)
+			sem_setOwner(s, current_process);
 		s->nest_count++;
 		proc_permit();
+		trace_event(TRACE_SEM_OBTAIN, s, 0);
 	}
 }
 
@@ -157,6 +256,9 @@ void sem_obtain(struct Semaphore *s)
 void sem_release(struct Semaphore *s)
 {
 	Process *proc = NULL;
+	bool lowered = false;
+
+	trace_event(TRACE_SEM_RELEASE, s, 0);
 
 	proc_forbid();
 	sem_verify(s);
@@ -169,18 +271,419 @@ void sem_release(struct Semaphore *s)
 	 */
 	if (--s->nest_count == 0)
 	{
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+		/* Drop the priority inherited from the waiters */
+		lowered = sem_disinherit(s);
+#endif
 		/* Disown semaphore */
 		s->owner = NULL;
 
 		/* Give semaphore to the first applicant, if any */
 		if (UNLIKELY((proc = (Process *)list_remHead(&s->wait_queue))))
 		{
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+			proc->wait_sem = NULL;
+#endif
 			s->nest_count = 1;
-			s->owner = proc;
+			sem_setOwner(s, proc);
 		}
 	}
 	proc_permit();
 
 	if (proc)
 		ATOMIC(proc_wakeup(proc));
+	else if (lowered)
+	{
+		/* Let run the processes we were keeping out */
+		bool yield;
+
+		ATOMIC(yield = prio_next() > prio_curr());
+		if (yield)
+			proc_yield();
+	}
+}
+
+
+INLINE void csem_verify(struct CountSem *s)
+{
+	(void)s;
+	ASSERT(s);
+	LIST_ASSERT_VALID(&s->wait_queue);
+	ASSERT(s->count >= 0);
+	ASSERT(s->count == 0 || LIST_EMPTY(&s->wait_queue));
+}
+
+/*
+ * The wait queue of a counting semaphore is protected by disabling
+ * interrupts, rather than by proc_forbid(): csem_obtainTimeout() removes
+ * the waiters from a timer callback.
+ */
+
+/**
+ * \brief Initialize a counting semaphore with \a count available resources.
+ */
+void csem_init(struct CountSem *s, int count)
+{
+	ASSERT(count >= 0);
+
+	LIST_INIT(&s->wait_queue);
+	s->count = count;
+}
+
+/**
+ * \brief Attempt to obtain a counting semaphore without waiting.
+ *
+ * \return true in case of success, false if no resource was available.
+ *
+ * \see csem_obtain() csem_release()
+ */
+bool csem_attempt(struct CountSem *s)
+{
+	bool result = false;
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+	csem_verify(s);
+	if (s->count > 0)
+	{
+		s->count--;
+		result = true;
+	}
+	IRQ_RESTORE(flags);
+
+	return result;
+}
+
+/**
+ * \brief Obtain a counting semaphore.
+ *
+ * If no resource is available, the calling process sleeps until
+ * another process calls csem_release().
+ *
+ * \sa csem_release() csem_attempt() csem_obtainTimeout()
+ */
+void csem_obtain(struct CountSem *s)
+{
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+	csem_verify(s);
+
+	if (UNLIKELY(s->count == 0))
+	{
+		sem_enqueue(&s->wait_queue);
+
+		/*
+		 * csem_release() hands the resource directly to us,
+		 * without incrementing the counter.
+		 */
+		proc_switch();
+	}
+	else
+		s->count--;
+	IRQ_RESTORE(flags);
+}
+
+#if CONFIG_TIMER_EVENTS
+
+#include <drv/timer.h>
+
+/* A process sleeping in csem_obtainTimeout() */
+typedef struct CsemWaiter
+{
+	struct CountSem *s;
+	Process *proc;
+	bool expired;  ///< The timer callback has run
+	bool timedout; ///< The waiter has been removed from the queue
+} CsemWaiter;
+
+/*
+ * Timer callback: wake up the waiter, unless csem_release() has already
+ * handed it the resource. Runs with interrupts disabled.
+ */
+static void csem_timeout(iptr_t data)
+{
+	CsemWaiter *w = (CsemWaiter *)data;
+	Node *node;
+
+	w->expired = true;
+	FOREACH_NODE(node, &w->s->wait_queue)
+	{
+		if ((Process *)node == w->proc)
+		{
+			REMOVE(node);
+			w->timedout = true;
+			SCHED_ENQUEUE(w->proc);
+			break;
+		}
+	}
+}
+
+/**
+ * \brief Obtain a counting semaphore, waiting at most \a timeout ticks.
+ *
+ * \return true if the semaphore has been obtained, false on timeout.
+ *
+ * \sa csem_obtain() csem_attempt()
+ */
+bool csem_obtainTimeout(struct CountSem *s, ticks_t timeout)
+{
+	CsemWaiter w;
+	Timer t;
+	cpu_flags_t flags;
+
+	/* IRQ are needed to run timer */
+	ASSERT(IRQ_ENABLED());
+
+	IRQ_SAVE_DISABLE(flags);
+	csem_verify(s);
+
+	if (s->count > 0)
+	{
+		s->count--;
+		IRQ_RESTORE(flags);
+		return true;
+	}
+	if (!timeout)
+	{
+		IRQ_RESTORE(flags);
+		return false;
+	}
+
+	w.s = s;
+	w.proc = current_process;
+	w.expired = w.timedout = false;
+	timer_setSoftint(&t, csem_timeout, (iptr_t)&w);
+	timer_setDelay(&t, timeout);
+	timer_add(&t);
+
+	sem_enqueue(&s->wait_queue);
+	proc_switch();
+
+	/* Remove the timer if the resource arrived before it */
+	if (!w.expired)
+		timer_abort(&t);
+	IRQ_RESTORE(flags);
+
+	return !w.timedout;
+}
+
+#endif /* CONFIG_TIMER_EVENTS */
+
+/**
+ * \brief Release a counting semaphore.
+ *
+ * The resource is given to the first waiting process, if any.
+ *
+ * \note Any process can release a counting semaphore, not only the
+ *       one that obtained it.
+ *
+ * \sa csem_obtain() csem_attempt()
+ */
+void csem_release(struct CountSem *s)
+{
+	Process *proc;
+	cpu_flags_t flags;
+
+	IRQ_SAVE_DISABLE(flags);
+	csem_verify(s);
+
+	if ((proc = (Process *)list_remHead(&s->wait_queue)))
+		proc_wakeup(proc);
+	else
+		s->count++;
+	IRQ_RESTORE(flags);
+}
+
+
+INLINE void rwlock_verify(struct RWLock *l)
+{
+	(void)l;
+	ASSERT(l);
+	LIST_ASSERT_VALID(&l->read_queue);
+	LIST_ASSERT_VALID(&l->write_queue);
+	ASSERT(l->readers >= 0);
+	ASSERT(!(l->readers && l->writer));
+}
+
+/**
+ * \brief Initialize a reader/writer lock.
+ */
+void rwlock_init(struct RWLock *l)
+{
+	LIST_INIT(&l->read_queue);
+	LIST_INIT(&l->write_queue);
+	l->readers = 0;
+	l->writer = NULL;
+}
+
+/*
+ * A reader can enter only if there are no writers, neither holding
+ * the lock nor waiting for it.
+ */
+INLINE bool rwlock_readFree(struct RWLock *l)
+{
+	return !l->writer && LIST_EMPTY(&l->write_queue);
+}
+
+/**
+ * \brief Attempt to obtain shared access without waiting.
+ *
+ * \return true in case of success, false if a writer holds or is
+ *         waiting for the lock.
+ */
+bool rwlock_readAttempt(struct RWLock *l)
+{
+	bool result = false;
+
+	proc_forbid();
+	rwlock_verify(l);
+	if (rwlock_readFree(l))
+	{
+		l->readers++;
+		result = true;
+	}
+	proc_permit();
+
+	return result;
+}
+
+/**
+ * \brief Obtain shared access to a reader/writer lock.
+ *
+ * The calling process sleeps while a writer holds or is waiting for
+ * the lock.
+ *
+ * \sa rwlock_readRelease()
+ */
+void rwlock_readObtain(struct RWLock *l)
+{
+	proc_forbid();
+	rwlock_verify(l);
+
+	if (UNLIKELY(!rwlock_readFree(l)))
+	{
+		sem_enqueue(&l->read_queue);
+
+		/* The writer accounts for us before waking us up */
+		proc_permit();
+		proc_switch();
+	}
+	else
+	{
+		l->readers++;
+		proc_permit();
+	}
+}
+
+/**
+ * \brief Release shared access to a reader/writer lock.
+ *
+ * The last reader leaving hands the lock to the first waiting writer.
+ */
+void rwlock_readRelease(struct RWLock *l)
+{
+	Process *proc = NULL;
+
+	proc_forbid();
+	rwlock_verify(l);
+	ASSERT(l->readers > 0);
+
+	if (--l->readers == 0)
+	{
+		if ((proc = (Process *)list_remHead(&l->write_queue)))
+			l->writer = proc;
+	}
+	proc_permit();
+
+	if (proc)
+		ATOMIC(proc_wakeup(proc));
+}
+
+/**
+ * \brief Attempt to obtain exclusive access without waiting.
+ *
+ * \return true in case of success, false if the lock is busy.
+ */
+bool rwlock_writeAttempt(struct RWLock *l)
+{
+	bool result = false;
+
+	proc_forbid();
+	rwlock_verify(l);
+	if (!l->writer && !l->readers)
+	{
+		l->writer = current_process;
+		result = true;
+	}
+	proc_permit();
+
+	return result;
+}
+
+/**
+ * \brief Obtain exclusive access to a reader/writer lock.
+ *
+ * The calling process sleeps until all the readers and the writer
+ * holding the lock have released it.
+ *
+ * \sa rwlock_writeRelease()
+ */
+void rwlock_writeObtain(struct RWLock *l)
+{
+	proc_forbid();
+	rwlock_verify(l);
+	ASSERT(l->writer != current_process);
+
+	if (UNLIKELY(l->writer || l->readers))
+	{
+		sem_enqueue(&l->write_queue);
+
+		/* We will be woken up already owning the lock */
+		proc_permit();
+		proc_switch();
+	}
+	else
+	{
+		l->writer = current_process;
+		proc_permit();
+	}
+}
+
+/**
+ * \brief Release exclusive access to a reader/writer lock.
+ *
+ * All the waiting readers are admitted at once; if there are none,
+ * the lock is handed to the first waiting writer.
+ */
+void rwlock_writeRelease(struct RWLock *l)
+{
+	List readers;
+	Process *proc = NULL;
+
+	LIST_INIT(&readers);
+
+	proc_forbid();
+	rwlock_verify(l);
+	ASSERT(l->writer == current_process);
+
+	l->writer = NULL;
+	if (!LIST_EMPTY(&l->read_queue))
+	{
+		/* Move all the waiting readers to our private list */
+		while ((proc = (Process *)list_remHead(&l->read_queue)))
+		{
+			ADDTAIL(&readers, (Node *)proc);
+			l->readers++;
+		}
+	}
+	else if ((proc = (Process *)list_remHead(&l->write_queue)))
+		l->writer = proc;
+	proc_permit();
+
+	if (proc)
+		ATOMIC(proc_wakeup(proc));
+
+	while ((proc = (Process *)list_remHead(&readers)))
+		ATOMIC(proc_wakeup(proc));
 }
@@ -31,11 +31,11 @@
  *
  * -->
  *
- * \defgroup kern_sem Mutually exclusive semaphores
+ * \defgroup kern_sem Semaphores
  * \ingroup kern
  * \{
- * \brief Mutually exclusive semaphores.
- *        Shared locking not supported in this implementation.
+ * \brief Mutually exclusive semaphores, counting semaphores and
+ *        reader/writer locks.
  *
  *
  * \author Bernie Innocenti <bernie@codewiz.org>
@@ -49,6 +49,10 @@
 #ifndef KERN_SEM_H
 #define KERN_SEM_H
 
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_sem.h"
+#include "cfg/cfg_timer.h"
+
 #include <cfg/compiler.h>
 #include <struct/list.h>
 
@@ -61,6 +65,10 @@ typedef struct Semaphore
 	struct Process *owner;
 	List            wait_queue;
 	int             nest_count;
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+	int             owner_pri;  ///< Priority of the owner before locking
+	int             ceiling;    ///< Priority ceiling, INT_MIN if disabled
+#endif
 } Semaphore;
 
 /**
@@ -71,6 +79,78 @@ void sem_init(struct Semaphore *s);
 bool sem_attempt(struct Semaphore *s);
 void sem_obtain(struct Semaphore *s);
 void sem_release(struct Semaphore *s);
+
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+/**
+ * Set the priority ceiling of a semaphore.
+ *
+ * The owner of the semaphore runs at least at priority \a pri until it
+ * releases the semaphore. This prevents priority inversion without
+ * waiting for a higher priority process to block on the semaphore.
+ * Use INT_MIN to disable the ceiling.
+ */
+INLINE void sem_setCeiling(struct Semaphore *s, int pri)
+{
+	s->ceiling = pri;
+}
+#endif
+/* \} */
+
+/**
+ * Counting semaphore.
+ *
+ * Unlike Semaphore, a counting semaphore has no owner: it can be
+ * released by any process and it can be obtained by up to \a count
+ * processes at the same time.
+ */
+typedef struct CountSem
+{
+	List wait_queue;
+	int  count;      ///< Number of available resources
+} CountSem;
+
+/**
+ * \name Counting semaphores
+ * \{
+ */
+void csem_init(struct CountSem *s, int count);
+bool csem_attempt(struct CountSem *s);
+void csem_obtain(struct CountSem *s);
+void csem_release(struct CountSem *s);
+#if CONFIG_TIMER_EVENTS
+bool csem_obtainTimeout(struct CountSem *s, ticks_t timeout);
+#endif
+/* \} */
+
+/**
+ * Reader/writer lock.
+ *
+ * Any number of readers can hold the lock at the same time, while a
+ * writer gets exclusive access. New readers wait as soon as a writer is
+ * waiting, so writers are not starved by a steady flow of readers;
+ * releasing the write lock admits all the waiting readers first.
+ *
+ * \note Locks are not recursive.
+ */
+typedef struct RWLock
+{
+	List            read_queue;   ///< Processes waiting for shared access
+	List            write_queue;  ///< Processes waiting for exclusive access
+	int             readers;      ///< Number of readers holding the lock
+	struct Process *writer;       ///< Writer holding the lock, if any
+} RWLock;
+
+/**
+ * \name Reader/writer locks
+ * \{
+ */
+void rwlock_init(struct RWLock *l);
+bool rwlock_readAttempt(struct RWLock *l);
+void rwlock_readObtain(struct RWLock *l);
+void rwlock_readRelease(struct RWLock *l);
+bool rwlock_writeAttempt(struct RWLock *l);
+void rwlock_writeObtain(struct RWLock *l);
+void rwlock_writeRelease(struct RWLock *l);
 /* \} */
 /* \} */ //defgroup kern_sem
 
@@ -78,4 +158,12 @@ int sem_testRun(void);
 int sem_testSetup(void);
 int sem_testTearDown(void);
 
+int csem_testRun(void);
+int csem_testSetup(void);
+int csem_testTearDown(void);
+
+int rwlock_testRun(void);
+int rwlock_testSetup(void);
+int rwlock_testTearDown(void);
+
 #endif /* KERN_SEM_H */
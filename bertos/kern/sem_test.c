@@ -131,6 +131,102 @@ PROC_TEST_STACK(6)
 PROC_TEST_STACK(7)
 PROC_TEST_STACK(8)
 
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+
+/*
+ * Priority inheritance test.
+ *
+ * A low priority process holds the semaphore while a medium and then a
+ * high priority process block on it. The low priority process must be
+ * boosted to the priority of the high priority process, get its own
+ * priority back on release, and the semaphore must be handed to the
+ * waiters in priority order.
+ */
+#define PI_PRI_LOW      1
+#define PI_PRI_MEDIUM   2
+#define PI_PRI_HIGH     3
+
+Semaphore pi_sem;
+static volatile bool pi_high_waiting;
+static volatile int pi_low_boost, pi_low_restored;
+static volatile int pi_order[2], pi_count;
+
+static void pi_low(void)
+{
+	sem_obtain(&pi_sem);
+	while (!pi_high_waiting)
+		timer_delay(DELAY);
+	pi_low_boost = proc_current()->link.pri;
+	sem_release(&pi_sem);
+	pi_low_restored = proc_current()->link.pri;
+}
+
+static void pi_medium(void)
+{
+	sem_obtain(&pi_sem);
+	pi_order[pi_count++] = PI_PRI_MEDIUM;
+	sem_release(&pi_sem);
+}
+
+static void pi_high(void)
+{
+	pi_high_waiting = true;
+	sem_obtain(&pi_sem);
+	pi_order[pi_count++] = PI_PRI_HIGH;
+	sem_release(&pi_sem);
+}
+
+PROC_DEFINE_STACK(pi_low_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(pi_medium_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(pi_high_stack, KERN_MINSTACKSIZE * 2);
+
+static int sem_testInheritance(void)
+{
+	Semaphore ceil_sem;
+	ticks_t start_time = timer_clock();
+
+	kputs("Run priority inheritance test..\n");
+	sem_init(&pi_sem);
+
+	/* Start the waiters only when the semaphore is locked */
+	proc_setPri(proc_new(pi_low, NULL, sizeof(pi_low_stack), pi_low_stack), PI_PRI_LOW);
+	while (!pi_sem.owner)
+		timer_delay(DELAY);
+	proc_setPri(proc_new(pi_medium, NULL, sizeof(pi_medium_stack), pi_medium_stack), PI_PRI_MEDIUM);
+	while (LIST_EMPTY(&pi_sem.wait_queue))
+		timer_delay(DELAY);
+	proc_setPri(proc_new(pi_high, NULL, sizeof(pi_high_stack), pi_high_stack), PI_PRI_HIGH);
+
+	while (pi_count < 2 || !pi_low_restored)
+	{
+		if (timer_clock() - start_time > ms_to_ticks(TEST_TIME_OUT_MS))
+			return -1;
+		timer_delay(DELAY);
+	}
+
+	kprintf("> low boosted to %d, restored to %d, order %d %d\n",
+		pi_low_boost, pi_low_restored, pi_order[0], pi_order[1]);
+	if (pi_low_boost != PI_PRI_HIGH || pi_low_restored != PI_PRI_LOW
+			|| pi_order[0] != PI_PRI_HIGH || pi_order[1] != PI_PRI_MEDIUM)
+		return -1;
+
+	kputs("Run priority ceiling test..\n");
+	sem_init(&ceil_sem);
+	sem_setCeiling(&ceil_sem, PI_PRI_HIGH);
+	sem_obtain(&ceil_sem);
+	sem_obtain(&ceil_sem);
+	if (proc_current()->link.pri != PI_PRI_HIGH)
+		return -1;
+	sem_release(&ceil_sem);
+	sem_release(&ceil_sem);
+	if (proc_current()->link.pri != 0)
+		return -1;
+
+	kputs("> Priority inheritance test..Ok!\n");
+	return 0;
+}
+#endif /* CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT */
+
 /**
  * Run semaphore test
  */
@@ -163,7 +259,12 @@ int sem_testRun(void)
 			if(global_count == MAX_GLOBAL_COUNT)
 			{
 				kputs("> Main: Test Finished..Ok!\n");
+				sem_release(&sem);
+#if CONFIG_KERN_PRI && CONFIG_SEM_PRI_INHERIT
+				return sem_testInheritance();
+#else
 				return 0;
+#endif
 			}
 			sem_release(&sem);
 			kputs("> Main: Test is still running..\n");
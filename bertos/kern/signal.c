@@ -88,6 +88,16 @@
  *     [P1]____sig_post()____[P1]____proc_schedule()____[P2]
  * </pre>
  *
+ * A process that sends a signal and then immediately sleeps waiting for an
+ * answer, as in a remote procedure call, can use sig_sendWaitSignal(): if
+ * the receiver is awakened and no process with a higher priority is ready,
+ * the CPU is handed off to it directly, without passing through the ready
+ * queue.
+ * <pre>
+ * - Send and wait:
+ *     [P1]____sig_sendWaitSignal()____proc_handoff()____[P2]
+ * </pre>
+ *
  * In this way, any execution context, including an interrupt handler, can
  * deliver a signal to a process. However, synchronous signal delivery from a
  * non-sleepable context (like an interrupt handler) is forbidden in order to
@@ -134,6 +144,7 @@
 #include <cpu/irq.h>
 #include <kern/proc.h>
 #include <kern/proc_p.h>
+#include <kern/trace.h>
 
 
 #if CONFIG_KERN_SIGNALS
@@ -149,6 +160,8 @@ sigmask_t sig_waitSignal(Signal *s, sigmask_t sigs)
 	IRQ_ASSERT_ENABLED();
 	ASSERT(proc_preemptAllowed());
 
+	trace_event(TRACE_SIG_WAIT, s, sigs);
+
 	/*
 	 * This is subtle: there's a race condition where a concurrent process
 	 * or an interrupt may call sig_send()/sig_post() to set a bit in
@@ -228,6 +241,8 @@ INLINE void __sig_signal(Signal *s, Process *proc, sigmask_t sigs, bool wakeup)
 
 	IRQ_SAVE_DISABLE(flags);
 
+	trace_event(TRACE_SIG_SEND, proc, sigs);
+
 	/* Set the signals */
 	s->recv |= sigs;
 
@@ -259,4 +274,53 @@ void sig_postSignal(Signal *s, Process *proc, sigmask_t sigs)
 	__sig_signal(s, proc, sigs, false);
 }
 
+sigmask_t sig_sendWaitSignal(Signal *dst, Process *proc, sigmask_t send_sigs,
+		Signal *s, sigmask_t wait_sigs)
+{
+	sigmask_t result;
+
+	ASSERT_USER_CONTEXT();
+	IRQ_ASSERT_ENABLED();
+	ASSERT(proc_preemptAllowed());
+
+	IRQ_DISABLE;
+
+	trace_event(TRACE_SIG_SEND, proc, send_sigs);
+	dst->recv |= send_sigs;
+
+	if (dst->recv & dst->wait)
+	{
+		ASSERT(proc != current_process);
+		dst->wait = 0;
+
+		/*
+		 * We are going to sleep anyway: give the CPU straight to the
+		 * receiver, unless the answer is already there or a process
+		 * with an higher priority is waiting for it.
+		 */
+		if (!(s->recv & wait_sigs) && prio_proc(proc) >= prio_next())
+		{
+			trace_event(TRACE_SIG_WAIT, s, wait_sigs);
+			s->wait = wait_sigs;
+			proc_handoff(proc);
+			ASSERT(!s->wait);
+		}
+		else
+			SCHED_ENQUEUE_HEAD(proc);
+	}
+
+	/* Same as sig_waitSignal() */
+	while (!(result = s->recv & wait_sigs))
+	{
+		s->wait = wait_sigs;
+		proc_switch();
+		ASSERT(!s->wait);
+		ASSERT(s->recv & wait_sigs);
+	}
+	s->recv &= ~wait_sigs;
+
+	IRQ_ENABLE;
+	return result;
+}
+
 #endif /* CONFIG_KERN_SIGNALS */
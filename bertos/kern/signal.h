@@ -150,6 +150,21 @@ INLINE sigmask_t sig_wait(sigmask_t sigs)
 sigmask_t sig_waitTimeoutSignal(Signal *s, sigmask_t sigs, ticks_t timeout,
 				Hook func, iptr_t data);
 
+/**
+ * Send the signals \a send_sigs to the process \a proc through the signal
+ * structure \a dst, then sleep until any of the signals in \a wait_sigs
+ * arrives on \a s.
+ *
+ * It is the same as sig_sendSignal() followed by sig_waitSignal(), but when
+ * \a proc is awoken the CPU is handed off to it directly, without queueing
+ * any of the two processes in the ready list.
+ *
+ * \return the signal(s) that have awoken the process.
+ * \note This function can't be called from IRQ context.
+ */
+sigmask_t sig_sendWaitSignal(Signal *dst, Process *proc, sigmask_t send_sigs,
+		Signal *s, sigmask_t wait_sigs);
+
 /**
  * Sleep until any of the signals in \a sigs or \a timeout ticks elapse.
  * If the timeout elapse a SIG_TIMEOUT is added to the received signal(s).
@@ -0,0 +1,177 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Kernel event trace ring buffer.
+ *
+ * Dump format, all fields little endian:
+ * \code
+ * header: u32 magic, u16 version, u16 event size,
+ *         u32 ticks/s, u32 hpticks/s, u32 hpticks/tick,
+ *         u32 event count, u32 lost events
+ * event:  u32 ticks, u32 hptime, u32 process, u32 object,
+ *         u16 arg, u8 type, u8 padding
+ * \endcode
+ * Events are saved from the oldest to the newest; events overwritten
+ * while dumping are saved with type 0. Pointers are truncated to 32
+ * bits, they are only used to tell objects apart.
+ */
+
+#include "trace.h"
+
+#if CONFIG_KERN_TRACE
+
+#include <cfg/debug.h>
+#include <cfg/macros.h>    // IS_POW2()
+
+#include <cpu/irq.h>
+#include <cpu/byteorder.h>
+
+#include <kern/proc.h>
+#include <drv/timer.h>
+#include <io/kfile.h>
+
+#include <string.h> // memcpy()
+
+STATIC_ASSERT(IS_POW2(CONFIG_KERN_TRACE_SIZE));
+
+#define TRACE_EVENT_SIZE  20
+
+typedef struct TraceEvent
+{
+	ticks_t     ticks;
+	hptime_t    hp;
+	const void *proc;
+	const void *obj;
+	uint16_t    arg;
+	uint8_t     type;
+} TraceEvent;
+
+static TraceEvent trace_buf[CONFIG_KERN_TRACE_SIZE];
+/* Total number of recorded events, the ring index is taken modulo the size */
+static unsigned long trace_idx;
+
+/**
+ * Record an event into the ring buffer.
+ *
+ * Safe to call from any context, including interrupts.
+ */
+void trace_record(uint8_t type, const void *obj, uint16_t arg)
+{
+	cpu_flags_t flags;
+	TraceEvent *e;
+
+	IRQ_SAVE_DISABLE(flags);
+	e = &trace_buf[trace_idx++ & (CONFIG_KERN_TRACE_SIZE - 1)];
+	e->ticks = timer_clock_unlocked();
+	e->hp = timer_hw_hpread();
+	e->proc = proc_current();
+	e->obj = obj;
+	e->arg = arg;
+	e->type = type;
+	IRQ_RESTORE(flags);
+}
+
+/**
+ * Discard all the recorded events.
+ */
+void trace_init(void)
+{
+	ATOMIC(trace_idx = 0);
+}
+
+static void trace_put16(uint8_t *buf, uint16_t val)
+{
+	val = cpu_to_le16(val);
+	memcpy(buf, &val, sizeof(val));
+}
+
+static void trace_put32(uint8_t *buf, uint32_t val)
+{
+	val = cpu_to_le32(val);
+	memcpy(buf, &val, sizeof(val));
+}
+
+/**
+ * Save the content of the trace buffer to \a fd.
+ *
+ * Events can still be recorded while dumping; the ones overwritten
+ * before being saved are accounted as lost.
+ *
+ * \return 0 on success, EOF on write errors.
+ */
+int trace_dump(struct KFile *fd)
+{
+	uint8_t buf[28];
+	unsigned long start, end, i;
+	TraceEvent e;
+
+	ATOMIC(end = trace_idx);
+	start = end > CONFIG_KERN_TRACE_SIZE ? end - CONFIG_KERN_TRACE_SIZE : 0;
+
+	trace_put32(buf, TRACE_MAGIC);
+	trace_put16(buf + 4, TRACE_VERSION);
+	trace_put16(buf + 6, TRACE_EVENT_SIZE);
+	trace_put32(buf + 8, TIMER_TICKS_PER_SEC);
+	trace_put32(buf + 12, TIMER_HW_HPTICKS_PER_SEC);
+	trace_put32(buf + 16, TIMER_HW_CNT);
+	trace_put32(buf + 20, end - start);
+	trace_put32(buf + 24, start);
+	if (kfile_write(fd, buf, 28) != 28)
+		return EOF;
+
+	for (i = start; i < end; i++)
+	{
+		bool valid;
+
+		ATOMIC(
+			valid = trace_idx - i <= CONFIG_KERN_TRACE_SIZE;
+			e = trace_buf[i & (CONFIG_KERN_TRACE_SIZE - 1)];
+		);
+
+		/* Keep the event count of the header, but mark it as lost */
+		if (!valid)
+			e.type = 0;
+
+		trace_put32(buf, e.ticks);
+		trace_put32(buf + 4, e.hp);
+		trace_put32(buf + 8, (uint32_t)(uintptr_t)e.proc);
+		trace_put32(buf + 12, (uint32_t)(uintptr_t)e.obj);
+		trace_put16(buf + 16, e.arg);
+		buf[18] = e.type;
+		buf[19] = 0;
+		if (kfile_write(fd, buf, TRACE_EVENT_SIZE) != TRACE_EVENT_SIZE)
+			return EOF;
+	}
+
+	return kfile_flush(fd);
+}
+
+#endif /* CONFIG_KERN_TRACE */
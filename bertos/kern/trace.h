@@ -0,0 +1,125 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \defgroup kern_trace Kernel event trace
+ * \ingroup kern
+ * \{
+ *
+ * \brief Record kernel events into a RAM ring buffer.
+ *
+ * When CONFIG_KERN_TRACE is enabled the kernel records context switches,
+ * signals, semaphores, messages, timer expirations and timer interrupts
+ * into a ring buffer of CONFIG_KERN_TRACE_SIZE events. Each event is
+ * time stamped with the system clock and timer_hw_hpread(), and costs
+ * a handful of stores with interrupts disabled, so tracing can be left
+ * enabled in production builds. When the buffer is full the oldest
+ * events are overwritten.
+ *
+ * The buffer can be saved at any time through a KFile with trace_dump()
+ * and decoded on the host with bertos/kern/trace_decode.py, which prints
+ * per-process timelines and latency histograms.
+ *
+ * Application code can add its own events with trace_event(), using
+ * types starting from TRACE_USER.
+ *
+ * With CONFIG_KERN_TRACE disabled all the hooks compile to nothing.
+ *
+ * $WIZ$ module_name = "trace"
+ * $WIZ$ module_depends = "kernel", "timer", "kfile"
+ * $WIZ$ module_configuration = "bertos/cfg/cfg_trace.h"
+ */
+
+#ifndef KERN_TRACE_H
+#define KERN_TRACE_H
+
+#include "cfg/cfg_trace.h"
+
+#include <cfg/compiler.h>
+
+/**
+ * Traced event types.
+ *
+ * \note Values are part of the dump format, don't reorder them.
+ */
+enum TraceType
+{
+	TRACE_SWITCH = 1,   ///< Switched to the current process from \a obj
+	TRACE_SIG_SEND,     ///< Signals \a arg sent to process \a obj
+	TRACE_SIG_WAIT,     ///< Waiting for signals \a arg
+	TRACE_SEM_OBTAIN,   ///< Semaphore \a obj obtained, \a arg != 0 if contended
+	TRACE_SEM_RELEASE,  ///< Semaphore \a obj released
+	TRACE_MSG_PUT,      ///< Message \a obj put into a port
+	TRACE_MSG_GET,      ///< Message \a obj taken from a port (NULL if empty)
+	TRACE_TIMER,        ///< Timer \a obj expired
+	TRACE_IRQ_ENTER,    ///< Interrupt \a arg entered
+	TRACE_IRQ_EXIT,     ///< Interrupt \a arg exited
+	TRACE_PROC_NEW,     ///< Process \a obj created
+	TRACE_PROC_EXIT,    ///< Current process exited
+	TRACE_IDLE,         ///< No process ready, \a obj was the last running
+
+	TRACE_USER = 0x80,  ///< First type free for application events
+};
+
+/// Interrupt number used for the system timer in TRACE_IRQ_* events.
+#define TRACE_IRQ_TIMER  0
+
+/// Magic number of the dump header ("BTRC").
+#define TRACE_MAGIC      0x43525442UL
+/// Version of the dump format.
+#define TRACE_VERSION    1
+
+#if CONFIG_KERN_TRACE
+
+struct KFile;
+
+void trace_record(uint8_t type, const void *obj, uint16_t arg);
+void trace_init(void);
+int trace_dump(struct KFile *fd);
+
+/**
+ * Record an event of type \a type concerning object \a obj.
+ */
+#define trace_event(type, obj, arg)  trace_record((type), (obj), (arg))
+
+#else /* !CONFIG_KERN_TRACE */
+
+#define trace_event(type, obj, arg)  do {} while (0)
+#define trace_init()                 do {} while (0)
+
+#endif /* CONFIG_KERN_TRACE */
+
+/** \} */ //defgroup kern_trace
+
+int trace_testRun(void);
+int trace_testSetup(void);
+int trace_testTearDown(void);
+
+#endif /* KERN_TRACE_H */
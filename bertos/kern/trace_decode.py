@@ -0,0 +1,241 @@
+#!/usr/bin/env python
+# This file is part of BeRTOS.
+#
+# Bertos is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+#
+# As a special exception, you may use this file as part of a free software
+# library without restriction.  Specifically, if other files instantiate
+# templates or use macros or inline functions from this file, or you compile
+# this file and link it with other files to produce an executable, this
+# file does not by itself cause the resulting executable to be covered by
+# the GNU General Public License.  This exception does not however
+# invalidate any other reasons why the executable file might be covered by
+# the GNU General Public License.
+#
+# Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+#
+# Decode a kernel trace saved with trace_dump() (see kern/trace.h).
+#
+# Usage: trace_decode.py [-t] [-n ADDR=NAME ...] DUMP
+#
+#  -t            print the timeline of all the events
+#  -n ADDR=NAME  name the process with TCB address ADDR, as printed
+#                by monitor_report()
+
+from __future__ import print_function
+
+import struct
+import sys
+
+TRACE_MAGIC = 0x43525442
+TRACE_VERSION = 1
+
+HEADER = struct.Struct("<IHHIIIII")
+EVENT = struct.Struct("<IIIIHBx")
+
+(SWITCH, SIG_SEND, SIG_WAIT, SEM_OBTAIN, SEM_RELEASE, MSG_PUT, MSG_GET,
+	TIMER, IRQ_ENTER, IRQ_EXIT, PROC_NEW, PROC_EXIT, IDLE) = range(1, 14)
+
+EVENT_NAMES = {
+	SWITCH: "switch from",
+	SIG_SEND: "sig_send to",
+	SIG_WAIT: "sig_wait",
+	SEM_OBTAIN: "sem_obtain",
+	SEM_RELEASE: "sem_release",
+	MSG_PUT: "msg_put",
+	MSG_GET: "msg_get",
+	TIMER: "timer expired",
+	IRQ_ENTER: "irq enter",
+	IRQ_EXIT: "irq exit",
+	PROC_NEW: "proc_new",
+	PROC_EXIT: "proc_exit",
+	IDLE: "idle after",
+}
+
+def parse(data):
+	if len(data) < HEADER.size:
+		raise ValueError("dump too short")
+	magic, version, evsize, tps, hptps, hwcnt, count, lost = \
+		HEADER.unpack_from(data, 0)
+	if magic != TRACE_MAGIC or version != TRACE_VERSION:
+		raise ValueError("not a trace dump")
+
+	events = []
+	for i in range(count):
+		off = HEADER.size + i * evsize
+		if off + EVENT.size > len(data):
+			raise ValueError("truncated dump")
+		events.append(EVENT.unpack_from(data, off))
+	return (tps, hptps, hwcnt, lost), events
+
+def timestamps(header, events):
+	"""Return the time of each event in microseconds."""
+	tps, hptps, hwcnt, lost = header
+	hp_per_tick = hptps // tps
+	times = []
+
+	if hwcnt <= hp_per_tick:
+		# The high precision counter restarts at each tick
+		for ticks, hp, proc, obj, arg, type in events:
+			times.append(ticks * 1e6 / tps + (hp % hp_per_tick) * 1e6 / hptps)
+	else:
+		# Free running high precision counter, 32 bits in the dump
+		base = 0
+		prev = None
+		for ticks, hp, proc, obj, arg, type in events:
+			if prev is not None and hp < prev:
+				base += 1 << 32
+			prev = hp
+			times.append((base + hp) * 1e6 / hptps)
+
+	if times:
+		start = times[0]
+		times = [t - start for t in times]
+	return times
+
+class Histogram(object):
+	"""Latency histogram with power of 2 buckets, in microseconds."""
+
+	def __init__(self, title):
+		self.title = title
+		self.samples = []
+
+	def add(self, value):
+		self.samples.append(value)
+
+	def show(self):
+		if not self.samples:
+			return
+		s = sorted(self.samples)
+		print("%s: %d samples, min %.1f us, median %.1f us, max %.1f us" %
+			(self.title, len(s), s[0], s[len(s) // 2], s[-1]))
+		buckets = {}
+		for v in s:
+			b = 1
+			while b < v:
+				b *= 2
+			buckets[b] = buckets.get(b, 0) + 1
+		width = max(buckets.values())
+		for b in sorted(buckets):
+			bar = "#" * max(1, buckets[b] * 40 // width)
+			print("  <= %8d us %6d %s" % (b, buckets[b], bar))
+		print()
+
+def main(argv):
+	timeline = False
+	names = {}
+	args = argv[1:]
+	path = None
+	while args:
+		a = args.pop(0)
+		if a == "-t":
+			timeline = True
+		elif a == "-n":
+			addr, name = args.pop(0).split("=", 1)
+			names[int(addr, 16) & 0xffffffff] = name
+		else:
+			path = a
+	if path is None:
+		print("Usage: trace_decode.py [-t] [-n ADDR=NAME ...] DUMP")
+		return 1
+
+	header, events = parse(open(path, "rb").read())
+	times = timestamps(header, events)
+
+	def pname(p):
+		if p is None:
+			return "<idle>"
+		return names.get(p, "%08x" % p)
+
+	cpu = {}
+	switches = {}
+	wakeup = {}
+	wake_lat = Histogram("Wakeup latency (sig_send to switch)")
+	irq_lat = Histogram("Timer interrupt duration")
+	sem_hold = Histogram("Semaphore hold time")
+	running = None
+	last_switch = None
+	irq_start = None
+	holding = {}
+	lost = 0
+
+	if timeline:
+		print("%12s  %-10s %s" % ("time [us]", "process", "event"))
+
+	for t, (ticks, hp, proc, obj, arg, type) in zip(times, events):
+		if type == 0:
+			lost += 1
+			continue
+
+		if timeline:
+			what = EVENT_NAMES.get(type, "user %#x" % type)
+			if type in (SWITCH, SIG_SEND, PROC_NEW, IDLE):
+				what += " " + pname(obj)
+			elif obj:
+				what += " %08x" % obj
+			if type in (SIG_SEND, SIG_WAIT):
+				what += " sigs %#x" % arg
+			elif type in (IRQ_ENTER, IRQ_EXIT):
+				what += " %d" % arg
+			elif type == SEM_OBTAIN and arg:
+				what += " (contended)"
+			print("%12.1f  %-10s %s" % (t, pname(proc), what))
+
+		if type in (SWITCH, IDLE):
+			if last_switch is not None:
+				cpu[running] = cpu.get(running, 0) + t - last_switch
+			last_switch = t
+			if type == IDLE:
+				running = None
+			else:
+				running = proc
+				switches[proc] = switches.get(proc, 0) + 1
+				if proc in wakeup:
+					wake_lat.add(t - wakeup.pop(proc))
+		elif type == SIG_SEND:
+			wakeup.setdefault(obj, t)
+		elif type == SIG_WAIT:
+			wakeup.pop(proc, None)
+		elif type == IRQ_ENTER:
+			irq_start = t
+		elif type == IRQ_EXIT and irq_start is not None:
+			irq_lat.add(t - irq_start)
+			irq_start = None
+		elif type == SEM_OBTAIN:
+			holding.setdefault((proc, obj), t)
+		elif type == SEM_RELEASE and (proc, obj) in holding:
+			sem_hold.add(t - holding.pop((proc, obj)))
+
+	if last_switch is not None:
+		cpu[running] = cpu.get(running, 0) + times[-1] - last_switch
+
+	total = times[-1] if times else 0
+	print()
+	print("%d events over %.1f us, %d dropped, %d lost while dumping" %
+		(len(events), total, header[3], lost))
+	print()
+	print("%-10s %10s %7s %9s" % ("process", "cpu [us]", "cpu %", "switches"))
+	for p in sorted(cpu, key=lambda p: -cpu[p]):
+		print("%-10s %10.1f %6.1f%% %9d" % (pname(p), cpu[p],
+			100.0 * cpu[p] / total if total else 0, switches.get(p, 0)))
+	print()
+
+	wake_lat.show()
+	sem_hold.show()
+	irq_lat.show()
+	return 0
+
+if __name__ == "__main__":
+	sys.exit(main(sys.argv))
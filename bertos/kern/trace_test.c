@@ -0,0 +1,207 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Kernel event trace test.
+ *
+ * A master and a slave process exchange signals, messages and a
+ * semaphore; the test then dumps the trace buffer into memory and checks
+ * that it contains the expected events, both before and after the ring
+ * buffer wraps around.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ * $test$: cp bertos/cfg/cfg_sem.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SEMAPHORES" >> $cfgdir/cfg_sem.h
+ * $test$: echo "#define CONFIG_KERN_SEMAPHORES 1" >> $cfgdir/cfg_sem.h
+ * $test$: cp bertos/cfg/cfg_trace.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_TRACE" >> $cfgdir/cfg_trace.h
+ * $test$: echo "#define CONFIG_KERN_TRACE 1" >> $cfgdir/cfg_trace.h
+ * $test$: echo  "#undef CONFIG_KERN_TRACE_SIZE" >> $cfgdir/cfg_trace.h
+ * $test$: echo "#define CONFIG_KERN_TRACE_SIZE 128" >> $cfgdir/cfg_trace.h
+ */
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/trace.h>
+#include <kern/signal.h>
+#include <kern/sem.h>
+#include <kern/msg.h>
+#include <kern/proc.h>
+
+#include <drv/timer.h>
+
+#include <struct/kfile_mem.h>
+
+#include <string.h>
+
+#define TRACE_HEADER_SIZE  28
+#define TRACE_EVENT_SIZE   20
+
+static Semaphore sem;
+static MsgPort port;
+static Msg msg;
+static Process *master;
+
+static uint8_t dump[TRACE_HEADER_SIZE + CONFIG_KERN_TRACE_SIZE * TRACE_EVENT_SIZE];
+
+static uint32_t get32(const uint8_t *buf)
+{
+	return buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+}
+
+static void slave(void)
+{
+	for (;;)
+	{
+		sig_wait(SIG_USER0);
+		sem_obtain(&sem);
+		msg_put(&port, &msg);
+		sem_release(&sem);
+		sig_send(master, SIG_USER1);
+	}
+}
+
+PROC_DEFINE_STACK(slave_stack, KERN_MINSTACKSIZE * 2);
+
+static void ping(Process *proc, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		sig_send(proc, SIG_USER0);
+		sig_wait(SIG_USER1);
+		if (msg_get(&port) != &msg)
+			kputs("> Message not received\n");
+	}
+}
+
+/*
+ * Dump the trace and check its content.
+ *
+ * \return the number of events in the dump, -1 on error.
+ */
+static int check_dump(unsigned *seen)
+{
+	KFileMem mem;
+	uint32_t count;
+	ticks_t prev_ticks = 0;
+
+	memset(dump, 0, sizeof(dump));
+	kfilemem_init(&mem, dump, sizeof(dump));
+	if (trace_dump(&mem.fd) != 0)
+		return -1;
+
+	if (get32(dump) != TRACE_MAGIC
+			|| (dump[4] | dump[5] << 8) != TRACE_VERSION
+			|| (dump[6] | dump[7] << 8) != TRACE_EVENT_SIZE
+			|| get32(dump + 8) != TIMER_TICKS_PER_SEC)
+		return -1;
+
+	count = get32(dump + 20);
+	if (count > CONFIG_KERN_TRACE_SIZE)
+		return -1;
+
+	*seen = 0;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const uint8_t *ev = dump + TRACE_HEADER_SIZE + i * TRACE_EVENT_SIZE;
+		ticks_t ticks = get32(ev);
+		uint8_t type = ev[18];
+
+		if (type == 0 || type > TRACE_IDLE)
+			return -1;
+		if (ticks - prev_ticks < 0)
+			return -1;
+		prev_ticks = ticks;
+		*seen |= BV(type);
+	}
+
+	kprintf("> %lu events in dump, %lu lost, types %#x\n",
+		(unsigned long)count, (unsigned long)get32(dump + 24), *seen);
+	return count;
+}
+
+int trace_testRun(void)
+{
+	unsigned seen, expected;
+	Process *p;
+	int count;
+
+	kputs("Run kernel trace test..\n");
+	master = proc_current();
+
+	trace_init();
+	p = proc_new(slave, NULL, sizeof(slave_stack), slave_stack);
+	ping(p, 2);
+	timer_delay(20);
+
+	/* All the events must still be in the buffer */
+	count = check_dump(&seen);
+	expected = BV(TRACE_SWITCH) | BV(TRACE_SIG_SEND) | BV(TRACE_SIG_WAIT)
+		| BV(TRACE_SEM_OBTAIN) | BV(TRACE_SEM_RELEASE) | BV(TRACE_MSG_PUT)
+		| BV(TRACE_MSG_GET) | BV(TRACE_TIMER) | BV(TRACE_IRQ_ENTER)
+		| BV(TRACE_IRQ_EXIT) | BV(TRACE_PROC_NEW);
+	if (count <= 0 || count == CONFIG_KERN_TRACE_SIZE || get32(dump + 24) != 0
+			|| (seen & expected) != expected)
+		return -1;
+
+	/* Fill the buffer more than once: only the newest events are kept */
+	ping(p, CONFIG_KERN_TRACE_SIZE);
+	count = check_dump(&seen);
+	if (count != CONFIG_KERN_TRACE_SIZE || get32(dump + 24) == 0
+			|| (seen & BV(TRACE_PROC_NEW)))
+		return -1;
+
+	kputs("> Kernel trace test..Ok!\n");
+	return 0;
+}
+
+int trace_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	sem_init(&sem);
+	msg_initPort(&port, event_createNone());
+	return 0;
+}
+
+int trace_testTearDown(void)
+{
+	kputs("TearDown kernel trace test.\n");
+	return 0;
+}
+
+TEST_MAIN(trace);
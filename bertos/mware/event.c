@@ -129,11 +129,15 @@ bool event_waitTimeout(Event *e, ticks_t timeout)
  * not yet notified, so it takes care of making the current process to sleep on
  * the list of events, mapping them to a different signal bit and issuing a
  * call to sig_waitTimeout() using the process's sigmask.
+ *
+ * On wakeup the events get back their own signal: the ones that have
+ * fired but are not reported stay notified for the next call.
  */
 static NOINLINE int event_selectSlowPath(Event **evs, int n, ticks_t timeout)
 {
 	sigmask_t mask = (1 << n) - 1;
-	int i;
+	sigmask_t fired;
+	int i, ret = -1;
 
 	for (i = 0; i < n; i++)
 	{
@@ -146,17 +150,31 @@ static NOINLINE int event_selectSlowPath(Event **evs, int n, ticks_t timeout)
 	}
 	IRQ_ENABLE;
 
-	mask = timeout ? sig_waitTimeout(mask, timeout) : sig_wait(mask);
-	if (mask & SIG_TIMEOUT)
-		return -1;
-	return UINT8_LOG2(mask);
+	fired = timeout ? sig_waitTimeout(mask, timeout) : sig_wait(mask);
+
+	IRQ_DISABLE;
+	fired = (fired | __sig_checkSignal(&proc_current()->sig, mask)) & mask;
+	if (fired)
+		ret = event_sigIndex(fired);
+	for (i = 0; i < n; i++)
+	{
+		Event *e = evs[i];
+
+		e->Ev.Sig.sig_bit = EVENT_GENERIC_SIGNAL;
+		e->action = event_hook_generic_signal;
+		if (i != ret && (fired & BV(i)))
+			e->Ev.Sig.sig.recv |= EVENT_GENERIC_SIGNAL;
+	}
+	IRQ_ENABLE;
+
+	return ret;
 }
 
 int event_select(Event **evs, int n, ticks_t timeout)
 {
 	int i;
 
-	ASSERT(n <= SIG_USER_MAX);
+	ASSERT(n <= UINT8_LOG2(SIG_USER_MAX));
 
 	IRQ_DISABLE;
 	/* Fast path: check if one of the event already happened */
@@ -174,14 +192,42 @@ int event_select(Event **evs, int n, ticks_t timeout)
 	/* Otherwise, fallback to the slow path */
 	return event_selectSlowPath(evs, n, timeout);
 }
+
+void event_setInit(EventSet *set)
+{
+	set->proc = proc_current();
+	set->mask = 0;
+}
+
+void event_setAdd(EventSet *set, Event *e, sigmask_t sig)
+{
+	/* Only user signals: SIG_SINGLE and the system ones are reserved */
+	ASSERT(IS_POW2(sig) && sig && sig < SIG_USER_MAX);
+	ASSERT(!(set->mask & sig));
+
+	event_initSignal(e, set->proc, sig);
+	set->evs[event_sigIndex(sig)] = e;
+	set->mask |= sig;
+}
+
+sigmask_t event_setWait(EventSet *set, ticks_t timeout)
+{
+	sigmask_t fired;
+
+	ASSERT(set->proc == proc_current());
+
+	/* Signals already delivered are returned without sleeping */
+	fired = timeout ? sig_waitTimeout(set->mask, timeout) : sig_wait(set->mask);
+	return fired & set->mask;
+}
 #else /* !(CONFIG_KERN && CONFIG_KERN_SIGNALS) */
 bool event_waitTimeout(Event *e, ticks_t timeout)
 {
 	ticks_t end = timer_clock() + timeout;
 	bool ret;
 
-	while ((ACCESS_SAFE(e->Ev.Gen.completed) == false) ||
-			TIMER_AFTER(timer_clock(), end))
+	while ((ACCESS_SAFE(e->Ev.Gen.completed) == false) &&
+			!TIMER_AFTER(timer_clock(), end))
 		cpu_relax();
 	ret = e->Ev.Gen.completed;
 	e->Ev.Gen.completed = false;
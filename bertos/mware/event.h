@@ -138,10 +138,12 @@
 #define KERN_EVENT_H
 
 #include <cfg/compiler.h>
+#include <cfg/macros.h>
 #include "cfg/cfg_proc.h"
 #include "cfg/cfg_signal.h"
 #include "cfg/cfg_timer.h"
 
+#include <cpu/types.h> /* CPU_BITS_PER_CHAR */
 #include <cpu/power.h> /* cpu_relax() */
 
 #if CONFIG_KERN && CONFIG_KERN_SIGNALS
@@ -283,6 +285,89 @@ INLINE void event_wait(Event *e)
  */
 int event_select(Event **evs, int n, ticks_t timeout);
 
+#if CONFIG_KERN && CONFIG_KERN_SIGNALS
+/**
+ * Set of events waited by a process, each one bound to a signal bit.
+ *
+ * Unlike event_select(), the events are bound once with event_setAdd()
+ * and a wakeup costs only the events that have fired, whatever the
+ * size of the set:
+ *
+ * \code
+ * EventSet set;
+ * sigmask_t fired;
+ *
+ * event_setInit(&set);
+ * event_setAdd(&set, &serial_ev, SIG_USER0);
+ * event_setAdd(&set, &radio_ev, SIG_USER1);
+ * event_setAdd(&set, &tick_ev, SIG_USER2);
+ *
+ * while ((fired = event_setWait(&set, ms_to_ticks(100))))
+ * {
+ *      Event *e;
+ *
+ *      while ((e = event_setNext(&set, &fired)))
+ *              handle(e);
+ * }
+ * \endcode
+ *
+ * \note The events of a set notify the process with its own signals:
+ *       don't use them with event_wait() or in other sets.
+ */
+typedef struct EventSet
+{
+	struct Process *proc;   /* Process waiting for the events */
+	sigmask_t mask;         /* Signals of the events in the set */
+	Event *evs[sizeof(sigmask_t) * CPU_BITS_PER_CHAR]; /* Events by signal bit */
+} EventSet;
+
+/** Index of the lowest signal in \a sigs, which must not be 0 */
+INLINE int event_sigIndex(sigmask_t sigs)
+{
+	sigmask_t low = sigs & -sigs;
+
+	return UINT8_LOG2(low);
+}
+
+/**
+ * Initialize the empty event set \a set, for the current process.
+ */
+void event_setInit(EventSet *set);
+
+/**
+ * Add the event \a e to \a set, binding it to the signal \a sig.
+ *
+ * \a sig is a single user signal bit (below SIG_USER_MAX), not used by
+ * other events of the set.
+ */
+void event_setAdd(EventSet *set, Event *e, sigmask_t sig);
+
+/**
+ * Wait for any of the events in \a set or \a timeout ticks elapse.
+ *
+ * \note timeout == 0 means no timeout.
+ * \return the signals of the events that have fired, 0 on timeout. Pass
+ *         them to event_setNext() to get the events.
+ */
+sigmask_t event_setWait(EventSet *set, ticks_t timeout);
+
+/**
+ * Take the next event from the signals \a fired returned by event_setWait().
+ *
+ * \return the event, or NULL when all of them have been taken.
+ */
+INLINE Event *event_setNext(EventSet *set, sigmask_t *fired)
+{
+	int i;
+
+	if (!*fired)
+		return NULL;
+	i = event_sigIndex(*fired);
+	*fired &= ~BV(i);
+	return set->evs[i];
+}
+#endif /* CONFIG_KERN && CONFIG_KERN_SIGNALS */
+
 /**
  * Wait the completion of event \a e or \a timeout elapses.
  *
@@ -305,4 +390,8 @@ INLINE void event_do(struct Event *e)
 
 /** \} */
 
+int event_testRun(void);
+int event_testSetup(void);
+int event_testTearDown(void);
+
 #endif /* KERN_EVENT_H */
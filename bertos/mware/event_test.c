@@ -0,0 +1,171 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ * -->
+ *
+ * \brief Test for multiple event waits: event_select() and event sets.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ */
+
+#include "event.h"
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <drv/timer.h>
+
+#include <kern/proc.h>
+
+#define N_EVENTS 4
+
+static Event events[N_EVENTS];
+static int fire_first, fire_second;
+
+PROC_DEFINE_STACK(fire_stack, KERN_MINSTACKSIZE * 2);
+
+/* Notify two events in a row, while the main process is sleeping */
+static void fire_proc(void)
+{
+	event_do(&events[fire_first]);
+	event_do(&events[fire_second]);
+}
+
+static void fire(int first, int second)
+{
+	fire_first = first;
+	fire_second = second;
+	proc_new(fire_proc, NULL, sizeof(fire_stack), fire_stack);
+}
+
+static int test_set(void)
+{
+	static const sigmask_t sigs[N_EVENTS] = { SIG_USER0, SIG_USER1, SIG_USER2, SIG_USER3 };
+	EventSet set;
+	sigmask_t fired;
+	ticks_t start;
+
+	event_setInit(&set);
+	for (int i = 0; i < N_EVENTS; i++)
+		event_setAdd(&set, &events[i], sigs[i]);
+
+	/* Both the events are reported by one wakeup, in order */
+	fire(3, 1);
+	fired = event_setWait(&set, ms_to_ticks(1000));
+	if (fired != (SIG_USER1 | SIG_USER3)
+			|| event_setNext(&set, &fired) != &events[1]
+			|| event_setNext(&set, &fired) != &events[3]
+			|| event_setNext(&set, &fired) != NULL)
+		return -1;
+	/* Nothing left behind */
+	if (sig_check(set.mask))
+		return -1;
+
+	/* Events that fired while the process was busy */
+	event_do(&events[2]);
+	fired = event_setWait(&set, ms_to_ticks(1000));
+	if (fired != SIG_USER2)
+		return -1;
+
+	/* Timeout */
+	start = timer_clock();
+	if (event_setWait(&set, ms_to_ticks(50)) != 0)
+		return -1;
+	if (timer_clock() - start < ms_to_ticks(50))
+		return -1;
+
+	return 0;
+}
+
+static int test_select(void)
+{
+	Event *evs[N_EVENTS];
+
+	for (int i = 0; i < N_EVENTS; i++)
+	{
+		event_initGeneric(&events[i]);
+		evs[i] = &events[i];
+	}
+
+	/* The event not reported by the first call is kept for the next one */
+	fire(2, 0);
+	if (event_select(evs, N_EVENTS, ms_to_ticks(1000)) != 0)
+		return -1;
+	if (event_select(evs, N_EVENTS, ms_to_ticks(1000)) != 2)
+		return -1;
+	if (event_select(evs, N_EVENTS, ms_to_ticks(50)) != -1)
+		return -1;
+
+	/* The events are back to plain generic events */
+	event_do(&events[1]);
+	if (!event_waitTimeout(&events[1], ms_to_ticks(50)))
+		return -1;
+	if (sig_check(BV(N_EVENTS) - 1))
+		return -1;
+
+	return 0;
+}
+
+int event_testRun(void)
+{
+	kprintf("Run event test..\n");
+	if (test_set() < 0)
+	{
+		kprintf("event set test..FAIL!\n");
+		return -1;
+	}
+	if (test_select() < 0)
+	{
+		kprintf("event select test..FAIL!\n");
+		return -1;
+	}
+	kprintf("Event test..ok!\n");
+	return 0;
+}
+
+int event_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	return 0;
+}
+
+int event_testTearDown(void)
+{
+	kputs("TearDown event test.\n");
+	return 0;
+}
+
+TEST_MAIN(event);
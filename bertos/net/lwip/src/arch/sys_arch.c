@@ -1,4 +1,6 @@
 #include "cfg/cfg_lwip.h"
+#include "cfg/cfg_proc.h"
+#include "cfg/cfg_timer.h"
 
 #define LOG_LEVEL  3
 #define LOG_FORMAT 0
@@ -6,89 +8,54 @@
 
 #include <drv/timer.h>
 
-#include <cpu/power.h>
 #include <cpu/types.h>
 
 #include <arch/sys_arch.h>
 #include <lwip/sys.h>
 
-#include <kern/signal.h>
-#include <kern/msg.h>
 #include <kern/proc.h>
-#include <kern/proc_p.h>
+#include <kern/sem.h>
 
 #include <struct/heap.h>
 
-#include <mware/event.h>
-
-/****************************************************************************/
-
 /*
- * Generic mutex (binary semaphore) implementation
- *
- * TODO: move this to a different place (i.e., bertos/kern/sem.c).
+ * The emulation layer needs the kernel and the timer events: without
+ * them, as in most of the unit tests, there's nothing to build.
  */
-INLINE void mutex_verify(struct Mutex *s)
-{
-	(void)s;
-	ASSERT(s);
-	LIST_ASSERT_VALID(&s->wait_queue);
-	ASSERT((s->count == MUTEX_LOCKED) || (s->count == MUTEX_UNLOCKED));
-}
+#if CONFIG_KERN && CONFIG_TIMER_EVENTS
 
-bool mutex_attempt(struct Mutex *s)
-{
-	return cpu_atomic_xchg(&s->count, MUTEX_LOCKED) == MUTEX_UNLOCKED;
-}
-
-static NOINLINE void mutex_slowpath_obtain(struct Mutex *s)
-{
-	PROC_ATOMIC(
-		mutex_verify(s);
-		ADDTAIL(&s->wait_queue, (Node *)current_process)
-	);
-	proc_switch();
-}
+/****************************************************************************/
 
-void mutex_obtain(struct Mutex *s)
-{
-	if (UNLIKELY(cpu_atomic_xchg(&s->count, MUTEX_LOCKED)) !=
-				MUTEX_UNLOCKED)
-		mutex_slowpath_obtain(s);
-}
+/* Semaphores */
 
-void mutex_release(struct Mutex *s)
-{
-	Process *proc = NULL;
+#define MAX_SEM_CNT 16
 
-	PROC_ATOMIC(
-		mutex_verify(s);
-		proc = (Process *)list_remHead(&s->wait_queue);
-		if (!proc)
-			s->count = 1;
-	);
-	if (proc)
-		ATOMIC(proc_wakeup(proc));
-}
+static SysSem sem_pool[MAX_SEM_CNT];
+static List free_sem;
 
-void mutex_init(struct Mutex *s)
+/*
+ * Obtain \a s, waiting at most \a timeout ticks (0 means forever).
+ *
+ * \return true if the semaphore has been obtained, false on timeout.
+ */
+static bool syssem_wait(CountSem *s, ticks_t timeout)
 {
-	LIST_INIT(&s->wait_queue);
-	s->count = 1;
+	if (!timeout)
+	{
+		csem_obtain(s);
+		return true;
+	}
+	return csem_obtainTimeout(s, timeout);
 }
 
-/****************************************************************************/
-
-typedef struct SemNode
+/*
+ * Convert a lwIP timeout in ms to ticks: 0 still means forever,
+ * any other value waits at least one tick.
+ */
+INLINE ticks_t timeout_ticks(u32_t timeout)
 {
-	Node node;
-	Mutex sem;
-} SemNode;
-
-#define MAX_SEM_CNT 16
-
-static struct SemNode sem_pool[MAX_SEM_CNT];
-static List free_sem;
+	return timeout ? MAX(ms_to_ticks(timeout), (ticks_t)1) : 0;
+}
 
 /**
  * Creates and returns a new semaphore.
@@ -98,31 +65,27 @@ static List free_sem;
  */
 sys_sem_t sys_sem_new(u8_t count)
 {
-	SemNode *sem;
+	SysSem *sem;
 
-	PROC_ATOMIC(sem = (SemNode *)list_remHead(&free_sem));
+	PROC_ATOMIC(sem = (SysSem *)list_remHead(&free_sem));
 	if (UNLIKELY(!sem))
 	{
 		LOG_ERR("Out of semaphores!\n");
 		return SYS_SEM_NULL;
 	}
 
-	mutex_init(&sem->sem);
-	// must obtain semaphore depending on the parameter
-	// NOTE: count == 1 means that the semaphore is unlocked
-	if (count <= 0)
-		mutex_obtain(&sem->sem);
-	return (sys_sem_t)&sem->sem;
+	csem_init(&sem->sem, count);
+	return sem;
 }
 
 /**
  * Frees a semaphore created by sys_sem_new.
  *
- * \param semaphore Mutex to be freed
+ * \param sem Semaphore to be freed
  */
-void sys_sem_free(sys_sem_t semaphore)
+void sys_sem_free(sys_sem_t sem)
 {
-	SemNode *sem = containerof(semaphore, SemNode, sem);
+	ASSERT(LIST_EMPTY(&sem->sem.wait_queue));
 	PROC_ATOMIC(ADDHEAD(&free_sem, &sem->node));
 }
 
@@ -131,7 +94,7 @@ void sys_sem_free(sys_sem_t semaphore)
  */
 void sys_sem_signal(sys_sem_t sem)
 {
-	mutex_release(sem);
+	csem_release(&sem->sem);
 }
 
 /**
@@ -146,71 +109,130 @@ void sys_sem_signal(sys_sem_t sem)
  */
 u32_t sys_arch_sem_wait(sys_sem_t sem, u32_t timeout)
 {
-	ticks_t end, start = timer_clock();
-
-	if (timeout == 0)
-	{
-		mutex_obtain(sem);
-		return ticks_to_ms(timer_clock() - start);
-	}
-	do
-	{
-		cpu_relax();
-		end = timer_clock();
-	} while ((end - start < ms_to_ticks(timeout) && !mutex_attempt(sem)));
+	ticks_t start = timer_clock();
 
-	return (end - start > ms_to_ticks(timeout)) ?
-			SYS_ARCH_TIMEOUT : (u32_t)ticks_to_ms(end - start);
+	if (!syssem_wait(&sem->sem, timeout_ticks(timeout)))
+		return SYS_ARCH_TIMEOUT;
+	return ticks_to_ms(timer_clock() - start);
 }
 
 /* Mbox functions */
 
-typedef struct IpPort
-{
-	Node node;
-	MsgPort port;
-} IpPort;
-
 #define MAX_PORT_CNT 16
-static struct IpPort port_pool[MAX_PORT_CNT];
+
+/* Size of the mailboxes lwIP creates with size 0 */
+#define MBOX_DEFAULT_SIZE 8
+
+#define MBOX_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/* Largest mailbox lwIP asks for, the tcpip thread or a connection one */
+#define MBOX_MAX_SIZE \
+	MBOX_MAX(MBOX_MAX(MBOX_MAX(TCPIP_MBOX_SIZE, MBOX_DEFAULT_SIZE), \
+			DEFAULT_ACCEPTMBOX_SIZE), \
+		MBOX_MAX(MBOX_MAX(DEFAULT_RAW_RECVMBOX_SIZE, DEFAULT_UDP_RECVMBOX_SIZE), \
+			DEFAULT_TCP_RECVMBOX_SIZE))
+
+/*
+ * Memory for the message rings of all the mailboxes: each ring is
+ * rounded to the heap granularity and may take a block header, plus
+ * the header terminating the heap.
+ */
+#define MBOX_HEAP_SIZE \
+	(MAX_PORT_CNT * (ROUND_UP2(MBOX_MAX_SIZE * sizeof(void *), sizeof(MemChunk)) \
+		+ sizeof(MemChunk)) + sizeof(MemChunk))
+
+static SysMbox port_pool[MAX_PORT_CNT];
 static List free_port;
 
-typedef struct IpMsg
+static HEAP_DEFINE_BUF(mbox_heap_buf, MBOX_HEAP_SIZE);
+static Heap mbox_heap;
+
+/**
+ * Creates a mailbox holding at most \a size messages.
+ *
+ * \return The mailbox or SYS_MBOX_NULL on error.
+ */
+sys_mbox_t sys_mbox_new(int size)
 {
-	Msg msg;
-	void *data;
-} IpMsg;
+	SysMbox *mbox;
+	void **msgs = NULL;
 
-#define MAX_MSG_CNT 32
-static struct IpMsg msg_pool[MAX_MSG_CNT];
-static List free_msg;
+	if (size <= 0)
+		size = MBOX_DEFAULT_SIZE;
 
-// TODO: allocate memory for 'size' messages
-sys_mbox_t sys_mbox_new(UNUSED_ARG(int, size))
-{
-	IpPort *port;
+	proc_forbid();
+	if ((mbox = (SysMbox *)list_remHead(&free_port))
+			&& !(msgs = HNEWVEC(&mbox_heap, void *, size)))
+	{
+		ADDHEAD(&free_port, &mbox->node);
+		mbox = NULL;
+	}
+	proc_permit();
 
-	PROC_ATOMIC(port = (IpPort *)list_remHead(&free_port));
-	if (UNLIKELY(!port))
+	if (UNLIKELY(!mbox))
 	{
 		LOG_ERR("Out of message ports!\n");
 		return SYS_MBOX_NULL;
 	}
-	msg_initPort(&port->port, event_createGeneric());
 
-	return (sys_mbox_t)(&port->port);
+	mbox->msgs = msgs;
+	mbox->size = size;
+	mbox->first = 0;
+	mbox->count = 0;
+	csem_init(&mbox->not_empty, 0);
+	csem_init(&mbox->not_full, size);
+
+	return mbox;
 }
 
 void sys_mbox_free(sys_mbox_t mbox)
 {
-	IpPort *port = containerof(mbox, IpPort, port);
-	PROC_ATOMIC(ADDHEAD(&free_port, &port->node));
+	ASSERT(LIST_EMPTY(&mbox->not_empty.wait_queue));
+	ASSERT(LIST_EMPTY(&mbox->not_full.wait_queue));
+
+	PROC_ATOMIC(
+		HDELETEVEC(&mbox_heap, void *, mbox->size, mbox->msgs);
+		ADDHEAD(&free_port, &mbox->node)
+	);
+}
+
+/*
+ * Put a message in a slot already reserved through mbox->not_full.
+ */
+static void mbox_put(SysMbox *mbox, void *data)
+{
+	PROC_ATOMIC(
+		ASSERT(mbox->count < mbox->size);
+		mbox->msgs[(mbox->first + mbox->count) % mbox->size] = data;
+		mbox->count++
+	);
+	csem_release(&mbox->not_empty);
 }
 
+/*
+ * Get a message already accounted through mbox->not_empty.
+ */
+static void *mbox_get(SysMbox *mbox)
+{
+	void *data;
+
+	PROC_ATOMIC(
+		ASSERT(mbox->count > 0);
+		data = mbox->msgs[mbox->first];
+		mbox->first = (mbox->first + 1) % mbox->size;
+		mbox->count--
+	);
+	csem_release(&mbox->not_full);
+	return data;
+}
+
+/*
+ * Post the "msg" to the mailbox, waiting while it is full.
+ */
 void sys_mbox_post(sys_mbox_t mbox, void *data)
 {
-	if (UNLIKELY(sys_mbox_trypost(mbox, data) == ERR_MEM))
-		LOG_ERR("out of messages!\n");
+	csem_obtain(&mbox->not_full);
+	mbox_put(mbox, data);
 }
 
 /*
@@ -219,13 +241,9 @@ void sys_mbox_post(sys_mbox_t mbox, void *data)
  */
 err_t sys_mbox_trypost(sys_mbox_t mbox, void *data)
 {
-	IpMsg *msg;
-
-	PROC_ATOMIC(msg = (IpMsg *)list_remHead(&free_msg));
-	if (UNLIKELY(!msg))
+	if (!csem_attempt(&mbox->not_full))
 		return ERR_MEM;
-	msg->data = data;
-	msg_put(mbox, &msg->msg);
+	mbox_put(mbox, data);
 
 	return ERR_OK;
 }
@@ -248,26 +266,15 @@ u32_t sys_arch_mbox_fetch(sys_mbox_t mbox, void **data, u32_t timeout)
 	implemented by lwIP.
 	*/
 
-	Msg *msg;
 	ticks_t start = timer_clock();
+	void *msg;
 
-	while (1)
-	{
-		/* Fast path */
-		msg = msg_get(mbox);
-		if (LIKELY(msg))
-			break;
-		/* Slow path */
-		if (!timeout)
-			event_wait(&mbox->event);
-		else if (!event_waitTimeout(&mbox->event,
-					ms_to_ticks(timeout)))
-			return SYS_ARCH_TIMEOUT;
-	}
-	if (data)
-		*data = containerof(msg, IpMsg, msg)->data;
+	if (!syssem_wait(&mbox->not_empty, timeout_ticks(timeout)))
+		return SYS_ARCH_TIMEOUT;
 
-	PROC_ATOMIC(ADDHEAD(&free_msg, &msg->link));
+	msg = mbox_get(mbox);
+	if (data)
+		*data = msg;
 
 	return ticks_to_ms(timer_clock() - start);
 }
@@ -286,14 +293,14 @@ u32_t sys_arch_mbox_tryfetch(sys_mbox_t mbox, void **data)
 	although this would introduce unnecessary delays.
 	*/
 
-	Msg *msg;
+	void *msg;
 
-	msg = msg_get(mbox);
-	if (UNLIKELY(!msg))
+	if (!csem_attempt(&mbox->not_empty))
 		return SYS_MBOX_EMPTY;
+
+	msg = mbox_get(mbox);
 	if (data)
-		*data = containerof(msg, IpMsg, msg)->data;
-	PROC_ATOMIC(ADDHEAD(&free_msg, &msg->link));
+		*data = msg;
 
 	return 0;
 }
@@ -369,7 +376,7 @@ sys_thread_t sys_thread_new(const char *name, void (* thread)(void *arg),
 
 	#if !CONFIG_KERN_HEAP
 		ASSERT(stacksize <= DEFAULT_THREAD_STACKSIZE);
-		PROC_ATOMIC(stackbase = &thread_stack[last_stack++]);
+		PROC_ATOMIC(stackbase = thread_stack[last_stack++]);
 	#else
 		stackbase = NULL;
 	#endif
@@ -392,7 +399,6 @@ void sys_init(void)
 {
 	LIST_INIT(&free_sem);
 	LIST_INIT(&free_port);
-	LIST_INIT(&free_msg);
 	LIST_INIT(&free_thread);
 	LIST_INIT(&used_thread);
 
@@ -401,10 +407,10 @@ void sys_init(void)
 
 	for (int i = 0; i < MAX_PORT_CNT; ++i)
 		ADDHEAD(&free_port, &port_pool[i].node);
-
-	for (int i = 0; i < MAX_MSG_CNT; ++i)
-		ADDHEAD(&free_msg, &msg_pool[i].msg.link);
+	heap_init(&mbox_heap, mbox_heap_buf, sizeof(mbox_heap_buf));
 
 	for (int i = 0; i < MAX_THREAD_CNT; ++i)
 		ADDHEAD(&free_thread, &thread_pool[i].node);
 }
+
+#endif /* CONFIG_KERN && CONFIG_TIMER_EVENTS */
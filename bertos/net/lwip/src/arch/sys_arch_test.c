@@ -0,0 +1,232 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Test of the lwIP semaphores and mailboxes.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: echo  "#undef CONFIG_KERN_PRI" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN_PRI 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ */
+
+#define LOG_LEVEL  LOG_LVL_INFO
+#define LOG_FORMAT LOG_FMT_TERSE
+#include <cfg/log.h>
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <kern/proc.h>
+
+#include <drv/timer.h>
+
+#include <arch/sys_arch.h>
+#include <lwip/sys.h>
+#include <lwip/err.h>
+
+#define MBOX_SIZE  4
+#define MBOX_MSGS  (MBOX_SIZE * 3)
+
+static sys_sem_t sem;
+static sys_mbox_t mbox;
+
+static volatile unsigned long idle_count;
+static volatile bool idle_stop;
+
+PROC_DEFINE_STACK(sem_helper_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(mbox_helper_stack, KERN_MINSTACKSIZE * 2);
+PROC_DEFINE_STACK(idle_stack, KERN_MINSTACKSIZE * 2);
+
+/*
+ * Runs only when every other process is sleeping.
+ */
+static void idle(void)
+{
+	while (!idle_stop)
+	{
+		idle_count++;
+		proc_yield();
+	}
+}
+
+static void sem_helper(void)
+{
+	timer_delay(50);
+	sys_sem_signal(sem);
+}
+
+static void mbox_helper(void)
+{
+	/* Blocks each time the mailbox gets full */
+	for (int i = 0; i < MBOX_MSGS; i++)
+		sys_mbox_post(mbox, (void *)(ssize_t)(i + 1));
+}
+
+static void sem_test(void)
+{
+	unsigned long count;
+	ticks_t start;
+	u32_t ret;
+
+	/* A counting semaphore */
+	sem = sys_sem_new(2);
+	ASSERT(sem != SYS_SEM_NULL);
+	ASSERT(sys_arch_sem_wait(sem, 100) != SYS_ARCH_TIMEOUT);
+	ASSERT(sys_arch_sem_wait(sem, 100) != SYS_ARCH_TIMEOUT);
+
+	/* The waiter sleeps until the timeout */
+	count = idle_count;
+	start = timer_clock();
+	ASSERT(sys_arch_sem_wait(sem, 100) == SYS_ARCH_TIMEOUT);
+	ASSERT(timer_clock() - start >= ms_to_ticks(100));
+	LOG_INFO("idle loops while waiting: %lu\n", idle_count - count);
+	ASSERT(idle_count - count > 10);
+	ASSERT(LIST_EMPTY(&sem->sem.wait_queue));
+
+	/* Released by another process before the timeout */
+	proc_new(sem_helper, NULL, sizeof(sem_helper_stack), sem_helper_stack);
+	ret = sys_arch_sem_wait(sem, 1000);
+	LOG_INFO("sem obtained after %lu ms\n", (unsigned long)ret);
+	ASSERT(ret != SYS_ARCH_TIMEOUT);
+	ASSERT(ret >= 40 && ret < 1000);
+
+	/* Signals are not lost without waiters */
+	sys_sem_signal(sem);
+	sys_sem_signal(sem);
+	ASSERT(sys_arch_sem_wait(sem, 0) == 0);
+	ASSERT(sys_arch_sem_wait(sem, 0) == 0);
+	ASSERT(sys_arch_sem_wait(sem, 10) == SYS_ARCH_TIMEOUT);
+
+	sys_sem_free(sem);
+}
+
+static void mbox_test(void)
+{
+	sys_mbox_t other;
+	void *msg;
+
+	mbox = sys_mbox_new(MBOX_SIZE);
+	other = sys_mbox_new(0);
+	ASSERT(mbox != SYS_MBOX_NULL);
+	ASSERT(other != SYS_MBOX_NULL);
+
+	/* A full mailbox doesn't affect the others */
+	for (int i = 0; i < MBOX_SIZE; i++)
+		ASSERT(sys_mbox_trypost(mbox, (void *)(ssize_t)(i + 1)) == ERR_OK);
+	ASSERT(sys_mbox_trypost(mbox, NULL) == ERR_MEM);
+	ASSERT(sys_mbox_trypost(other, (void *)(ssize_t)42) == ERR_OK);
+
+	for (int i = 0; i < MBOX_SIZE; i++)
+	{
+		ASSERT(sys_arch_mbox_tryfetch(mbox, &msg) == 0);
+		ASSERT(msg == (void *)(ssize_t)(i + 1));
+	}
+	ASSERT(sys_arch_mbox_tryfetch(mbox, &msg) == SYS_MBOX_EMPTY);
+	ASSERT(sys_arch_mbox_fetch(other, &msg, 0) == 0);
+	ASSERT(msg == (void *)(ssize_t)42);
+	ASSERT(sys_arch_mbox_fetch(other, &msg, 50) == SYS_ARCH_TIMEOUT);
+
+	/* Mailboxes created with size 0 get the default size */
+	for (int i = 0; i < other->size; i++)
+		ASSERT(sys_mbox_trypost(other, NULL) == ERR_OK);
+	ASSERT(other->size > 1);
+	ASSERT(sys_mbox_trypost(other, NULL) == ERR_MEM);
+	while (sys_arch_mbox_tryfetch(other, NULL) == 0)
+		;
+	sys_mbox_free(other);
+
+	/* The poster sleeps while the mailbox is full */
+	proc_new(mbox_helper, NULL, sizeof(mbox_helper_stack), mbox_helper_stack);
+	for (int i = 0; i < MBOX_MSGS; i++)
+	{
+		ASSERT(sys_arch_mbox_fetch(mbox, &msg, 1000) != SYS_ARCH_TIMEOUT);
+		ASSERT(msg == (void *)(ssize_t)(i + 1));
+	}
+	ASSERT(sys_arch_mbox_fetch(mbox, &msg, 50) == SYS_ARCH_TIMEOUT);
+
+	sys_mbox_free(mbox);
+}
+
+/* Create mailboxes of \a size until the ports or the memory run out */
+static int mbox_fill(int size)
+{
+	sys_mbox_t boxes[64];
+	int n = 0;
+
+	while (n < (int)countof(boxes) && (boxes[n] = sys_mbox_new(size)) != SYS_MBOX_NULL)
+		n++;
+	for (int i = 0; i < n; i++)
+		sys_mbox_free(boxes[i]);
+	return n;
+}
+
+static void mbox_poolTest(void)
+{
+	int ports = mbox_fill(1);
+
+	/* The memory is enough to give every port the largest mailbox */
+	LOG_INFO("%d mailboxes available\n", ports);
+	ASSERT(ports > 0);
+	ASSERT(mbox_fill(TCPIP_MBOX_SIZE) == ports);
+	ASSERT(mbox_fill(0) == ports);
+}
+
+int sys_arch_testRun(void)
+{
+	sem_test();
+	mbox_test();
+	mbox_poolTest();
+
+	idle_stop = true;
+	return 0;
+}
+
+int sys_arch_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	sys_init();
+
+	proc_setPri(proc_new(idle, NULL, sizeof(idle_stack), idle_stack), -1);
+	return 0;
+}
+
+int sys_arch_testTearDown(void)
+{
+	return 0;
+}
+
+TEST_MAIN(sys_arch);
@@ -67,11 +67,18 @@ typedef uint16_t u16_t;
 typedef int16_t s16_t;
 typedef uint32_t u32_t;
 typedef int32_t s32_t;
-typedef int mem_ptr_t;
+typedef uintptr_t mem_ptr_t;
 
 
 /* Define (sn)printf formatters for these lwIP types */
-#if CPU_ARM_AT91 || CPU_CM3_SAM3 || (ARCH & ARCH_EMUL)
+#if (ARCH & ARCH_EMUL) && CPU_X86_64
+	#define U16_F "hu"
+	#define S16_F "d"
+	#define X16_F "x"
+	#define U32_F "u"
+	#define S32_F "d"
+	#define X32_F "x"
+#elif CPU_ARM_AT91 || CPU_CM3_SAM3 || (ARCH & ARCH_EMUL)
 	#define U16_F "hu"
 	#define S16_F "d"
 	#define X16_F "x"
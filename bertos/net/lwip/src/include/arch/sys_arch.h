@@ -40,40 +40,43 @@
 
 #include <arch/cc.h>
 
-#include <kern/sem.h>
-#include <kern/msg.h>
 #include <kern/proc.h>
+#include <kern/sem.h>
 
 /****************************************************************************/
 
-/*
- * Generic mutex (binary semaphore) prototypes
- *
- * TODO: move this to a different place (i.e., bertos/kern/sem.h).
- */
-#include <cpu/byteorder.h> // cpu_atomic_xchg()
-#include <cpu/types.h>
-
 #include <struct/list.h>
 
-#define MUTEX_UNLOCKED	1
-#define MUTEX_LOCKED	(!MUTEX_UNLOCKED)
-
-typedef struct Mutex
+/**
+ * lwIP semaphore: a kernel counting semaphore taken from a static pool.
+ */
+typedef struct SysSem
 {
-	List wait_queue;
-	cpu_atomic_t count;
-} Mutex;
+	Node     node; ///< Link in the free semaphores list
+	CountSem sem;
+} SysSem;
 
-void mutex_init(struct Mutex *s);
-bool mutex_attempt(struct Mutex *s);
-void mutex_obtain(struct Mutex *s);
-void mutex_release(struct Mutex *s);
+/**
+ * Bounded mailbox.
+ *
+ * Each mailbox has its own ring of message slots, sized at creation:
+ * a full mailbox blocks only its own posters.
+ */
+typedef struct SysMbox
+{
+	Node    node;      ///< Link in the free mailboxes list
+	CountSem not_empty; ///< Counts the messages in the ring
+	CountSem not_full;  ///< Counts the free slots in the ring
+	void  **msgs;      ///< Ring of \a size message slots
+	int     size;
+	int     first;     ///< Index of the oldest message
+	int     count;     ///< Number of messages in the ring
+} SysMbox;
 
 /****************************************************************************/
 
-typedef Mutex *sys_sem_t;
-typedef MsgPort *sys_mbox_t;
+typedef SysSem *sys_sem_t;
+typedef SysMbox *sys_mbox_t;
 typedef struct Process *sys_thread_t;
 // TODO: what does it mean?
 typedef int sys_prot_t;
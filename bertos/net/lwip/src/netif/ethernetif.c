@@ -75,6 +75,7 @@
  */
 
 #include "cfg/cfg_lwip.h"
+#include "cfg/cfg_eth.h"
 
 #include <drv/eth.h>
 
@@ -82,6 +83,8 @@
 
 #include <kern/proc.h>
 
+#include <struct/list.h>
+
 #include <lwip/def.h>
 #include <lwip/mem.h>
 #include <lwip/pbuf.h>
@@ -94,6 +97,44 @@
 
 #include <netif/ethernetif.h>
 
+#if CONFIG_ETH_ZEROCOPY
+	#if !LWIP_SUPPORT_CUSTOM_PBUF
+		#error CONFIG_ETH_ZEROCOPY needs LWIP_SUPPORT_CUSTOM_PBUF
+	#endif
+	#if ETH_PAD_SIZE
+		#error CONFIG_ETH_ZEROCOPY does not support ETH_PAD_SIZE
+	#endif
+
+/* Longest pbuf chain transmitted without copying it */
+#define ETH_TX_SEGS  8
+
+/**
+ * Pbuf referencing a receive buffer of the driver.
+ */
+typedef struct EthRxPbuf
+{
+	struct pbuf_custom pc;
+	Node link;
+	uint8_t *buf;
+} EthRxPbuf;
+
+static EthRxPbuf rx_pbufs[PBUF_POOL_SIZE];
+static List rx_free;
+
+/*
+ * Give the buffer back to the driver when lwIP frees the pbuf.
+ */
+static void rx_pbuf_free(struct pbuf *p)
+{
+	EthRxPbuf *rx = (EthRxPbuf *)p;
+
+	eth_putFrameBuf(rx->buf);
+	proc_forbid();
+	ADDTAIL(&rx_free, &rx->link);
+	proc_permit();
+}
+#endif /* CONFIG_ETH_ZEROCOPY */
+
 /* Define those to better describe your network interface. */
 #define IFNAME0 'e'
 #define IFNAME1 '0'
@@ -137,6 +178,15 @@ static void low_level_init(struct netif *netif)
 	/* don't set NETIF_FLAG_ETHARP if this device is not an ethernet one */
 	netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_LINK_UP;
 
+	#if CONFIG_ETH_ZEROCOPY
+		LIST_INIT(&rx_free);
+		for (size_t i = 0; i < countof(rx_pbufs); i++)
+		{
+			rx_pbufs[i].pc.custom_free_function = rx_pbuf_free;
+			ADDTAIL(&rx_free, &rx_pbufs[i].link);
+		}
+	#endif
+
 	eth_init();
 }
 
@@ -160,6 +210,31 @@ static err_t low_level_output(UNUSED_ARG(struct netif *, netif), struct pbuf *p)
 {
 	struct pbuf *q;
 
+	#if CONFIG_ETH_ZEROCOPY
+		EthSeg segs[ETH_TX_SEGS];
+		size_t count = 0;
+
+		for (q = p; q != NULL && count < countof(segs); q = q->next, count++)
+		{
+			segs[count].data = q->payload;
+			segs[count].len = q->len;
+		}
+		/* Longer chains fall back to the copy */
+		if (q == NULL)
+		{
+			proc_forbid();
+			if (eth_sendSegs(segs, count) < 0)
+			{
+				LINK_STATS_INC(link.err);
+				proc_permit();
+				return ERR_IF;
+			}
+			LINK_STATS_INC(link.xmit);
+			proc_permit();
+			return ERR_OK;
+		}
+	#endif
+
 	#if ETH_PAD_SIZE
 		pbuf_header(p, -ETH_PAD_SIZE); /* drop the padding word */
 	#endif
@@ -189,9 +264,36 @@ static err_t low_level_output(UNUSED_ARG(struct netif *, netif), struct pbuf *p)
  */
 static struct pbuf *low_level_input(UNUSED_ARG(struct netif *, netif))
 {
-	struct pbuf *p, *q;
+	struct pbuf *p;
 	size_t len;
 
+	#if CONFIG_ETH_ZEROCOPY
+		EthRxPbuf *rx;
+		Node *node;
+		uint8_t *buf;
+
+		buf = eth_getFrameBuf(&len);
+
+		proc_forbid();
+		node = list_remHead(&rx_free);
+		if (node == NULL)
+		{
+			eth_putFrameBuf(buf);
+			LINK_STATS_INC(link.memerr);
+			LINK_STATS_INC(link.drop);
+			proc_permit();
+			return NULL;
+		}
+		rx = containerof(node, EthRxPbuf, link);
+		rx->buf = buf;
+		p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &rx->pc, buf, ETH_FRAME_LEN);
+		LINK_STATS_INC(link.recv);
+		proc_permit();
+
+		return p;
+	#else
+	struct pbuf *q;
+
 	len = eth_getFrameLen();
 	if (UNLIKELY(len <= 0))
 		return NULL;
@@ -226,6 +328,7 @@ static struct pbuf *low_level_input(UNUSED_ARG(struct netif *, netif))
 	proc_permit();
 
 	return p;
+	#endif
 }
 
 /**
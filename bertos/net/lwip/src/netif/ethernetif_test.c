@@ -0,0 +1,113 @@
+/**
+ * \file
+ * <!--
+ * This file is part of BeRTOS.
+ *
+ * Bertos is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * As a special exception, you may use this file as part of a free software
+ * library without restriction.  Specifically, if other files instantiate
+ * templates or use macros or inline functions from this file, or you compile
+ * this file and link it with other files to produce an executable, this
+ * file does not by itself cause the resulting executable to be covered by
+ * the GNU General Public License.  This exception does not however
+ * invalidate any other reasons why the executable file might be covered by
+ * the GNU General Public License.
+ *
+ * Copyright 2010 Develer S.r.l. (http://www.develer.com/)
+ *
+ * -->
+ *
+ * \brief Test of the zero-copy path between the ethernet driver and lwIP.
+ *
+ * Runs the lwIP benchmark over the emulated ethernet with
+ * CONFIG_ETH_ZEROCOPY: no received frame may be copied by the CPU and all
+ * the receive buffers lent to the stack must go back to the driver.
+ * The emulator copies the transmitted frames, where a controller would
+ * use its DMA, so those are the only copies counted.
+ *
+ * $test$: cp bertos/cfg/cfg_proc.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN" >> $cfgdir/cfg_proc.h
+ * $test$: echo "#define CONFIG_KERN 1" >> $cfgdir/cfg_proc.h
+ * $test$: cp bertos/cfg/cfg_signal.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_KERN_SIGNALS" >> $cfgdir/cfg_signal.h
+ * $test$: echo "#define CONFIG_KERN_SIGNALS 1" >> $cfgdir/cfg_signal.h
+ * $test$: cp bertos/cfg/cfg_eth.h $cfgdir/
+ * $test$: sed -i "s/#define CONFIG_ETH_ZEROCOPY  *0/#define CONFIG_ETH_ZEROCOPY 1/" $cfgdir/cfg_eth.h
+ * $test$: cp bertos/cfg/cfg_lwip.h $cfgdir/
+ * $test$: sed -i "s/#define LWIP_SO_RCVTIMEO  *0/#define LWIP_SO_RCVTIMEO 1/" $cfgdir/cfg_lwip.h
+ * $test$: sed -i "s/#define LWIP_SUPPORT_CUSTOM_PBUF  *0/#define LWIP_SUPPORT_CUSTOM_PBUF 1/" $cfgdir/cfg_lwip.h
+ */
+
+#include <netif/ethernetif.h>
+
+#include <benchmark/lwip_bench.h>
+
+#include <cfg/debug.h>
+#include <cfg/test.h>
+
+#include <drv/timer.h>
+
+#include <emul/eth_emul.h>
+
+#include <kern/proc.h>
+
+int ethernetif_testRun(void);
+int ethernetif_testSetup(void);
+int ethernetif_testTearDown(void);
+
+int ethernetif_testRun(void)
+{
+	EthEmulStats st;
+
+	kputs("Run zero-copy ethernet test..\n");
+	eth_emul_stats(&st, true);
+	if (lwip_bench() < 0)
+		return -1;
+
+	/* Let the stack release the last frames */
+	while (!eth_emul_idle())
+		proc_yield();
+	timer_delay(100);
+
+	eth_emul_stats(&st, false);
+	kprintf("frames=%lu copies=%lu lent=%lu dropped=%lu\n",
+		(unsigned long)st.rx_frames, (unsigned long)st.copies,
+		(unsigned long)st.rx_lent, (unsigned long)st.rx_dropped);
+	ASSERT(st.rx_frames > 0);
+	ASSERT(st.copy_bytes == st.tx_bytes);
+	ASSERT(st.rx_lent == 0);
+
+	if (!st.rx_frames || st.copy_bytes != st.tx_bytes || st.rx_lent)
+		return -1;
+	kputs("> zero-copy ethernet test..Ok!\n");
+	return 0;
+}
+
+int ethernetif_testSetup(void)
+{
+	kdbg_init();
+	timer_init();
+	proc_init();
+	return lwip_bench_init();
+}
+
+int ethernetif_testTearDown(void)
+{
+	kputs("TearDown zero-copy ethernet test.\n");
+	return 0;
+}
+
+TEST_MAIN(ethernetif);
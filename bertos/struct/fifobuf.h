@@ -64,6 +64,15 @@
  * location and head points to the first one:
  *		\code head == begin && tail == end \endcode
  *
+ * Besides single bytes, data can be moved in blocks with fifo_pushBlock()
+ * and fifo_popBlock(), or accessed in place with fifo_peekWrite() /
+ * fifo_commitWrite() and fifo_peekRead() / fifo_commitRead().
+ * These need no locking with one producer and one consumer, for instance
+ * an interrupt handler and a process: the producer only writes \c tail
+ * and the consumer only writes \c head, each once per span and after
+ * a memory barrier. Interrupts are disabled only to access the pointers
+ * on CPUs that can't update them atomically.
+ *
  * \author Bernie Innocenti <bernie@codewiz.org>
  */
 
@@ -73,6 +82,9 @@
 #include <cpu/types.h>
 #include <cpu/irq.h>
 #include <cfg/debug.h>
+#include <cfg/macros.h> // MIN()
+
+#include <string.h> // memcpy()
 
 typedef struct FIFOBuffer
 {
@@ -300,6 +312,159 @@ INLINE size_t fifo_len(FIFOBuffer *fb)
 	return fb->end - fb->begin;
 }
 
+/*
+ * Read or write a pointer shared with the concurrent context on the
+ * other side of the fifo. Only CPUs that can't update a pointer with a
+ * single write need to disable interrupts, and just for the access.
+ */
+#if CPU_REG_BITS >= CPU_BITS_PER_PTR
+	#define FIFO_PTR_GET(dst, ptr)  ((dst) = (ptr))
+	#define FIFO_PTR_SET(ptr, val)  ((ptr) = (val))
+#else
+	#define FIFO_PTR_GET(dst, ptr)  ATOMIC((dst) = (ptr))
+	#define FIFO_PTR_SET(ptr, val)  ATOMIC((ptr) = (val))
+#endif
+
+/**
+ * \return Number of bytes currently stored in the FIFOBuffer \a fb.
+ */
+INLINE size_t fifo_count(const FIFOBuffer *fb)
+{
+	unsigned char *head, *tail;
+
+	FIFO_PTR_GET(head, fb->head);
+	FIFO_PTR_GET(tail, fb->tail);
+
+	if (tail >= head)
+		return tail - head;
+	return (fb->end - head + 1) + (tail - fb->begin);
+}
+
+/**
+ * Get the contiguous free space at the tail of the fifo.
+ *
+ * The caller can fill up to \a *len bytes at the returned address
+ * and hand them to the consumer with fifo_commitWrite().
+ * To be called by the producer only.
+ */
+INLINE unsigned char *fifo_peekWrite(FIFOBuffer *fb, size_t *len)
+{
+	unsigned char *head, *tail = fb->tail;
+
+	FIFO_PTR_GET(head, fb->head);
+
+	/* One slot is always left free to tell a full fifo from an empty one */
+	if (tail >= head)
+		*len = fb->end - tail + (head != fb->begin);
+	else
+		*len = head - tail - 1;
+	return tail;
+}
+
+/**
+ * Push \a len bytes written at the address returned by fifo_peekWrite().
+ */
+INLINE void fifo_commitWrite(FIFOBuffer *fb, size_t len)
+{
+	unsigned char *tail = fb->tail + len;
+
+	ASSERT(tail <= fb->end + 1);
+	if (tail > fb->end)
+		tail = fb->begin;
+
+	/* Data must be in the buffer before the consumer can see it */
+	MEMORY_BARRIER;
+	FIFO_PTR_SET(fb->tail, tail);
+}
+
+/**
+ * Get the contiguous data at the head of the fifo.
+ *
+ * The caller can read up to \a *len bytes at the returned address
+ * and release them with fifo_commitRead().
+ * To be called by the consumer only.
+ */
+INLINE unsigned char *fifo_peekRead(FIFOBuffer *fb, size_t *len)
+{
+	unsigned char *head = fb->head, *tail;
+
+	FIFO_PTR_GET(tail, fb->tail);
+	*len = (tail >= head) ? (size_t)(tail - head) : (size_t)(fb->end - head + 1);
+
+	/* Do not read data older than the tail */
+	MEMORY_BARRIER;
+	return head;
+}
+
+/**
+ * Pop \a len bytes read at the address returned by fifo_peekRead().
+ */
+INLINE void fifo_commitRead(FIFOBuffer *fb, size_t len)
+{
+	unsigned char *head = fb->head + len;
+
+	ASSERT(head <= fb->end + 1);
+	if (head > fb->end)
+		head = fb->begin;
+
+	/* Data must be read before the producer can overwrite it */
+	MEMORY_BARRIER;
+	FIFO_PTR_SET(fb->head, head);
+}
+
+/**
+ * Push up to \a len bytes from \a block on the fifo buffer.
+ *
+ * Data is copied with at most two memcpy() calls, one for each
+ * contiguous span of free space.
+ *
+ * \return the number of bytes actually pushed, less than \a len
+ *         if the fifo got full.
+ */
+INLINE size_t fifo_pushBlock(FIFOBuffer *fb, const void *block, size_t len)
+{
+	const unsigned char *src = (const unsigned char *)block;
+	size_t count = 0;
+
+	for (int i = 0; i < 2 && count < len; i++)
+	{
+		size_t span;
+		unsigned char *dst = fifo_peekWrite(fb, &span);
+
+		span = MIN(span, len - count);
+		memcpy(dst, src + count, span);
+		fifo_commitWrite(fb, span);
+		count += span;
+	}
+	return count;
+}
+
+/**
+ * Pop up to \a len bytes from the fifo buffer into \a block.
+ *
+ * Like fifo_pushBlock(), data is moved in contiguous spans.
+ *
+ * \return the number of bytes actually popped, less than \a len
+ *         if the fifo got empty.
+ */
+INLINE size_t fifo_popBlock(FIFOBuffer *fb, void *block, size_t len)
+{
+	unsigned char *dst = (unsigned char *)block;
+	size_t count = 0;
+
+	for (int i = 0; i < 2 && count < len; i++)
+	{
+		size_t span;
+		const unsigned char *src = fifo_peekRead(fb, &span);
+
+		span = MIN(span, len - count);
+		memcpy(dst + count, src, span);
+		fifo_commitRead(fb, span);
+		count += span;
+	}
+	return count;
+}
+
 
 #if 0
 
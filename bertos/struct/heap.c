@@ -38,11 +38,457 @@
 #include "heap.h"
 
 #include <cfg/debug.h> // ASSERT()
-#include <string.h>    // memset()
+#include <string.h>    // memset(), memcpy()
 
 #define FREE_FILL_CODE     0xDEAD
 #define ALLOC_FILL_CODE    0xBEEF
 
+#if CONFIG_HEAP_STATS
+
+/* Account an allocation of \a size bytes for a request of \a req bytes */
+static void heap_statsAlloc(struct Heap *h, size_t req, size_t size)
+{
+	int cls = 0;
+
+	while (cls < HEAP_STATS_CLASSES - 1 && req > ((size_t)HEAP_STATS_MIN_SIZE << cls))
+		cls++;
+	h->stats.histogram[cls]++;
+
+	h->stats.used += size;
+	if (h->stats.used > h->stats.peak)
+		h->stats.peak = h->stats.used;
+}
+
+#define STATS_ALLOC(h, req, size)  heap_statsAlloc(h, req, size)
+#define STATS_GROW(h, size) \
+	do { \
+		(h)->stats.used += (size); \
+		if ((h)->stats.used > (h)->stats.peak) \
+			(h)->stats.peak = (h)->stats.used; \
+	} while (0)
+#define STATS_FREE(h, size)        ((h)->stats.used -= (size))
+#define STATS_FAIL(h)              ((h)->stats.failures++)
+#define STATS_CHUNKS(h, n)         ((h)->stats.free_chunks += (n))
+/*
+ * largest_free is an upper bound of the free chunk sizes, exact unless
+ * largest_stale is set: a chunk at least as large makes it exact again,
+ * otherwise heap_stats() searches the free chunks.
+ */
+
+/* A free chunk of \a size bytes has been added or grown */
+#define STATS_LARGEST(h, size) \
+	do { \
+		if ((size) >= (h)->stats.largest_free) \
+		{ \
+			(h)->stats.largest_free = (size); \
+			(h)->largest_stale = false; \
+		} \
+	} while (0)
+/* A free chunk of \a size bytes has been removed or shrunk */
+#define STATS_SHRUNK(h, size) \
+	do { \
+		if ((size) == (h)->stats.largest_free) \
+			(h)->largest_stale = true; \
+	} while (0)
+
+#else /* !CONFIG_HEAP_STATS */
+
+#define STATS_ALLOC(h, req, size)  do { } while (0)
+#define STATS_GROW(h, size)        do { } while (0)
+#define STATS_FREE(h, size)        do { } while (0)
+#define STATS_FAIL(h)              do { } while (0)
+#define STATS_CHUNKS(h, n)         do { } while (0)
+#define STATS_LARGEST(h, size)     do { } while (0)
+#define STATS_SHRUNK(h, size)      do { } while (0)
+
+#endif /* !CONFIG_HEAP_STATS */
+
+#if CONFIG_HEAP_TLSF
+
+/*
+ * Two-level segregated fit allocator.
+ *
+ * Free blocks are kept in CONFIG_HEAP_TLSF_FL * HEAP_TLSF_SL lists: the
+ * first level splits sizes by powers of 2, the second level splits each
+ * power of 2 in HEAP_TLSF_SL linear ranges. Blocks smaller than
+ * HEAP_TLSF_SL chunks all go in the first level class 0, one list per
+ * size. Two bitmaps track the non empty lists, so a suitable free block
+ * is found with a couple of bit scans.
+ *
+ * Each block starts with a header linking it to the previous block in
+ * memory; the next one is found adding the block size. This allows to
+ * merge a freed block with its free neighbours in constant time.
+ * A used header-only block of size 0 terminates the heap.
+ */
+
+#define BLOCK_FREE  ((size_t)1)
+#define BLOCK_HDR   sizeof(MemChunk)
+#define BLOCK_MIN   sizeof(HeapBlock)
+
+STATIC_ASSERT(offsetof(HeapBlock, next_free) == BLOCK_HDR);
+STATIC_ASSERT(BLOCK_MIN == 2 * BLOCK_HDR);
+
+INLINE size_t block_size(const HeapBlock *b)
+{
+	return b->size & ~BLOCK_FREE;
+}
+
+INLINE bool block_isFree(const HeapBlock *b)
+{
+	return b->size & BLOCK_FREE;
+}
+
+INLINE HeapBlock *block_next(HeapBlock *b)
+{
+	return (HeapBlock *)((uint8_t *)b + block_size(b));
+}
+
+/* Return the index of the most significant bit set in \a x */
+INLINE int heap_fls(uint32_t x)
+{
+	ASSERT(x);
+#if GNUC_PREREQ(3,4)
+	return 31 - __builtin_clz(x);
+#else
+	int bit = 0;
+
+	if (x & 0xFFFF0000UL) { x >>= 16; bit += 16; }
+	if (x & 0xFF00) { x >>= 8; bit += 8; }
+	if (x & 0xF0) { x >>= 4; bit += 4; }
+	if (x & 0xC) { x >>= 2; bit += 2; }
+	if (x & 0x2) bit += 1;
+	return bit;
+#endif
+}
+
+/* Return the index of the least significant bit set in \a x */
+INLINE int heap_ffs(uint32_t x)
+{
+	return heap_fls(x & -x);
+}
+
+/* Find the free list for blocks of \a size bytes */
+static void heap_mapping(size_t size, int *fl, int *sl)
+{
+	uint32_t chunks = size / BLOCK_HDR;
+
+	if (chunks < HEAP_TLSF_SL)
+	{
+		*fl = 0;
+		*sl = chunks;
+	}
+	else
+	{
+		int msb = heap_fls(chunks);
+
+		*fl = msb - HEAP_TLSF_SL_LOG2 + 1;
+		*sl = (chunks >> (msb - HEAP_TLSF_SL_LOG2)) - HEAP_TLSF_SL;
+	}
+}
+
+/*
+ * Round \a size up to the next list boundary, so that any block in the
+ * list found by heap_mapping() is big enough.
+ */
+static size_t heap_roundUp(size_t size)
+{
+	uint32_t chunks = size / BLOCK_HDR;
+
+	if (chunks >= HEAP_TLSF_SL)
+	{
+		uint32_t step = (1UL << (heap_fls(chunks) - HEAP_TLSF_SL_LOG2)) - 1;
+		chunks = (chunks + step) & ~step;
+	}
+	return chunks * BLOCK_HDR;
+}
+
+static void heap_insert(struct Heap *h, HeapBlock *b)
+{
+	int fl, sl;
+
+	heap_mapping(block_size(b), &fl, &sl);
+	ASSERT(fl < CONFIG_HEAP_TLSF_FL);
+
+	b->prev_free = NULL;
+	b->next_free = h->free[fl][sl];
+	if (b->next_free)
+		b->next_free->prev_free = b;
+	h->free[fl][sl] = b;
+
+	h->fl_bitmap |= 1UL << fl;
+	h->sl_bitmap[fl] |= 1 << sl;
+
+	b->size |= BLOCK_FREE;
+	h->free_space += block_size(b) - BLOCK_HDR;
+	STATS_CHUNKS(h, 1);
+	STATS_LARGEST(h, block_size(b) - BLOCK_HDR);
+}
+
+static void heap_remove(struct Heap *h, HeapBlock *b)
+{
+	int fl, sl;
+
+	heap_mapping(block_size(b), &fl, &sl);
+
+	if (b->next_free)
+		b->next_free->prev_free = b->prev_free;
+	if (b->prev_free)
+		b->prev_free->next_free = b->next_free;
+	else
+	{
+		h->free[fl][sl] = b->next_free;
+		if (!b->next_free)
+		{
+			h->sl_bitmap[fl] &= ~(1 << sl);
+			if (!h->sl_bitmap[fl])
+				h->fl_bitmap &= ~(1UL << fl);
+		}
+	}
+
+	b->size &= ~BLOCK_FREE;
+	h->free_space -= block_size(b) - BLOCK_HDR;
+	STATS_CHUNKS(h, -1);
+	STATS_SHRUNK(h, block_size(b) - BLOCK_HDR);
+}
+
+/*
+ * Shrink the used block \a b to \a size bytes, giving back the tail
+ * if big enough to make a block.
+ */
+static void heap_split(struct Heap *h, HeapBlock *b, size_t size)
+{
+	HeapBlock *rest, *next;
+
+	if (block_size(b) - size < BLOCK_MIN)
+		return;
+
+	rest = (HeapBlock *)((uint8_t *)b + size);
+	rest->size = block_size(b) - size;
+	rest->prev_phys = b;
+	b->size = size;
+
+	/* The tail may be followed by a free block */
+	next = block_next(rest);
+	if (block_isFree(next))
+	{
+		heap_remove(h, next);
+		rest->size += block_size(next);
+		next = block_next(rest);
+	}
+	next->prev_phys = rest;
+	heap_insert(h, rest);
+}
+
+/* Return the first block of the first non empty list from \a fl, \a sl on */
+static HeapBlock *heap_find(struct Heap *h, int fl, int sl)
+{
+	uint32_t map = h->sl_bitmap[fl] & (0xFFUL << sl);
+
+	if (!map)
+	{
+		/* Shifting by 32 is undefined */
+		map = (fl + 1 < 32) ? h->fl_bitmap & (~0UL << (fl + 1)) : 0;
+		if (!map)
+			return NULL;
+
+		fl = heap_ffs(map);
+		map = h->sl_bitmap[fl];
+	}
+	return h->free[fl][heap_ffs(map)];
+}
+
+/*
+ * This function prototype is deprecated, will change in:
+ * void heap_init(struct Heap* h, heap_buf_t* memory, size_t size)
+ * in the next BeRTOS release.
+ */
+void heap_init(struct Heap* h, void* memory, size_t size)
+{
+	HeapBlock *b, *end;
+
+	#ifdef _DEBUG
+	memset(memory, FREE_FILL_CODE, size);
+	#endif
+
+	ASSERT2(((size_t)memory % alignof(heap_buf_t)) == 0,
+	"memory buffer is unaligned, please use the HEAP_DEFINE_BUF() macro to declare heap buffers!\n");
+
+	memset(h, 0, sizeof(*h));
+
+	size = ROUND_DOWN(size, BLOCK_HDR);
+	ASSERT(size >= BLOCK_MIN + BLOCK_HDR);
+
+	/* A single big free block, followed by the terminator */
+	b = (HeapBlock *)memory;
+	b->prev_phys = NULL;
+	b->size = size - BLOCK_HDR;
+
+	end = block_next(b);
+	end->prev_phys = b;
+	end->size = 0;
+
+	heap_insert(h, b);
+}
+
+
+void *heap_allocmem(struct Heap* h, size_t size)
+{
+	HeapBlock *b;
+	size_t req = size;
+	int fl, sl;
+
+	(void)req;
+
+	/* Round size up to the allocation granularity */
+	size = ROUND_UP2(size, sizeof(MemChunk));
+
+	/* Handle allocations of 0 bytes */
+	if (!size)
+		size = sizeof(MemChunk);
+
+	size += BLOCK_HDR;
+
+	heap_mapping(heap_roundUp(size), &fl, &sl);
+	b = (fl < CONFIG_HEAP_TLSF_FL) ? heap_find(h, fl, sl) : NULL;
+
+	if (!b)
+	{
+		/*
+		 * No list is guaranteed to fit: the blocks in the list of
+		 * the exact size may still be big enough.
+		 */
+		heap_mapping(size, &fl, &sl);
+		b = NULL;
+		if (fl < CONFIG_HEAP_TLSF_FL)
+			for (b = h->free[fl][sl]; b && block_size(b) < size; b = b->next_free)
+				;
+		if (!b)
+		{
+			STATS_FAIL(h);
+			return NULL; /* fail */
+		}
+	}
+
+	heap_remove(h, b);
+	heap_split(h, b, size);
+	STATS_ALLOC(h, req, block_size(b));
+
+	#ifdef _DEBUG
+		memset((uint8_t *)b + BLOCK_HDR, ALLOC_FILL_CODE, block_size(b) - BLOCK_HDR);
+	#endif
+	return (uint8_t *)b + BLOCK_HDR;
+}
+
+
+void heap_freemem(struct Heap* h, void *mem, size_t size)
+{
+	HeapBlock *b, *next;
+	ASSERT(mem);
+
+	b = (HeapBlock *)((uint8_t *)mem - BLOCK_HDR);
+	ASSERT(!block_isFree(b));
+	ASSERT(ROUND_UP2(size, sizeof(MemChunk)) + BLOCK_HDR <= block_size(b));
+	(void)size;
+	STATS_FREE(h, block_size(b));
+
+#ifdef _DEBUG
+	memset(mem, FREE_FILL_CODE, block_size(b) - BLOCK_HDR);
+#endif
+
+	/* Merge with the next block */
+	next = block_next(b);
+	if (block_isFree(next))
+	{
+		heap_remove(h, next);
+		b->size += block_size(next);
+		block_next(b)->prev_phys = b;
+	}
+
+	/* Merge with the previous block */
+	if (b->prev_phys && block_isFree(b->prev_phys))
+	{
+		HeapBlock *prev = b->prev_phys;
+
+		heap_remove(h, prev);
+		prev->size += block_size(b);
+		block_next(prev)->prev_phys = prev;
+		b = prev;
+	}
+
+	heap_insert(h, b);
+}
+
+/**
+ * Returns the number of free bytes in a heap.
+ * \param h the heap to check.
+ *
+ * \note The returned value is the sum of the space available for
+ *       allocation in all the free blocks, headers excluded.
+ *       Those blocks are likely to be *not* contiguous,
+ *       so a successive allocation may fail even if the
+ *       requested amount of memory is lower than the current free space.
+ */
+size_t heap_freeSpace(struct Heap *h)
+{
+	return h->free_space;
+}
+
+#if CONFIG_HEAP_STATS
+/* Only the list of the highest size class needs to be searched */
+static size_t heap_largestFree(struct Heap *h)
+{
+	size_t largest = 0;
+	int fl;
+
+	if (!h->fl_bitmap)
+		return 0;
+
+	fl = heap_fls(h->fl_bitmap);
+	for (HeapBlock *b = h->free[fl][heap_fls(h->sl_bitmap[fl])]; b; b = b->next_free)
+		if (block_size(b) - BLOCK_HDR > largest)
+			largest = block_size(b) - BLOCK_HDR;
+	return largest;
+}
+#endif
+
+#if CONFIG_HEAP_MALLOC
+/*
+ * Resize in place the block at \a mem from \a old_size to \a new_size
+ * bytes, merging it with the following block if free.
+ *
+ * \return true on success, false if the block can not grow.
+ */
+static bool heap_resize(struct Heap *h, void *mem, UNUSED_ARG(size_t, old_size), size_t new_size)
+{
+	HeapBlock *b = (HeapBlock *)((uint8_t *)mem - BLOCK_HDR);
+	size_t size = ROUND_UP2(new_size, sizeof(MemChunk));
+
+	if (!size)
+		size = sizeof(MemChunk);
+	size += BLOCK_HDR;
+
+	if (size > block_size(b))
+	{
+		HeapBlock *next = block_next(b);
+
+		if (!block_isFree(next) || block_size(b) + block_size(next) < size)
+			return false;
+
+		heap_remove(h, next);
+		STATS_GROW(h, block_size(next));
+		b->size += block_size(next);
+		block_next(b)->prev_phys = b;
+	}
+
+	STATS_FREE(h, block_size(b));
+	heap_split(h, b, size);
+	STATS_GROW(h, block_size(b));
+	return true;
+}
+#endif /* CONFIG_HEAP_MALLOC */
+
+#else /* !CONFIG_HEAP_TLSF */
+
 
 /*
  * This function prototype is deprecated, will change in:
@@ -62,12 +508,22 @@ void heap_init(struct Heap* h, void* memory, size_t size)
 	h->FreeList = (MemChunk *)memory;
 	h->FreeList->next = NULL;
 	h->FreeList->size = size;
+
+	#if CONFIG_HEAP_STATS
+	memset(&h->stats, 0, sizeof(h->stats));
+	h->stats.free_chunks = 1;
+	h->stats.largest_free = size;
+	h->largest_stale = false;
+	#endif
 }
 
 
 void *heap_allocmem(struct Heap* h, size_t size)
 {
 	MemChunk *chunk, *prev;
+	size_t req = size;
+
+	(void)req;
 
 	/* Round size up to the allocation granularity */
 	size = ROUND_UP2(size, sizeof(MemChunk));
@@ -89,6 +545,9 @@ void *heap_allocmem(struct Heap* h, size_t size)
 			{
 				/* Just remove this chunk from the free list */
 				prev->next = chunk->next;
+				STATS_CHUNKS(h, -1);
+				STATS_SHRUNK(h, size);
+				STATS_ALLOC(h, req, size);
 				#ifdef _DEBUG
 					memset(chunk, ALLOC_FILL_CODE, size);
 				#endif
@@ -98,6 +557,8 @@ void *heap_allocmem(struct Heap* h, size_t size)
 			{
 				/* Allocate from the END of an existing chunk */
 				chunk->size -= size;
+				STATS_SHRUNK(h, chunk->size + size);
+				STATS_ALLOC(h, req, size);
 				#ifdef _DEBUG
 					memset((uint8_t *)chunk + chunk->size, ALLOC_FILL_CODE, size);
 				#endif
@@ -106,6 +567,7 @@ void *heap_allocmem(struct Heap* h, size_t size)
 		}
 	}
 
+	STATS_FAIL(h);
 	return NULL; /* fail */
 }
 
@@ -126,6 +588,8 @@ void heap_freemem(struct Heap* h, void *mem, size_t size)
 	if (!size)
 		size = sizeof(MemChunk);
 
+	STATS_FREE(h, size);
+
 	/* Special cases: first chunk in the free list or memory completely full */
 	ASSERT((uint8_t*)mem != (uint8_t*)h->FreeList);
 	if (((uint8_t *)mem) < ((uint8_t *)h->FreeList) || !h->FreeList)
@@ -135,6 +599,7 @@ void heap_freemem(struct Heap* h, void *mem, size_t size)
 		prev->next = h->FreeList;
 		prev->size = size;
 		h->FreeList = prev;
+		STATS_CHUNKS(h, 1);
 	}
 	else /* Normal case: not the first chunk in the free list */
 	{
@@ -166,6 +631,7 @@ void heap_freemem(struct Heap* h, void *mem, size_t size)
 			curr->next = prev->next;
 			curr->size = size;
 			prev->next = curr;
+			STATS_CHUNKS(h, 1);
 
 			/* Adjust for the following test */
 			prev = curr;
@@ -177,10 +643,12 @@ void heap_freemem(struct Heap* h, void *mem, size_t size)
 	{
 		prev->size += prev->next->size;
 		prev->next = prev->next->next;
+		STATS_CHUNKS(h, -1);
 
 		/* There should be only one merge opportunity, becuase we always merge on free */
 		ASSERT((uint8_t*)prev + prev->size != (uint8_t*)prev->next);
 	}
+	STATS_LARGEST(h, prev->size);
 }
 
 /**
@@ -202,6 +670,90 @@ size_t heap_freeSpace(struct Heap *h)
 	return free_mem;
 }
 
+#if CONFIG_HEAP_STATS
+static size_t heap_largestFree(struct Heap *h)
+{
+	size_t largest = 0;
+	for (MemChunk *chunk = h->FreeList; chunk; chunk = chunk->next)
+		if (chunk->size > largest)
+			largest = chunk->size;
+
+	return largest;
+}
+#endif
+
+#if CONFIG_HEAP_MALLOC
+/*
+ * Resize in place the block at \a mem from \a old_size to \a new_size
+ * bytes, taking the space from the following chunk if free.
+ *
+ * \return true on success, false if the block can not grow.
+ */
+static bool heap_resize(struct Heap *h, void *mem, size_t old_size, size_t new_size)
+{
+	MemChunk *chunk, *prev;
+	uint8_t *end;
+	size_t extra;
+
+	old_size = ROUND_UP2(old_size, sizeof(MemChunk));
+	new_size = ROUND_UP2(new_size, sizeof(MemChunk));
+	if (!old_size)
+		old_size = sizeof(MemChunk);
+	if (!new_size)
+		new_size = sizeof(MemChunk);
+
+	/* Shrink: give back the tail */
+	if (new_size <= old_size)
+	{
+		if (new_size < old_size)
+			heap_freemem(h, (uint8_t *)mem + new_size, old_size - new_size);
+		return true;
+	}
+
+	/* Look for a free chunk right after the block */
+	end = (uint8_t *)mem + old_size;
+	for (prev = (MemChunk *)&h->FreeList, chunk = h->FreeList;
+		chunk && (uint8_t *)chunk < end;
+		prev = chunk, chunk = chunk->next)
+		;
+
+	extra = new_size - old_size;
+	if ((uint8_t *)chunk != end || chunk->size < extra)
+		return false;
+
+	if (chunk->size == extra)
+	{
+		prev->next = chunk->next;
+		STATS_CHUNKS(h, -1);
+	}
+	else
+	{
+		MemChunk *rest = (MemChunk *)(end + extra);
+
+		rest->next = chunk->next;
+		rest->size = chunk->size - extra;
+		prev->next = rest;
+	}
+	STATS_SHRUNK(h, chunk->size);
+	STATS_GROW(h, extra);
+	return true;
+}
+#endif /* CONFIG_HEAP_MALLOC */
+
+#endif /* !CONFIG_HEAP_TLSF */
+
+#if CONFIG_HEAP_STATS
+void heap_stats(struct Heap *h, HeapStats *stats)
+{
+	if (h->largest_stale)
+	{
+		h->stats.largest_free = heap_largestFree(h);
+		h->largest_stale = false;
+	}
+	*stats = h->stats;
+}
+#endif
+
 #if CONFIG_HEAP_MALLOC
 
 /**
@@ -255,4 +807,51 @@ void heap_free(struct Heap *h, void *mem)
 	}
 }
 
+/**
+ * Change the size of a block of memory.
+ *
+ * The block is resized in place when possible, taking the space from
+ * the following chunk if it is free; otherwise a new block is allocated
+ * and the contents are copied.
+ *
+ * \param h     Heap from which the block was allocated.
+ * \param mem   Block previously allocated with heap_malloc(), heap_calloc()
+ *              or heap_realloc(). If NULL, the call is equivalent to
+ *              heap_malloc().
+ * \param size  New size of the block. If 0, the block is freed.
+ *
+ * \return The resized block or NULL if there is not enough memory, in
+ *         which case the original block is left untouched.
+ *
+ * \note This function works like the ANSI C realloc().
+ */
+void *heap_realloc(struct Heap *h, void *mem, size_t size)
+{
+	size_t *_mem = (size_t *)mem;
+	void *new_mem;
+
+	if (!_mem)
+		return heap_malloc(h, size);
+
+	if (!size)
+	{
+		heap_free(h, mem);
+		return NULL;
+	}
+
+	--_mem;
+	if (heap_resize(h, _mem, *_mem, size + sizeof(size_t)))
+	{
+		*_mem = size + sizeof(size_t);
+		return mem;
+	}
+
+	if (!(new_mem = heap_malloc(h, size)))
+		return NULL;
+
+	memcpy(new_mem, mem, MIN(*_mem - sizeof(size_t), size));
+	heap_freemem(h, _mem, *_mem);
+	return new_mem;
+}
+
 #endif /* CONFIG_HEAP_MALLOC */
@@ -64,12 +64,85 @@ STATIC_ASSERT(IS_POW2(sizeof(MemChunk)));
 
 typedef MemChunk heap_buf_t;
 
+#if CONFIG_HEAP_STATS
+
+/// Number of size classes in the allocation histogram
+#define HEAP_STATS_CLASSES  8
+/// Upper bound of the smallest size class, in bytes
+#define HEAP_STATS_MIN_SIZE 16
+
+/**
+ * Heap usage statistics.
+ *
+ * Sizes count the memory taken from the heap, so they include the
+ * rounding to the allocation granularity and the block headers.
+ */
+typedef struct HeapStats
+{
+	size_t used;            ///< Bytes currently allocated
+	size_t peak;            ///< Maximum value of \a used
+	size_t largest_free;    ///< Largest free block
+	size_t free_chunks;     ///< Number of free chunks
+	uint32_t failures;      ///< Failed allocations
+	/**
+	 * Number of allocations by requested size: class \c i counts
+	 * requests up to HEAP_STATS_MIN_SIZE << \c i bytes, the last class
+	 * all the bigger ones.
+	 */
+	uint32_t histogram[HEAP_STATS_CLASSES];
+} HeapStats;
+
+#endif /* CONFIG_HEAP_STATS */
+
+#if CONFIG_HEAP_TLSF
+
+/// Number of second level lists for each first level class (log2)
+#define HEAP_TLSF_SL_LOG2   3
+#define HEAP_TLSF_SL        (1 << HEAP_TLSF_SL_LOG2)
+
+STATIC_ASSERT(CONFIG_HEAP_TLSF_FL <= 32);
+
+/**
+ * Block header of the TLSF allocator.
+ *
+ * The header takes sizeof(MemChunk) bytes in front of each block; the
+ * free list links overlay the payload of free blocks.
+ */
+typedef struct HeapBlock
+{
+	struct HeapBlock *prev_phys;    ///< Previous block in memory
+	size_t size;                    ///< Block size, header included; bit 0 set if free
+	struct HeapBlock *next_free;    ///< Next block in the same free list
+	struct HeapBlock *prev_free;    ///< Previous block in the same free list
+} HeapBlock;
+
+/// A heap
+typedef struct Heap
+{
+	uint32_t fl_bitmap;                             ///< Non empty first level classes
+	uint8_t sl_bitmap[CONFIG_HEAP_TLSF_FL];         ///< Non empty second level lists
+	HeapBlock *free[CONFIG_HEAP_TLSF_FL][HEAP_TLSF_SL]; ///< Free lists
+	size_t free_space;                              ///< Allocatable bytes in free blocks
+#if CONFIG_HEAP_STATS
+	HeapStats stats;                                ///< Usage statistics
+	bool largest_stale;                             ///< stats.largest_free must be searched
+#endif
+} Heap;
+
+#else /* !CONFIG_HEAP_TLSF */
+
 /// A heap
 typedef struct Heap
 {
 	struct _MemChunk *FreeList;     ///< Head of the free list
+#if CONFIG_HEAP_STATS
+	HeapStats stats;                ///< Usage statistics
+	bool largest_stale;             ///< stats.largest_free must be searched
+#endif
 } Heap;
 
+#endif /* !CONFIG_HEAP_TLSF */
+
 /**
  * Utility macro to allocate a heap of size \a size.
  *
@@ -90,6 +163,18 @@ void heap_freemem(struct Heap* heap, void *mem, size_t size);
 
 size_t heap_freeSpace(struct Heap *h);
 
+#if CONFIG_HEAP_STATS
+/**
+ * Read the usage statistics of heap \a h.
+ *
+ * All the counters are updated on each allocation and release. The
+ * size of the largest free block is searched here only if that block
+ * has been allocated or split since the last call, and no block at
+ * least as large has been freed.
+ */
+void heap_stats(struct Heap *h, HeapStats *stats);
+#endif
+
 #define HNEW(heap, type) \
 	(type*)heap_allocmem(heap, sizeof(type))
 
@@ -112,6 +197,7 @@ size_t heap_freeSpace(struct Heap *h);
 void *heap_malloc(struct Heap* heap, size_t size);
 void *heap_calloc(struct Heap* heap, size_t size);
 void heap_free(struct Heap* heap, void * mem);
+void *heap_realloc(struct Heap* heap, void *mem, size_t size);
 /** \} */
 
 #endif
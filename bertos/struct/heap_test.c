@@ -32,6 +32,10 @@
  *
  * \brief Heap test.
  *
+ * $test$: cp bertos/cfg/cfg_heap.h $cfgdir/
+ * $test$: echo  "#undef CONFIG_HEAP_STATS" >> $cfgdir/cfg_heap.h
+ * $test$: echo "#define CONFIG_HEAP_STATS 1" >> $cfgdir/cfg_heap.h
+ *
  * \author Francesco Sacchi <batt@codewiz.org>
  */
 
@@ -43,13 +47,32 @@
 #include <cfg/test.h>
 #include <cfg/debug.h>
 
+#include <os/hptime.h>
+
 #define TEST_LEN 31
 #define ALLOC_SIZE 113
 
 #define TEST_LEN2 32
 #define ALLOC_SIZE2 128
 
-#define HEAP_SIZE 4096
+#define FRAG_LEN 32
+#define FRAG_ROUNDS 2000
+
+#define TIMING_HOLES 64
+#define TIMING_SIZE 512
+#define TIMING_OPS 1000
+#define TIMING_BATCHES 9
+
+#if CONFIG_HEAP_TLSF
+	#define HEAP_SIZE 8192
+	/* Each block has a header and the heap ends with a terminator */
+	#define HEAP_FREE_TOTAL (HEAP_SIZE - 2 * sizeof(MemChunk))
+	#define CHUNK_COST(size) (ROUND_UP2(size, sizeof(MemChunk)) + sizeof(MemChunk))
+#else
+	#define HEAP_SIZE 4096
+	#define HEAP_FREE_TOTAL HEAP_SIZE
+	#define CHUNK_COST(size) ROUND_UP2(size, sizeof(MemChunk))
+#endif
 
 HEAP_DEFINE_BUF(heap_buf, HEAP_SIZE);
 STATIC_ASSERT(sizeof(heap_buf) % sizeof(heap_buf_t) == 0);
@@ -76,7 +99,7 @@ static void alloc_test(size_t size, size_t test_len)
 			a[i][j] = i;
 	}
 
-	ASSERT(heap_freeSpace(&h) == HEAP_SIZE - test_len * ROUND_UP2(size, sizeof(MemChunk)));
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL - test_len * CHUNK_COST(size));
 
 	for (size_t i = 0; i < test_len; i++)
 	{
@@ -87,30 +110,262 @@ static void alloc_test(size_t size, size_t test_len)
 		}
 		heap_freemem(&h, a[i], size);
 	}
-	ASSERT(heap_freeSpace(&h) == HEAP_SIZE);
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL);
+}
+
+static uint32_t frag_seed = 1;
+
+static size_t frag_rand(size_t max)
+{
+	frag_seed = frag_seed * 1103515245UL + 12345;
+	return (frag_seed >> 16) % max;
+}
+
+/*
+ * Allocate and release blocks of random sizes in random order, checking
+ * their contents: when everything is released the free space must be
+ * merged back into a single block.
+ */
+static void frag_test(void)
+{
+	uint8_t *a[FRAG_LEN];
+	size_t size[FRAG_LEN];
+
+	for (int i = 0; i < FRAG_LEN; i++)
+		a[i] = NULL;
+
+	for (int round = 0; round < FRAG_ROUNDS; round++)
+	{
+		int i = frag_rand(FRAG_LEN);
+
+		if (a[i])
+		{
+			for (size_t j = 0; j < size[i]; j++)
+				ASSERT(a[i][j] == (uint8_t)i);
+			heap_freemem(&h, a[i], size[i]);
+			a[i] = NULL;
+		}
+		else
+		{
+			size[i] = frag_rand(HEAP_SIZE / FRAG_LEN * 2);
+			a[i] = heap_allocmem(&h, size[i]);
+			if (a[i])
+				for (size_t j = 0; j < size[i]; j++)
+					a[i][j] = i;
+		}
+	}
+
+	for (int i = 0; i < FRAG_LEN; i++)
+		if (a[i])
+			heap_freemem(&h, a[i], size[i]);
+
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL);
+	a[0] = heap_allocmem(&h, HEAP_FREE_TOTAL);
+	ASSERT(a[0]);
+	heap_freemem(&h, a[0], HEAP_FREE_TOTAL);
+}
+
+/* Return the median time of an alloc/free pair of TIMING_SIZE bytes [ns] */
+static long timing_measure(void)
+{
+	long t[TIMING_BATCHES];
+
+	for (int b = 0; b < TIMING_BATCHES; b++)
+	{
+		hptime_t start = hptime_get();
+
+		for (int i = 0; i < TIMING_OPS; i++)
+		{
+			void *p = heap_allocmem(&h, TIMING_SIZE);
+			ASSERT(p);
+			heap_freemem(&h, p, TIMING_SIZE);
+		}
+		t[b] = (long)((hptime_get() - start) * 1000 / TIMING_OPS);
+	}
+
+	/* Sort to find the median */
+	for (int i = 1; i < TIMING_BATCHES; i++)
+		for (int j = i; j > 0 && t[j - 1] > t[j]; j--)
+		{
+			long tmp = t[j];
+			t[j] = t[j - 1];
+			t[j - 1] = tmp;
+		}
+	return t[TIMING_BATCHES / 2];
 }
 
+/*
+ * Time allocations on an empty heap and on a heap where TIMING_HOLES
+ * free chunks, too small for the request, precede the free space.
+ */
+static void timing_test(void)
+{
+	void *a[TIMING_HOLES * 2];
+	void *big, *filler;
+	size_t filler_size;
+	long clean, frag;
+
+	clean = timing_measure();
+
+	/* Lay out the heap: big block, small blocks, filler */
+	big = heap_allocmem(&h, TIMING_SIZE * 2);
+	ASSERT(big);
+	for (int i = 0; i < TIMING_HOLES * 2; i++)
+	{
+		a[i] = heap_allocmem(&h, 1);
+		ASSERT(a[i]);
+	}
+	filler_size = heap_freeSpace(&h);
+	filler = heap_allocmem(&h, filler_size);
+	ASSERT(filler);
+	ASSERT(heap_freeSpace(&h) == 0);
+
+	heap_freemem(&h, big, TIMING_SIZE * 2);
+	for (int i = 0; i < TIMING_HOLES * 2; i += 2)
+		heap_freemem(&h, a[i], 1);
+
+	frag = timing_measure();
+	kprintf("alloc/free %d bytes: %ld ns on empty heap, %ld ns with %d holes\n",
+		TIMING_SIZE, clean, frag, TIMING_HOLES);
+
+#if CONFIG_HEAP_TLSF
+	/* Constant time: the holes must not matter */
+	ASSERT(frag <= clean * 4 + 100);
+#endif
+
+	for (int i = 1; i < TIMING_HOLES * 2; i += 2)
+		heap_freemem(&h, a[i], 1);
+	heap_freemem(&h, filler, filler_size);
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL);
+}
+
+#if CONFIG_HEAP_STATS
+static void stats_test(void)
+{
+	HeapStats st;
+	uint32_t failures;
+	void *a, *b;
+
+	heap_stats(&h, &st);
+	ASSERT(st.used == 0);
+	ASSERT(st.free_chunks == 1);
+	ASSERT(st.largest_free == HEAP_FREE_TOTAL);
+
+	/* Forget the previous tests */
+	h.stats.peak = 0;
+
+	a = heap_allocmem(&h, ALLOC_SIZE);
+	b = heap_allocmem(&h, 8);
+	ASSERT(a && b);
+	heap_stats(&h, &st);
+	ASSERT(st.used == CHUNK_COST(ALLOC_SIZE) + CHUNK_COST(8));
+	ASSERT(st.peak == st.used);
+	ASSERT(st.free_chunks == 1);
+	ASSERT(st.largest_free == HEAP_FREE_TOTAL - st.used);
+
+	/* Free the first block: it can not be merged */
+	heap_freemem(&h, a, ALLOC_SIZE);
+	heap_stats(&h, &st);
+	ASSERT(st.used == CHUNK_COST(8));
+	ASSERT(st.free_chunks == 2);
+	ASSERT(st.largest_free == HEAP_FREE_TOTAL - CHUNK_COST(ALLOC_SIZE) - CHUNK_COST(8));
+
+	failures = st.failures;
+	ASSERT(!heap_allocmem(&h, HEAP_SIZE * 2));
+	heap_stats(&h, &st);
+	ASSERT(st.failures == failures + 1);
+
+	heap_freemem(&h, b, 8);
+	heap_stats(&h, &st);
+	ASSERT(st.used == 0);
+	ASSERT(st.peak == CHUNK_COST(ALLOC_SIZE) + CHUNK_COST(8));
+	ASSERT(st.free_chunks == 1);
+	ASSERT(st.largest_free == HEAP_FREE_TOTAL);
+
+	/* 113 and 128 bytes go in the 128 bytes class, 8 bytes in the first */
+	ASSERT(st.histogram[0] >= 1);
+	ASSERT(st.histogram[3] >= TEST_LEN + TEST_LEN2);
+	ASSERT(st.histogram[HEAP_STATS_CLASSES - 1] >= 2);
+}
+#endif
+
+#if CONFIG_HEAP_MALLOC
+static void realloc_test(void)
+{
+	uint8_t *a, *b, *c;
+
+	/* Two adjacent blocks: free the upper one and grow the lower one */
+	a = heap_malloc(&h, 100);
+	b = heap_malloc(&h, 100);
+	ASSERT(a && b);
+	if (b < a)
+		SWAP(a, b);
+	heap_free(&h, b);
+
+	for (int i = 0; i < 100; i++)
+		a[i] = i;
+	b = heap_realloc(&h, a, 180);
+	ASSERT(b == a);
+	for (int i = 0; i < 100; i++)
+		ASSERT(b[i] == i);
+
+	/* Shrink in place */
+	for (int i = 0; i < 180; i++)
+		b[i] = i;
+	b = heap_realloc(&h, b, 40);
+	ASSERT(b == a);
+	for (int i = 0; i < 40; i++)
+		ASSERT(b[i] == i);
+
+	/* A block in the way forces a move */
+	c = heap_malloc(&h, 16);
+	ASSERT(c);
+	a = heap_realloc(&h, b, 1000);
+	ASSERT(a);
+	for (int i = 0; i < 40; i++)
+		ASSERT(a[i] == i);
+
+	/* Too big: the block is left untouched */
+	ASSERT(!heap_realloc(&h, a, HEAP_SIZE * 2));
+	for (int i = 0; i < 40; i++)
+		ASSERT(a[i] == i);
+
+	ASSERT(!heap_realloc(&h, a, 0));
+	heap_free(&h, c);
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL);
+}
+#endif
+
 int heap_testRun(void)
 {
 	alloc_test(ALLOC_SIZE, TEST_LEN);
 	alloc_test(ALLOC_SIZE2, TEST_LEN2);
 	/* Try to allocate the whole heap */
-	uint8_t *b = heap_allocmem(&h, HEAP_SIZE);
+	uint8_t *b = heap_allocmem(&h, HEAP_FREE_TOTAL);
 	ASSERT(b);
 	ASSERT(heap_freeSpace(&h) == 0);
 
 	ASSERT(!heap_allocmem(&h, HEAP_SIZE));
 
-	for (int j = 0; j < HEAP_SIZE; j++)
+	for (int j = 0; j < (int)HEAP_FREE_TOTAL; j++)
 		b[j] = j;
 	
-	for (int j = 0; j < HEAP_SIZE; j++)
+	for (int j = 0; j < (int)HEAP_FREE_TOTAL; j++)
 	{
 		kprintf("b[%d] = %d\n", j, j);
 		ASSERT(b[j] == (j & 0xff));
 	}
-	heap_freemem(&h, b, HEAP_SIZE);
-	ASSERT(heap_freeSpace(&h) == HEAP_SIZE);
+	heap_freemem(&h, b, HEAP_FREE_TOTAL);
+	ASSERT(heap_freeSpace(&h) == HEAP_FREE_TOTAL);
+
+	frag_test();
+	timing_test();
+#if CONFIG_HEAP_STATS
+	stats_test();
+#endif
+#if CONFIG_HEAP_MALLOC
+	realloc_test();
+#endif
 
 	return 0;
 }
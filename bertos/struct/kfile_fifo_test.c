@@ -32,6 +32,9 @@
  *
  * \brief FIFO and KFileFifo test.
  *
+ * The lock-free block functions are also stressed with a timer interrupt handler
+ * running concurrently on the other side of the fifo.
+ *
  * \author Bernie Innocenti <bernie@codewiz.org>
  */
 
@@ -43,10 +46,220 @@
 #include <cfg/test.h>
 #include <cfg/debug.h>
 
+#include <cpu/irq.h>
+
+#include <drv/timer.h>
+
+#define BLOCK_LEN        64
+#define STRESS_BYTES     10000
+#define STRESS_CHUNK     40
+#define STRESS_TIMEOUT   ms_to_ticks(30000)
+
+static unsigned char block_buf[BLOCK_LEN];
+static FIFOBuffer block_fifo;
+
+static Timer stress_timer;
+static uint8_t isr_seq;
+static volatile size_t isr_count;
+static volatile int isr_errors;
+static uint32_t isr_seed = 1;
+
+/* Pseudo random chunk size from 1 to STRESS_CHUNK */
+static size_t stress_rand(uint32_t *seed)
+{
+	*seed = *seed * 1103515245UL + 12345;
+	return (*seed >> 16) % STRESS_CHUNK + 1;
+}
+
+static void block_test(void)
+{
+	unsigned char out[BLOCK_LEN * 2], in[BLOCK_LEN * 2];
+	const unsigned char *rp;
+	unsigned char *wp;
+	size_t len;
+
+	for (size_t i = 0; i < sizeof(out); i++)
+		out[i] = i;
+
+	/* Blocks wrapping around the end of the buffer */
+	fifo_init(&block_fifo, block_buf, sizeof(block_buf));
+	for (int round = 0; round < 10; round++)
+	{
+		size_t n = 17 + round * 5;
+
+		ASSERT(fifo_pushBlock(&block_fifo, out, n) == n);
+		ASSERT(fifo_count(&block_fifo) == n);
+		memset(in, 0, sizeof(in));
+		ASSERT(fifo_popBlock(&block_fifo, in, sizeof(in)) == n);
+		ASSERT(memcmp(in, out, n) == 0);
+	}
+
+	/* Partial push on overflow, with the data wrapping around */
+	fifo_init(&block_fifo, block_buf, sizeof(block_buf));
+	ASSERT(fifo_pushBlock(&block_fifo, out, 60) == 60);
+	ASSERT(fifo_popBlock(&block_fifo, in, 60) == 60);
+	ASSERT(fifo_pushBlock(&block_fifo, out, sizeof(out)) == BLOCK_LEN - 1);
+	ASSERT(fifo_popBlock(&block_fifo, in, 10) == 10);
+	ASSERT(memcmp(in, out, 10) == 0);
+
+	/* Zero-copy access: spans stop at the end of the buffer */
+	wp = fifo_peekWrite(&block_fifo, &len);
+	ASSERT(wp == block_buf + 59);
+	ASSERT(len == 5);
+	memcpy(wp, out + BLOCK_LEN - 1, len);
+	fifo_commitWrite(&block_fifo, len);
+
+	wp = fifo_peekWrite(&block_fifo, &len);
+	ASSERT(wp == block_buf);
+	ASSERT(len == 5);
+	memcpy(wp, out + BLOCK_LEN + 4, len);
+	fifo_commitWrite(&block_fifo, len);
+	ASSERT(fifo_isfull(&block_fifo));
+
+	rp = fifo_peekRead(&block_fifo, &len);
+	ASSERT(rp == block_buf + 6);
+	ASSERT(len == BLOCK_LEN - 6);
+	ASSERT(memcmp(rp, out + 10, len) == 0);
+	fifo_commitRead(&block_fifo, len);
+
+	rp = fifo_peekRead(&block_fifo, &len);
+	ASSERT(rp == block_buf);
+	ASSERT(len == 5);
+	ASSERT(memcmp(rp, out + BLOCK_LEN + 4, len) == 0);
+	fifo_commitRead(&block_fifo, len);
+	ASSERT(fifo_isempty(&block_fifo));
+
+	fifo_pushBlock(&block_fifo, out, 5);
+	fifo_flush(&block_fifo);
+	ASSERT(fifo_isempty(&block_fifo));
+}
+
+/* Producer in interrupt context, alternating the different APIs */
+static void stress_produce(UNUSED_ARG(iptr_t, data))
+{
+	size_t n = stress_rand(&isr_seed);
+
+	if (n & 1)
+	{
+		unsigned char chunk[STRESS_CHUNK];
+
+		for (size_t i = 0; i < n; i++)
+			chunk[i] = isr_seq + i;
+		isr_seq += fifo_pushBlock(&block_fifo, chunk, n);
+	}
+	else
+	{
+		size_t len;
+		unsigned char *p = fifo_peekWrite(&block_fifo, &len);
+
+		n = MIN(n, len);
+		for (size_t i = 0; i < n; i++)
+			p[i] = isr_seq++;
+		fifo_commitWrite(&block_fifo, n);
+	}
+
+	timer_add(&stress_timer);
+}
+
+/* Consumer in interrupt context */
+static void stress_consume(UNUSED_ARG(iptr_t, data))
+{
+	unsigned char chunk[STRESS_CHUNK];
+	size_t n = fifo_popBlock(&block_fifo, chunk, stress_rand(&isr_seed));
+
+	for (size_t i = 0; i < n; i++)
+		if (chunk[i] != isr_seq++)
+			isr_errors++;
+	isr_count += n;
+
+	timer_add(&stress_timer);
+}
+
+/*
+ * Move STRESS_BYTES through the fifo between the timer interrupt and the
+ * main loop, in both directions, checking the sequence of the data.
+ */
+static void block_stressTest(void)
+{
+	uint32_t seed = 7;
+	uint8_t seq = 0;
+	size_t count = 0;
+	ticks_t start;
+
+	/* Interrupt to main */
+	fifo_init(&block_fifo, block_buf, sizeof(block_buf));
+	isr_seq = 0;
+	timer_setSoftint(&stress_timer, stress_produce, 0);
+	timer_setDelay(&stress_timer, 1);
+	timer_add(&stress_timer);
+
+	start = timer_clock();
+	while (count < STRESS_BYTES)
+	{
+		unsigned char chunk[STRESS_CHUNK];
+		const unsigned char *p;
+		size_t n;
+
+		ASSERT(timer_clock() - start < STRESS_TIMEOUT);
+		switch (stress_rand(&seed) % 3)
+		{
+		case 0:
+			n = fifo_popBlock(&block_fifo, chunk, stress_rand(&seed));
+			p = chunk;
+			break;
+		case 1:
+			p = fifo_peekRead(&block_fifo, &n);
+			n = MIN(n, stress_rand(&seed));
+			break;
+		default:
+			n = 0;
+			if (!fifo_isempty(&block_fifo))
+				chunk[n++] = fifo_pop(&block_fifo);
+			p = chunk;
+			break;
+		}
+
+		for (size_t i = 0; i < n; i++)
+			ASSERT(p[i] == seq++);
+		if (p != chunk)
+			fifo_commitRead(&block_fifo, n);
+		count += n;
+	}
+	timer_abort(&stress_timer);
+
+	/* Main to interrupt */
+	fifo_init(&block_fifo, block_buf, sizeof(block_buf));
+	isr_seq = 0;
+	isr_count = 0;
+	seq = 0;
+	timer_setSoftint(&stress_timer, stress_consume, 0);
+	timer_add(&stress_timer);
+
+	start = timer_clock();
+	while (isr_count < STRESS_BYTES)
+	{
+		unsigned char chunk[STRESS_CHUNK];
+		size_t n = stress_rand(&seed);
+
+		ASSERT(timer_clock() - start < STRESS_TIMEOUT);
+		if (n & 1)
+		{
+			for (size_t i = 0; i < n; i++)
+				chunk[i] = seq + i;
+			seq += fifo_pushBlock(&block_fifo, chunk, n);
+		}
+		else if (!fifo_isfull(&block_fifo))
+			fifo_push(&block_fifo, seq++);
+	}
+	timer_abort(&stress_timer);
+	ASSERT(isr_errors == 0);
+}
 
 int kfilefifo_testSetup(void)
 {
 	kdbg_init();
+	IRQ_ENABLE;
+	timer_init();
 	return 0;
 }
 
@@ -136,6 +349,32 @@ int kfilefifo_testRun(void)
 	ASSERT(!fifo_isfull(&fifo));
 	ASSERT(fifo_isempty(&fifo));
 	ASSERT(kfile_getc(&kfifo.fd) == EOF);
+
+	/* Block copies across the wrap point of a small fifo */
+	uint8_t small[8];
+	fifo_init(&fifo, small, sizeof(small));
+	for (int i = 0; i < 5; i++)
+		fifo_push(&fifo, 0);
+	for (int i = 0; i < 5; i++)
+		fifo_pop(&fifo);
+
+	for (int i = 0; i < FIFOBUF_LEN; i++)
+		buf[i] = i;
+	ASSERT(fifo_pushBlock(&fifo, buf, sizeof(small) + 3) == sizeof(small) - 1);
+	ASSERT(fifo_isfull(&fifo));
+	ASSERT(fifo_count(&fifo) == sizeof(small) - 1);
+	ASSERT(fifo_pushBlock(&fifo, buf, 1) == 0);
+	ASSERT(fifo_popBlock(&fifo, test_buf, 4) == 4);
+	ASSERT(fifo_count(&fifo) == sizeof(small) - 5);
+	ASSERT(fifo_pushBlock(&fifo, buf + sizeof(small) - 1, 4) == 4);
+	ASSERT(fifo_popBlock(&fifo, test_buf + 4, FIFOBUF_LEN) == sizeof(small) - 1);
+	ASSERT(fifo_isempty(&fifo));
+	ASSERT(fifo_popBlock(&fifo, test_buf, 1) == 0);
+	for (size_t i = 0; i < sizeof(small) + 3; i++)
+		ASSERT(test_buf[i] == i);
+
+	block_test();
+	block_stressTest();
 	return 0;
 }
 
@@ -18,7 +18,7 @@ VERBOSE=${VERBOSE:-1}
 CC=gcc
 #FIXME: -Ibertos/emul should not be needed
 CFLAGS="-W -Wall -Wextra -Wundef -Wpointer-arith -Wcast-qual -Wcast-align -Wwrite-strings -Wsign-compare -Wmissing-noreturn \
--O0 -g3 -ggdb -Ibertos -Ibertos/emul -std=gnu99 -fno-builtin -D_DEBUG -DARCH=(ARCH_EMUL|ARCH_UNITTEST) \
+-O0 -g3 -ggdb -Ibertos -Ibertos/emul -Ibertos/net/lwip/src/include -Ibertos/net/lwip/src/include/ipv4 -std=gnu99 -fno-builtin -D_DEBUG -DARCH=(ARCH_EMUL|ARCH_UNITTEST) \
 -DCPU_FREQ=(12288000UL) -ffunction-sections -fdata-sections -Wl,--gc-sections"
 
 CXX=g++
@@ -33,10 +33,15 @@ SRC_LIST="
 	bertos/algo/ramp.c
 	bertos/drv/kdebug.c
 	bertos/drv/timer.c
+	bertos/drv/ser.c
+	bertos/emul/ser_posix.c
 	bertos/kern/monitor.c
 	bertos/kern/proc.c
 	bertos/kern/signal.c
+	bertos/kern/msg.c
 	bertos/kern/sem.c
+	bertos/kern/trace.c
+	bertos/benchmark/ipc_bench.c
 	bertos/kern/preempt.c
 	bertos/mware/event.c
 	bertos/mware/formatwr.c
@@ -60,10 +65,13 @@ SRC_LIST="
 	bertos/net/afsk.c
 	bertos/net/nmeap/src/nmeap01.c
 	bertos/net/nmea.c
+	bertos/net/lwip/src/arch/sys_arch.c
 	bertos/cfg/kfile_debug.c
 	bertos/io/kblock.c
 	bertos/io/kblock_ram.c
 	bertos/io/kblock_posix.c
+	bertos/io/kblock_cache.c
+	bertos/io/kfile_block.c
 	bertos/io/kfile.c
 	bertos/sec/cipher.c
 	bertos/sec/cipher/blowfish.c
@@ -77,6 +85,40 @@ SRC_LIST="
 	bertos/sec/mac/omac.c
 "
 
+# lwIP is built only for the tests using it
+LWIP_TESTS="ethernetif_test lwip_bench_test"
+LWIP_SRC_LIST="
+	bertos/net/lwip/src/core/init.c
+	bertos/net/lwip/src/core/mem.c
+	bertos/net/lwip/src/core/memp.c
+	bertos/net/lwip/src/core/netif.c
+	bertos/net/lwip/src/core/pbuf.c
+	bertos/net/lwip/src/core/raw.c
+	bertos/net/lwip/src/core/stats.c
+	bertos/net/lwip/src/core/sys.c
+	bertos/net/lwip/src/core/tcp.c
+	bertos/net/lwip/src/core/tcp_in.c
+	bertos/net/lwip/src/core/tcp_out.c
+	bertos/net/lwip/src/core/udp.c
+	bertos/net/lwip/src/core/dhcp.c
+	bertos/net/lwip/src/core/ipv4/icmp.c
+	bertos/net/lwip/src/core/ipv4/inet.c
+	bertos/net/lwip/src/core/ipv4/inet_chksum.c
+	bertos/net/lwip/src/core/ipv4/ip.c
+	bertos/net/lwip/src/core/ipv4/ip_addr.c
+	bertos/net/lwip/src/core/ipv4/ip_frag.c
+	bertos/net/lwip/src/api/api_lib.c
+	bertos/net/lwip/src/api/api_msg.c
+	bertos/net/lwip/src/api/err.c
+	bertos/net/lwip/src/api/netbuf.c
+	bertos/net/lwip/src/api/sockets.c
+	bertos/net/lwip/src/api/tcpip.c
+	bertos/net/lwip/src/netif/etharp.c
+	bertos/net/lwip/src/netif/ethernetif.c
+	bertos/emul/eth_emul.c
+	bertos/benchmark/lwip_bench.c
+"
+
 buildout='/dev/null'
 runout='/dev/null'
 [ "$VERBOSE" -ge 2 ] && buildout='/dev/stdout'
@@ -98,8 +140,13 @@ for src in $TESTS; do
 	mkdir -p "$cfgdir"
 	exe="$testdir/$name"
 
+	srcs="$SRC_LIST"
+	case " $LWIP_TESTS " in
+		*" $name "*) srcs="$srcs $LWIP_SRC_LIST" ;;
+	esac
+
 	PREPARECMD="test/parsetest.py $src"
-	BUILDCMD="$CC -I$testdir $CFLAGS $src $SRC_LIST -o $exe"
+	BUILDCMD="$CC -I$testdir $CFLAGS $src $srcs -o $exe"
 	export testdir name cfgdir
 
 	[ $VERBOSE -gt 0 ] && echo "Preparing $name..."